@@ -27,7 +27,20 @@ layout (std140) uniform lyricColors {
 
 const vec4 epsilon = vec4(1.96e-3);
 
-#ifdef ENABLE_TEXTURING
+#ifdef ENABLE_YUV
+// Planar video frames: tex holds Y, texU and texV the half resolution chroma
+uniform sampler2D tex;
+uniform sampler2D texU;
+uniform sampler2D texV;
+uniform mat4 yuvMatrix;
+vec4 yuvToRgb() {
+	vec4 yuv = vec4(texture(tex, fragIn.texCoord).r, texture(texU, fragIn.texCoord).r, texture(texV, fragIn.texCoord).r, 1.0);
+	vec3 rgb = clamp((yuvMatrix * yuv).rgb, 0.0, 1.0);
+	// Linearize like the sRGB textures of RGB video frames are when sampled
+	return vec4(mix(rgb / 12.92, pow((rgb + 0.055) / 1.055, vec3(2.4)), step(0.04045, rgb)), 1.0);
+}
+#define TEXFUNC yuvToRgb()
+#elif defined(ENABLE_TEXTURING)
 uniform sampler2D tex;
 #define TEXFUNC texture(tex, fragIn.texCoord)
 #else
@@ -1,29 +1,31 @@
 #pragma once
 
+#include "libda/fft.hpp"
+#include "libda/resampler.hpp"
+#include "pitchengine.hh"
 #include "ringbuffer.hh"
 #include "tone.hh"
+#include "trace.hh"
 
 #include <cstdint>
 #include <complex>
+#include <memory>
 #include <vector>
 #include <list>
 #include <algorithm>
 #include <cmath>
 
-static const unsigned FFT_P = 10;
-static const std::size_t FFT_N = 1 << FFT_P;
-
- /** class to analyze input audio and transform it to frequency domain to get tone data */
+ /** class to analyze input audio and find the tones in it (with a PitchEngine) */
 class Analyzer {
   public:
 	Analyzer(const Analyzer&) = delete;
 	const Analyzer& operator=(const Analyzer&) = delete;
-	/// fast fourier transform vector
+	/// fast fourier transform vector (bins 0 to FFT_N / 2)
 	using fft_t = std::vector<std::complex<float>>;
 	/// list of tones
 	using tones_t = std::list<Tone>;
 	/// constructor
-	Analyzer(double rate, std::string id, unsigned step = 200);
+	Analyzer(double rate, std::string id, PitchEngine::Type engine = PitchEngine::Type::FFT, unsigned step = 200);
 	/** Add input data to buffer. This is thread-safe (against other functions). **/
 	template <typename InIt> void input(InIt begin, InIt end) {
 		m_buf.insert(begin, end);
@@ -31,8 +33,11 @@ class Analyzer {
 	}
 	/** Call this to process all data input so far. **/
 	void process();
-	/** Get the raw FFT. **/
-	fft_t const& getFFT() const { return m_fft; }
+	/** Get the raw FFT (the non-redundant half of the spectrum of real input), if the pitch engine makes one. **/
+	fft_t const& getFFT() const { return m_engine->spectrum(); }
+	PitchEngine::Type getEngine() const { return m_engine->type(); }
+	/** Time that the pitch engine took for each frame, since the analyzer was made. This is thread-safe. **/
+	trace::Histogram::Summary getCost() const { return m_cost.summary(); }
 	/** Get the peak level in dB (negative value, 0.0 = clipping). **/
 	double getPeak() const { return 10.0 * log10(m_peak); }
 	/** Get a list of all tones detected. **/
@@ -45,20 +50,20 @@ class Analyzer {
 	std::string const& getId() const { return m_id; }
 
   private:
-	bool calcFFT();
-	void calcTones();
+	bool readFrame();
 	void mergeWithOld(tones_t& tones) const;
 
 	const unsigned m_step;
 	RingBuffer<2 * FFT_N> m_buf;  // Twice the FFT size should give enough room for sliding window and for engine delays
 	RingBuffer<4096> m_passthrough;
-	double m_resampleFactor;
-	double m_resamplePos;
+	std::vector<float> m_passthroughBuf;  ///< Preallocated for output(), which runs in the audio callback
+	da::Resampler m_resampler;  ///< From the mic rate to the output rate
+	da::DriftCompensator m_drift;  ///< Keeps m_passthrough from running empty or full when the mic and output clocks differ
 	double m_rate;
 	std::string m_id;
-	std::vector<float> m_window;
-	fft_t m_fft;
-	std::vector<float> m_fftLastPhase;
+	std::unique_ptr<PitchEngine> m_engine;
+	std::vector<float> m_frame;  ///< Samples for m_engine, allocated once
+	trace::Histogram m_cost;
 	double m_peak;
 	tones_t m_tones;
 	mutable double m_oldfreq;
@@ -1,50 +1,27 @@
 #pragma once
 
+#include "audiooutput.hh"
 #include "configuration.hh"
 #include "ffmpeg.hh"
+#include "mixbus.hh"
 #include "notes.hh"
+#include "pitchengine.hh"
+#include "trace.hh"
 #include "libda/portaudio.hpp"
-#include "aubio/aubio.h"
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <map>
 #include <memory>
-#include <mutex>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 const unsigned AUDIO_MAX_ANALYZERS = 11;
 
 int PaHostApiNameToHostApiTypeId (const std::string& name);
 
-struct Output;
-
-/**
-* Advanced audio sync code.
-* Produces precise monotonic clock synced to audio output callback (which may suffer of major jitter).
-* Uses system clock as timebase but the clock is skewed (made slower or faster) depending on whether
-* it is late or early. The clock is also stopped if audio output pauses.
-**/
-class AudioClock {
-	mutable std::mutex m_mutex;
-	Time m_baseTime; ///< A reference time (corresponds to m_basePos)
-	Seconds m_basePos = 0.0s; ///< A reference position in song
-	double m_skew = 0.0; ///< The skew ratio applied to system time (since baseTime)
-	std::atomic<Seconds> m_max{ 0.0s }; ///< Maximum output value for the clock (end of the current audio block)
-	/// Get the current position (current time via parameter, no locking)
-	Seconds pos_internal(Time now) const;
-  public:
-	/**
-	* Called from audio callback to keep the clock synced.
-	* @param audioPos the current position in the song
-	* @param length the duration of the current audio block
-	*/
-	void timeSync(Seconds audioPos, Seconds length);
-	/// Get the current position in seconds
-	Seconds pos() const;
-};
+/// Pitch engine of a mic: its entry in audio/pitch_engines (color=engine), otherwise audio/pitch_engine
+PitchEngine::Type configuredPitchEngine(std::string const& mic);
 
 class Analyzer;
 
@@ -53,9 +30,11 @@ struct Device {
 	const int in, out;
 	const double rate;
 	const PaDeviceIndex dev;
+	trace::RingReservation traceRing;  ///< Taken here rather than by the first event of the callback (declared before stream to outlive it)
 	portaudio::Stream stream;
 	std::vector<Analyzer*> mics;
 	Output* outptr;
+	MixBus mixBus;  ///< Scratch space for the output callback, sized when the stream is opened
 
 	Device(int in, int out, double rate, PaDeviceIndex dev);
 	/// Start
@@ -80,13 +59,13 @@ class Audio {
 	static portaudio::Init init;
 	struct Impl;
 	std::unique_ptr<Impl> self;
-	friend class ScreenSongs;
-	friend class Music;
-	static std::recursive_mutex aubio_mutex;
   public:
 	typedef std::map<std::string, fs::path> Files;
+	/// Tag for headless operation (--bench): no audio devices are opened, render() produces the output instead
+	struct Headless {};
 	static ConfigItem& backendConfig();
 	Audio();
+	explicit Audio(Headless);
 	~Audio();
 	void restart();
 	void close();
@@ -94,6 +73,8 @@ class Audio {
 	std::deque<Device>& devices();
 	bool isOpen() const;
 	bool hasPlayback() const;
+	/** Send current volume and pass-through settings to the audio callback. Call from the UI thread whenever config may have changed. **/
+	void publishParams();
 	/** Play a song beginning at startPos (defaults to 0)
 	 * @param filename the track filename
 	 * @param preview if the song preview is to play
@@ -103,6 +84,11 @@ class Audio {
 	void playMusic(Game&, fs::path const& filename, bool preview = false, double fadeTime = 0.5, double startPos = 0.0);
 	/** Plays a list of songs **/
 	void playMusic(Game&, Files const& filenames, bool preview = false, double fadeTime = 0.5, double startPos = 0.0);
+	/** Plays songs without a Game (headless, never a preview) **/
+	void playMusic(Files const& filenames, double startPos = 0.0);
+	/** Mix the next block of interleaved stereo output into [begin, end), as the playback device would (headless only).
+	 * Music that is still loading is waited for, so that the output does not depend on timing. **/
+	void render(float* begin, float* end);
 	/** Loads/plays/unloads a sample **/
 	void loadSample(std::string const& streamId, fs::path const& filename);
 	void playSample(std::string const& streamId);
@@ -138,45 +124,6 @@ class Audio {
 	void streamBend(std::string track, double pitchFactor);
 	/** Get sample rate */
 	static float getSR() { return 48000.0f; }
-	static unsigned aubio_hop_size;
-	static unsigned aubio_win_size;
-	static std::unique_ptr<aubio_tempo_t, void(*)(aubio_tempo_t*)> aubioTempo;
-};
-
-class Music {
-	struct Track {
-		AudioBuffer audioBuffer;
-		double fadeLevel = 1.0;
-		double pitchFactor = 0.0;
-		template <typename... Args> Track(Args&&... args): audioBuffer(std::forward<Args>(args)...) {}
-	};
-	friend class ScreenSongs;
-  public:
-	std::unordered_map<std::string, std::unique_ptr<Track>> tracks; ///< Audio decoders
-	double srate; ///< Sample rate
-	std::int64_t m_pos = 0; ///< Current sample position
-	bool m_preview;
-	class AudioClock m_clock;
-	Seconds durationOf(std::int64_t samples) const { return 1.0s * samples / srate / 2.0; }
-	float* sampleStartPtr = nullptr;
-	float* sampleEndPtr = nullptr;
-  public:
-	bool suppressCenterChannel = false;
-	double fadeLevel = 0.0;
-	double fadeRate = 0.0;
-	using Buffer = std::vector<float>;
-	Music(Game&, Audio::Files const& files, unsigned int sr, bool preview);
-	/// Sums the stream to output sample range, returns true if the stream still has audio left afterwards.
-	bool operator()(float* begin, float* end);
-	void seek(double time) { m_pos = static_cast<std::int64_t>(time * srate * 2.0); }
-	/// Get the current position in seconds
-	double pos() const { return m_clock.pos().count(); }
-	double duration() const;
-	/// Prepare (seek) all tracks to current position, return true when done (nonblocking)
-	bool prepare();
-	void trackFade(std::string const& name, double fadeLevel);
-	void trackPitchBend(std::string const& name, double pitchFactor);
-
   private:
-	Game& m_game;
+	void playMusic_internal(Files const& filenames, bool preview, double fadeTime, double startPos);
 };
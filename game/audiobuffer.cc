@@ -0,0 +1,175 @@
+#include "audiobuffer.hh"
+
+#include "chrono.hh"
+#include "libda/mix.hpp"
+#include "libda/sample.hpp"
+#include "trace.hh"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+	constexpr unsigned CHANNELS = 2;
+}
+
+template <typename Ready> void AudioBuffer::decoderWait(Ready ready) {
+	while (!ready()) {
+		// The reader posts a wakeup after consuming if it sees the flag; checking again after setting it
+		// makes sure that a consume between the first check and the flag is not missed.
+		m_decoderWaiting.store(true);
+		if (!ready()) m_wakeup.wait(100ms);
+		m_decoderWaiting.store(false);
+	}
+}
+
+void AudioBuffer::operator()(const std::int16_t *data, std::int64_t count, std::int64_t sample_position) {
+	if (sample_position < 0) {
+		std::clog << "ffmpeg/warning: Negative audio sample_position " << sample_position << " seconds, frame ignored." << std::endl;
+		return;
+	}
+	// frame to be dropped as being before read... arrived too late or due to a seek.
+	if (seekRequested() || sample_position < m_ring.consumed()) return;
+
+	// Keep at most half of the ring ahead of the reader
+	auto const half = static_cast<std::int64_t>(m_ring.capacity() / 2);
+	decoderWait([&]{ return m_quit || seekRequested() || sample_position + count <= m_ring.consumed() + half; });
+	if (m_quit || seekRequested()) return;
+
+	std::int64_t written = m_ring.written();
+	if (written != sample_position) {
+		std::clog << "ffmpeg/debug: Gap in audio: expected=" << written << " received=" << sample_position << '\n';
+	}
+	if (sample_position < written) {
+		// Overlaps what the reader may already be reading, keep only the new part
+		auto const skip = std::min(count, written - sample_position);
+		data += skip;
+		count -= skip;
+		sample_position += skip;
+	} else if (sample_position > written) {
+		// Silence instead of whatever the ring held before
+		written = std::max(written, m_ring.consumed());
+		if (sample_position > written) {
+			m_convert.assign(static_cast<size_t>(sample_position - written), 0.0f);
+			m_ring.write(written, m_convert.data(), m_convert.size());
+		}
+	}
+	m_convert.resize(static_cast<size_t>(count));
+	std::transform(data, data + count, m_convert.begin(), da::conv_from_s16);
+	m_ring.write(sample_position, m_convert.data(), m_convert.size());
+	m_ring.publish(sample_position + count);
+}
+
+void AudioBuffer::requestSeek(std::int64_t pos) {
+	m_ring.consume(pos);
+	m_seekTarget.store(pos);
+	m_seekRequest.store(++m_seekRequested, std::memory_order_release);
+	if (m_decoderWaiting.load()) m_wakeup.post();
+}
+
+bool AudioBuffer::prepare(std::int64_t pos) {
+	// perform fake read to trigger any potential seek
+	if (!read(nullptr, 0, pos, 1)) return true;
+	if (seeking()) return false;
+
+	// Has enough been prebuffered already and is the requested position still within buffer
+	auto ring_size = static_cast<std::int64_t>(m_ring.capacity());
+	std::int64_t const written = m_ring.written();
+	std::int64_t const consumed = m_ring.consumed();
+	return written > consumed + ring_size / 16 && written <= consumed + ring_size;
+}
+
+// pos may be negative because upper layer may request 'extra time' before
+// starting the play back. In this case, the buffer is filled of zero.
+//
+// Called from the audio thread: never locks or waits. Samples that the decoder has not published yet
+// are left as they are in the mix (i.e. silence for this track).
+bool AudioBuffer::read(float* begin, std::int64_t samples, std::int64_t pos, float volume, float volumeStep) {
+	float* const start = begin;
+	if (pos < 0) {
+		std::int64_t negative_samples;
+		if (samples + pos > 0) negative_samples = samples - (samples + pos);
+		else negative_samples = samples;
+
+		// put zeros to negative positions
+		std::fill(begin, begin + negative_samples, 0);
+
+		if (negative_samples == samples) return true;
+
+		// if there are remaining samples to read in positive land, do the 'normal' read
+		begin += negative_samples;
+		pos = 0;
+		samples -= negative_samples;
+	}
+
+	if (eof(pos + samples) || m_quit)
+		return false;
+
+	// one cannot read more data than the size of buffer
+	std::int64_t size = static_cast<std::int64_t>(m_ring.capacity());
+	samples = std::min(samples, size);
+	std::int64_t const consumed = m_ring.consumed();
+	if (pos >= consumed + size - samples || pos < consumed) {
+		// in case request position is not in the current possible range, we trigger a seek
+		requestSeek(pos + samples);
+		return true;
+	}
+
+	if (!seeking()) {
+		std::int64_t const available = std::min(samples, m_ring.written() - pos);
+		if (available > 0) {
+			auto const add = da::mix_kernels::best().stereo;
+			float* out = begin;
+			m_ring.segments(pos, static_cast<size_t>(available), [&](float const* data, size_t n) {
+				// Segments of the ring are whole frames, as positions and the ring size are even
+				add(out, data, n / 2, volume + static_cast<float>((out - start) / 2) * volumeStep, volumeStep);
+				out += n;
+			});
+		}
+	}
+
+	m_ring.consume(pos + samples);
+	if (m_decoderWaiting.load()) m_wakeup.post();
+	return true;
+}
+
+double AudioBuffer::duration() { return m_duration; }
+
+AudioBuffer::AudioBuffer(OpenDecoder const& open, unsigned rate, size_t size):
+	m_ring(size), m_sps(rate * CHANNELS) {
+		auto decoder = open(*this);
+		const_cast<double&>(m_duration) = decoder->duration();
+		reader_thread = std::async(std::launch::async, [this, decoder = std::move(decoder)] {
+			trace::setThreadName("audio decoder");
+			auto errors = 0u;
+			while (!m_quit) {
+				if (seekRequested()) {
+					m_seekAnswered = m_seekRequest.load(std::memory_order_acquire);
+					std::int64_t const target = m_seekTarget.load();
+					m_ring.publish(target);
+					m_seekDone.store(m_seekAnswered, std::memory_order_release);
+					decoder->seek(target);
+					continue;
+				}
+
+				try {
+					decoder->decode();
+					errors = 0;
+				} catch (const Decoder::Eof&) {
+					// now we know exact eof_pos
+					m_eof_pos = m_ring.written();
+					// Wait here on eof: either quit is asked, either a new seek
+					// was asked and return back reading frames
+					decoderWait([this]{ return m_quit || seekRequested(); });
+				} catch (const std::exception& e) {
+					std::clog << "ffmpeg/error: " << e.what() << std::endl;
+					if (++errors > 2) std::clog << "ffmpeg/error: FFMPEG terminating due to multiple errors" << std::endl;
+				}
+			}
+		});
+}
+
+AudioBuffer::~AudioBuffer() {
+	m_quit = true;
+	m_wakeup.post();
+	reader_thread.get();
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "fs.hh"
+#include "spscring.hh"
+#include "wakeup.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+/**
+* Decoded audio of one track, read by the audio thread while a decoder thread keeps it filled.
+*
+* The samples are kept as floats in a lock-free ring, so the audio thread never takes a lock, waits or
+* converts: it only adds the published samples to its mix. Seeks are requested through atomics and the
+* decoder is woken up without blocking when it is waiting for space.
+**/
+class AudioBuffer {
+  public:
+	/// What the decoder thread runs: it passes interleaved stereo to the operator() of the buffer
+	struct Decoder {
+		/// Thrown by decode() at the end of the stream
+		class Eof: public std::exception {};
+		virtual ~Decoder() = default;
+		/// Length of the stream in seconds
+		virtual double duration() const = 0;
+		/// Continue decoding from a position (in samples), or from before it
+		virtual void seek(std::int64_t sample) = 0;
+		/// Decode the next piece of audio
+		virtual void decode() = 0;
+	};
+	/// Makes the decoder of a buffer (in the thread that constructs the buffer)
+	using OpenDecoder = std::function<std::unique_ptr<Decoder>(AudioBuffer&)>;
+
+	/// Decode a file with FFmpeg (see ffmpeg.cc)
+	AudioBuffer(fs::path const& file, unsigned rate, size_t size = 1 << 22);
+	AudioBuffer(OpenDecoder const& open, unsigned rate, size_t size = 1 << 22);
+	~AudioBuffer();
+
+	void operator()(const std::int16_t *data, std::int64_t count, std::int64_t sample_position);
+	bool prepare(std::int64_t pos);
+	/// Add samples from pos to begin, the frame k (of two samples) at volume + k * volumeStep
+	bool read(float* begin, std::int64_t samples, std::int64_t pos, float volume = 1.0f, float volumeStep = 0.0f);
+	bool terminating();
+	double duration();
+
+  private:
+	bool eof(std::int64_t pos) const {
+		std::int64_t eofPos = m_eof_pos.load();
+		return (eofPos != -1 && pos >= eofPos) || (double(pos) / m_sps >= m_duration);
+	}
+	/// Ask the decoder to continue from pos (reader)
+	void requestSeek(std::int64_t pos);
+	/// Is a seek requested by the reader still unanswered? (reader)
+	bool seeking() const { return m_seekDone.load(std::memory_order_acquire) != m_seekRequested; }
+	/// Has the reader requested a seek that has not been handled yet? (decoder)
+	bool seekRequested() const { return m_seekRequest.load(std::memory_order_acquire) != m_seekAnswered; }
+	/// Sleep until ready() returns true, checking it again whenever the reader consumes something (decoder)
+	template <typename Ready> void decoderWait(Ready ready);
+
+	SpscRing<float> m_ring;
+	std::vector<float> m_convert;  ///< Decoder-side scratch for int16 to float conversion
+	Wakeup m_wakeup;
+	std::atomic<bool> m_decoderWaiting{ false };
+
+	std::atomic<std::int64_t> m_seekTarget{ 0 };
+	std::atomic<unsigned> m_seekRequest{ 0 };  ///< Bumped by the reader for every seek
+	std::atomic<unsigned> m_seekDone{ 0 };  ///< Last seek request the decoder has handled
+	unsigned m_seekRequested = 0;  ///< Reader's copy of m_seekRequest
+	unsigned m_seekAnswered = 0;  ///< Decoder's copy of m_seekDone
+
+	std::atomic<std::int64_t> m_eof_pos{ -1 }; // -1 until we get the read end from ffmpeg
+
+	const unsigned m_sps;
+	const double m_duration{ 0 };
+	std::atomic<bool> m_quit{ false };
+	std::future<void> reader_thread;
+};
@@ -0,0 +1,277 @@
+#include "audiooutput.hh"
+
+#include "analyzer.hh"
+#include "musicalscale.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cmath>
+
+void AudioClock::timeSync(Seconds audioPos, Seconds length) {
+	constexpr Seconds maxError = 100ms;  // Step the clock instead of skewing if over 100 ms off
+	State& s = m_state;
+	Seconds max = audioPos + length;
+	auto now = Clock::now();
+	const Seconds sys = s.at(now);  // Current position (based on system clock + corrections)
+	const Seconds audio = audioPos;  // Audio time
+	const Seconds diff = audio - sys;
+	// Skew-based correction only if going forward and relatively well synced
+	if (max > s.max && std::abs(diff.count()) < maxError.count()) {
+		constexpr double fudgeFactor = 0.001;  // Adjustment ratio
+		// Update base position (this should not affect the clock)
+		s.baseTime = now;
+		s.basePos = sys;
+		// Apply a VERY ARTIFICIAL correction for clock!
+		const Seconds valadj = length * 0.1 * double(m_dither() - m_dither.min()) / double(m_dither.max() - m_dither.min());  // Dither
+		s.skew += (diff < valadj ? -1.0 : 1.0) * fudgeFactor;
+		// Limits to keep things sane in abnormal situations
+		s.skew = clamp(s.skew, -0.01, 0.01);
+	} else {
+		// Off too much, step to correct time
+		s.baseTime = now;
+		s.basePos = audio;
+		s.skew = 0.0;
+	}
+	s.max = max;
+	m_published.write(s);
+}
+
+Seconds AudioClock::State::at(Time now) const {
+	Seconds t = basePos + (1.0 + skew) * (now - baseTime);
+	return std::min<Seconds>(t, max);
+}
+
+Seconds AudioClock::pos() const {
+	std::lock_guard<std::mutex> l(m_readMutex);
+	return m_published.read().at(Clock::now());
+}
+
+Music::Music(Tracks tracks, double rate, bool preview, std::size_t mixBlock)
+: mixer(mixBlock), m_rate(rate), m_preview(preview) {
+	for (auto& [name, buffer]: tracks) {
+		auto& track = m_tracks[name] = std::make_unique<Track>();
+		track->audioBuffer = std::move(buffer);
+		track->stem = mixer.addStem(name);
+		m_stems.push_back(track.get());
+	}
+}
+
+double Music::duration() const {
+	double dur = 0.0;
+	for (auto& kv: m_tracks) dur = std::max(dur, kv.second->audioBuffer->duration());
+	return dur;
+}
+
+void Music::trackFade(std::string const& name, double fadeLevel) {
+	auto it = m_tracks.find(name);
+	if (it == m_tracks.end()) return;
+	it->second->fadeLevel.store(static_cast<float>(fadeLevel));
+}
+
+void Music::trackPitchBend(std::string const& name, double pitchFactor) {
+	auto it = m_tracks.find(name);
+	if (it == m_tracks.end()) return;
+	it->second->pitchFactor.store(pitchFactor);
+}
+
+void Music::toggleCenterChannelSuppressor() {
+	if (!m_preview) m_centerCancel.store(!m_centerCancel.load());
+}
+
+bool Music::cancel() {
+	State expected = State::LOADING;
+	return m_state.compare_exchange_strong(expected, State::CANCELLED) || expected == State::CANCELLED;
+}
+
+void Music::applySeek() {
+	std::int64_t const seek = m_seek.exchange(-1);
+	if (seek >= 0) m_pos = seek;
+}
+
+bool Music::prepare() {
+	applySeek();
+	for (Track* track: m_stems) {
+		if (!track->audioBuffer->prepare(m_pos)) return false;  // Need to wait for buffering
+	}
+	return true;
+}
+
+bool Music::start() {
+	State expected = State::LOADING;
+	return m_state.compare_exchange_strong(expected, State::PLAYING);
+}
+
+bool Music::operator()(float* begin, float* end, MixBus& bus, MixParams const& params) {
+	applySeek();
+	std::int64_t samples = end - begin;
+	m_clock.timeSync(durationOf(m_pos), durationOf(samples)); // Keep the clock synced
+	for (std::size_t s = 0; s < m_stems.size(); ++s) mixer.setGain(s, m_stems[s]->fadeLevel.load(std::memory_order_relaxed));
+	mixer.centerCancel = m_centerCancel.load(std::memory_order_relaxed);
+	// FIXME: Apply pitchFactor once there is a sane pitch shifting algorithm
+	bool const playing = mixer.mix(begin, end, bus, m_preview ? params.previewVolume : params.musicVolume,
+	  [this](std::size_t stem, float* mix, std::size_t n, std::size_t offset, GainRamp::Ramp ramp) {
+		return m_stems[stem]->audioBuffer->read(mix, static_cast<std::int64_t>(n), m_pos + static_cast<std::int64_t>(offset), ramp.gain, ramp.step);
+	});
+	m_pos += samples;
+	if (!playing) m_state.store(State::DONE);
+	return playing;
+}
+
+void Sample::operator()(float* begin, float* end, MixBus& bus, float volume) {
+	unsigned const plays = m_plays.load();
+	if (plays != m_played) {
+		m_played = plays;
+		m_eof = false;
+		m_pos = 0;
+	}
+	if (m_eof) {
+		// No more data to play in this sample
+		return;
+	}
+	if (end <= begin) {
+		m_eof = true;
+		return;
+	}
+	std::int64_t size = end - begin;
+	float* mixbuf = bus.clear(static_cast<size_t>(size));
+	if (!m_audioBuffer->read(mixbuf, size, m_pos, 1.0)) {
+		m_eof = true;
+	}
+	for (size_t i = 0, iend = static_cast<size_t>(size); i != iend; ++i) {
+		begin[i] += mixbuf[i] * volume;
+	}
+	m_pos += end - begin;
+}
+
+void Synth::operator()(float* begin, float* end, double position) {
+	for (float *i = begin; i < end; ++i) *i *= 0.3f; // Decrease music volume
+	if (end <= begin) return;
+	auto it = m_tones.begin();
+	while (it != m_tones.end() && it->end < position) ++it;
+	if (it == m_tones.end() || it->begin > position) { m_phase = 0.0; return; }
+	float note = std::fmod(it->note, 12.0f);
+	double d = (note + 1.0) / 13.0;
+	double freq = MusicalScale().setNote(note + 4.0 * 12.0).getFreq();
+	double value = 0.0;
+	// Synthesize tones
+	for (std::ptrdiff_t i = 0, iend = end - begin; i != iend; ++i) {
+		if (i % 2 == 0) {
+			value = d * 0.2 * std::sin(m_phase) + 0.2 * std::sin(2 * m_phase) + (1.0 - d) * 0.2 * std::sin(4 * m_phase);
+			m_phase += TAU * freq / m_rate;
+		}
+		begin[i] += static_cast<float>(value);
+	}
+}
+
+void Output::callback(float* begin, float* end, double rate, MixBus& bus) {
+	std::fill(begin, end, 0.0f);
+	if (paused) return;
+	MixParams const& p = params.read();
+	Program const& program = m_published.read();
+	auto const& music = program.music;
+	// The newest music takes over once it is buffered, fading out the music before it
+	if (!music.empty() && music[0]->state() == Music::State::LOADING && music[0]->prepare() && music[0]->start()) {
+		for (std::size_t i = 1; i < music.size(); ++i) {
+			if (music[i]->state() == Music::State::PLAYING && music[i]->mixer.fadeRate >= 0.0) music[i]->mixer.fadeRate = -music[0]->mixer.fadeRate;
+		}
+	}
+	// Mix in from the streams currently playing
+	Music* latest = nullptr;
+	for (auto const& m: music) {
+		if (m->state() != Music::State::PLAYING) continue;
+		if (!latest) latest = m.get();
+		(*m)(begin, end, bus, p);  // Do the actual mixing
+	}
+	// Mix in microphones (if pass-through is enabled)
+	if (program.mics.size() > 0 && p.passThrough) {
+		// Decrease music volume
+		float amp = 1.0f / p.passThroughRatio;
+		if (amp != 1.0f)
+			for (auto& s : make_iterator_range(begin, end))
+				s *= amp;
+		// Do the mixing
+		for (auto& m: program.mics) if (m) m->output(begin, end, rate);
+	}
+	// Mix in the samples currently playing
+	for (auto const& sample: program.samples) (*sample)(begin, end, bus, p.failVolume);
+	// Mix synth if available (should be done at the end)
+	if (program.synth && latest) (*program.synth)(begin, end, latest->audioPos());
+}
+
+void Output::publish() {
+	auto& music = m_program.music;
+	music.erase(std::remove_if(music.begin(), music.end(), [](std::shared_ptr<Music> const& m) {
+		return m->state() == Music::State::CANCELLED || m->state() == Music::State::DONE;
+	}), music.end());
+	m_published.write(m_program);
+}
+
+void Output::play(std::shared_ptr<Music> music) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	// Music that has not started yet never will
+	for (auto const& m: m_program.music) m->cancel();
+	m_program.music.insert(m_program.music.begin(), std::move(music));
+	publish();
+}
+
+std::shared_ptr<Music> Output::current() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto const& m: m_program.music) {
+		if (m->state() == Music::State::LOADING || m->state() == Music::State::PLAYING) return m;
+	}
+	return nullptr;
+}
+
+std::vector<std::shared_ptr<Music>> Output::playing() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<std::shared_ptr<Music>> ret;
+	for (auto const& m: m_program.music) if (m->state() == Music::State::PLAYING) ret.push_back(m);
+	return ret;
+}
+
+bool Output::busy() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto const& m: m_program.music) {
+		if (m->state() == Music::State::LOADING || m->state() == Music::State::PLAYING) return true;
+	}
+	return false;
+}
+
+void Output::loadSample(std::string const& name, std::shared_ptr<Sample> sample) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_samples.emplace(name, std::move(sample));
+	m_program.samples.clear();
+	for (auto const& kv: m_samples) m_program.samples.push_back(kv.second);
+	publish();
+}
+
+void Output::playSample(std::string const& name) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto it = m_samples.find(name);
+	if (it != m_samples.end()) it->second->play();
+}
+
+void Output::unloadSample(std::string const& name) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (!m_samples.erase(name)) return;
+	m_program.samples.clear();
+	for (auto const& kv: m_samples) m_program.samples.push_back(kv.second);
+	publish();
+}
+
+void Output::setSynth(std::shared_ptr<Synth> synth) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_program.synth = std::move(synth);
+	publish();
+}
+
+bool Output::hasSynth() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_program.synth != nullptr;
+}
+
+void Output::setMics(std::vector<Analyzer*> mics) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_program.mics = std::move(mics);
+	publish();
+}
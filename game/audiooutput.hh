@@ -0,0 +1,200 @@
+#pragma once
+
+#include "audiobuffer.hh"
+#include "chrono.hh"
+#include "mixbus.hh"
+#include "mixengine.hh"
+#include "triplebuffer.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Analyzer;
+
+/**
+* Advanced audio sync code.
+* Produces precise monotonic clock synced to audio output callback (which may suffer of major jitter).
+* Uses system clock as timebase but the clock is skewed (made slower or faster) depending on whether
+* it is late or early. The clock is also stopped if audio output pauses.
+*
+* The audio thread owns the clock and publishes it through a TripleBuffer, so timeSync never locks; the mutex
+* only serializes the threads that read the position.
+**/
+class AudioClock {
+  public:
+	/**
+	* Called from audio callback to keep the clock synced.
+	* @param audioPos the current position in the song
+	* @param length the duration of the current audio block
+	*/
+	void timeSync(Seconds audioPos, Seconds length);
+	/// Get the current position in seconds
+	Seconds pos() const;
+
+  private:
+	struct State {
+		Time baseTime; ///< A reference time (corresponds to basePos)
+		Seconds basePos = 0.0s; ///< A reference position in song
+		double skew = 0.0; ///< The skew ratio applied to system time (since baseTime)
+		Seconds max = 0.0s; ///< Maximum output value for the clock (end of the current audio block)
+		/// The position at the given time
+		Seconds at(Time now) const;
+	};
+	State m_state;  ///< Audio thread's copy
+	std::minstd_rand m_dither;  ///< Unlike rand(), never locks
+	mutable std::mutex m_readMutex;
+	mutable TripleBuffer<State> m_published;
+};
+
+/**
+* Music being played: the tracks of a song mixed by a MixEngine.
+*
+* The UI thread controls it through atomics (seek, track levels, center channel suppression), which the audio
+* thread applies at the start of its next block. The audio thread moves it from LOADING to PLAYING once the
+* tracks are buffered and to DONE when it has ended; the UI thread may cancel it while it is still LOADING.
+**/
+class Music {
+  public:
+	enum class State { LOADING, PLAYING, CANCELLED, DONE };
+	/// Decoded audio of each track by name
+	using Tracks = std::vector<std::pair<std::string, std::unique_ptr<AudioBuffer>>>;
+
+	Music(Tracks tracks, double rate, bool preview, std::size_t mixBlock = MixEngine::DEFAULT_BLOCK);
+
+	MixEngine mixer;  ///< Mixes the tracks, with their fade levels, the fade of the music and center channel suppression
+	State state() const { return m_state.load(); }
+	bool preview() const { return m_preview; }
+	/// Get the current position in seconds
+	double pos() const { return m_clock.pos().count(); }
+	double duration() const;
+	/// Continue from the given position (in seconds) at the next block
+	void seek(double time) { m_seek.store(2 * static_cast<std::int64_t>(time * m_rate)); }  // Whole frames
+	void trackFade(std::string const& name, double fadeLevel);
+	void trackPitchBend(std::string const& name, double pitchFactor);
+	void toggleCenterChannelSuppressor();
+	/// Cancel music that has not started yet, returning false if it already has
+	bool cancel();
+
+	// Audio thread
+	/// Prepare (seek) all tracks to current position, return true when done (nonblocking)
+	bool prepare();
+	/// Move from LOADING to PLAYING, returning false if the music was cancelled
+	bool start();
+	/// Sums the stream to output sample range (using bus as scratch space), returns true if the stream still has audio left afterwards.
+	bool operator()(float* begin, float* end, MixBus& bus, MixParams const& params);
+	/// Position of the audio thread in seconds
+	double audioPos() const { return durationOf(m_pos).count(); }
+
+  private:
+	struct Track {
+		std::unique_ptr<AudioBuffer> audioBuffer;
+		std::size_t stem;  ///< Index in Music::mixer
+		std::atomic<float> fadeLevel{ 1.0f };
+		std::atomic<double> pitchFactor{ 0.0 };
+	};
+	Seconds durationOf(std::int64_t samples) const { return 1.0s * samples / m_rate / 2.0; }
+	void applySeek();
+
+	std::unordered_map<std::string, std::unique_ptr<Track>> m_tracks; ///< Audio decoders
+	std::vector<Track*> m_stems;  ///< Tracks by stem index of mixer
+	double m_rate; ///< Sample rate
+	bool m_preview;
+	std::atomic<State> m_state{ State::LOADING };
+	std::atomic<std::int64_t> m_seek{ -1 };  ///< Position requested by seek (-1 if none)
+	std::atomic<bool> m_centerCancel{ false };
+	std::int64_t m_pos = 0; ///< Current sample position
+	AudioClock m_clock;
+};
+
+/// A sound effect, played from the start every time play() is called
+class Sample {
+  public:
+	explicit Sample(std::unique_ptr<AudioBuffer> audioBuffer): m_audioBuffer(std::move(audioBuffer)) {}
+	/// Restart the sample (any thread)
+	void play() { m_plays.fetch_add(1); }
+	/// Mix the sample in at volume (audio thread)
+	void operator()(float* begin, float* end, MixBus& bus, float volume);
+
+  private:
+	std::unique_ptr<AudioBuffer> m_audioBuffer;
+	std::atomic<unsigned> m_plays{ 0 };
+	unsigned m_played = 0;  ///< Value of m_plays when the sample was last restarted
+	std::int64_t m_pos = 0;
+	bool m_eof = true;
+};
+
+/// Plays the notes of a vocal track as tones over the music
+class Synth {
+  public:
+	/// A note to play
+	struct Tone {
+		double begin, end;
+		float note;
+	};
+	Synth(std::vector<Tone> tones, double rate): m_tones(std::move(tones)), m_rate(rate) {}
+	/// Quieten the music in [begin, end) and add the tone of the note at position (seconds)
+	void operator()(float* begin, float* end, double position);
+
+  private:
+	std::vector<Tone> m_tones;
+	double m_rate; ///< Sample rate
+	double m_phase = 0.0;
+};
+
+/**
+* Audio output callback wrapper. The playback Device calls this when it needs samples.
+*
+* Whatever the callback plays is a Program, which the other threads change and publish as a whole through a
+* TripleBuffer. The Music, Sample and Synth objects in it are shared, so the callback never creates or destroys
+* anything: the last reference to them goes away on the publishing side once a newer program has replaced the
+* ones that held them. The callback never locks, waits or allocates.
+**/
+class Output {
+  public:
+	/// Everything that the callback plays
+	struct Program {
+		std::vector<std::shared_ptr<Music>> music;  ///< Newest first
+		std::vector<std::shared_ptr<Sample>> samples;
+		std::shared_ptr<Synth> synth;
+		std::vector<Analyzer*> mics;  ///< Used for audio pass-through
+	};
+
+	std::atomic<bool> paused{ false };
+	TripleBuffer<MixParams> params;  ///< Written by Audio::publishParams, read by the callback
+
+	/// Mix one block of output. Must not allocate, block or look up config: use bus for scratch space and params for settings.
+	void callback(float* begin, float* end, double rate, MixBus& bus);
+
+	// Any other thread
+	/// Start music once it is buffered, fading out the music before it (and cancelling music that has not started yet)
+	void play(std::shared_ptr<Music> music);
+	/// The latest music that has not ended (which may still be loading), if any
+	std::shared_ptr<Music> current() const;
+	/// All music that the callback is playing
+	std::vector<std::shared_ptr<Music>> playing() const;
+	/// Is there music loading or playing?
+	bool busy() const;
+	void loadSample(std::string const& name, std::shared_ptr<Sample> sample);
+	void playSample(std::string const& name);
+	void unloadSample(std::string const& name);
+	void setSynth(std::shared_ptr<Synth> synth);
+	bool hasSynth() const;
+	void setMics(std::vector<Analyzer*> mics);
+
+  private:
+	/// Publish m_program, leaving out the music that has ended (call with m_mutex locked)
+	void publish();
+
+	mutable std::mutex m_mutex;  ///< Serializes the threads that change the program (never taken by the callback)
+	Program m_program;  ///< Latest published program
+	std::unordered_map<std::string, std::shared_ptr<Sample>> m_samples;
+	TripleBuffer<Program> m_published;
+};
@@ -0,0 +1,50 @@
+#include "beatgrid.hh"
+
+#include "cache.hh"
+#include "songcache.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+
+fs::path BeatGrid::fileName(fs::path const& music) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.beats", static_cast<unsigned long long>(SongCache::hash(music.string())));
+	return name;
+}
+
+bool BeatGrid::load(fs::path const& file, FileStamp const& source, double start) {
+	std::error_code ec;
+	auto const size = fs::file_size(file, ec);
+	if (ec || size < sizeof(Header)) return false;
+	std::ifstream in(file, std::ios::binary);
+	Header header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+	if (std::memcmp(header.magic, Header().magic, sizeof(header.magic)) != 0 || header.version != Header().version) return false;
+	if (header.sourceTime != source.time || header.sourceSize != source.size || header.start != start) return false;
+	if (size != sizeof(header) + header.count * sizeof(double)) return false;
+	std::vector<double> data(static_cast<std::size_t>(header.count));
+	if (!in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(double)))) return false;
+	this->start = start;
+	beats = std::move(data);
+	return true;
+}
+
+void BeatGrid::save(fs::path const& file, FileStamp const& source) const {
+	Header header;
+	header.sourceTime = source.time;
+	header.sourceSize = source.size;
+	header.start = start;
+	header.count = beats.size();
+	cache::writeAtomically(file, { std::string_view(reinterpret_cast<char const*>(&header), sizeof(header)),
+	  std::string_view(reinterpret_cast<char const*>(beats.data()), beats.size() * sizeof(double)) });
+}
+
+void BeatGrid::extendBackwards(double period) {
+	if (beats.empty() || !(period > 0.0)) return;
+	std::vector<double> extra;
+	for (double beat = beats.front() - period; beat - start > 0.02; beat -= period) extra.push_back(beat);
+	beats.insert(beats.begin(), extra.rbegin(), extra.rend());
+}
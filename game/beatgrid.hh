@@ -0,0 +1,40 @@
+#pragma once
+
+#include "fs.hh"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* Beats found in a piece of music by tempo detection, and their cache on disk.
+*
+* Detection (see BeatTracker) covers the music from a start time onwards, so a cached grid is only valid for the
+* same start and the same version of the music file. Each music file has one grid file, which is replaced when
+* either changes.
+**/
+struct BeatGrid {
+	/// Beats file header, followed by count doubles (seconds from the start of the music)
+	struct Header {
+		char magic[4] = { 'P', 'B', 'T', 'S' };
+		std::uint32_t version = 1;
+		std::int64_t sourceTime = 0;
+		std::uint64_t sourceSize = 0;
+		double start = 0.0;
+		std::uint64_t count = 0;
+	};
+
+	double start = 0.0;  ///< Where detection began (seconds)
+	std::vector<double> beats;
+
+	/// File name (relative to the beats directory) of the grid of a music file
+	static fs::path fileName(fs::path const& music);
+	/// Read a grid file. Returns false if it is missing, damaged, or made of another version or start of the source.
+	bool load(fs::path const& file, FileStamp const& source, double start);
+	/// Write the grid, replacing any existing file atomically
+	void save(fs::path const& file, FileStamp const& source) const;
+	/**
+	* Add the beats that detection misses at the beginning: the period of the first detected beat repeated
+	* backwards, as long as the beats stay more than 20 ms after start.
+	**/
+	void extendBackwards(double period);
+};
@@ -0,0 +1,141 @@
+#include "beattracker.hh"
+
+#include "chrono.hh"
+#include "ffmpeg.hh"
+#include "fs.hh"
+#include "trace.hh"
+#include "util.hh"
+
+#include "aubio/aubio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+	constexpr unsigned WIN_SIZE = 1536;
+	constexpr unsigned HOP_SIZE = 768;
+}
+
+BeatTracker::BeatTracker(): m_dir(getCacheDir() / "beats"), m_thread(&BeatTracker::run, this) {}
+
+BeatTracker::~BeatTracker() {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_quit = true;
+		++m_serial;  // Abandon the work in progress
+	}
+	m_cond.notify_one();
+	m_thread.join();
+}
+
+void BeatTracker::request(fs::path const& music, double start) {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_request.emplace(music, start);
+		++m_serial;
+	}
+	m_cond.notify_one();
+}
+
+BeatTracker::Result const* BeatTracker::poll() {
+	Result const& result = m_results.read();
+	if (result.serial == m_seen) return nullptr;
+	m_seen = result.serial;
+	return &result;
+}
+
+void BeatTracker::run() {
+	trace::setThreadName("beat tracker");
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true) {
+		m_cond.wait(l, [this] { return m_quit || m_request; });
+		if (m_quit) return;
+		auto [music, start] = std::move(*m_request);
+		m_request.reset();
+		unsigned const serial = m_serial;
+		UnlockGuard<decltype(l)> unlocked(l);
+		auto const begin = Clock::now();
+		FileStamp const stamp = FileStamp::of(music);
+		fs::path const cached = m_dir / BeatGrid::fileName(music);
+		Result result{ music, BeatGrid(), serial };
+		// A grid of the whole song (see --analyze-library) covers any preview
+		if (!result.grid.load(cached, stamp, start) && !result.grid.load(cached, stamp, 0.0)) {
+			try {
+				auto grid = detect(music, start, PREVIEW_SECONDS, [&] { return m_serial.load() != serial; });
+				if (!grid) continue;  // Outdated
+				result.grid = std::move(*grid);
+			} catch (std::exception const& e) {
+				std::clog << "audio/warning: Cannot detect beats of " << music << ": " << e.what() << std::endl;
+			}
+			// Failures are cached too (as no beats), so that they are not retried at every preview
+			try {
+				fs::create_directories(m_dir);
+				result.grid.save(cached, stamp);
+			} catch (std::exception const& e) {
+				std::clog << "audio/warning: Cannot cache beats " << cached << ": " << e.what() << std::endl;
+			}
+			std::clog << "audio/debug: Detected " << result.grid.beats.size() << " beats of " << music << " in " << Seconds(Clock::now() - begin).count() << " s" << std::endl;
+		}
+		m_results.write(result);
+	}
+}
+
+std::optional<BeatGrid> BeatTracker::detect(fs::path const& music, double start, double seconds, std::function<bool()> const& cancel) {
+	TRACE_ZONE("audio/beats");
+	std::vector<float> stereo;
+	if (!AudioFFmpeg::decode(music, RATE, start, 2 * static_cast<std::size_t>(std::min(seconds * RATE, 1e10)), stereo, cancel)) return std::nullopt;
+	std::vector<float> mono(stereo.size() / 2);
+	for (std::size_t i = 0; i < mono.size(); ++i) mono[i] = 0.5f * (stereo[2 * i] + stereo[2 * i + 1]);
+	return detect(mono, start);
+}
+
+BeatGrid BeatTracker::detect(std::vector<float> const& mono, double start) {
+	Detector detector(start);
+	detector.process(mono.data(), mono.size());
+	return detector.finish();
+}
+
+struct BeatTracker::Detector::Impl {
+	std::unique_ptr<aubio_tempo_t, decltype(&del_aubio_tempo)> tempo{ new_aubio_tempo("default", WIN_SIZE, HOP_SIZE, RATE), del_aubio_tempo };
+	std::unique_ptr<fvec_t, decltype(&del_fvec)> in{ new_fvec(HOP_SIZE), del_fvec }, out{ new_fvec(1), del_fvec };
+	std::size_t fill = 0;  ///< Samples in in
+	BeatGrid grid;
+	double period = 0.0;
+};
+
+BeatTracker::Detector::Detector(double start): self(std::make_unique<Impl>()) {
+	if (!self->tempo || !self->in || !self->out) throw std::runtime_error("Cannot create aubio tempo detection");
+	aubio_tempo_set_silence(self->tempo.get(), -50.0f);
+	aubio_tempo_set_threshold(self->tempo.get(), 0.4f);
+	self->grid.start = start;
+}
+
+BeatTracker::Detector::~Detector() = default;
+
+void BeatTracker::Detector::process(float const* mono, std::size_t samples) {
+	// Tempo detection, a hop at a time
+	Impl& d = *self;
+	while (samples > 0) {
+		std::size_t const n = std::min<std::size_t>(samples, HOP_SIZE - d.fill);
+		std::copy_n(mono, n, d.in->data + d.fill);
+		mono += n;
+		samples -= n;
+		d.fill += n;
+		if (d.fill < HOP_SIZE) break;
+		d.fill = 0;
+		aubio_tempo_do(d.tempo.get(), d.in.get(), d.out.get());
+		if (d.out->data[0] == 0) continue;
+		if (d.grid.beats.empty()) d.period = aubio_tempo_get_period_s(d.tempo.get());
+		d.grid.beats.push_back(d.grid.start + aubio_tempo_get_last_s(d.tempo.get()));
+	}
+}
+
+BeatGrid BeatTracker::Detector::finish() {
+	BeatGrid grid = std::move(self->grid);
+	grid.extendBackwards(self->period);
+	return grid;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "beatgrid.hh"
+#include "fs.hh"
+#include "triplebuffer.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/**
+* Finds the beats of song previews in a worker thread, so that neither the audio thread nor the GUI waits for it.
+*
+* The worker decodes the music on its own (PREVIEW_SECONDS from the preview start) and runs aubio tempo detection
+* on it, unless the grid is already in the cache (getCacheDir()/beats). Only the latest request matters: a new one
+* abandons the one in progress. Results come back through a TripleBuffer, so that polling never blocks.
+**/
+class BeatTracker {
+  public:
+	/// Beats of a music file
+	struct Result {
+		fs::path music;
+		BeatGrid grid;
+		unsigned serial = 0;  ///< Of the request
+	};
+	static constexpr double PREVIEW_SECONDS = 40.0;
+	static constexpr unsigned RATE = 48000;  ///< Of the audio that beats are detected in
+
+	BeatTracker();
+	~BeatTracker();
+	/// Find the beats of music from start onwards (replacing any earlier request)
+	void request(fs::path const& music, double start);
+	/// The result of the latest request, once and if it is done (single reader)
+	Result const* poll();
+
+	/**
+	* Decode music from start for at most the given number of seconds and detect its beats.
+	* Returns nothing if cancel() becomes true before it is done. Throws if the file cannot be decoded.
+	**/
+	static std::optional<BeatGrid> detect(fs::path const& music, double start, double seconds, std::function<bool()> const& cancel = [] { return false; });
+	/// Detect the beats of mono audio at RATE that starts at start (seconds)
+	static BeatGrid detect(std::vector<float> const& mono, double start);
+
+	/// Beat detection on mono audio at RATE that is given a piece at a time, so that a whole song need not be in memory
+	class Detector {
+	  public:
+		/// The audio starts at start (seconds)
+		explicit Detector(double start);
+		~Detector();
+		void process(float const* mono, std::size_t samples);
+		/// The beats of the audio processed (a trailing part of a hop is left out)
+		BeatGrid finish();
+	  private:
+		struct Impl;
+		std::unique_ptr<Impl> self;
+	};
+
+  private:
+	void run();
+
+	fs::path m_dir;
+	TripleBuffer<Result> m_results;
+	unsigned m_seen = 0;  ///< Serial of the latest result returned by poll
+	// Shared with the worker
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::optional<std::pair<fs::path, double>> m_request;
+	std::atomic<unsigned> m_serial{ 0 };  ///< Of the latest request, so that the worker notices when it is outdated
+	bool m_quit = false;
+	std::thread m_thread;
+};
@@ -0,0 +1,174 @@
+#include "bench.hh"
+
+#include "analyzer.hh"
+#include "audio.hh"
+#include "chrono.hh"
+#include "database.hh"
+#include "engine.hh"
+#include "ffmpeg.hh"
+#include "json.hh"
+#include "microphones.hh"
+#include "platform.hh"
+#include "song.hh"
+#include "trace.hh"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if (BOOST_OS_WINDOWS)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+	/// A recording that is sung into a virtual microphone
+	class VirtualMic {
+	  public:
+		VirtualMic(fs::path const& file, unsigned rate): m_file(file), m_buffer(file, rate) {}
+		fs::path const& file() const { return m_file; }
+		/// Give the next frames of the recording (mixed to mono) to the analyzer, waiting for the decoder if needed
+		void feed(Analyzer& analyzer, std::size_t frames) {
+			while (!m_buffer.prepare(m_pos)) std::this_thread::sleep_for(1ms);
+			m_stereo.assign(2 * frames, 0.0f);
+			m_buffer.read(m_stereo.data(), static_cast<std::int64_t>(m_stereo.size()), m_pos);
+			m_pos += static_cast<std::int64_t>(m_stereo.size());
+			m_mono.resize(frames);
+			for (std::size_t i = 0; i < frames; ++i) m_mono[i] = 0.5f * (m_stereo[2 * i] + m_stereo[2 * i + 1]);
+			analyzer.input(m_mono.begin(), m_mono.end());
+		}
+
+	  private:
+		fs::path m_file;
+		AudioBuffer m_buffer;
+		std::int64_t m_pos = 0;  ///< Samples (not frames) read so far
+		std::vector<float> m_stereo, m_mono;
+	};
+
+	struct Usage {
+		double cpu = 0.0;  ///< Seconds of user and system time of all threads
+		std::uint64_t peakKiB = 0;  ///< Memory high-water mark (resident set)
+	};
+
+	Usage usage() {
+		Usage u;
+#if (BOOST_OS_WINDOWS)
+		FILETIME creation, exit, kernel, user;
+		auto seconds = [](FILETIME const& ft) { return static_cast<double>(std::uint64_t(ft.dwHighDateTime) << 32 | ft.dwLowDateTime) * 1e-7; };
+		if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) u.cpu = seconds(kernel) + seconds(user);
+		PROCESS_MEMORY_COUNTERS pmc{};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) u.peakKiB = pmc.PeakWorkingSetSize / 1024;
+#else
+		rusage ru{};
+		if (getrusage(RUSAGE_SELF, &ru) != 0) return u;
+		auto seconds = [](timeval const& tv) { return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) * 1e-6; };
+		u.cpu = seconds(ru.ru_utime) + seconds(ru.ru_stime);
+		u.peakKiB = static_cast<std::uint64_t>(ru.ru_maxrss);
+#if (BOOST_OS_MACOS)
+		u.peakKiB /= 1024;  // Bytes on macOS, KiB elsewhere
+#endif
+#endif
+		return u;
+	}
+}
+
+void runBench(BenchOptions const& options) {
+	trace::setThreadName("bench");
+	trace::clear();
+	trace::enable(true);
+	std::clog << "bench/info: Loading " << options.song << std::endl;
+	Song song(options.song);
+	song.loadNotes(false);
+	auto const micConfig = getMicrophoneConfig();
+	if (options.mics.size() > std::min<std::size_t>(AUDIO_MAX_ANALYZERS, micConfig.size())) throw std::runtime_error("Too many microphones");
+	if (!options.mics.empty() && song.vocalTracks.empty()) throw std::runtime_error("The song has no vocals to sing");
+	unsigned const rate = static_cast<unsigned>(Audio::getSR());
+	std::size_t const frames = static_cast<std::size_t>(std::lround(Engine::TIMESTEP * rate));  // One engine step per block
+	Seconds const block(Engine::TIMESTEP);
+	// The database is only needed for the players of the engine, keep it away from the user's files (and from other runs)
+	fs::path const tmpDir = fs::temp_directory_path() / ("performous-bench-" + std::to_string(std::random_device{}()));
+	nlohmann::json report;
+	{
+		Audio audio{ Audio::Headless() };
+		Database database(tmpDir / "database.xml");
+		auto& analyzers = audio.analyzers();
+		std::vector<std::unique_ptr<VirtualMic>> mics;
+		Engine::VocalTrackPtrs tracks;
+		for (std::size_t i = 0; i < options.mics.size(); ++i) {
+			analyzers.emplace_back(rate, micConfig[i].colorname, configuredPitchEngine(micConfig[i].colorname));
+			mics.push_back(std::make_unique<VirtualMic>(options.mics[i], rate));
+			tracks.push_back(&song.getVocalTrack(static_cast<unsigned>(i % song.vocalTracks.size())));  // Duets alternate
+		}
+		Engine engine(audio, tracks, database, Engine::Mode::MANUAL);
+		audio.playMusic(song.music);
+		double end = 0.0;
+		for (auto const* track: tracks) end = std::max(end, track->endTime);
+		std::vector<float> out(2 * frames);
+		unsigned blocks = 0, missed = 0, late = 0;
+		double worst = 0.0;
+		Usage const before = usage();
+		auto const start = Clock::now();
+		for (; ; ++blocks) {
+			Seconds const t = static_cast<double>(blocks) * block;
+			for (std::size_t i = 0; i < mics.size(); ++i) mics[i]->feed(analyzers[i], frames);
+			auto const callback = Clock::now();
+			audio.render(out.data(), out.data() + out.size());
+			Seconds const took = Clock::now() - callback;
+			// A sound card would have needed the block within its duration
+			if (took > block) ++missed;
+			worst = std::max(worst, took.count());
+			engine.step();
+			if (blocks == 0) {
+				double const length = audio.getLength();
+				if (!std::isnan(length)) end = std::max(end, length);
+			}
+			if (t + block >= end * 1s || !audio.isPlaying()) break;
+			if (options.speed > 0.0) {
+				auto const due = start + std::chrono::duration_cast<Clock::duration>((t + block) / options.speed);
+				if (Clock::now() > due) ++late;
+				else std::this_thread::sleep_until(due);
+			}
+		}
+		Seconds const wall = Clock::now() - start;
+		Usage const after = usage();
+		Seconds const played = static_cast<double>(blocks + 1) * block;
+		std::clog << "bench/info: Played " << played.count() << " s in " << wall.count() << " s, " << missed << " audio blocks over their deadline." << std::endl;
+		report["song"] = { { "file", options.song.string() }, { "title", song.title }, { "artist", song.artist }, { "seconds", played.count() } };
+		report["speed"] = options.speed;
+		report["seconds"] = { { "wall", wall.count() }, { "cpu", after.cpu - before.cpu } };
+		report["realtime_factor"] = played.count() / std::max(wall.count(), 1e-9);
+		report["audio"] = { { "block_ms", block.count() * 1e3 }, { "blocks", blocks + 1 }, { "missed_deadlines", missed },
+		  { "late_blocks", late }, { "worst_callback_ms", worst * 1e3 } };
+		report["scores"] = nlohmann::json::array();
+		auto player = database.cur.begin();
+		for (std::size_t i = 0; i < mics.size() && player != database.cur.end(); ++i, ++player) {
+			auto const cost = analyzers[i].getCost();
+			report["scores"].push_back({ { "mic", analyzers[i].getId() }, { "file", mics[i]->file().string() },
+			  { "track", tracks[i]->name }, { "score", player->getScore() }, { "pitch_engine", PitchEngine::name(analyzers[i].getEngine()) },
+			  { "pitch_frame_us", { { "p50", cost.p50 * 1e6 }, { "p99", cost.p99 * 1e6 }, { "max", cost.max * 1e6 } } } });
+		}
+		report["memory"] = { { "peak_rss_kib", after.peakKiB } };
+	}
+	// Time spent in each traced zone, on all threads
+	report["zones"] = nlohmann::json::array();
+	for (auto const& [name, s]: trace::summaries(true)) {
+		report["zones"].push_back({ { "name", name }, { "count", s.count }, { "total_ms", s.total * 1e3 },
+		  { "p50_ms", s.p50 * 1e3 }, { "p99_ms", s.p99 * 1e3 }, { "max_ms", s.max * 1e3 } });
+	}
+	if (!options.trace.empty()) trace::writeChromeTrace(options.trace);
+	trace::enable(false);
+	std::error_code ec;
+	fs::remove_all(tmpDir, ec);
+	if (options.report.empty()) std::cout << report.dump(4) << std::endl;
+	else writeJSON(report, options.report);
+}
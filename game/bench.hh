@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fs.hh"
+
+#include <vector>
+
+/// Settings of a headless benchmark run (--bench)
+struct BenchOptions {
+	fs::path song;  ///< Song file to play
+	std::vector<fs::path> mics;  ///< Audio files sung into virtual microphones, one per singer
+	double speed = 1.0;  ///< Playback speed relative to real time, 0 = as fast as possible
+	fs::path report;  ///< Where to write the JSON report (empty = standard output)
+	fs::path trace;  ///< Where to write a Chrome trace of the run (empty = none)
+};
+
+/**
+* Play a song from start to end without a window or a sound card, and report how long everything took.
+*
+* The output is mixed by Audio::render in blocks of one Engine::TIMESTEP (a null output device), the mic files are
+* decoded and fed to the analyzers block by block, and the engine scores each block right after it, so that the
+* scores are the same at any speed. Runs where there is no display or GPU (e.g. in CI).
+**/
+void runBench(BenchOptions const& options);
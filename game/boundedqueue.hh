@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+* Blocking multi-producer/multi-consumer queue with a fixed capacity.
+* Producers wait while the queue is full, so a fast producer cannot run arbitrarily far ahead of its consumers.
+* After close(), pushing fails and consumers get the remaining items, after which pop() returns false.
+**/
+template <typename T> class BoundedQueue {
+  public:
+	explicit BoundedQueue(std::size_t capacity): m_capacity(capacity > 0 ? capacity : 1) {}
+	BoundedQueue(BoundedQueue const&) = delete;
+	BoundedQueue& operator=(BoundedQueue const&) = delete;
+
+	/// Add an item, waiting for space if needed. Returns false (dropping the item) if the queue is closed.
+	bool push(T item) {
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_notFull.wait(l, [this] { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed) return false;
+		m_items.push_back(std::move(item));
+		l.unlock();
+		m_notEmpty.notify_one();
+		return true;
+	}
+	/// Take the oldest item, waiting for one if needed. Returns false once the queue is closed and empty.
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_notEmpty.wait(l, [this] { return m_closed || !m_items.empty(); });
+		if (m_items.empty()) return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		l.unlock();
+		m_notFull.notify_one();
+		return true;
+	}
+	/// Stop accepting items and wake up everyone waiting
+	void close() {
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_closed = true;
+		}
+		m_notFull.notify_all();
+		m_notEmpty.notify_all();
+	}
+	std::size_t capacity() const { return m_capacity; }
+
+  private:
+	std::size_t const m_capacity;
+	std::mutex m_mutex;
+	std::condition_variable m_notFull, m_notEmpty;
+	std::deque<T> m_items;
+	bool m_closed = false;
+};
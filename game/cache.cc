@@ -1,16 +1,87 @@
 #include "cache.hh"
+
 #include "fs.hh"
 #include "util.hh"
 
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <fmt/format.h>
 
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
 namespace cache {
+	void writeAtomically(fs::path const& filename, std::initializer_list<std::string_view> parts) {
+		// Written under a name of its own, so that threads writing the same file do not mix their output
+		fs::path const tmp = filename.string() + fmt::format(".{:x}.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+		try {
+			std::ofstream out(tmp, std::ios::binary);
+			for (auto const& part: parts) out.write(part.data(), static_cast<std::streamsize>(part.size()));
+			out.close();
+			if (!out) throw std::runtime_error("Cannot write " + tmp.string());
+			fs::rename(tmp, filename);
+		} catch (...) {
+			std::error_code ec;
+			fs::remove(tmp, ec);
+			throw;
+		}
+	}
+
 	fs::path constructSVGCacheFileName(fs::path const& svgfilename, float factor){
 		std::string const lod = fmt::format("{:.2f}", factor);
-		std::string const cache_basename = svgfilename.filename().string() + ".cache_" + lod + ".premul.png";
+		std::string const cache_basename = svgfilename.filename().string() + ".cache_" + lod + ".premul.raw";
 		// Windows drive name handling
 		auto const fullpath = replace(svgfilename.parent_path().string(), ':', '_');
 
 		return getCacheDir() / "misc" / fs::path(fullpath).relative_path() / cache_basename;
 	}
+
+	namespace {
+		bool valid(RasterHeader const& header, FileStamp const& source, std::uintmax_t fileSize) {
+			if (std::memcmp(header.magic, RasterHeader().magic, sizeof(header.magic)) != 0 || header.version != RasterHeader().version) return false;
+			if (header.sourceTime != source.time || header.sourceSize != source.size) return false;
+			return header.width > 0 && header.height > 0 && fileSize == sizeof(header) + std::uintmax_t(header.width) * header.height * 4;
+		}
+	}
+
+	bool hasRaster(fs::path const& filename, FileStamp const& source) {
+		std::error_code ec;
+		auto const size = fs::file_size(filename, ec);
+		if (ec) return false;
+		RasterHeader header;
+		std::ifstream in(filename, std::ios::binary);
+		return in.read(reinterpret_cast<char*>(&header), sizeof(header)) && valid(header, source, size);
+	}
+
+	bool readRaster(fs::path const& filename, FileStamp const& source, unsigned& width, unsigned& height, std::vector<unsigned char>& pixels) {
+		if (!fs::is_regular_file(filename)) return false;
+		try {
+			boost::iostreams::mapped_file_source file(filename.string());
+			RasterHeader header;
+			if (file.size() < sizeof(header)) return false;
+			std::memcpy(&header, file.data(), sizeof(header));
+			if (!valid(header, source, file.size())) return false;
+			std::size_t const bytes = std::size_t(header.width) * header.height * 4;
+			pixels.resize(bytes);
+			std::memcpy(pixels.data(), file.data() + sizeof(header), bytes);
+			width = header.width;
+			height = header.height;
+		} catch (std::exception const&) {
+			return false;
+		}
+		return true;
+	}
+
+	void writeRaster(fs::path const& filename, FileStamp const& source, unsigned width, unsigned height, unsigned char const* pixels) {
+		RasterHeader header;
+		header.width = width;
+		header.height = height;
+		header.sourceTime = source.time;
+		header.sourceSize = source.size;
+		writeAtomically(filename, { std::string_view(reinterpret_cast<char const*>(&header), sizeof(header)),
+		  std::string_view(reinterpret_cast<char const*>(pixels), std::size_t(width) * height * 4) });
+	}
 }
@@ -1,24 +1,42 @@
 #pragma once
 
-#include "configuration.hh"
 #include "fs.hh"
-#include <cstring>
-#include <stdexcept>
+
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
 
 namespace cache {
 
+	/**
+	* Write the parts one after another into a file, replacing any existing file atomically. Threads writing the
+	* same file at once each write a temporary file of their own, and the last rename wins.
+	**/
+	void writeAtomically(fs::path const& filename, std::initializer_list<std::string_view> parts);
+
 	/** Builds the full path and file name for the SVG cache resource **/
 	fs::path constructSVGCacheFileName(fs::path const& svgfilename, float factor);
 
-	/** Load an SVG from the cache, if loading fails invalid_cache_error is thrown **/
-	template <typename T> bool loadSVG(T& target, fs::path const& source_filename, float factor) {
-		fs::path const cache_filename = cache::constructSVGCacheFileName(source_filename, factor);
-		// Verify that a cached file exists and that it is more recent than the original SVG
-		if (!fs::is_regular_file(cache_filename)) return false;
-		if (fs::last_write_time(source_filename) > fs::last_write_time(cache_filename)) return false;
-		// Try to load the cached file		
-		try { loadPNG(target, cache_filename.string()); } catch( ... ) { return false; }
-		return true;
-	}
-}
+	/**
+	* Raw raster files: a header followed by uncompressed RGBA rows, so that loading one is a single copy out of a
+	* memory-mapped file. The header records the stamp of the source file, which must match when loading.
+	**/
+	struct RasterHeader {
+		char magic[4] = { 'P', 'R', 'A', 'W' };
+		std::uint32_t version = 1;
+		std::uint32_t width = 0;
+		std::uint32_t height = 0;
+		std::int64_t sourceTime = 0;
+		std::uint64_t sourceSize = 0;
+	};
 
+	/** Read a raster file. Returns false if it is missing, damaged or made of another version of the source. **/
+	bool readRaster(fs::path const& filename, FileStamp const& source, unsigned& width, unsigned& height, std::vector<unsigned char>& pixels);
+
+	/** Check the header of a raster file without reading the pixels **/
+	bool hasRaster(fs::path const& filename, FileStamp const& source);
+
+	/** Write width x height RGBA pixels into a raster file, replacing any existing file atomically **/
+	void writeRaster(fs::path const& filename, FileStamp const& source, unsigned width, unsigned height, unsigned char const* pixels);
+}
@@ -0,0 +1,139 @@
+#include "covercache.hh"
+
+#include "configuration.hh"
+#include "thumbnailfile.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+	unsigned const CELLS_PER_ROW = CoverCache::PAGE / CoverCache::CELL;
+	std::size_t const PAGE_BYTES = std::size_t(CoverCache::PAGE) * CoverCache::PAGE * 4;
+
+	unsigned pageCount() {
+		std::size_t const limit = std::size_t(config["graphic/cover_memory"].ui()) << 20;
+		return static_cast<unsigned>(std::max<std::size_t>(1, limit / PAGE_BYTES));
+	}
+}
+
+void CoverCache::Image::draw(Window& window) const {
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	m_page->draw(window, dimensions, m_tex);
+}
+
+CoverCache::CoverCache(): m_dir(getCacheDir() / "covers"), m_slots(pageCount(), CELLS_PER_ROW * CELLS_PER_ROW), m_thread(&CoverCache::run, this) {}
+
+CoverCache::~CoverCache() {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_quit = true;
+	}
+	m_cond.notify_one();
+	m_thread.join();
+	if (m_warm.samples || m_cold.samples) std::clog << "covers/info: Thumbnails from cache: " << m_warm << ", from images: " << m_cold << std::endl;
+}
+
+bool CoverCache::supports(fs::path const& image) {
+	auto const ext = toLower(image.extension().string());
+	return ext == ".jpg" || ext == ".jpeg" || ext == ".png";
+}
+
+CoverCache::Image* CoverCache::get(fs::path const& image) {
+	std::string key = image.string();
+	if (m_slots.find(key)) return &m_images.at(key);
+	if (!m_failed.count(key)) request(key, true);
+	return nullptr;
+}
+
+void CoverCache::prefetch(fs::path const& image) {
+	std::string key = image.string();
+	auto it = m_images.find(key);
+	if (it == m_images.end() && !m_failed.count(key)) request(key, false);
+}
+
+void CoverCache::request(std::string const& key, bool urgent) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_pending.count(key)) {
+		if (!urgent) return;
+		// Move a prefetch to the front
+		auto it = std::find(m_queue.begin(), m_queue.end(), key);
+		if (it == m_queue.end() || it == m_queue.begin()) return;
+		m_queue.erase(it);
+	} else m_pending.insert(key);
+	if (urgent) m_queue.push_front(key);
+	else m_queue.push_back(key);
+	m_cond.notify_one();
+}
+
+void CoverCache::run() {
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true) {
+		m_cond.wait(l, [this] { return m_quit || !m_queue.empty(); });
+		if (m_quit) return;
+		std::string key = std::move(m_queue.front());
+		m_queue.pop_front();
+		Thumbnail thumbnail;
+		{
+			UnlockGuard<decltype(l)> unlocked(l);
+			try {
+				thumbnail = make(key);
+			} catch (std::exception const& e) {
+				std::clog << "covers/warning: " << key << ": " << e.what() << std::endl;
+			}
+		}
+		m_done.emplace_back(std::move(key), std::move(thumbnail));
+	}
+}
+
+Thumbnail CoverCache::make(fs::path const& image) {
+	auto start = Clock::now();
+	bool cached = false;
+	Thumbnail t = loadThumbnail(image, m_dir, CELL, cached);
+	std::lock_guard<std::mutex> l(m_mutex);
+	(cached ? m_warm : m_cold).add(Seconds(Clock::now() - start).count());
+	return t;
+}
+
+void CoverCache::update() {
+	std::deque<std::pair<std::string, Thumbnail>> done;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		done.swap(m_done);
+		for (auto const& item: done) m_pending.erase(item.first);
+	}
+	if (done.empty()) return;
+	glutil::GLErrorChecker glerror("CoverCache::update");
+	glActiveTexture(GL_TEXTURE0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // Thumbnail rows are not padded
+	for (auto& [key, thumbnail]: done) {
+		if (thumbnail.rgb.empty()) {
+			m_failed.insert(key);
+			continue;
+		}
+		if (m_slots.find(key)) continue;  // Requested twice
+		auto [slot, evicted] = m_slots.insert(key);
+		if (!evicted.empty()) m_images.erase(evicted);
+		// Pages are created when first needed
+		while (m_pages.size() <= slot.page) {
+			auto page = std::make_unique<OpenGLTexture<GL_TEXTURE_2D>>();
+			glBindTexture(GL_TEXTURE_2D, page->id());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, PAGE, PAGE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			m_pages.push_back(std::move(page));
+		}
+		unsigned const x = slot.cell % CELLS_PER_ROW * CELL, y = slot.cell / CELLS_PER_ROW * CELL;
+		glBindTexture(GL_TEXTURE_2D, m_pages[slot.page]->id());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(y), static_cast<GLsizei>(thumbnail.width),
+		  static_cast<GLsizei>(thumbnail.height), GL_RGB, GL_UNSIGNED_BYTE, thumbnail.rgb.data());
+		Image& image = m_images[key];
+		image.m_page = m_pages[slot.page].get();
+		// Half a texel inside the thumbnail, so that filtering does not pick up the neighbouring cells
+		float const p = float(PAGE);
+		image.m_tex = TexCoords((float(x) + 0.5f) / p, (float(y) + 0.5f) / p, (float(x + thumbnail.width) - 0.5f) / p, (float(y + thumbnail.height) - 0.5f) / p);
+		image.dimensions = Dimensions(float(thumbnail.width) / float(thumbnail.height)).fixedWidth(1.0f);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glerror.check("upload");
+}
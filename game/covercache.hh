@@ -0,0 +1,72 @@
+#pragma once
+
+#include "profiler.hh"
+#include "texture.hh"
+#include "thumbnail.hh"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Cover thumbnails for the song browser, drawn from a few large atlas textures.
+*
+* Thumbnails are made by a worker thread: from the thumbnail cache on disk (getCacheDir()/covers, keyed by the
+* path and stamp of the image) when possible, otherwise by decoding and scaling down the original image, which
+* is then cached. The atlas pages are allocated up to the graphic/cover_memory limit; after that, the least
+* recently drawn thumbnails give their cells to new ones.
+**/
+class CoverCache {
+  public:
+	/// A thumbnail in an atlas, drawn like a Texture
+	class Image {
+	  public:
+		Dimensions dimensions;
+		void draw(Window& window) const;
+	  private:
+		friend class CoverCache;
+		OpenGLTexture<GL_TEXTURE_2D> const* m_page = nullptr;
+		TexCoords m_tex;
+	};
+
+	CoverCache();
+	~CoverCache();
+	/// Can thumbnails be made of this image file?
+	static bool supports(fs::path const& image);
+	/// Thumbnail of the image, or nullptr while it is being made (or if it cannot be made)
+	Image* get(fs::path const& image);
+	/// Start making the thumbnail of an image that will be needed soon
+	void prefetch(fs::path const& image);
+	/// Copy finished thumbnails into the atlas (GL thread)
+	void update();
+
+	static constexpr unsigned CELL = 128;  ///< Maximum thumbnail size (pixels)
+	static constexpr unsigned PAGE = 2048;  ///< Atlas page size (pixels)
+
+  private:
+	void request(std::string const& key, bool urgent);
+	void run();
+	Thumbnail make(fs::path const& image);
+
+	fs::path m_dir;
+	std::vector<std::unique_ptr<OpenGLTexture<GL_TEXTURE_2D>>> m_pages;
+	AtlasSlots m_slots;
+	std::map<std::string, Image> m_images;  ///< Thumbnails in the atlas
+	std::set<std::string> m_failed;  ///< Images that could not be loaded
+	// Shared with the worker
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::deque<std::string> m_queue;  ///< Most urgent first
+	std::set<std::string> m_pending;  ///< Queued or being made
+	std::deque<std::pair<std::string, Thumbnail>> m_done;
+	ProfCP m_warm;  ///< Thumbnails read from the cache
+	ProfCP m_cold;  ///< Thumbnails made from the original images
+	bool m_quit = false;
+	std::thread m_thread;
+};
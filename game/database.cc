@@ -5,9 +5,16 @@
 #include "fs.hh"
 #include "i18n.hh"
 
+#include <chrono>
 #include <iostream>
 
-Database::Database(fs::path const& filename): m_filename(filename) {
+namespace {
+	/// Journal records after which flush() compacts the database
+	constexpr std::size_t COMPACT_RECORDS = 4096;
+}
+
+Database::Database(fs::path const& filename): m_filename(filename),
+  m_snapshot(fs::path(filename).replace_extension(".bin")), m_journal(fs::path(filename).replace_extension(".journal")) {
 	load();
 }
 
@@ -16,41 +23,138 @@ Database::~Database() {
 }
 
 void Database::load() {
-	if (!exists(m_filename)) return;
+	auto const start = std::chrono::steady_clock::now();
+	auto const apply = [this](DatabaseRecord&& record) {
+		try {
+			this->apply(std::move(record));
+		} catch (std::exception const& e) {
+			std::clog << "database/warning: Skipping a record: " << e.what() << std::endl;
+		}
+	};
+	std::error_code ec;
+	bool const haveSnapshot = fs::exists(m_snapshot.filename(), ec);
+	bool const haveXML = fs::exists(m_filename, ec);
+	// A database.xml newer than the snapshot was written by an older version, which did not know the snapshot
+	bool const xmlIsNewer = haveSnapshot && haveXML && fs::last_write_time(m_filename, ec) > fs::last_write_time(m_snapshot.filename(), ec);
+	std::optional<std::uint64_t> generation;  // Of the snapshot that the journal must continue
+	bool damaged = false;
+	if (haveSnapshot && !xmlIsNewer) {
+		try {
+			generation = m_snapshot.load(apply);
+		} catch (std::exception const& e) {
+			fs::path const snapshot = m_snapshot.filename().string() + ".damaged";
+			fs::path const journal = m_journal.filename().string() + ".damaged";
+			std::clog << "database/error: Error loading " + m_snapshot.filename().string() + ": " + e.what() + " (kept as " + snapshot.string() + ")" << std::endl;
+			fs::rename(m_snapshot.filename(), snapshot, ec);
+			// The journal continues the damaged snapshot, so it is gone with the next save() unless the xml export matches it
+			fs::copy_file(m_journal.filename(), journal, fs::copy_options::overwrite_existing, ec);
+			damaged = true;
+		}
+	}
+	if (!generation) {
+		std::optional<std::uint64_t> exported;
+		if (haveXML) exported = loadXML();
+		if (!haveSnapshot) generation = 0;  // Never compacted, the journal continues the xml (or an empty database)
+		else if (damaged) generation = exported;  // Exported right after the snapshot that the journal continues
+	}
+	std::size_t journaled = 0;
+	try {
+		// Without a generation the journal belongs to a snapshot that was not loaded and is discarded
+		journaled = m_journal.replay(generation.value_or(DatabaseSnapshot::newGeneration()), apply);
+	} catch (std::exception const& e) {
+		std::clog << "database/error: Error replaying " + m_journal.filename().string() + ": " + e.what() << std::endl;
+	}
+	m_players.update();
+	std::chrono::duration<double> const took = std::chrono::steady_clock::now() - start;
+	std::clog << "database/info: Loaded " << m_players.count() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores ("
+	  << journaled << " journaled changes) in " << took.count() << " s." << std::endl;
+	// Start a snapshot that the new journal can continue
+	if (!generation || damaged) save();
+}
+
+std::optional<std::uint64_t> Database::loadXML() {
 	try {
 		xmlpp::DomParser domParser(m_filename.string());
-		xmlpp::Node* nodeRoot = domParser.get_document()->get_root_node();
+		xmlpp::Element* nodeRoot = domParser.get_document()->get_root_node();
 		m_players.load(nodeRoot->find("/performous/players/player"));
 		m_songs.load(nodeRoot->find("/performous/songs/song"));
 		m_hiscores.load(nodeRoot->find("/performous/hiscores/hiscore"));
-		std::clog << "database/info: Loaded " << m_players.count() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores from " << m_filename.string() << std::endl;
+		std::clog << "database/info: Loaded " << m_filename.string() << std::endl;
+		if (xmlpp::Attribute* a = nodeRoot->get_attribute("generation")) return std::stoull(a->get_value());
 	} catch (std::exception const& e) {
 		std::clog << "database/error: Error loading " + m_filename.string() + ": " + e.what() << std::endl;
 	}
+	return std::nullopt;
+}
+
+void Database::apply(DatabaseRecord&& record) {
+	if (auto const* p = std::get_if<PlayerRecord>(&record)) m_players.addPlayer(p->name, p->picture, p->id);
+	else if (auto const* s = std::get_if<SongRecord>(&record)) m_songs.addSongItem(s->artist, s->title, s->broken, s->id);
+	else m_hiscores.addHiscore(std::move(std::get<HiscoreItem>(record)));
 }
 
 void Database::save() {
 	try {
-		create_directories(m_filename.parent_path());
-		fs::path tmp = m_filename.string() + ".tmp";
-		{
-			xmlpp::Document doc;
-			auto nodeRoot = doc.create_root_node("performous");
-			m_players.save(xmlpp::add_child_element(nodeRoot, "players"));
-			m_songs.save(xmlpp::add_child_element(nodeRoot, "songs"));
-			m_hiscores.save(xmlpp::add_child_element(nodeRoot, "hiscores"));
-			doc.write_to_file_formatted(tmp.string(), "UTF-8");
+		auto const start = std::chrono::steady_clock::now();
+		std::uint64_t const generation = DatabaseSnapshot::newGeneration();
+		// Changes wait meanwhile, so that each is either in the snapshot or in the new journal
+		m_journal.rotate(generation, [&] {
+			m_snapshot.begin(generation);
+			m_players.save(m_snapshot);
+			m_songs.save(m_snapshot);
+			m_hiscores.save(m_snapshot);
+			m_snapshot.commit();
+		});
+		std::chrono::duration<double> const took = std::chrono::steady_clock::now() - start;
+		std::clog << "database/info: Saved " << m_players.count() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores to "
+		  << m_snapshot.filename().string() << " in " << took.count() << " s." << std::endl;
+	} catch (std::exception const& e) {
+		std::clog << "database/error: Could not save " + m_snapshot.filename().string() + ": " + e.what() << std::endl;
+		try {
+			m_journal.flush();
+		} catch (std::exception const& e) {
+			std::clog << "database/error: Could not write " + m_journal.filename().string() + ": " + e.what() << std::endl;
 		}
-		rename(tmp, m_filename);
-		std::clog << "database/info: Saved " << m_players.count() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores to " << m_filename.string() << std::endl;
+		return;
+	}
+	if (!config["game/database_xml"].b()) return;
+	try {
+		exportXML(m_filename, generation);
+		// Dated like the snapshot, so that load() does not take it for the database of an older version
+		fs::last_write_time(m_filename, fs::last_write_time(m_snapshot.filename()));
+	} catch (std::exception const& e) {
+		std::clog << "database/error: Could not export " + m_filename.string() + ": " + e.what() << std::endl;
+	}
+}
+
+void Database::flush() {
+	try {
+		m_journal.flush();
 	} catch (std::exception const& e) {
-		std::clog << "database/error: Could not save " + m_filename.string() + ": " + e.what() << std::endl;
+		std::clog << "database/error: Could not write " + m_journal.filename().string() + ": " + e.what() << std::endl;
 		return;
 	}
+	if (m_journal.size() >= COMPACT_RECORDS) save();
+}
+
+void Database::exportXML(fs::path const& filename, std::optional<std::uint64_t> generation) {
+	create_directories(filename.parent_path());
+	fs::path tmp = filename.string() + ".tmp";
+	{
+		xmlpp::Document doc;
+		auto nodeRoot = doc.create_root_node("performous");
+		if (generation) nodeRoot->set_attribute("generation", std::to_string(*generation));
+		m_players.save(xmlpp::add_child_element(nodeRoot, "players"));
+		m_songs.save(xmlpp::add_child_element(nodeRoot, "songs"));
+		m_hiscores.save(xmlpp::add_child_element(nodeRoot, "hiscores"));
+		doc.write_to_file_formatted(tmp.string(), "UTF-8");
+	}
+	rename(tmp, filename);
+	std::clog << "database/info: Exported " << filename.string() << std::endl;
 }
 
 void Database::addPlayer(std::string const& name, std::string const& picture, std::optional<PlayerId> id) {
-	m_players.addPlayer(name, picture, id);
+	m_journal.append([&]() -> std::optional<DatabaseRecord> { return PlayerRecord{ m_players.addPlayer(name, picture, id), name, picture }; });
 }
 
 Players const& Database::getPlayers() const {
@@ -58,7 +162,13 @@ Players const& Database::getPlayers() const {
 }
 
 void Database::addSong(std::shared_ptr<Song> s) {
-	m_songs.addSong(s);
+	m_journal.append([&]() -> std::optional<DatabaseRecord> {
+		bool const known = m_songs.lookup(s).has_value();
+		m_songs.addSong(s);
+		auto const id = m_songs.lookup(s);
+		if (known || !id) return std::nullopt;
+		return SongRecord{ *id, s->artist, s->title, s->isBroken() };
+	});
 }
 
 void Database::addHiscore(std::shared_ptr<Song> s) {
@@ -76,7 +186,14 @@ void Database::addHiscore(std::shared_ptr<Song> s) {
 		return;
 	}
 	unsigned short level = config["game/difficulty"].ui();
-	m_hiscores.addHiscore(score, playerid, songid.value(), level, track);
+	HiscoreItem item(score, playerid, songid.value(), level, track);
+	bool added = false;
+	m_journal.append([&]() -> std::optional<DatabaseRecord> {
+		if (!(added = m_hiscores.addHiscore(HiscoreItem(item)))) return std::nullopt;
+		return item;
+	});
+	if (!added) return;
+	flush();  // The score survives a crash from now on
 	std::clog << "database/info: Added new hiscore " << score << " points on track " << track << " of songid " << std::to_string(songid.value()) << " level "<< level<< std::endl;
 }
 
@@ -2,6 +2,7 @@
 
 #include "color.hh"
 #include "controllers.hh"
+#include "databasestore.hh"
 #include "fs.hh"
 #include "hiscore.hh"
 #include "players.hh"
@@ -11,12 +12,19 @@
 #include <string>
 #include <ostream>
 
+struct BenchOptions;
+
 /**Access to a database for performous which holds
   Player-, Hiscore-, Song-, Track- and (in future)
   Partydata.
 
   This is a facade for Players, Hiscore and SongItems.
 
+  Changes are appended to a journal (database.journal) and written to
+  disk by flush(), after each song. save() compacts the journal into a
+  binary snapshot (database.bin); database.xml is only read when there
+  is no snapshot yet, and written only if game/database_xml is set.
+
   Will be initialized at the very beginning of
   the program.
 
@@ -37,19 +45,24 @@ public:
 	  */
 	~Database();
 
-	/**Loads the whole database from xml.
-	  @exception bad_cast may be thrown if xml element is not of correct type
-	  @exception xmlpp exceptions may be thrown on any parse errors
-	  @exception PlayersException if some conditions of players fail (e.g. no id)
-	  @exception HiscoreException if some hiscore conditions fail (e.g. score too high)
-	  @exception SongItemsExceptions if some songs conditions fail (e.g. no id)
+	/**Loads the whole database from the snapshot (or xml) and replays the journal.
+	  Errors are logged, leaving whatever could be loaded.
 	  @post filled database
 	  */
 	void load();
-	/**Saves the whole database to xml.
-	  Will write out everything to the file given in the constructor, @see file()
+	/**Compacts the journal into a new snapshot (and then exports xml if game/database_xml is set).
+	  If the snapshot cannot be written, the journal is flushed instead.
 	*/
 	void save();
+	/**Writes the changes made since the last flush to the journal and waits until they are on disk.
+	  Compacts the journal with save() once it has grown long.
+	*/
+	void flush();
+	/**Writes the whole database as xml (the format of older versions).
+	  The generation of the snapshot saved with it lets load() continue it with the journal if the snapshot is damaged.
+	  @exception xmlpp and filesystem exceptions on errors
+	*/
+	void exportXML(fs::path const& filename, std::optional<std::uint64_t> generation = std::nullopt);
 
 	friend class ScreenHiscore;
 	friend class ScreenPlayers;
@@ -58,6 +71,7 @@ public:
 	friend class LayoutSinger;
 	friend class NoteGraph;
 	friend class Engine;
+	friend void runBench(BenchOptions const&);
 private: // will be bypassed by above friend declaration
 	typedef std::list<Player> cur_players_t;
 	typedef std::list<ScoreItem> cur_scores_t;
@@ -94,7 +108,14 @@ public: // methods for database queries
 	bool noPlayers() const;
 
 private:
+	/// Returns the generation that the xml was exported with, if any
+	std::optional<std::uint64_t> loadXML();
+	/// Add a record read from the snapshot or journal
+	void apply(DatabaseRecord&& record);
+
 	fs::path m_filename;
+	DatabaseSnapshot m_snapshot;
+	DatabaseJournal m_journal;
 
 	Players m_players;
 	Hiscore m_hiscores;
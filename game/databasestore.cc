@@ -0,0 +1,378 @@
+#include "databasestore.hh"
+
+#include <boost/crc.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/predef/os.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#if (BOOST_OS_WINDOWS)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	/// Header of journals and snapshots
+	struct Header {
+		char magic[8] = {};
+		std::uint32_t version = DatabaseSnapshot::FORMAT_VERSION;
+		std::uint32_t reserved = 0;
+		std::uint64_t generation = 0;  ///< The snapshot (a journal continues it)
+		std::uint64_t records = 0;  ///< Snapshots only, journals are read up to the first damaged record
+	};
+	constexpr char JOURNAL_MAGIC[8] = { 'P', 'E', 'R', 'F', 'J', 'R', 'N', 'L' };
+	constexpr char SNAPSHOT_MAGIC[8] = { 'P', 'E', 'R', 'F', 'S', 'N', 'A', 'P' };
+	/// Each record starts with the length and the CRC-32 of the rest of it
+	constexpr std::size_t FRAME_BYTES = 2 * sizeof(std::uint32_t);
+
+	enum class Type : std::uint8_t { PLAYER = 1, SONG = 2, HISCORE = 3 };
+
+	Header makeHeader(char const (&magic)[8], std::uint64_t generation) {
+		Header header;
+		std::memcpy(header.magic, magic, sizeof(header.magic));
+		header.generation = generation;
+		return header;
+	}
+
+	std::uint32_t crc32(char const* data, std::size_t size) {
+		boost::crc_32_type crc;
+		crc.process_bytes(data, size);
+		return crc.checksum();
+	}
+
+	template <typename T> void put(std::string& out, T value) {
+		static_assert(std::is_trivially_copyable<T>::value, "Fields are written as raw bytes");
+		out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+	}
+
+	void putString(std::string& out, std::string const& str) {
+		put(out, static_cast<std::uint32_t>(str.size()));
+		out += str;
+	}
+
+	/// Append a framed record to out
+	void encode(std::string& out, DatabaseRecord const& record) {
+		std::size_t const frame = out.size();
+		out.append(FRAME_BYTES, '\0');
+		std::size_t const payload = out.size();
+		if (auto const* p = std::get_if<PlayerRecord>(&record)) {
+			put(out, Type::PLAYER);
+			put<std::uint32_t>(out, p->id);
+			putString(out, p->name);
+			putString(out, p->picture);
+		} else if (auto const* s = std::get_if<SongRecord>(&record)) {
+			put(out, Type::SONG);
+			put<std::uint32_t>(out, s->id);
+			putString(out, s->artist);
+			putString(out, s->title);
+			put<std::uint8_t>(out, s->broken);
+		} else {
+			auto const& h = std::get<HiscoreItem>(record);
+			put(out, Type::HISCORE);
+			put<std::uint32_t>(out, h.score);
+			put<std::uint32_t>(out, h.playerid);
+			put<std::uint32_t>(out, h.songid);
+			put<std::uint16_t>(out, h.level);
+			put<std::int64_t>(out, h.unixtime.count());
+			putString(out, h.track);
+		}
+		std::uint32_t const size = static_cast<std::uint32_t>(out.size() - payload);
+		std::uint32_t const crc = crc32(out.data() + payload, size);
+		std::memcpy(&out[frame], &size, sizeof(size));
+		std::memcpy(&out[frame + sizeof(size)], &crc, sizeof(crc));
+	}
+
+	/// Reads the fields of a record
+	class Reader {
+	  public:
+		Reader(char const* begin, char const* end): m_pos(begin), m_end(end) {}
+		template <typename T> T get() {
+			need(sizeof(T));
+			T value;
+			std::memcpy(&value, m_pos, sizeof(T));
+			m_pos += sizeof(T);
+			return value;
+		}
+		std::string string() {
+			auto const size = get<std::uint32_t>();
+			need(size);
+			std::string str(m_pos, size);
+			m_pos += size;
+			return str;
+		}
+
+	  private:
+		void need(std::size_t bytes) const {
+			if (static_cast<std::size_t>(m_end - m_pos) < bytes) throw std::runtime_error("Truncated database record");
+		}
+		char const* m_pos;
+		char const* m_end;
+	};
+
+	DatabaseRecord decode(char const* begin, char const* end) {
+		Reader r(begin, end);
+		switch (r.get<Type>()) {
+		  case Type::PLAYER: {
+			PlayerRecord p;
+			p.id = r.get<std::uint32_t>();
+			p.name = r.string();
+			p.picture = r.string();
+			return p;
+		  }
+		  case Type::SONG: {
+			SongRecord s;
+			s.id = r.get<std::uint32_t>();
+			s.artist = r.string();
+			s.title = r.string();
+			s.broken = r.get<std::uint8_t>() != 0;
+			return s;
+		  }
+		  case Type::HISCORE: {
+			auto const score = r.get<std::uint32_t>();
+			auto const playerid = r.get<std::uint32_t>();
+			auto const songid = r.get<std::uint32_t>();
+			auto const level = r.get<std::uint16_t>();
+			auto const unixtime = std::chrono::seconds(r.get<std::int64_t>());
+			return HiscoreItem(score, playerid, songid, level, r.string(), unixtime);
+		  }
+		}
+		throw std::runtime_error("Unknown database record type");
+	}
+
+	/// Bytes of intact records at the start of [begin, end), counting them
+	std::size_t scan(char const* begin, char const* end, std::size_t& count) {
+		char const* pos = begin;
+		while (static_cast<std::size_t>(end - pos) >= FRAME_BYTES) {
+			std::uint32_t size, crc;
+			std::memcpy(&size, pos, sizeof(size));
+			std::memcpy(&crc, pos + sizeof(size), sizeof(crc));
+			if (size > static_cast<std::size_t>(end - pos) - FRAME_BYTES || crc32(pos + FRAME_BYTES, size) != crc) break;
+			pos += FRAME_BYTES + size;
+			++count;
+		}
+		return static_cast<std::size_t>(pos - begin);
+	}
+
+	/// Give the records in [begin, end), which scan has found intact, to apply
+	void applyAll(char const* begin, char const* end, DatabaseApply const& apply) {
+		while (begin < end) {
+			std::uint32_t size;
+			std::memcpy(&size, begin, sizeof(size));
+			begin += FRAME_BYTES;
+			apply(decode(begin, begin + size));
+			begin += size;
+		}
+	}
+
+	struct FileCloser { void operator()(std::FILE* file) const { std::fclose(file); } };
+	using File = std::unique_ptr<std::FILE, FileCloser>;
+
+	/// Open a file for writing, either truncated or (if create is false) keeping its contents
+	File openFile(fs::path const& path, bool create) {
+#if (BOOST_OS_WINDOWS)
+		std::FILE* file = _wfopen(path.c_str(), create ? L"wb" : L"r+b");
+#else
+		std::FILE* file = std::fopen(path.c_str(), create ? "wb" : "r+b");
+#endif
+		if (!file) throw std::runtime_error("Cannot open " + path.string());
+		return File(file);
+	}
+
+	void write(std::FILE* file, void const* data, std::size_t size, fs::path const& path) {
+		if (std::fwrite(data, 1, size, file) != size) throw std::runtime_error("Cannot write " + path.string());
+	}
+
+	/// Wait until what was written to the file is on disk
+	void sync(std::FILE* file, fs::path const& path) {
+		bool ok = std::fflush(file) == 0;
+#if (BOOST_OS_WINDOWS)
+		ok = ok && _commit(_fileno(file)) == 0;
+#else
+		ok = ok && fsync(fileno(file)) == 0;
+#endif
+		if (!ok) throw std::runtime_error("Cannot write " + path.string() + " to disk");
+	}
+
+	/// Replace a file by a new one, so that the replacement survives a crash
+	void replace(fs::path const& tmp, fs::path const& path) {
+		fs::rename(tmp, path);
+#if !(BOOST_OS_WINDOWS)
+		// The rename itself is only durable once the folder is synced
+		int fd = open(path.parent_path().c_str(), O_RDONLY);
+		if (fd >= 0) {
+			fsync(fd);
+			close(fd);
+		}
+#endif
+	}
+}
+
+DatabaseJournal::DatabaseJournal(fs::path const& filename): m_filename(filename) {}
+
+std::size_t DatabaseJournal::replay(std::uint64_t generation, DatabaseApply const& apply) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_generation = generation;
+	m_end = 0;
+	m_pending.clear();
+	m_records = 0;
+	std::string data;
+	{
+		std::ifstream file(m_filename, std::ios::binary);
+		if (!file) return 0;
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	Header header;
+	if (data.size() < sizeof(Header)) return 0;
+	std::memcpy(&header, data.data(), sizeof(Header));
+	if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 || header.version != DatabaseSnapshot::FORMAT_VERSION) {
+		std::clog << "database/warning: Ignoring journal " << m_filename << " (not a journal or a different version)." << std::endl;
+		return 0;
+	}
+	if (header.generation != generation) {
+		std::clog << "database/warning: Ignoring journal " << m_filename << " (it continues a different snapshot)." << std::endl;
+		return 0;
+	}
+	char const* begin = data.data() + sizeof(Header);
+	std::size_t const available = data.size() - sizeof(Header);
+	std::size_t count = 0;
+	std::size_t const intact = scan(begin, begin + available, count);
+	if (intact != available) {
+		std::clog << "database/warning: Cutting off " << available - intact << " damaged bytes at the end of " << m_filename << "." << std::endl;
+		fs::resize_file(m_filename, sizeof(Header) + intact);
+	}
+	// From here on new records go after the intact ones, even if applying fails
+	m_end = sizeof(Header) + intact;
+	m_records = count;
+	applyAll(begin, begin + intact, apply);
+	return count;
+}
+
+void DatabaseJournal::append(DatabaseRecord const& record) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	encode(m_pending, record);
+	++m_records;
+}
+
+void DatabaseJournal::flush() {
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_pending.empty()) return;
+	if (m_end != 0 && !fs::exists(m_filename)) m_end = 0;
+	fs::create_directories(m_filename.parent_path());
+	File file = openFile(m_filename, m_end == 0);
+	std::uint64_t end = m_end;
+	if (end == 0) {
+		Header const header = makeHeader(JOURNAL_MAGIC, m_generation);
+		write(file.get(), &header, sizeof(header), m_filename);
+		end = sizeof(header);
+	} else if (std::fseek(file.get(), static_cast<long>(end), SEEK_SET) != 0) {
+		throw std::runtime_error("Cannot seek in " + m_filename.string());
+	}
+	write(file.get(), m_pending.data(), m_pending.size(), m_filename);
+	sync(file.get(), m_filename);
+	m_end = end + m_pending.size();
+	m_pending.clear();
+}
+
+void DatabaseJournal::append(std::function<std::optional<DatabaseRecord>()> const& change) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (auto const record = change()) {
+		encode(m_pending, *record);
+		++m_records;
+	}
+}
+
+void DatabaseJournal::reset(std::uint64_t generation) {
+	rotate(generation, [] {});
+}
+
+void DatabaseJournal::rotate(std::uint64_t generation, std::function<void()> const& writeSnapshot) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	writeSnapshot();
+	fs::path const tmp = m_filename.string() + ".tmp";
+	fs::create_directories(m_filename.parent_path());
+	{
+		File file = openFile(tmp, true);
+		Header const header = makeHeader(JOURNAL_MAGIC, generation);
+		write(file.get(), &header, sizeof(header), tmp);
+		sync(file.get(), tmp);
+	}
+	replace(tmp, m_filename);
+	m_generation = generation;
+	m_end = sizeof(Header);
+	m_pending.clear();
+	m_records = 0;
+}
+
+std::size_t DatabaseJournal::size() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_records;
+}
+
+DatabaseSnapshot::DatabaseSnapshot(fs::path const& filename): m_filename(filename) {}
+
+DatabaseSnapshot::~DatabaseSnapshot() {
+	if (!m_file) return;
+	m_file.reset();  // An unfinished snapshot is thrown away
+	std::error_code ec;
+	fs::remove(m_filename.string() + ".tmp", ec);
+}
+
+std::uint64_t DatabaseSnapshot::load(DatabaseApply const& apply) const {
+	boost::iostreams::mapped_file_source file(m_filename.string());
+	if (file.size() < sizeof(Header)) throw std::runtime_error("Truncated header");
+	Header header;
+	std::memcpy(&header, file.data(), sizeof(Header));
+	if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) throw std::runtime_error("Not a database snapshot");
+	if (header.version != FORMAT_VERSION) throw std::runtime_error("Different version");
+	char const* begin = file.data() + sizeof(Header);
+	std::size_t const available = file.size() - sizeof(Header);
+	std::size_t count = 0;
+	if (scan(begin, begin + available, count) != available || count != header.records) throw std::runtime_error("Damaged records");
+	applyAll(begin, begin + available, apply);
+	return header.generation;
+}
+
+void DatabaseSnapshot::begin(std::uint64_t generation) {
+	fs::path const tmp = m_filename.string() + ".tmp";
+	fs::create_directories(m_filename.parent_path());
+	m_file.reset(openFile(tmp, true).release());
+	m_generation = generation;
+	m_records = 0;
+	m_buffer.clear();
+	put(m_buffer, makeHeader(SNAPSHOT_MAGIC, generation));  // Placeholder, rewritten once the count is known
+}
+
+void DatabaseSnapshot::add(DatabaseRecord const& record) {
+	if (!m_file) throw std::logic_error("DatabaseSnapshot::add called without begin");
+	encode(m_buffer, record);
+	++m_records;
+	if (m_buffer.size() < 1 << 20) return;
+	write(m_file.get(), m_buffer.data(), m_buffer.size(), m_filename);
+	m_buffer.clear();
+}
+
+void DatabaseSnapshot::commit() {
+	if (!m_file) throw std::logic_error("DatabaseSnapshot::commit called without begin");
+	fs::path const tmp = m_filename.string() + ".tmp";
+	write(m_file.get(), m_buffer.data(), m_buffer.size(), tmp);
+	m_buffer.clear();
+	Header header = makeHeader(SNAPSHOT_MAGIC, m_generation);
+	header.records = m_records;
+	if (std::fseek(m_file.get(), 0, SEEK_SET) != 0) throw std::runtime_error("Cannot seek in " + tmp.string());
+	write(m_file.get(), &header, sizeof(header), tmp);
+	sync(m_file.get(), tmp);
+	if (std::fclose(m_file.release()) != 0) throw std::runtime_error("Cannot write " + tmp.string());
+	replace(tmp, m_filename);
+}
+
+std::uint64_t DatabaseSnapshot::newGeneration() {
+	return static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+}
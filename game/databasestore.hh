@@ -0,0 +1,106 @@
+#pragma once
+
+#include "fs.hh"
+#include "hiscoreitem.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <variant>
+
+/// A player as stored in the database files
+struct PlayerRecord {
+	unsigned id = 0;
+	std::string name;
+	std::string picture;
+};
+
+/// A song id as stored in the database files
+struct SongRecord {
+	unsigned id = 0;
+	std::string artist;
+	std::string title;
+	bool broken = false;
+};
+
+/// One entry of a journal or snapshot
+using DatabaseRecord = std::variant<PlayerRecord, SongRecord, HiscoreItem>;
+using DatabaseApply = std::function<void(DatabaseRecord&&)>;
+
+/**
+* Append-only log of the changes made to the database since its last snapshot.
+*
+* Each record is written with its length and CRC-32, so that a record torn by a crash is noticed and cut off
+* on the next start. append() may be called from any thread; flush() writes what was appended and waits until
+* it is on disk, so that scores survive a crash right after a song.
+**/
+class DatabaseJournal {
+  public:
+	explicit DatabaseJournal(fs::path const& filename);
+	/**
+	* Read the journal and give its records to apply, if it continues the snapshot of the given generation
+	* (otherwise it is discarded). A torn or damaged end is cut off. Returns the number of records applied.
+	**/
+	std::size_t replay(std::uint64_t generation, DatabaseApply const& apply);
+	/// Queue a record for the next flush()
+	void append(DatabaseRecord const& record);
+	/**
+	* Make a change to the data and queue its record (if it returns one) as one step, so that rotate() sees
+	* both or neither of them
+	**/
+	void append(std::function<std::optional<DatabaseRecord>()> const& change);
+	/// Write queued records and wait until they are on disk
+	void flush();
+	/// Start over empty, after a snapshot of the given generation has been written
+	void reset(std::uint64_t generation);
+	/// Write a snapshot of the given generation with writeSnapshot and start over empty, with no append() in between
+	void rotate(std::uint64_t generation, std::function<void()> const& writeSnapshot);
+	/// Records in the journal, including queued ones
+	std::size_t size() const;
+	fs::path const& filename() const { return m_filename; }
+
+  private:
+	fs::path m_filename;
+	mutable std::mutex m_mutex;
+	std::uint64_t m_generation = 0;
+	std::uint64_t m_end = 0;  ///< Bytes of intact data in the file (0 = the file needs a new header)
+	std::string m_pending;  ///< Encoded records not yet written
+	std::size_t m_records = 0;
+};
+
+/**
+* Binary copy of the whole database (players, song ids and hiscores), loaded by mapping it to memory.
+*
+* A new snapshot is written to a temporary file and renamed over the old one only once it is on disk, so there
+* is always a complete snapshot. The generation identifies the snapshot that a journal continues.
+**/
+class DatabaseSnapshot {
+  public:
+	static constexpr std::uint32_t FORMAT_VERSION = 1;
+	explicit DatabaseSnapshot(fs::path const& filename);
+	~DatabaseSnapshot();
+	/// Give every record to apply and return the generation. Throws if the file is damaged, before applying anything.
+	std::uint64_t load(DatabaseApply const& apply) const;
+	/// Start writing a new snapshot
+	void begin(std::uint64_t generation);
+	void add(DatabaseRecord const& record);
+	/// Finish the new snapshot, wait until it is on disk and replace the old one with it
+	void commit();
+	/// Records added since begin()
+	std::uint64_t size() const { return m_records; }
+	fs::path const& filename() const { return m_filename; }
+	/// A generation not used before (the current time)
+	static std::uint64_t newGeneration();
+
+  private:
+	struct Closer { void operator()(std::FILE* file) const { std::fclose(file); } };
+	fs::path m_filename;
+	std::unique_ptr<std::FILE, Closer> m_file;  ///< The temporary file being written
+	std::string m_buffer;
+	std::uint64_t m_generation = 0;
+	std::uint64_t m_records = 0;
+};
@@ -5,13 +5,15 @@
 #include "song.hh"
 #include "database.hh"
 #include "configuration.hh"
+#include "trace.hh"
+#include <algorithm>
 #include <iostream>
 #include <list>
 
 const double Engine::TIMESTEP = 0.01;
 
-Engine::Engine(Audio& audio, VocalTrackPtrs vocals, Database& database):
-  m_audio(audio), m_time(), m_quit(), m_database(database)
+Engine::Engine(Audio& audio, VocalTrackPtrs vocals, Database& database, Mode mode):
+  m_audio(audio), m_time(), m_quit(), m_database(database), m_analyze([this](std::size_t i) { m_players[i]->prepare(); })
 {
 	auto& analyzers = m_audio.analyzers();
 	if (analyzers.size() != vocals.size()) throw std::logic_error("Engine requires the same number of vocal tracks as there are analyzers.");
@@ -23,19 +25,59 @@ Engine::Engine(Audio& audio, VocalTrackPtrs vocals, Database& database):
 		// Calculate the space required for pitch frames
 		size_t frames = static_cast<size_t>(vocals[i]->endTime / Engine::TIMESTEP);
 		m_database.cur.push_back(Player(*vocals[i], a, frames));
+		m_players.push_back(&m_database.cur.back());
 		++i;
 	}
-	m_thread.reset(new std::thread(std::ref(*this)));
+	// Analysis threads, including the engine thread itself (0 = one per mic, limited by CPU cores)
+	unsigned threads = config["audio/analyzer_threads"].ui();
+	if (threads == 0) threads = std::min(std::max(1u, std::thread::hardware_concurrency()), static_cast<unsigned>(m_players.size()));
+	m_pool = std::make_unique<WorkerPool>(std::max(1u, threads) - 1);
+	std::clog << "engine/info: Analyzing " << m_players.size() << " mics with " << m_pool->threads() << " threads." << std::endl;
+	if (mode == Mode::THREAD) m_thread.reset(new std::thread(std::ref(*this)));
+}
+
+void Engine::kill() {
+	m_quit = true;
+	if (!m_thread || !m_thread->joinable()) return;
+	m_thread->join();
+	if (m_ticks > 0) {
+		std::clog << "engine/info: Scoring lag behind audio: max " << m_maxLag * 1000.0 << " ms, "
+		  << m_lateTicks << " of " << m_ticks << " time steps over " << TIMESTEP * 1000.0 << " ms." << std::endl;
+	}
+}
+
+void Engine::analyze() {
+	TRACE_ZONE("engine/analyze");
+	m_pool->run(m_players.size(), m_analyze);  // Analyzers are independent; all are done before scoring this step
+}
+
+void Engine::score() {
+	TRACE_ZONE("engine/score");
+	// Scoring stays serial because players may share notes of the same vocal track
+	for (Player& player: m_database.cur) player.update();
+	m_time += TIMESTEP;
+}
+
+void Engine::step() {
+	analyze();
+	score();
+	++m_ticks;
 }
 
 void Engine::operator()() {
+	trace::setThreadName("engine");
 	while (!m_quit) {
-		for (Player& player: m_database.cur) player.prepare();
+		analyze();
 		double t = m_audio.getPosition() - config["audio/round-trip"].f();
 		double timeLeft = m_time - t;
 		if (timeLeft != timeLeft || timeLeft > 1.0) timeLeft = 1.0;  // FIXME: Workaround for NaN values and other weirdness (should fix the weirdness instead)
 		if (timeLeft > 0.0) { std::this_thread::sleep_for(std::min(TIMESTEP, timeLeft) * 1s); continue; }
-		for (Player& player: m_database.cur) player.update();
-		m_time += TIMESTEP;
+		score();
+		// Record how far behind the audio clock this step was scored
+		double lag = -timeLeft;
+		m_lag = lag;
+		if (lag > m_maxLag) m_maxLag = lag;
+		++m_ticks;
+		if (lag > TIMESTEP) ++m_lateTicks;
 	}
 }
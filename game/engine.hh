@@ -1,5 +1,7 @@
 #pragma once
 
+#include "workerpool.hh"
+
 #include <atomic>
 #include <memory>
 #include <thread>
@@ -8,6 +10,7 @@
 class Audio;
 class Database;
 class VocalTrack;
+struct Player;
 
 /// performous engine
 class Engine {
@@ -15,19 +18,40 @@ class Engine {
 	double m_time;
 	std::atomic<bool> m_quit{ false };
 	Database& m_database;
+	std::vector<Player*> m_players;  ///< The entries of m_database.cur, for indexed access by the analysis workers
+	std::unique_ptr<WorkerPool> m_pool;  ///< Runs the analyzers of all players in parallel
+	WorkerPool::Task m_analyze;
+	std::atomic<double> m_lag{ 0.0 };
+	std::atomic<double> m_maxLag{ 0.0 };
+	std::atomic<unsigned> m_ticks{ 0 };
+	std::atomic<unsigned> m_lateTicks{ 0 };
 	std::unique_ptr<std::thread> m_thread;
+	/// Run the analyzers of all players on the input so far
+	void analyze();
+	/// Score the players for the current time step and advance to the next one
+	void score();
 
   public:
 	typedef std::vector<VocalTrack*> VocalTrackPtrs;
 	static const double TIMESTEP;  ///< The duration of one engine time step in seconds
-	/// Construct an engine thread with vocal tracks and players specified by parameters
-	Engine(Audio& audio, VocalTrackPtrs vocals, Database& database);
+	enum class Mode {
+		THREAD,  ///< Follow the audio clock in an engine thread
+		MANUAL  ///< Advance only when step() is called (headless benchmark)
+	};
+	/// Construct an engine with vocal tracks and players specified by parameters
+	Engine(Audio& audio, VocalTrackPtrs vocals, Database& database, Mode mode = Mode::THREAD);
 	~Engine() { kill(); }
 	/// Terminates processing
-	void kill() { 
-		m_quit = true;
-		if (m_thread->joinable()) m_thread->join();
-		}
+	void kill();
+	/// Analyze and score one TIMESTEP (Mode::MANUAL), after the mic input of that time has been given to the analyzers
+	void step();
+	/// How far behind the audio clock (minus round-trip latency) scoring was on the most recent time step, in seconds
+	double lag() const { return m_lag; }
+	/// Worst lag seen since the engine started, in seconds
+	double maxLag() const { return m_maxLag; }
+	/// Number of time steps scored so far, and how many of them lagged more than one TIMESTEP
+	unsigned ticks() const { return m_ticks; }
+	unsigned lateTicks() const { return m_lateTicks; }
 	/** Used internally for std::thread. Do not call this yourself. (std::thread requires this to be public). **/
 	void operator()();
 };
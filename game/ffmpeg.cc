@@ -2,11 +2,17 @@
 
 #include "chrono.hh"
 #include "config.hh"
+#include "framepool.hh"
+#include "libda/mix.hpp"
 #include "screen_songs.hh"
+#include "trace.hh"
 #include "util.hh"
 
-#include "aubio/aubio.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
@@ -48,164 +54,28 @@ namespace {
 	}
 }
 
-AudioBuffer::uFvec AudioBuffer::makePreviewBuffer() {
-	uFvec fvec(new_fvec(static_cast<uint_t>(m_data.size() / 2)));
-	float previewVol = float(config["audio/preview_volume"].ui()) / 100.0f;
-	{
-		std::lock_guard<std::mutex> l(m_mutex);
-		for (size_t rpos = 0, bpos = 0; rpos < m_data.size(); rpos += 2, bpos ++) {
-			fvec->data[bpos] = (((da::conv_from_s16(m_data.at(rpos)) + da::conv_from_s16(m_data.at(rpos + 1))) / 2) / previewVol);
+namespace {
+	/// Feeds an AudioBuffer from a file
+	class FFmpegDecoder: public AudioBuffer::Decoder {
+	  public:
+		FFmpegDecoder(fs::path const& file, unsigned rate, AudioBuffer& buffer): m_ffmpeg(file, static_cast<int>(rate), std::ref(buffer)) {}
+		double duration() const override { return m_ffmpeg.duration(); }
+		void seek(std::int64_t sample) override { m_ffmpeg.seek(static_cast<double>(sample) / double(AV_TIME_BASE)); }
+		void decode() override {
+			try {
+				m_ffmpeg.handleOneFrame();
+			} catch (FFmpeg::Eof const&) {
+				throw Eof();
+			}
 		}
-	}
-	return fvec;
-}
-
-bool AudioBuffer::wantMore() {
-	return m_write_pos < m_read_pos + static_cast<std::int64_t>(m_data.size() / 2);
-}
-
-/// Should the input stop waiting?
-bool AudioBuffer::condition() {
-	return m_quit || m_seek_asked || wantMore();
-}
-
-void AudioBuffer::operator()(const std::int16_t *data, std::int64_t count, std::int64_t sample_position) {
-	if (sample_position < 0) {
-		std::clog << "ffmpeg/warning: Negative audio sample_position " << sample_position << " seconds, frame ignored." << std::endl;
-		return;
-	}
-
-	std::unique_lock<std::mutex> l(m_mutex);
-	if (sample_position < m_read_pos) {
-		// frame to be dropped as being before read... arrived too last or due to a seek.
-		return;
-	}
-
-	m_cond.wait(l, [this]{ return  condition(); });
-	if (m_quit || m_seek_asked) return;
-
-	if (m_write_pos != sample_position) {
-		std::clog << "ffmpeg/debug: Gap in audio: expected=" << m_write_pos << " received=" << sample_position << '\n';
-	}
-
-	m_write_pos = sample_position;
-	std::int64_t write_pos_in_ring = m_write_pos % static_cast<std::int64_t>(m_data.size());
-	auto first_hunk_size = std::min(count, static_cast<std::int64_t>(m_data.size()) - write_pos_in_ring);
-	std::copy(data, data + first_hunk_size, m_data.begin() + write_pos_in_ring);
-	// second part is when data wrapped in the ring buffer
-	std::copy(data + first_hunk_size, data + count, m_data.begin());
-	m_write_pos += count;
-	m_cond.notify_all();
-}
-
-bool AudioBuffer::prepare(std::int64_t pos) {
-	// perform fake read to trigger any potential seek
-	if (!read(nullptr, 0, pos, 1)) return true;
-
-	std::unique_lock<std::mutex> l(m_mutex);
-	// Has enough been prebuffered already and is the requested position still within buffer
-	auto ring_size = static_cast<std::int64_t>(m_data.size());
-	return m_write_pos > m_read_pos + ring_size / 16 && m_write_pos <= m_read_pos + ring_size;
-}
-
-// pos may be negative because upper layer may request 'extra time' before
-// starting the play back. In this case, the buffer is filled of zero.
-//
-bool AudioBuffer::read(float* begin, std::int64_t samples, std::int64_t pos, float volume) {
-	if (pos < 0) {
-		std::int64_t negative_samples;
-		if (samples + pos > 0) negative_samples = samples - (samples + pos);
-		else negative_samples = samples;
-
-		// put zeros to negative positions
-		std::fill(begin, begin + negative_samples, 0);
-
-		if (negative_samples == samples) return true;
-
-		// if there are remaining samples to read in positive land, do the 'normal' read
-		pos = 0;
-		samples -= negative_samples;
-	}
-
-	std::unique_lock<std::mutex> l(m_mutex);
-	if (eof(pos + samples) || m_quit)
-		return false;
-
-	// one cannot read more data than the size of buffer
-	std::int64_t size = static_cast<std::int64_t>(m_data.size());
-	samples = std::min(samples, size);
-	if (pos >= m_read_pos + size - samples || pos < m_read_pos) {
-		// in case request position is not in the current possible range, we trigger a seek
-		// Note: m_write_pos is not checked on purpose: if pos is after
-		// m_write_pos, zeros present in buffer will be returned
-		std::fill(begin, begin + samples, 0);
-		m_read_pos = pos + samples;
-		m_seek_asked = true;
-		std::fill(m_data.begin(), m_data.end(), 0);
-		m_cond.notify_all();
-		return true;
-	}
 
-	for (std::int64_t s = 0; s < samples; ++s) {
-		begin[s] += volume * da::conv_from_s16(m_data[static_cast<size_t>((m_read_pos + s)) % m_data.size()]);
-	}
-
-	m_read_pos = pos + samples;
-	m_cond.notify_all();
-	return true;
+	  private:
+		AudioFFmpeg m_ffmpeg;
+	};
 }
 
-double AudioBuffer::duration() { return m_duration; }
-
 AudioBuffer::AudioBuffer(fs::path const& file, unsigned rate, size_t size):
-	m_data(size), m_sps(rate * AUDIO_CHANNELS) {
-		auto ffmpeg = std::make_unique<AudioFFmpeg>(file, rate, std::ref(*this));
-		const_cast<double&>(m_duration) = ffmpeg->duration();
-		reader_thread = std::async(std::launch::async, [this, ffmpeg = std::move(ffmpeg)] {
-			auto errors = 0u;
-			std::unique_lock<std::mutex> l(m_mutex);
-			while (!m_quit) {
-				if (m_seek_asked) {
-					m_seek_asked = false;
-					m_write_pos = m_read_pos;
-					auto seek_pos = static_cast<double>(m_read_pos) / double(AV_TIME_BASE);
-
-					UnlockGuard<decltype(l)> unlocked(l); // release lock during seek
-					ffmpeg->seek(seek_pos);
-					continue;
-				}
-
-				try {
-					UnlockGuard<decltype(l)> unlocked(l); // release lock during possibly blocking ffmpeg stuff
-
-					ffmpeg->handleOneFrame();
-					errors = 0;
-				} catch (const FFmpeg::Eof&) {
-					// now we know exact eof_pos
-					m_eof_pos = m_write_pos;
-					// Wait here on eof: either quit is asked, either a new seek
-					// was asked and return back reading frames
-					m_cond.wait(l, [this]{ return m_quit || m_seek_asked; });
-				} catch (const std::exception& e) {
-					UnlockGuard<decltype(l)> unlocked(l); // unlock while doing IOs
-					std::clog << "ffmpeg/error: " << e.what() << std::endl;
-					if (++errors > 2) std::clog << "ffmpeg/error: FFMPEG terminating due to multiple errors" << std::endl;
-				}
-			}
-		});
-}
-
-AudioBuffer::~AudioBuffer() {
-	{
-		std::unique_lock<std::mutex> l(m_mutex);
-		m_read_pos = 0;
-		m_write_pos = 0;
-		std::fill(m_data.begin(), m_data.end(), 0);
-		m_quit = true;
-	}
-	m_cond.notify_all();
-	reader_thread.get();
-}
+  AudioBuffer([&](AudioBuffer& buffer) { return std::make_unique<FFmpegDecoder>(file, rate, buffer); }, rate, size) {}
 
 static void printFFmpegInfo() {
 	bool matches = LIBAVUTIL_VERSION_INT == avutil_version() &&
@@ -264,6 +134,11 @@ FFmpeg::FFmpeg(fs::path const& _filename, int mediaType) : m_filename(_filename)
 
 	decltype(m_codecContext) pCodecCtx{avcodec_alloc_context3(codec), avcodec_free_context};
 	avcodec_parameters_to_context(pCodecCtx.get(), m_formatContext->streams[m_streamId]->codecpar);
+	if (mediaType == AVMEDIA_TYPE_VIDEO) {
+		// Decode several frames (or slices of a frame) in parallel, 0 lets FFmpeg pick by the number of CPUs
+		pCodecCtx->thread_count = static_cast<int>(config["graphic/video_threads"].ui());
+		pCodecCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	}
 	{
 		static std::mutex s_avcodec_mutex;
 		// ffmpeg documentation is clear on the fact that avcodec_open2 is not thread safe.
@@ -274,7 +149,10 @@ FFmpeg::FFmpeg(fs::path const& _filename, int mediaType) : m_filename(_filename)
 	m_codecContext = std::move(pCodecCtx);
 }
 
-VideoFFmpeg::VideoFFmpeg(fs::path const& filename, VideoCb videoCb) : FFmpeg(filename, AVMEDIA_TYPE_VIDEO), handleVideoData(videoCb) {
+VideoFFmpeg::VideoFFmpeg(fs::path const& filename, VideoCb videoCb, FramePool& pool, bool allowYuv) :
+	FFmpeg(filename, AVMEDIA_TYPE_VIDEO), handleVideoData(videoCb), m_pool(pool) {
+	auto fmt = m_codecContext->pix_fmt;
+	if (allowYuv && (fmt == AV_PIX_FMT_YUV420P || fmt == AV_PIX_FMT_YUVJ420P)) return;  // Planes are copied as they are
 	// Setup software scaling context for YUV to RGB conversion
 	m_swsContext.reset(sws_getContext(
 				m_codecContext->width, m_codecContext->height, m_codecContext->pix_fmt,
@@ -282,6 +160,16 @@ VideoFFmpeg::VideoFFmpeg(fs::path const& filename, VideoCb videoCb) : FFmpeg(fil
 				SWS_POINT, nullptr, nullptr, nullptr));
 }
 
+bool VideoFFmpeg::bt709() const {
+	auto cs = m_codecContext->colorspace;
+	if (cs == AVCOL_SPC_UNSPECIFIED) return m_codecContext->height >= 720;  // HD video is usually BT.709
+	return cs == AVCOL_SPC_BT709;
+}
+
+bool VideoFFmpeg::fullRange() const {
+	return m_codecContext->color_range == AVCOL_RANGE_JPEG || m_codecContext->pix_fmt == AV_PIX_FMT_YUVJ420P;
+}
+
 AudioFFmpeg::AudioFFmpeg(fs::path const& filename, int rate, AudioCb audioCb) :
 	FFmpeg(filename, AVMEDIA_TYPE_AUDIO), m_rate(rate), handleAudioData(audioCb) {
 		// setup resampler
@@ -365,11 +253,31 @@ void AudioFFmpeg::seek(double time) {
 	m_position_in_48k_frames = -1; //kill previous position
 }
 
+bool AudioFFmpeg::decode(fs::path const& file, int rate, double start, std::size_t maxSamples, std::vector<float>& out, std::function<bool()> const& cancel) {
+	std::int64_t const first = AUDIO_CHANNELS * static_cast<std::int64_t>(std::llround(start * rate));  // Samples before start are dropped
+	out.clear();
+	AudioFFmpeg ffmpeg(file, rate, [&](std::int16_t const* data, std::int64_t count, std::int64_t pos) {
+		std::int64_t const skip = std::clamp<std::int64_t>(first - pos, 0, count);
+		std::transform(data + skip, data + count, std::back_inserter(out), da::conv_from_s16);
+	});
+	if (start > 0.0) ffmpeg.seek(start);
+	try {
+		while (out.size() < maxSamples) {
+			if (cancel()) return false;
+			ffmpeg.handleOneFrame();
+		}
+	} catch (Eof const&) {}
+	return true;
+}
+
 void FFmpeg::handleSomeFrames() {
 		int ret;
 		do {
 		uFrame frame{av_frame_alloc()};
-		ret = avcodec_receive_frame(m_codecContext.get(), frame.get());
+		{
+			TRACE_ZONE("ffmpeg/decode");
+			ret = avcodec_receive_frame(m_codecContext.get(), frame.get());
+		}
 		if (ret == AVERROR_EOF) {
 			// End of file: no more data.
 			throw Eof();
@@ -391,14 +299,35 @@ void FFmpeg::handleSomeFrames() {
 }
 
 void VideoFFmpeg::processFrame(uFrame frame) {
-	// Convert into RGB and scale the data
-	auto w = static_cast<unsigned>((m_codecContext->width + 15) & ~15);
-	auto h = static_cast<unsigned>(m_codecContext->height);
-	Bitmap f;
+	Bitmap f = m_pool.get();
 	f.timestamp = m_position;
-	f.fmt = pix::Format::RGB;
-	f.resize(w, h);
-	{
+	if (yuv()) {
+		// Copy the planes without padding, the video shader converts them to RGB
+		TRACE_ZONE("ffmpeg/copy yuv");
+		auto w = static_cast<unsigned>(m_codecContext->width);
+		auto h = static_cast<unsigned>(m_codecContext->height);
+		unsigned cw = (w + 1) / 2, ch = (h + 1) / 2;
+		f.fmt = pix::Format::YUV420P;
+		f.buf.resize(w * h + 2 * cw * ch);
+		f.width = w;
+		f.height = h;
+		f.ar = float(w) / float(h);
+		std::uint8_t* out = f.data();
+		auto copyPlane = [&out, &frame](int plane, unsigned width, unsigned height) {
+			for (unsigned y = 0; y < height; ++y, out += width) {
+				std::memcpy(out, frame->data[plane] + std::ptrdiff_t(y) * frame->linesize[plane], width);
+			}
+		};
+		copyPlane(0, w, h);
+		copyPlane(1, cw, ch);
+		copyPlane(2, cw, ch);
+	} else {
+		// Convert into RGB and scale the data
+		TRACE_ZONE("ffmpeg/convert rgb");
+		auto w = static_cast<unsigned>((m_codecContext->width + 15) & ~15);
+		auto h = static_cast<unsigned>(m_codecContext->height);
+		f.fmt = pix::Format::RGB;
+		f.resize(w, h);
 		std::uint8_t* data = f.data();
 		int linesize = static_cast<int>(w * 3);
 		sws_scale(m_swsContext.get(), frame->data, frame->linesize, 0, static_cast<int>(h), &data, &linesize);
@@ -409,11 +338,15 @@ void VideoFFmpeg::processFrame(uFrame frame) {
 void AudioFFmpeg::processFrame(uFrame frame) {
 	// resample to output
 	std::int16_t *output;
-	int out_samples = swr_get_out_samples(m_resampleContext.get(), frame->nb_samples);
-	av_samples_alloc((std::uint8_t**)&output, nullptr, AUDIO_CHANNELS, out_samples,
-			AV_SAMPLE_FMT_S16, 0);
-	out_samples = swr_convert(m_resampleContext.get(), (std::uint8_t**)&output, out_samples,
-			(const std::uint8_t**)&frame->data[0], frame->nb_samples);
+	int out_samples;
+	{
+		TRACE_ZONE("ffmpeg/resample");
+		out_samples = swr_get_out_samples(m_resampleContext.get(), frame->nb_samples);
+		av_samples_alloc((std::uint8_t**)&output, nullptr, AUDIO_CHANNELS, out_samples,
+				AV_SAMPLE_FMT_S16, 0);
+		out_samples = swr_convert(m_resampleContext.get(), (std::uint8_t**)&output, out_samples,
+				(const std::uint8_t**)&frame->data[0], frame->nb_samples);
+	}
 	// The output is now an interleaved array of 16-bit samples
 	if (m_position_in_48k_frames == -1) {
 		m_position_in_48k_frames = static_cast<std::int64_t>(m_position * m_rate + 0.5f);
@@ -1,12 +1,11 @@
 #pragma once
 
+#include "audiobuffer.hh"
 #include "chrono.hh"
 #include "texture.hh"
 #include "util.hh"
 #include "libda/sample.hpp"
-#include "aubio/aubio.h"
 #include <atomic>
-#include <condition_variable>
 #include <cstdint>
 #include <exception>
 #include <future>
@@ -86,6 +85,11 @@ class AudioFFmpeg : public FFmpeg {
 	AudioFFmpeg(fs::path const& file, int rate, AudioCb audioCb);
 
 	void seek(double time) override;
+	/**
+	* Decode a file into interleaved stereo at rate, from start (seconds) until the file ends or out holds at least
+	* maxSamples. Returns false if cancel() became true first.
+	**/
+	static bool decode(fs::path const& file, int rate, double start, std::size_t maxSamples, std::vector<float>& out, std::function<bool()> const& cancel = [] { return false; });
   protected:
 	void processFrame(uFrame frame) override;
   private:
@@ -95,56 +99,25 @@ class AudioFFmpeg : public FFmpeg {
 	std::unique_ptr<SwrContext, void(*)(SwrContext*)> m_resampleContext{nullptr, [] (auto p) { swr_close(p); swr_free(&p); }};
 };
 
+class FramePool;
+
 class VideoFFmpeg : public FFmpeg {
   public:
 	using VideoCb = std::function<void(Bitmap)>;
-	VideoFFmpeg(fs::path const& file, VideoCb videoCb);
+	/// Frames are allocated from pool. With allowYuv, 4:2:0 video is passed on as YUV420P planes instead of RGB.
+	VideoFFmpeg(fs::path const& file, VideoCb videoCb, FramePool& pool, bool allowYuv);
+
+	/// Are YUV420P frames produced?
+	bool yuv() const { return !m_swsContext; }
+	/// Does the video use BT.709 colors (as opposed to BT.601)?
+	bool bt709() const;
+	/// Does the video use the full 0-255 range for YUV (as opposed to 16-235)?
+	bool fullRange() const;
 
   protected:
 	void processFrame(uFrame frame) override;
   private:
 	std::unique_ptr<SwsContext, void(*)(SwsContext*)> m_swsContext{nullptr, sws_freeContext};
-        VideoCb handleVideoData;
-
+	VideoCb handleVideoData;
+	FramePool& m_pool;
 };
-
-class AudioBuffer {
-  public:
-	using uFvec = std::unique_ptr<fvec_t, std::integral_constant<decltype(&del_fvec), &del_fvec>>;
-
-	AudioBuffer(fs::path const& file, unsigned rate, size_t size = 4320256);
-	~AudioBuffer();
-
-	uFvec makePreviewBuffer();
-	void operator()(const std::int16_t *data, std::int64_t count, std::int64_t sample_position);
-	bool prepare(std::int64_t pos);
-	bool read(float* begin, std::int64_t samples, std::int64_t pos, float volume = 1.0f);
-	bool terminating();
-	double duration();
-
-  private:
-	// must be called holding the mutex
-	bool eof(std::int64_t pos) const {
-		return (m_eof_pos != -1 && pos >= m_eof_pos) || (double(pos) / m_sps >= m_duration);
-	}
-
-	bool wantSeek();
-	bool wantMore();
-	/// Should the input stop waiting?
-	bool condition();
-
-	mutable std::mutex m_mutex;
-	std::condition_variable m_cond;
-
-	std::vector<std::int16_t> m_data;
-	std::int64_t m_write_pos = 0;
-	std::int64_t m_read_pos = 0;
-	std::int64_t m_eof_pos = -1; // -1 until we get the read end from ffmpeg
-
-	const unsigned m_sps;
-	const double m_duration{ 0 };
-	bool m_seek_asked { false };
-	bool m_quit{ false };
-	std::future<void> reader_thread;
-};
-
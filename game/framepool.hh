@@ -0,0 +1,32 @@
+#pragma once
+
+#include "image.hh"
+
+#include <mutex>
+#include <vector>
+
+/// Recycles the pixel buffers of video frames, so that a playing video does not allocate memory for every frame
+class FramePool {
+  public:
+	/// Get an empty frame, reusing the buffer of an earlier one if available (thread-safe)
+	Bitmap get() {
+		Bitmap bitmap;
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_buffers.empty()) {
+			bitmap.buf.swap(m_buffers.back());
+			m_buffers.pop_back();
+		}
+		return bitmap;
+	}
+	/// Give back a frame that is no longer needed (thread-safe)
+	void put(Bitmap&& bitmap) {
+		if (bitmap.buf.empty()) return;
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_buffers.size() < m_max) m_buffers.emplace_back(std::move(bitmap.buf));
+	}
+
+  private:
+	std::mutex m_mutex;
+	std::vector<std::vector<unsigned char>> m_buffers;
+	static const unsigned m_max = 24;  ///< Enough for a full queue and the frames being decoded and displayed
+};
@@ -379,3 +379,15 @@ Paths getPathsConfig(std::string const& confOption) {
 	}
 	return ret;
 }
+
+FileStamp FileStamp::of(fs::path const& file) {
+	std::error_code ec;
+	FileStamp stamp;
+	auto const time = fs::last_write_time(file, ec);
+	if (ec) return stamp;
+	auto const size = fs::file_size(file, ec);
+	if (ec) return stamp;
+	stamp.time = static_cast<std::int64_t>(time.time_since_epoch().count());
+	stamp.size = static_cast<std::uint64_t>(size);
+	return stamp;
+}
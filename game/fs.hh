@@ -53,6 +53,16 @@ static inline fs::path absolute(const fs::path& p, const fs::path& base) {
 
 using BinaryBuffer = std::vector<std::uint8_t>;
 
+/// Size and modification time of a file, used for noticing changed files (songs, images, music) without reading them.
+struct FileStamp {
+	std::int64_t time = 0;  ///< last_write_time in ticks of fs::file_time_type
+	std::uint64_t size = 0;
+	/// Stamp of the given file (all zeroes if it cannot be accessed)
+	static FileStamp of(fs::path const& file);
+	bool operator==(FileStamp const& other) const { return time == other.time && size == other.size; }
+	bool operator!=(FileStamp const& other) const { return !(*this == other); }
+};
+
 std::list<std::string> getThemes();  ///< Find all theme folders and return theme names.
 
 /// Recursively copies a folder, throws on error.
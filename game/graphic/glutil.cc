@@ -1,10 +1,56 @@
 #include "glutil.hh"
+#include "../configuration.hh"
 #include "../log.hh"
 #include "video_driver.hh"
 #include "window.hh"
 
+#include <cstring>
+#include <stdexcept>
+
 namespace glutil {
 
+	namespace {
+		bool compactVertices = false;
+		StreamRing ring(std::size_t(4) << 20);
+		DrawStats stats;
+
+		void pack(VertexInfo const* src, std::size_t count, CompactVertex* dst) {
+			for (VertexInfo const* end = src + count; src < end; ++src, ++dst) {
+				dst->pos[0] = src->vertPos.x;
+				dst->pos[1] = src->vertPos.y;
+				dst->pos[2] = src->vertPos.z;
+				dst->texCoord[0] = src->vertTexCoord.x;
+				dst->texCoord[1] = src->vertTexCoord.y;
+				dst->normal = packNormal(src->vertNormal.x, src->vertNormal.y, src->vertNormal.z);
+				for (int i = 0; i < 4; ++i) dst->color[i] = toHalf(src->vertColor[i]);
+			}
+		}
+	}
+
+	DrawStats& drawStats() { return stats; }
+
+	void setupVertexStream(GLuint vertPos, GLuint vertTexCoord, GLuint vertNormal, GLuint vertColor) {
+		compactVertices = config["graphic/compact_vertices"].b();
+		ring.reset();
+		glEnableVertexAttribArray(vertPos);
+		glEnableVertexAttribArray(vertTexCoord);
+		glEnableVertexAttribArray(vertNormal);
+		glEnableVertexAttribArray(vertColor);
+		if (compactVertices) {
+			GLsizei const stride = sizeof(CompactVertex);
+			glVertexAttribPointer(vertPos, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(CompactVertex, pos));
+			glVertexAttribPointer(vertTexCoord, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(CompactVertex, texCoord));
+			glVertexAttribPointer(vertNormal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void *)offsetof(CompactVertex, normal));
+			glVertexAttribPointer(vertColor, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offsetof(CompactVertex, color));
+		} else {
+			GLsizei const stride = sizeof(VertexInfo);
+			glVertexAttribPointer(vertPos, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(VertexInfo, vertPos));
+			glVertexAttribPointer(vertTexCoord, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(VertexInfo, vertTexCoord));
+			glVertexAttribPointer(vertNormal, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(VertexInfo, vertNormal));
+			glVertexAttribPointer(vertColor, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(VertexInfo, vertColor));
+		}
+	}
+
 	GLintptr alignOffset(GLintptr offset) {
 		if (Window::bufferOffsetAlignment == -1) {
 		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Window::bufferOffsetAlignment);
@@ -17,16 +63,32 @@ namespace glutil {
 
 	void VertexArray::clear() {
 		m_vertices.clear();
+		m_split = false;
 	}
 
 	void VertexArray::draw(GLint mode) {
 		GLErrorChecker glerror("VertexArray::draw");
 		if (empty()) return;
 
-		glBufferData(GL_ARRAY_BUFFER, stride() * size(), &m_vertices.front(), GL_DYNAMIC_DRAW);
+		// Append to the streaming buffer instead of replacing its contents, so that the GPU can keep drawing from the earlier parts
+		std::size_t const stride = compactVertices ? sizeof(CompactVertex) : sizeof(VertexInfo);
+		std::size_t const bytes = stride * m_vertices.size();
+		auto const range = ring.allocate(bytes, stride);
+		if (range.orphan) {
+			glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(ring.capacity()), nullptr, GL_STREAM_DRAW);
+			++stats.orphans;
+		}
+		void* dst = glMapBufferRange(GL_ARRAY_BUFFER, static_cast<GLintptr>(range.offset), static_cast<GLsizeiptr>(bytes),
+		  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!dst) throw std::runtime_error("Cannot map the vertex buffer");
+		if (compactVertices) pack(m_vertices.data(), m_vertices.size(), static_cast<CompactVertex*>(dst));
+		else std::memcpy(dst, m_vertices.data(), bytes);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		++stats.draws;
+		stats.bytes += bytes;
 
 		glerror.check("draw arrays");
-		glDrawArrays(mode, 0, size());
+		glDrawArrays(mode, static_cast<GLint>(range.offset / stride), size());
 	}
 
 	GLErrorChecker::GLErrorChecker(std::string const& info): info(info) {
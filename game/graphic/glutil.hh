@@ -3,6 +3,7 @@
 
 #include "../color.hh"
 #include "glmath.hh"
+#include "vertexstream.hh"
 #include <epoxy/gl.h>
 #include <string>
 #include <iostream>
@@ -75,11 +76,24 @@ namespace glutil {
 	}; // 32 bytes
 	// Total 368 bytes
 
+	/// Counters of vertex drawing, for graphic/fps
+	struct DrawStats {
+		unsigned draws = 0;  ///< glDrawArrays calls
+		std::size_t bytes = 0;  ///< Vertex data uploaded
+		unsigned orphans = 0;  ///< Times the streaming buffer was given new storage
+	};
+	/// Counters since they were last reset (by whoever reads them)
+	DrawStats& drawStats();
+
+	/// Set up the vertex attributes of the bound VAO for the streaming buffer bound to GL_ARRAY_BUFFER (graphic/compact_vertices chooses the layout)
+	void setupVertexStream(GLuint vertPos, GLuint vertTexCoord, GLuint vertNormal, GLuint vertColor);
+
 	/// Handy vertex array capable of drawing itself
 	class VertexArray {
 	private:
 		std::vector<VertexInfo> m_vertices;
 		VertexInfo m_vert;
+		bool m_split = false;
 	public:
 		VertexArray& vertex(float x, float y, float z = 0.0f) {
 			return vertex(glmath::vec3(x, y, z));
@@ -87,11 +101,23 @@ namespace glutil {
 
 		VertexArray& vertex(glmath::vec3 const& v) {
 			m_vert.vertPos = v;
+			if (m_split && !m_vertices.empty()) {
+				// Join the strips with degenerate triangles
+				m_vertices.push_back(m_vertices.back());
+				m_vertices.push_back(m_vert);
+			}
+			m_split = false;
 			m_vertices.push_back(m_vert);
 			m_vert = VertexInfo();
 			return *this;
 		}
 
+		/// Start another triangle strip in the same array, so that several strips (with the same shader and texture) are drawn at once
+		VertexArray& split() {
+			m_split = true;
+			return *this;
+		}
+
 		VertexArray& normal(float x, float y, float z) {
 			return normal(glmath::vec3(x, y, z));
 		}
@@ -125,8 +151,6 @@ namespace glutil {
 			return static_cast<int>(m_vertices.size());
 		}
 		
-		static GLsizei stride() { return sizeof(VertexInfo); }
-		
 		void clear();
 	};
 
@@ -1,8 +1,16 @@
 #include "text_renderer.hh"
 
+#include "configuration.hh"
+
 #include <pango/pangocairo.h>
 
+#include <cstring>
+#include <iostream>
+#include <list>
 #include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
 
 namespace {
 	PangoAlignment parseAlignment(std::string const& fontalign) {
@@ -29,25 +37,127 @@ namespace {
 	void alignFactor(float& factor) {
 		factor *= 2.0f;  // HACK to improve text quality without affecting compatibility with old versions
 	}
+
+	/// Layout of the text in the given style, on a Pango context that is created once per thread
+	PangoLayout* setupLayout(std::string const& text, TextStyle const& style, float m) {
+		thread_local std::shared_ptr<PangoContext> ctx;
+		thread_local std::shared_ptr<PangoLayout> layout;
+		if (!layout) {
+			ctx.reset(pango_font_map_create_context(pango_cairo_font_map_get_default()), g_object_unref);
+			layout.reset(pango_layout_new(ctx.get()), g_object_unref);
+		}
+		std::shared_ptr<PangoFontDescription> desc(pango_font_description_new(), pango_font_description_free);
+		pango_font_description_set_weight(desc.get(), parseWeight(style.fontweight));
+		pango_font_description_set_style(desc.get(), parseStyle(style.fontstyle));
+		pango_font_description_set_family(desc.get(), style.fontfamily.c_str());
+		pango_font_description_set_absolute_size(desc.get(), style.fontsize * PANGO_SCALE * m);
+		pango_layout_set_alignment(layout.get(), parseAlignment(style.fontalign));
+		pango_layout_set_font_description(layout.get(), desc.get());
+		pango_layout_set_text(layout.get(), text.c_str(), -1);
+		return layout.get();
+	}
+
+	/// Everything that affects the rendering of a text
+	std::string cacheKey(std::string const& text, TextStyle const& style, float m) {
+		std::string key;
+		auto add = [&key](auto value) {
+			char bytes[sizeof(value)];
+			std::memcpy(bytes, &value, sizeof(value));
+			key.append(bytes, sizeof(value));
+		};
+		for (Color const* c: { &style.fill_col, &style.stroke_col }) { add(c->r); add(c->g); add(c->b); add(c->a); }
+		add(style.stroke_width);
+		add(style.stroke_miterlimit);
+		add(style.fontsize);
+		add(m);
+		for (std::string const* s: { &style.fontfamily, &style.fontstyle, &style.fontweight, &style.fontalign, &style.stroke_linejoin, &style.stroke_linecap }) {
+			key += *s;
+			key += '\0';
+		}
+		key += text;
+		return key;
+	}
+}
+
+class TextCache::Impl {
+	struct Entry {
+		std::shared_ptr<Texture> texture;
+		float width;
+		float height;
+		std::size_t bytes;
+	};
+	using Lru = std::list<std::pair<std::string, Entry>>;  ///< Most recently used first
+	Lru m_lru;
+	std::unordered_map<std::string, Lru::iterator> m_index;
+	Stats m_stats;
+	double m_frame = 0.0;  ///< Rendering time of the current frame
+	Time m_reported = Clock::now();
+	unsigned long m_reportedMisses = 0;
+
+	/// Drop textures that no OpenGLText uses any more until the cache fits in its limit
+	void trim() {
+		std::size_t const limit = std::size_t(config["graphic/text_cache"].ui()) << 20;
+		for (auto it = m_lru.end(); m_stats.bytes > limit && it != m_lru.begin(); ) {
+			--it;
+			if (it->second.texture.use_count() > 1) continue;  // Still drawn
+			m_stats.bytes -= it->second.bytes;
+			m_index.erase(it->first);
+			it = m_lru.erase(it);
+		}
+		m_stats.entries = m_index.size();
+	}
+
+public:
+	std::optional<OpenGLText> find(std::string const& key, std::string const& text) {
+		auto it = m_index.find(key);
+		if (it == m_index.end()) return std::nullopt;
+		++m_stats.hits;
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		Entry const& e = it->second->second;
+		return OpenGLText(text, e.texture, e.width, e.height);
+	}
+	void add(std::string key, std::shared_ptr<Texture> const& texture, float width, float height, std::size_t bytes, double seconds) {
+		++m_stats.misses;
+		m_stats.raster.add(seconds);
+		m_frame += seconds;
+		m_stats.bytes += bytes;
+		m_lru.emplace_front(key, Entry{ texture, width, height, bytes });
+		m_index.emplace(std::move(key), m_lru.begin());
+		trim();
+	}
+	void endFrame() {
+		if (m_frame > 0.0) m_stats.frame.add(std::exchange(m_frame, 0.0));
+		if (m_stats.misses == m_reportedMisses || Clock::now() - m_reported < 10s) return;
+		m_reported = Clock::now();
+		m_reportedMisses = m_stats.misses;
+		std::clog << "text/debug: " << m_stats.hits << " hits, " << m_stats.misses << " rendered, " << m_stats.entries << " cached ("
+		  << (m_stats.bytes >> 20) << " MiB), render " << m_stats.raster << ", per frame " << m_stats.frame << std::endl;
+	}
+	Stats stats() const { return m_stats; }
+};
+
+namespace {
+	std::unique_ptr<TextCache::Impl> cache;
 }
 
+TextCache::TextCache() { cache = std::make_unique<Impl>(); }
+
+TextCache::~TextCache() { cache.reset(); }
+
+TextCache::Stats TextCache::stats() { return cache ? cache->stats() : Stats(); }
+
+void TextCache::endFrame() { if (cache) cache->endFrame(); }
+
 OpenGLText TextRenderer::render(std::string const& text, TextStyle const& style, float m) {
 	alignFactor(m);
-
-	// Setup font settings
-	auto alignment = parseAlignment(style.fontalign);
-	std::shared_ptr<PangoFontDescription> desc(pango_font_description_new(), pango_font_description_free);
-	pango_font_description_set_weight(desc.get(), parseWeight(style.fontweight));
-	pango_font_description_set_style(desc.get(), parseStyle(style.fontstyle));
-	pango_font_description_set_family(desc.get(), style.fontfamily.c_str());
-	pango_font_description_set_absolute_size(desc.get(), style.fontsize * PANGO_SCALE * m);
+	std::string key;
+	if (cache) {
+		key = cacheKey(text, style, m);
+		if (auto found = cache->find(key, text)) return std::move(*found);
+	}
+	auto const start = Clock::now();
 	auto border = style.stroke_width * m;
-	// Setup Pango context and layout
-	std::shared_ptr<PangoContext> ctx(pango_font_map_create_context(pango_cairo_font_map_get_default()), g_object_unref);
-	std::shared_ptr<PangoLayout> layout(pango_layout_new(ctx.get()), g_object_unref);
-	pango_layout_set_alignment(layout.get(), alignment);
-	pango_layout_set_font_description(layout.get(), desc.get());
-	pango_layout_set_text(layout.get(), text.c_str(), -1);
+	PangoLayout* layout = setupLayout(text, style, m);
 
 	auto width = 0.f;
 	auto height = 0.f;
@@ -55,7 +165,7 @@ OpenGLText TextRenderer::render(std::string const& text, TextStyle const& style,
 	// Compute text extents
 	{
 		PangoRectangle rec;
-		pango_layout_get_pixel_extents(layout.get(), nullptr, &rec);
+		pango_layout_get_pixel_extents(layout, nullptr, &rec);
 		width = static_cast<float>(rec.width) + border;  // Add twice half a border for margins
 		height = static_cast<float>(rec.height) + border;
 	}
@@ -70,8 +180,8 @@ OpenGLText TextRenderer::render(std::string const& text, TextStyle const& style,
 	cairo_set_operator(dc.get(),CAIRO_OPERATOR_SOURCE);
 	// Add Pango line and path to proper position on the DC
 	cairo_move_to(dc.get(), 0.5f * border, 0.5f * border);  // Margins needed for border stroke to fit in
-	pango_cairo_update_layout(dc.get(), layout.get());
-	pango_cairo_layout_path(dc.get(), layout.get());
+	pango_cairo_update_layout(dc.get(), layout);
+	pango_cairo_layout_path(dc.get(), layout);
 	// Render text
 	if (style.fill_col.a > 0.0f) {
 		cairo_set_source_rgba(dc.get(), style.fill_col.r, style.fill_col.g, style.fill_col.b, style.fill_col.a);
@@ -98,34 +208,21 @@ OpenGLText TextRenderer::render(std::string const& text, TextStyle const& style,
 	auto bitmapWidth = static_cast<unsigned>(cairo_image_surface_get_width(surface.get()));
 	auto bitmapHeight = static_cast<unsigned>(cairo_image_surface_get_height(surface.get()));
 	bitmap.resize(bitmapWidth, bitmapHeight);
-	auto texture = std::make_unique<Texture>();
+	auto texture = std::make_shared<Texture>();
 	texture->load(bitmap, true);
 
 	// We don't want text quality multiplier m to affect rendering size...
+	if (cache) cache->add(std::move(key), texture, width / m, height / m, std::size_t(bitmapWidth) * bitmapHeight * 4, Seconds(Clock::now() - start).count());
 	return OpenGLText(text, texture, width / m, height / m);
 }
 
 Size TextRenderer::measure(const std::string& text, const TextStyle& style, float m) {
 	alignFactor(m);
-
-	// Setup font settings
-	auto alignment = parseAlignment(style.fontalign);
-	std::shared_ptr<PangoFontDescription> desc(pango_font_description_new(), pango_font_description_free);
-	pango_font_description_set_weight(desc.get(), parseWeight(style.fontweight));
-	pango_font_description_set_style(desc.get(), parseStyle(style.fontstyle));
-	pango_font_description_set_family(desc.get(), style.fontfamily.c_str());
-	pango_font_description_set_absolute_size(desc.get(), style.fontsize * PANGO_SCALE * m);
 	auto border = style.stroke_width * m;
-	// Setup Pango context and layout
-	std::shared_ptr<PangoContext> ctx(pango_font_map_create_context(pango_cairo_font_map_get_default()), g_object_unref);
-	std::shared_ptr<PangoLayout> layout(pango_layout_new(ctx.get()), g_object_unref);
-	pango_layout_set_alignment(layout.get(), alignment);
-	pango_layout_set_font_description(layout.get(), desc.get());
-	pango_layout_set_text(layout.get(), text.c_str(), -1);
 
 	// Compute text extents
 	PangoRectangle rec;
-	pango_layout_get_pixel_extents(layout.get(), nullptr, &rec);
+	pango_layout_get_pixel_extents(setupLayout(text, style, m), nullptr, &rec);
 
 	auto const width = static_cast<float>(rec.width) + border;  // Add twice half a border for margins
 	auto const height = static_cast<float>(rec.height) + border;
@@ -133,4 +230,3 @@ Size TextRenderer::measure(const std::string& text, const TextStyle& style, floa
 	// We don't want text quality multiplier m to affect rendering size...
 	return {width / m, height / m};
 }
-
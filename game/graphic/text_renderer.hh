@@ -2,6 +2,7 @@
 
 #include "size.hh"
 #include "opengl_text.hh"
+#include "profiler.hh"
 
 #include <string>
 
@@ -11,3 +12,27 @@ public:
 	Size measure(std::string const&, TextStyle const&, float m);
 };
 
+/**
+* Cache of rendered texts, shared by all TextRenderers. A text rendered again with the same style and quality reuses
+* the texture of the first one. Textures that no text uses any more are dropped, least recently used first, when the
+* cache grows over graphic/text_cache.
+* There must be exactly one (global) instance for the cache to be used, and it must go before the GL context does.
+**/
+class TextCache {
+public:
+	TextCache();
+	~TextCache();
+	/// Counters for tuning the cache
+	struct Stats {
+		unsigned long hits = 0;  ///< Texts found in the cache
+		unsigned long misses = 0;  ///< Texts rendered
+		std::size_t entries = 0;
+		std::size_t bytes = 0;  ///< Estimated texture memory of the cached texts
+		ProfCP raster;  ///< Time of rendering one text
+		ProfCP frame;  ///< Time of rendering texts in one frame (frames that rendered any)
+	};
+	static Stats stats();
+	/// Count the rendering time of the frame that was just drawn (and log the counters every now and then)
+	static void endFrame();
+	class Impl;
+};
@@ -0,0 +1,67 @@
+#include "vertexstream.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace glutil {
+
+	StreamRing::Range StreamRing::allocate(std::size_t bytes, std::size_t alignment) {
+		bool orphan = false;
+		if (bytes > m_capacity) {
+			while (m_capacity < bytes) m_capacity *= 2;
+			m_offset = m_capacity;
+		}
+		std::size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+		if (offset + bytes > m_capacity) {
+			orphan = true;
+			offset = 0;
+		}
+		m_offset = offset + bytes;
+		return Range{ offset, orphan };
+	}
+
+	std::uint16_t toHalf(float f) {
+		std::uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		std::uint32_t const sign = (bits >> 16) & 0x8000u;
+		std::uint32_t const exponent = (bits >> 23) & 0xFFu;
+		std::uint32_t mantissa = bits & 0x7FFFFFu;
+		if (exponent == 0xFF) return static_cast<std::uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));  // Inf or NaN
+		int const e = static_cast<int>(exponent) - 127 + 15;
+		if (e >= 0x1F) return static_cast<std::uint16_t>(sign | 0x7C00u);  // Too large: infinity
+		if (e <= 0) {
+			// Subnormal half (or zero)
+			if (e < -10) return static_cast<std::uint16_t>(sign);
+			mantissa |= 0x800000u;
+			unsigned const shift = static_cast<unsigned>(14 - e);
+			std::uint32_t half = mantissa >> shift;
+			std::uint32_t const rest = mantissa & ((1u << shift) - 1u), halfway = 1u << (shift - 1u);
+			if (rest > halfway || (rest == halfway && (half & 1u))) ++half;
+			return static_cast<std::uint16_t>(sign | half);
+		}
+		std::uint32_t half = static_cast<std::uint32_t>(e) << 10 | mantissa >> 13;
+		std::uint32_t const rest = mantissa & 0x1FFFu;
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) ++half;  // May carry into the exponent, which is still correct
+		return static_cast<std::uint16_t>(sign | half);
+	}
+
+	float fromHalf(std::uint16_t h) {
+		std::uint32_t const sign = std::uint32_t(h & 0x8000u) << 16;
+		std::uint32_t const exponent = (h >> 10) & 0x1Fu;
+		std::uint32_t const mantissa = h & 0x3FFu;
+		float f;
+		if (exponent == 0) f = std::ldexp(static_cast<float>(mantissa), -24);
+		else if (exponent == 0x1F) f = mantissa ? NAN : INFINITY;
+		else f = std::ldexp(static_cast<float>(mantissa | 0x400u), static_cast<int>(exponent) - 25);
+		return sign ? -f : f;
+	}
+
+	std::uint32_t packNormal(float x, float y, float z) {
+		auto snorm10 = [](float v) {
+			int const i = static_cast<int>(std::lround(std::clamp(v, -1.0f, 1.0f) * 511.0f));
+			return static_cast<std::uint32_t>(i) & 0x3FFu;
+		};
+		return snorm10(x) | snorm10(y) << 10 | snorm10(z) << 20;
+	}
+}
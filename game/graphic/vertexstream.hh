@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace glutil {
+
+	/**
+	* Placement of vertex data in a streaming buffer that is written front to back. When the data no longer fits,
+	* the buffer is orphaned (given new storage while the GPU keeps drawing from the old one) and writing restarts
+	* from the front, so the CPU never waits for the GPU.
+	**/
+	class StreamRing {
+	public:
+		struct Range {
+			std::size_t offset;  ///< Where to write the data (bytes)
+			bool orphan;  ///< The buffer must be given new storage of capacity() bytes first
+		};
+		explicit StreamRing(std::size_t capacity): m_capacity(capacity), m_offset(capacity) {}
+		/// Place bytes at a multiple of alignment, growing the buffer if it is too small
+		Range allocate(std::size_t bytes, std::size_t alignment);
+		/// Start from new storage on the next allocate() (the buffer was recreated)
+		void reset() { m_offset = m_capacity; }
+		std::size_t capacity() const { return m_capacity; }
+
+	private:
+		std::size_t m_capacity;
+		std::size_t m_offset;
+	};
+
+	/// Vertex layout of graphic/compact_vertices: 32 bytes instead of the 48 of VertexInfo
+	struct CompactVertex {
+		float pos[3];
+		float texCoord[2];  ///< Full floats because animated textures scroll far
+		std::uint32_t normal;  ///< GL_INT_2_10_10_10_REV, normalized
+		std::uint16_t color[4];  ///< GL_HALF_FLOAT, so that colors brighter than white survive
+	};
+	static_assert(sizeof(CompactVertex) == 32, "CompactVertex must be tightly packed");
+
+	/// IEEE 754 half precision value of f (rounded to nearest even)
+	std::uint16_t toHalf(float f);
+	/// Float value of a half precision value
+	float fromHalf(std::uint16_t h);
+	/// Pack a normal (components in [-1, 1]) into signed normalized 10-bit fields
+	std::uint32_t packNormal(float x, float y, float z);
+}
@@ -186,6 +186,7 @@ void Window::createShaders() {
 			// Compile geometry shaders when stereo is requested
 			shader("color").compileFile(findFile("shaders/stereo3d.geom"));
 			shader("texture").compileFile(findFile("shaders/stereo3d.geom"));
+			shader("yuv").compileFile(findFile("shaders/stereo3d.geom"));
 			shader("3dobject").compileFile(findFile("shaders/stereo3d.geom"));
 			shader("dancenote").compileFile(findFile("shaders/stereo3d.geom"));
 		}
@@ -208,6 +209,13 @@ void Window::createShaders() {
 	  .compileFile(findFile("shaders/core.frag"))
 	  .link()
 	  .bindUniformBlocks();
+	shader("yuv")
+	  .addDefines("#define ENABLE_YUV\n")
+	  .addDefines("#define ENABLE_VERTEX_COLOR\n")
+	  .compileFile(findFile("shaders/core.vert"))
+	  .compileFile(findFile("shaders/core.frag"))
+	  .link()
+	  .bindUniformBlocks();
 	shader("3dobject")
 	  .addDefines("#define ENABLE_LIGHTING\n")
 	  .compileFile(findFile("shaders/core.vert"))
@@ -241,17 +249,8 @@ void Window::initBuffers() {
 	glGenBuffers(1, &Window::m_vbo); // Create VBO.
 	glGenBuffers(1, &Window::m_ubo); // Create UBO.
 
-	GLsizei stride = glutil::VertexArray::stride();
 	glBindBuffer(GL_ARRAY_BUFFER, Window::m_vbo);
-
-	glEnableVertexAttribArray(vertPos);
-	glVertexAttribPointer(vertPos, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(glutil::VertexInfo, vertPos));
-	glEnableVertexAttribArray(vertTexCoord);
-	glVertexAttribPointer(vertTexCoord, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(glutil::VertexInfo, vertTexCoord));
-	glEnableVertexAttribArray(vertNormal);
-	glVertexAttribPointer(vertNormal, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(glutil::VertexInfo, vertNormal));
-	glEnableVertexAttribArray(vertColor);
-	glVertexAttribPointer(vertColor, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(glutil::VertexInfo, vertColor));
+	glutil::setupVertexStream(vertPos, vertTexCoord, vertNormal, vertColor);
 }
 
 void Window::blank() {
@@ -918,13 +918,14 @@ void GuitarGraph::drawNeckStuff(double time) {
 	drawNotes(time);
 
 	auto drumsKickButtonId = to_underlying(input::ButtonId::DRUMS_KICK);
-	// Draw flames
+	// Draw flames, all at once
+	Texture* ftex = &m_flame;
+	if (m_starpower.get() > 0.01f) ftex = &m_flame_godmode;
+	glutil::VertexArray flames;
 	for (unsigned fret = 0; fret < m_pads; ++fret) { // Loop through the frets
 		if (m_drums && fret == drumsKickButtonId) { // Skip bass drum
 			m_flames[fret].clear(); continue;
 		}
-		Texture* ftex = &m_flame;
-		if (m_starpower.get() > 0.01f) ftex = &m_flame_godmode;
 		float x = getFretX(fret);
 		for (auto it = m_flames[fret].begin(); it != m_flames[fret].end();) {
 			float flameAnim = static_cast<float>(it->get());
@@ -933,17 +934,19 @@ void GuitarGraph::drawNeckStuff(double time) {
 				continue;
 			}
 			float h = flameAnim * 4.0f * fretWid;
-			UseTexture tblock(window, *ftex);
-			glutil::VertexArray va;
 			glmath::vec4 c(1.0f, 1.0f, 1.0f, 1.0f - flameAnim);
-			va.texCoord(0.0f, 1.0f).color(c).vertex(x - fretWid, time2y(0.0f), 0.0f);
-			va.texCoord(1.0f, 1.0f).color(c).vertex(x + fretWid, time2y(0.0f), 0.0f);
-			va.texCoord(0.0f, 0.0f).color(c).vertex(x - fretWid, time2y(0.0f), h);
-			va.texCoord(1.0f, 0.0f).color(c).vertex(x + fretWid, time2y(0.0f), h);
-			va.draw();
+			flames.split();
+			flames.texCoord(0.0f, 1.0f).color(c).vertex(x - fretWid, time2y(0.0f), 0.0f);
+			flames.texCoord(1.0f, 1.0f).color(c).vertex(x + fretWid, time2y(0.0f), 0.0f);
+			flames.texCoord(0.0f, 0.0f).color(c).vertex(x - fretWid, time2y(0.0f), h);
+			flames.texCoord(1.0f, 0.0f).color(c).vertex(x + fretWid, time2y(0.0f), h);
 			++it;
 		}
 	}
+	if (!flames.empty()) {
+		UseTexture tblock(window, *ftex);
+		flames.draw();
+	}
 	// Accuracy indicator
 	UseShader us(getShader(window, "color"));
 	float maxsize = 1.5f;
@@ -20,64 +20,69 @@ bool Hiscore::reachedHiscore(unsigned score, SongId songid, unsigned short level
 		return false; // come on, did you even try to sing?
 	}
 
+	auto const* bucket = m_hiscore.find(songid, level, track);
+	if (!bucket) return true; // nothing found for that song -> true
 	unsigned position = 0;
-	for (auto const& elem: m_hiscore) {
-		if (elem.songid != songid) continue;
-		if (elem.track != track) continue;
-		if (elem.level != level) continue;
-		if (score > elem.score) return true;
+	for (auto const& elem: *bucket) {
+		if (score > elem->score) return true;
 		if (++position >= MaximumStoredScores) return false;
 	}
-	return true; // nothing found for that song -> true
+	return true;
 }
 
-void Hiscore::addHiscore(unsigned score, const PlayerId& playerid, SongId songid, unsigned short level, std::string const& track) {
-	addHiscore({score, playerid, songid, level, track});
+bool Hiscore::addHiscore(unsigned score, const PlayerId& playerid, SongId songid, unsigned short level, std::string const& track) {
+	return addHiscore({score, playerid, songid, level, track});
 }
 
-void Hiscore::addHiscore(HiscoreItem&& item) {
+bool Hiscore::addHiscore(HiscoreItem&& item) {
 	if (item.track.empty())
 		throw std::runtime_error("No track given");
 	if (!reachedHiscore(item.score, item.songid, item.level, item.track))
-		return;
-	m_hiscore.insert(std::move(item));
+		return false;
+	m_hiscore.add(std::move(item));
+	return true;
 }
 
 Hiscore::HiscoreVector Hiscore::queryHiscore(std::optional<PlayerId> playerid, std::optional<SongId> songid, std::string const& track, std::optional<unsigned> max) const {
 	HiscoreVector hv;
-	for (auto const& h: m_hiscore) {
-		if (playerid && playerid.value() != h.playerid) continue;
-		if (songid && songid.value() != h.songid) continue;
-		if (currentLevel() != h.level) continue;
-		if (!track.empty() && track != h.track) continue;
-		if (max && --max.value() == 0) break;
+	auto const level = currentLevel();
+	auto add = [&](HiscoreItem const& h) {
+		if (playerid && playerid.value() != h.playerid) return true;
+		if (!track.empty() && track != h.track) return true;
+		if (max && --max.value() == 0) return false;
 		hv.push_back(h);
+		return true;
+	};
+	if (songid) {
+		for (auto const& h: getHiscores(songid.value())) if (!add(h)) break;
+		return hv;
+	}
+	for (auto const& h: m_hiscore.items()) {
+		if (level != h.level) continue;
+		if (!add(h)) break;
 	}
 	return hv;
 }
 
 bool Hiscore::hasHiscore(const SongId& songid) const {
-	return std::any_of(m_hiscore.begin(),m_hiscore.end(), [&songid, level = currentLevel()](auto const& h) {
-		return songid == h.songid && level == h.level;
-	});
+	auto const* tracks = m_hiscore.tracks(songid, currentLevel());
+	return tracks && std::any_of(tracks->begin(), tracks->end(), [](auto const& t) { return !t.second.empty(); });
 }
 
 unsigned Hiscore::getHiscore(SongId songid) const {
-	for (auto const& score: m_hiscore) {
-		if (songid == score.songid && currentLevel() == score.level) {
-			return score.score;
-		}
+	unsigned best = 0;
+	if (auto const* tracks = m_hiscore.tracks(songid, currentLevel())) {
+		for (auto const& [track, bucket]: *tracks) if (!bucket.empty()) best = std::max(best, bucket.front()->score);
 	}
-
-	return 0;
+	return best;
 }
 
 std::vector<HiscoreItem> Hiscore::getHiscores(SongId songid) const {
 	auto scores = std::vector<HiscoreItem>{};
-
-	std::copy_if(m_hiscore.begin(), m_hiscore.end(), std::back_inserter(scores),
-		[&](auto const& score){return songid == score.songid && currentLevel() == score.level;});
-
+	if (auto const* tracks = m_hiscore.tracks(songid, currentLevel())) {
+		for (auto const& [track, bucket]: *tracks) for (auto const& it: bucket) scores.push_back(*it);
+	}
+	std::stable_sort(scores.begin(), scores.end());
 	return scores;
 }
 
@@ -120,7 +125,7 @@ void Hiscore::load(xmlpp::NodeSet const& nodes) {
 }
 
 void Hiscore::save(xmlpp::Element *hiscores) {
-	for (auto const& h: m_hiscore) {
+	for (auto const& h: m_hiscore.items()) {
 		xmlpp::Element* hiscore = xmlpp::add_child_element(hiscores, "hiscore");
 		hiscore->set_attribute("playerid", std::to_string(h.playerid));
 		hiscore->set_attribute("songid", std::to_string(h.songid));
@@ -131,6 +136,10 @@ void Hiscore::save(xmlpp::Element *hiscores) {
 	}
 }
 
+void Hiscore::save(DatabaseSnapshot& snapshot) const {
+	for (auto const& h: m_hiscore.items()) snapshot.add(h);
+}
+
 unsigned short Hiscore::currentLevel() const {
 	return config["game/difficulty"].ui();
 }
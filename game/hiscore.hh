@@ -1,11 +1,12 @@
 #pragma once
 
+#include "databasestore.hh"
+#include "hiscoreindex.hh"
 #include "hiscoreitem.hh"
 #include "libxml++.hh"
 #include "player.hh"
 #include "songitems.hh"
 
-#include <set>
 #include <string>
 #include <vector>
 
@@ -17,6 +18,7 @@ public:
 
 	void load(xmlpp::NodeSet const& n);
 	void save(xmlpp::Element *players);
+	void save(DatabaseSnapshot& snapshot) const;
 
 	/**Check if you reached a new highscore.
 
@@ -40,9 +42,11 @@ public:
 	  The method will check if all ids are non-negative and the score
 	  in its valid interval. If one of this conditions is not net a
 	  HiscoreException will be raised.
+
+	  @return false if the score was not good enough to be stored
 	  */
-	void addHiscore(unsigned score, const PlayerId& playerid, SongId songid, unsigned short level, std::string const& track);
-	void addHiscore(HiscoreItem&&);
+	bool addHiscore(unsigned score, const PlayerId& playerid, SongId songid, unsigned short level, std::string const& track);
+	bool addHiscore(HiscoreItem&&);
 
 	using HiscoreVector = std::vector<HiscoreItem>;
 
@@ -55,7 +59,6 @@ public:
 	std::size_t size() const { return m_hiscore.size(); }
 
   private:
-	using hiscore_t = std::multiset<HiscoreItem>;
-	hiscore_t m_hiscore;
+	HiscoreIndex m_hiscore;
 	unsigned short currentLevel() const;
 };
@@ -0,0 +1,28 @@
+#include "hiscoreindex.hh"
+
+#include <algorithm>
+
+void HiscoreIndex::add(HiscoreItem item) {
+	Bucket& bucket = m_buckets[key(item.songid, item.level)][item.track];
+	auto it = m_items.insert(std::move(item));
+	// Equal scores go after the existing ones, like in the multiset
+	auto pos = std::upper_bound(bucket.begin(), bucket.end(), it, [](auto const& a, auto const& b) { return *a < *b; });
+	bucket.insert(pos, it);
+}
+
+void HiscoreIndex::clear() {
+	m_buckets.clear();
+	m_items.clear();
+}
+
+HiscoreIndex::Bucket const* HiscoreIndex::find(unsigned songid, unsigned short level, std::string const& track) const {
+	auto const* t = tracks(songid, level);
+	if (!t) return nullptr;
+	auto it = t->find(track);
+	return it == t->end() ? nullptr : &it->second;
+}
+
+HiscoreIndex::Tracks const* HiscoreIndex::tracks(unsigned songid, unsigned short level) const {
+	auto it = m_buckets.find(key(songid, level));
+	return it == m_buckets.end() ? nullptr : &it->second;
+}
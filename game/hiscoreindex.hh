@@ -0,0 +1,38 @@
+#pragma once
+
+#include "hiscoreitem.hh"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Storage of hiscores, bucketed by song, level and track.
+*
+* All scores are kept in one list ordered by score (used for saving and global queries). In addition, the
+* scores of each song, level and track are kept in a bucket, so that per-song queries (e.g. sorting the song
+* list by score) take time proportional to the scores of that song instead of all scores.
+**/
+class HiscoreIndex {
+  public:
+	using Items = std::multiset<HiscoreItem>;  ///< Highest score first
+	using Bucket = std::vector<Items::const_iterator>;  ///< Scores of one song, level and track, highest first
+	using Tracks = std::map<std::string, Bucket>;
+
+	void add(HiscoreItem item);
+	void clear();
+	Items const& items() const { return m_items; }
+	std::size_t size() const { return m_items.size(); }
+	/// Scores of a song on a level and track (nullptr if there are none)
+	Bucket const* find(unsigned songid, unsigned short level, std::string const& track) const;
+	/// Scores of a song on a level, by track (nullptr if there are none)
+	Tracks const* tracks(unsigned songid, unsigned short level) const;
+
+  private:
+	static std::uint64_t key(unsigned songid, unsigned short level) { return std::uint64_t{ songid } << 16 | level; }
+	Items m_items;
+	std::unordered_map<std::uint64_t, Tracks> m_buckets;
+};
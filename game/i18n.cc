@@ -95,7 +95,8 @@ std::to_string(error.get()) + ": " + error.errorName());
 	UnicodeUtil::m_searchCollator.reset(search);
 	UnicodeUtil::m_sortCollator.reset(sort);
 	UnicodeUtil::m_searchCollator->setStrength(icu::Collator::PRIMARY);
-	UnicodeUtil::m_sortCollator->setStrength(icu::Collator::SECONDARY);
+	// Songs keep tertiary sort keys, which are cut to secondary strength unless game/case-sorting is set
+	UnicodeUtil::m_sortCollator->setStrength(icu::Collator::TERTIARY);
 
 	// We ideally want an ICU locale to feed to the case-mapping functions in UnicodeUtil.
 	auto icuLoc = icu::Locale::createCanonical(getCurrentLanguage().first.c_str());
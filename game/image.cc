@@ -4,6 +4,7 @@
 #include <jpeglib.h>
 #include <png.h>
 
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -179,6 +180,38 @@ void loadJPEG(Bitmap& bitmap, fs::path const& filename) {
 	jpeg_destroy_decompress(&cinfo);
 }
 
+void writeJPEG(fs::path const& filename, Bitmap const& bitmap, int quality, unsigned stride) {
+	if (bitmap.fmt != pix::Format::RGB) throw std::logic_error("Unsupported pixel format in writeJPEG");
+	if (stride == 0) stride = bitmap.width * 3;
+	std::FILE* file = std::fopen(filename.string().c_str(), "wb");
+	if (!file) throw std::runtime_error("Cannot open " + filename.string() + " for writing");
+	struct my_jpeg_error_mgr jerr;
+	jpeg_compress_struct cinfo;
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = my_jpeg_error_exit;
+	if (setjmp(jerr.setjmp_buffer)) {
+		jpeg_destroy_compress(&cinfo);
+		std::fclose(file);
+		throw std::runtime_error("Error in libjpeg when encoding " + filename.string());
+	}
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, file);
+	cinfo.image_width = bitmap.width;
+	cinfo.image_height = bitmap.height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = const_cast<JSAMPROW>(bitmap.data() + std::size_t(cinfo.next_scanline) * stride);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	std::fclose(file);
+}
+
 void Bitmap::crop(const unsigned width, const unsigned height, const unsigned x, const unsigned y) {
 	if (ptr) throw std::logic_error("Cannot Bitmap::crop foreign pointers.");
 	if (x + width > this->width || y+ height > this->height)
@@ -14,7 +14,8 @@ namespace pix {
 		INT_ARGB,  // Cairo's pixel format (SVG, text): premultiplied linear RGB (BGRA byte order)
 		CHAR_RGBA,  // libpng w/ alpha: non-premul sRGB (RGBA byte order)
 		RGB,  // libpng w/o alpha, libjpeg, ffmpeg: sRGB (RGB byte order, no padding)
-		BGR  // OpenCV/webcam: sRGB (BGR byte order, no padding)
+		BGR,  // OpenCV/webcam: sRGB (BGR byte order, no padding)
+		YUV420P  // ffmpeg: Y plane followed by half resolution U and V planes (no padding), converted to RGB by the video shader
 	}; 
 }
 
@@ -53,4 +54,6 @@ struct Bitmap {
 void writePNG(fs::path const& filename, Bitmap const& bitmap, unsigned stride = 0);
 void loadPNG(Bitmap& bitmap, fs::path const& filename);
 void loadJPEG(Bitmap& bitmap, fs::path const& filename);
+/// Write an RGB bitmap as JPEG (quality 0..100). By default rows are assumed to have no padding.
+void writeJPEG(fs::path const& filename, Bitmap const& bitmap, int quality = 85, unsigned stride = 0);
 
@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * @file cpu.hpp Runtime detection of SIMD instruction sets.
+ *
+ * SIMD kernels are compiled with per-function target attributes, so that the
+ * binary keeps running on any CPU of the architecture and the best kernel is
+ * picked at runtime with these checks.
+ */
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DA_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define DA_NEON 1
+#endif
+
+// GCC and Clang need target attributes for using instructions above the baseline; MSVC allows them anywhere.
+#if defined(DA_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DA_TARGET(isa)
+#endif
+
+namespace da {
+	namespace cpu {
+#if defined(DA_X86) && defined(_MSC_VER)
+		namespace internal {
+			inline bool cpuid(int leaf, int reg, int bit) {
+				int info[4];
+				__cpuid(info, leaf);
+				return (info[reg] >> bit) & 1;
+			}
+			inline bool osSavesYmm() { return cpuid(1, 2, 27) && (_xgetbv(0) & 6) == 6; }
+		}
+		inline bool sse3() { return internal::cpuid(1, 2, 0); }
+		inline bool avx() { return internal::cpuid(1, 2, 28) && internal::osSavesYmm(); }
+#elif defined(DA_X86)
+		inline bool sse3() { return __builtin_cpu_supports("sse3"); }
+		inline bool avx() { return __builtin_cpu_supports("avx"); }
+#else
+		inline bool sse3() { return false; }
+		inline bool avx() { return false; }
+#endif
+		/// NEON is part of the AArch64 baseline, so no runtime check is needed.
+		inline bool neon() {
+#ifdef DA_NEON
+			return true;
+#else
+			return false;
+#endif
+		}
+	}
+}
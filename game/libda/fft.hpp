@@ -4,11 +4,20 @@
  * @file fft.hpp FFT and related facilities.
  */
 
+#include "cpu.hpp"
 #include "sample.hpp"
+#include <cmath>
 #include <complex>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
+#if defined(DA_X86)
+#include <immintrin.h>
+#elif defined(DA_NEON)
+#include <arm_neon.h>
+#endif
+
 
 namespace da {
 
@@ -78,4 +87,189 @@ namespace da {
 		for (std::size_t i = 0; i < N; ++i) data[i] = scale * std::conj(data[i]);  // Invert back, and apply IFFT scaling
 	}
 	
+
+	/**
+	 * Radix-2 butterfly passes used by RealFFT. Every kernel performs exactly the same
+	 * floating point operations in the same order, so all of them give identical results.
+	 */
+	namespace fft_kernels {
+		/// One pass over n complex values: butterflies of span half, using half twiddles from w.
+		using Pass = void (*)(std::complex<float>* data, std::size_t n, std::size_t half, std::complex<float> const* w);
+
+		struct Kernel {
+			char const* name;
+			Pass pass;
+		};
+
+		inline void butterflyScalar(float* a, float* b, float const* w) {
+			const float tr = b[0] * w[0] - b[1] * w[1];
+			const float ti = b[1] * w[0] + b[0] * w[1];
+			b[0] = a[0] - tr;
+			b[1] = a[1] - ti;
+			a[0] = a[0] + tr;
+			a[1] = a[1] + ti;
+		}
+
+		inline void passScalar(std::complex<float>* data, std::size_t n, std::size_t half, std::complex<float> const* w) {
+			float* d = reinterpret_cast<float*>(data);
+			float const* wf = reinterpret_cast<float const*>(w);
+			for (std::size_t start = 0; start < n; start += 2 * half) {
+				for (std::size_t i = 0; i < half; ++i) butterflyScalar(d + 2 * (start + i), d + 2 * (start + i + half), wf + 2 * i);
+			}
+		}
+
+#if defined(DA_X86)
+		DA_TARGET("sse3") inline void passSSE3(std::complex<float>* data, std::size_t n, std::size_t half, std::complex<float> const* w) {
+			if (half < 2) return passScalar(data, n, half, w);
+			float* d = reinterpret_cast<float*>(data);
+			float const* wf = reinterpret_cast<float const*>(w);
+			for (std::size_t start = 0; start < n; start += 2 * half) {
+				float* a = d + 2 * start;
+				float* b = a + 2 * half;
+				for (std::size_t i = 0; i < 2 * half; i += 4) {
+					__m128 va = _mm_loadu_ps(a + i);
+					__m128 vb = _mm_loadu_ps(b + i);
+					__m128 vw = _mm_loadu_ps(wf + i);
+					__m128 re = _mm_mul_ps(vb, _mm_moveldup_ps(vw));
+					__m128 im = _mm_mul_ps(_mm_shuffle_ps(vb, vb, 0xB1), _mm_movehdup_ps(vw));
+					__m128 t = _mm_addsub_ps(re, im);
+					_mm_storeu_ps(b + i, _mm_sub_ps(va, t));
+					_mm_storeu_ps(a + i, _mm_add_ps(va, t));
+				}
+			}
+		}
+
+		DA_TARGET("avx") inline void passAVX(std::complex<float>* data, std::size_t n, std::size_t half, std::complex<float> const* w) {
+			if (half < 4) return passSSE3(data, n, half, w);
+			float* d = reinterpret_cast<float*>(data);
+			float const* wf = reinterpret_cast<float const*>(w);
+			for (std::size_t start = 0; start < n; start += 2 * half) {
+				float* a = d + 2 * start;
+				float* b = a + 2 * half;
+				for (std::size_t i = 0; i < 2 * half; i += 8) {
+					__m256 va = _mm256_loadu_ps(a + i);
+					__m256 vb = _mm256_loadu_ps(b + i);
+					__m256 vw = _mm256_loadu_ps(wf + i);
+					__m256 re = _mm256_mul_ps(vb, _mm256_moveldup_ps(vw));
+					__m256 im = _mm256_mul_ps(_mm256_permute_ps(vb, 0xB1), _mm256_movehdup_ps(vw));
+					__m256 t = _mm256_addsub_ps(re, im);
+					_mm256_storeu_ps(b + i, _mm256_sub_ps(va, t));
+					_mm256_storeu_ps(a + i, _mm256_add_ps(va, t));
+				}
+			}
+		}
+#endif
+
+#if defined(DA_NEON)
+		inline void passNEON(std::complex<float>* data, std::size_t n, std::size_t half, std::complex<float> const* w) {
+			if (half < 2) return passScalar(data, n, half, w);
+			float* d = reinterpret_cast<float*>(data);
+			float const* wf = reinterpret_cast<float const*>(w);
+			const float signs[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+			const float32x4_t sign = vld1q_f32(signs);
+			for (std::size_t start = 0; start < n; start += 2 * half) {
+				float* a = d + 2 * start;
+				float* b = a + 2 * half;
+				for (std::size_t i = 0; i < 2 * half; i += 4) {
+					float32x4_t va = vld1q_f32(a + i);
+					float32x4_t vb = vld1q_f32(b + i);
+					float32x4_t vw = vld1q_f32(wf + i);
+					float32x4_t re = vmulq_f32(vb, vtrn1q_f32(vw, vw));
+					float32x4_t im = vmulq_f32(vrev64q_f32(vb), vtrn2q_f32(vw, vw));
+					float32x4_t t = vaddq_f32(re, vmulq_f32(im, sign));
+					vst1q_f32(b + i, vsubq_f32(va, t));
+					vst1q_f32(a + i, vaddq_f32(va, t));
+				}
+			}
+		}
+#endif
+
+		/// All kernels that the current CPU can run, slowest first.
+		inline std::vector<Kernel> available() {
+			std::vector<Kernel> ret{ { "scalar", passScalar } };
+#if defined(DA_X86)
+			if (cpu::sse3()) ret.push_back({ "sse3", passSSE3 });
+			if (cpu::avx()) ret.push_back({ "avx", passAVX });
+#endif
+#if defined(DA_NEON)
+			ret.push_back({ "neon", passNEON });
+#endif
+			return ret;
+		}
+
+		/// The fastest kernel for the current CPU (detected once).
+		inline Kernel best() {
+			static const Kernel kernel = available().back();
+			return kernel;
+		}
+	}
+
+	/**
+	 * FFT of real input of size N = 2^P, computed as a complex FFT of size N/2 plus a split pass.
+	 * All twiddle factors and the bit-reversal permutation are precomputed. The output is the
+	 * non-redundant half of the spectrum (N/2 + 1 bins), the rest being its complex conjugate.
+	 */
+	template<unsigned P> class RealFFT {
+	  public:
+		static_assert(P >= 2, "RealFFT needs at least four samples");
+		static constexpr std::size_t N = std::size_t(1) << P;  ///< Number of real input samples
+		static constexpr std::size_t M = N / 2;  ///< Size of the inner complex FFT
+		static constexpr std::size_t BINS = M + 1;  ///< Number of output bins
+
+		explicit RealFFT(fft_kernels::Kernel kernel = fft_kernels::best()): m_pass(kernel.pass) {}
+
+		/// Transform N samples from begin, multiplied by window, into BINS bins at out (no allocations).
+		template <typename InIt, typename Window> void operator()(InIt begin, Window const& window, std::complex<float>* out) const {
+			Tables const& t = tables();
+			// Pack even/odd samples as real/imaginary parts, in bit-reversed order
+			for (std::size_t n = 0; n < M; ++n) {
+				const float re = *begin++ * window[2 * n];
+				const float im = *begin++ * window[2 * n + 1];
+				out[t.bitrev[n]] = std::complex<float>(re, im);
+			}
+			for (std::size_t half = 1, offset = 0; half < M; offset += half, half *= 2) m_pass(out, M, half, &t.twiddles[offset]);
+			// Split the packed spectrum into the spectrum of the real input, pairing bins k and M - k so that this can be done in place
+			for (std::size_t k = 1; k <= M / 2; ++k) {
+				const std::complex<float> a = out[k];
+				const std::complex<float> b = out[M - k];
+				out[k] = split(a, std::conj(b), t.split[k]);
+				out[M - k] = split(b, std::conj(a), t.split[M - k]);
+			}
+			const std::complex<float> z0 = out[0];
+			out[0] = z0.real() + z0.imag();
+			out[M] = z0.real() - z0.imag();
+		}
+
+	  private:
+		struct Tables {
+			std::vector<std::uint32_t> bitrev;  ///< Bit-reversal permutation of the inner FFT
+			std::vector<std::complex<float>> twiddles;  ///< Per pass, contiguous: pass with span h uses exp(-i tau j / 2h), j < h
+			std::vector<std::complex<float>> split;  ///< exp(-i tau k / N) for the split pass
+			Tables(): bitrev(M), split(M) {
+				for (std::size_t i = 0, j = 0; i < M; ++i) {
+					bitrev[i] = static_cast<std::uint32_t>(j);
+					std::size_t m = M / 2;
+					while (m >= 1 && j >= m) { j -= m; m >>= 1; }
+					j += m;
+				}
+				for (std::size_t half = 1; half < M; half *= 2) {
+					for (std::size_t j = 0; j < half; ++j) twiddles.push_back(static_cast<std::complex<float>>(std::polar(1.0, -TAU * static_cast<double>(j) / static_cast<double>(2 * half))));
+				}
+				for (std::size_t k = 0; k < M; ++k) split[k] = static_cast<std::complex<float>>(std::polar(1.0, -TAU * static_cast<double>(k) / static_cast<double>(N)));
+			}
+		};
+		static Tables const& tables() {
+			static const Tables t;
+			return t;
+		}
+		/// Bin of the real FFT from packed bin a, conjugate mirror bin b and twiddle w
+		static std::complex<float> split(std::complex<float> a, std::complex<float> b, std::complex<float> w) {
+			const std::complex<float> even = 0.5f * (a + b);
+			const std::complex<float> diff = 0.5f * (a - b);
+			const std::complex<float> odd(diff.imag(), -diff.real());  // -i * diff
+			return even + w * odd;
+		}
+
+		fft_kernels::Pass m_pass;
+	};
 }
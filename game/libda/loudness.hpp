@@ -0,0 +1,103 @@
+#pragma once
+
+/**
+ * @file loudness.hpp Programme loudness measurement (EBU R 128 / ITU-R BS.1770).
+ */
+
+#include "sample.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace da {
+
+	/**
+	 * Integrated loudness of interleaved audio, in LUFS.
+	 *
+	 * Each channel goes through the K-weighting filter (a high shelf modelling the head, then a high-pass),
+	 * the mean square is taken over 400 ms blocks that overlap by 75 %, and the blocks below -70 LUFS and
+	 * then those more than 10 LU below the loudness of the rest are left out (the gating of BS.1770-4).
+	 * All channels are weighted equally, which is right for mono and stereo. Only the energy of each
+	 * 100 ms step is stored, so any length of audio can be measured.
+	 */
+	class LoudnessMeter {
+	  public:
+		static constexpr double ABSOLUTE_GATE = -70.0;  ///< LUFS
+		static constexpr double RELATIVE_GATE = -10.0;  ///< LU
+
+		LoudnessMeter(double rate, unsigned channels):
+		  m_channels(channels), m_step(std::max<std::size_t>(1, static_cast<std::size_t>(std::lround(rate / 10.0)))), m_state(channels)
+		{
+			// The filters of BS.1770 are specified at 48 kHz; these are their analog prototypes
+			double k = std::tan(pi * 1681.974450955533 / rate);
+			double q = 0.7071752369554196;
+			double const vh = std::pow(10.0, 3.999843853973347 / 20.0);
+			double const vb = std::pow(vh, 0.4996667741545416);
+			double a0 = 1.0 + k / q + k * k;
+			m_shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+			k = std::tan(pi * 38.13547087602444 / rate);
+			q = 0.5003270373238773;
+			a0 = 1.0 + k / q + k * k;
+			m_highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+		}
+
+		/// Measure frames of interleaved audio
+		void process(float const* data, std::size_t frames) {
+			for (std::size_t f = 0; f < frames; ++f, data += m_channels) {
+				for (unsigned c = 0; c < m_channels; ++c) {
+					double const y = m_highPass.filter(m_state[c].highPass, m_shelf.filter(m_state[c].shelf, data[c]));
+					m_sum += y * y;
+				}
+				if (++m_frames == m_step) {
+					m_steps.push_back(m_sum / double(m_step));
+					m_sum = 0.0;
+					m_frames = 0;
+				}
+			}
+		}
+
+		/// Loudness of everything measured so far (-inf if all of it is below the absolute gate)
+		double integrated() const {
+			std::vector<double> blocks;  // Mean square of each 400 ms block
+			for (std::size_t i = 3; i < m_steps.size(); ++i) blocks.push_back(0.25 * (m_steps[i - 3] + m_steps[i - 2] + m_steps[i - 1] + m_steps[i]));
+			auto gated = [&](double threshold) {
+				double sum = 0.0;
+				std::size_t count = 0;
+				for (double b: blocks) if (loudness(b) > threshold) { sum += b; ++count; }
+				return count ? sum / double(count) : 0.0;
+			};
+			double const absolute = gated(ABSOLUTE_GATE);
+			if (absolute <= 0.0) return -std::numeric_limits<double>::infinity();
+			return loudness(gated(std::max(ABSOLUTE_GATE, loudness(absolute) + RELATIVE_GATE)));
+		}
+
+		/// Loudness of a mean square (summed over the channels)
+		static double loudness(double meanSquare) { return -0.691 + 10.0 * std::log10(meanSquare); }
+
+	  private:
+		struct Biquad {
+			double b0, b1, b2, a1, a2;
+			/// Direct form II transposed, with the two state variables in s
+			double filter(double (&s)[2], double x) const {
+				double const y = b0 * x + s[0];
+				s[0] = b1 * x - a1 * y + s[1];
+				s[1] = b2 * x - a2 * y;
+				return y;
+			}
+		};
+		struct State {
+			double shelf[2] = {};
+			double highPass[2] = {};
+		};
+
+		unsigned m_channels;
+		std::size_t m_step;  ///< Frames per 100 ms
+		Biquad m_shelf, m_highPass;
+		std::vector<State> m_state;
+		std::vector<double> m_steps;  ///< Mean square of each complete 100 ms step
+		double m_sum = 0.0;
+		std::size_t m_frames = 0;  ///< Frames in m_sum
+	};
+}
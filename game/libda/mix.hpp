@@ -0,0 +1,237 @@
+#pragma once
+
+/**
+ * @file mix.hpp Mixing kernels: adding audio with linear gain ramps and center channel cancellation.
+ */
+
+#include "cpu.hpp"
+#include <cstddef>
+#include <vector>
+
+#if defined(DA_X86)
+#include <immintrin.h>
+#elif defined(DA_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace da {
+
+	/**
+	 * Inner loops of mixing. Audio is interleaved stereo. The gain of frame k is gain + k * step, computed
+	 * the same way by every kernel, so all of them give identical results.
+	 */
+	namespace mix_kernels {
+		/// out += in * gain ramp, over frames of stereo input
+		using AddStereo = void (*)(float* out, float const* in, std::size_t frames, float gain, float step);
+		/// out += in * gain ramp, over frames of mono input added to both channels of out
+		using AddMono = void (*)(float* out, float const* in, std::size_t frames, float gain, float step);
+		/// Replace both channels with left - right, which cancels what is panned to the center (usually vocals)
+		using CenterCancel = void (*)(float* data, std::size_t frames);
+
+		struct Kernel {
+			char const* name;
+			AddStereo stereo;
+			AddMono mono;
+			CenterCancel centerCancel;
+		};
+
+		inline void stereoScalar(float* out, float const* in, std::size_t frames, float gain, float step) {
+			for (std::size_t k = 0; k < frames; ++k) {
+				float const g = gain + static_cast<float>(k) * step;
+				out[2 * k] += in[2 * k] * g;
+				out[2 * k + 1] += in[2 * k + 1] * g;
+			}
+		}
+
+		inline void monoScalar(float* out, float const* in, std::size_t frames, float gain, float step) {
+			for (std::size_t k = 0; k < frames; ++k) {
+				float const s = in[k] * (gain + static_cast<float>(k) * step);
+				out[2 * k] += s;
+				out[2 * k + 1] += s;
+			}
+		}
+
+		inline void centerCancelScalar(float* data, std::size_t frames) {
+			for (std::size_t k = 0; k < frames; ++k) {
+				float const d = data[2 * k] - data[2 * k + 1];
+				data[2 * k] = d;
+				data[2 * k + 1] = d;
+			}
+		}
+
+#if defined(DA_X86)
+		DA_TARGET("sse3") inline void stereoSSE3(float* out, float const* in, std::size_t frames, float gain, float step) {
+			__m128 const g0 = _mm_set1_ps(gain);
+			__m128 const s = _mm_set1_ps(step);
+			__m128 const two = _mm_set1_ps(2.0f);
+			__m128 k = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);  // Frame of each sample
+			std::size_t i = 0;
+			for (; i + 2 <= frames; i += 2) {
+				__m128 g = _mm_add_ps(g0, _mm_mul_ps(k, s));
+				_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(_mm_loadu_ps(in + 2 * i), g)));
+				k = _mm_add_ps(k, two);
+			}
+			for (; i < frames; ++i) {
+				float const g = gain + static_cast<float>(i) * step;
+				out[2 * i] += in[2 * i] * g;
+				out[2 * i + 1] += in[2 * i + 1] * g;
+			}
+		}
+
+		DA_TARGET("sse3") inline void monoSSE3(float* out, float const* in, std::size_t frames, float gain, float step) {
+			__m128 const g0 = _mm_set1_ps(gain);
+			__m128 const s = _mm_set1_ps(step);
+			__m128 const two = _mm_set1_ps(2.0f);
+			__m128 const four = _mm_set1_ps(4.0f);
+			__m128 k = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4) {
+				__m128 x = _mm_loadu_ps(in + i);
+				__m128 lo = _mm_unpacklo_ps(x, x);  // Frames i and i + 1 to both channels
+				__m128 hi = _mm_unpackhi_ps(x, x);
+				__m128 glo = _mm_add_ps(g0, _mm_mul_ps(k, s));
+				__m128 ghi = _mm_add_ps(g0, _mm_mul_ps(_mm_add_ps(k, two), s));
+				_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(lo, glo)));
+				_mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out + 2 * i + 4), _mm_mul_ps(hi, ghi)));
+				k = _mm_add_ps(k, four);
+			}
+			for (; i < frames; ++i) {
+				float const v = in[i] * (gain + static_cast<float>(i) * step);
+				out[2 * i] += v;
+				out[2 * i + 1] += v;
+			}
+		}
+
+		DA_TARGET("sse3") inline void centerCancelSSE3(float* data, std::size_t frames) {
+			std::size_t i = 0;
+			for (; i + 2 <= frames; i += 2) {
+				__m128 x = _mm_loadu_ps(data + 2 * i);
+				__m128 d = _mm_sub_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)));  // L - R in the left lanes
+				_mm_storeu_ps(data + 2 * i, _mm_moveldup_ps(d));
+			}
+			centerCancelScalar(data + 2 * i, frames - i);
+		}
+
+		DA_TARGET("avx") inline void stereoAVX(float* out, float const* in, std::size_t frames, float gain, float step) {
+			__m256 const g0 = _mm256_set1_ps(gain);
+			__m256 const s = _mm256_set1_ps(step);
+			__m256 const four = _mm256_set1_ps(4.0f);
+			__m256 k = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4) {
+				__m256 g = _mm256_add_ps(g0, _mm256_mul_ps(k, s));
+				_mm256_storeu_ps(out + 2 * i, _mm256_add_ps(_mm256_loadu_ps(out + 2 * i), _mm256_mul_ps(_mm256_loadu_ps(in + 2 * i), g)));
+				k = _mm256_add_ps(k, four);
+			}
+			for (; i < frames; ++i) {
+				float const g = gain + static_cast<float>(i) * step;
+				out[2 * i] += in[2 * i] * g;
+				out[2 * i + 1] += in[2 * i + 1] * g;
+			}
+		}
+
+		DA_TARGET("avx") inline void monoAVX(float* out, float const* in, std::size_t frames, float gain, float step) {
+			__m256 const g0 = _mm256_set1_ps(gain);
+			__m256 const s = _mm256_set1_ps(step);
+			__m256 const four = _mm256_set1_ps(4.0f);
+			__m256 k = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4) {
+				__m128 x = _mm_loadu_ps(in + i);
+				__m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(x, x)), _mm_unpackhi_ps(x, x), 1);
+				__m256 g = _mm256_add_ps(g0, _mm256_mul_ps(k, s));
+				_mm256_storeu_ps(out + 2 * i, _mm256_add_ps(_mm256_loadu_ps(out + 2 * i), _mm256_mul_ps(v, g)));
+				k = _mm256_add_ps(k, four);
+			}
+			for (; i < frames; ++i) {
+				float const v = in[i] * (gain + static_cast<float>(i) * step);
+				out[2 * i] += v;
+				out[2 * i + 1] += v;
+			}
+		}
+
+		DA_TARGET("avx") inline void centerCancelAVX(float* data, std::size_t frames) {
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4) {
+				__m256 x = _mm256_loadu_ps(data + 2 * i);
+				__m256 d = _mm256_sub_ps(x, _mm256_permute_ps(x, 0xB1));
+				_mm256_storeu_ps(data + 2 * i, _mm256_moveldup_ps(d));
+			}
+			centerCancelScalar(data + 2 * i, frames - i);
+		}
+#endif
+
+#if defined(DA_NEON)
+		inline void stereoNEON(float* out, float const* in, std::size_t frames, float gain, float step) {
+			float32x4_t const g0 = vdupq_n_f32(gain);
+			float32x4_t const s = vdupq_n_f32(step);
+			float32x4_t const two = vdupq_n_f32(2.0f);
+			float const first[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+			float32x4_t k = vld1q_f32(first);
+			std::size_t i = 0;
+			for (; i + 2 <= frames; i += 2) {
+				float32x4_t g = vaddq_f32(g0, vmulq_f32(k, s));
+				vst1q_f32(out + 2 * i, vaddq_f32(vld1q_f32(out + 2 * i), vmulq_f32(vld1q_f32(in + 2 * i), g)));
+				k = vaddq_f32(k, two);
+			}
+			for (; i < frames; ++i) {
+				float const g = gain + static_cast<float>(i) * step;
+				out[2 * i] += in[2 * i] * g;
+				out[2 * i + 1] += in[2 * i + 1] * g;
+			}
+		}
+
+		inline void monoNEON(float* out, float const* in, std::size_t frames, float gain, float step) {
+			float32x4_t const g0 = vdupq_n_f32(gain);
+			float32x4_t const s = vdupq_n_f32(step);
+			float32x4_t const two = vdupq_n_f32(2.0f);
+			float32x4_t const four = vdupq_n_f32(4.0f);
+			float const first[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+			float32x4_t k = vld1q_f32(first);
+			std::size_t i = 0;
+			for (; i + 4 <= frames; i += 4) {
+				float32x4_t x = vld1q_f32(in + i);
+				float32x4_t glo = vaddq_f32(g0, vmulq_f32(k, s));
+				float32x4_t ghi = vaddq_f32(g0, vmulq_f32(vaddq_f32(k, two), s));
+				vst1q_f32(out + 2 * i, vaddq_f32(vld1q_f32(out + 2 * i), vmulq_f32(vzip1q_f32(x, x), glo)));
+				vst1q_f32(out + 2 * i + 4, vaddq_f32(vld1q_f32(out + 2 * i + 4), vmulq_f32(vzip2q_f32(x, x), ghi)));
+				k = vaddq_f32(k, four);
+			}
+			for (; i < frames; ++i) {
+				float const v = in[i] * (gain + static_cast<float>(i) * step);
+				out[2 * i] += v;
+				out[2 * i + 1] += v;
+			}
+		}
+
+		inline void centerCancelNEON(float* data, std::size_t frames) {
+			std::size_t i = 0;
+			for (; i + 2 <= frames; i += 2) {
+				float32x4_t x = vld1q_f32(data + 2 * i);
+				float32x4_t d = vsubq_f32(x, vrev64q_f32(x));  // L - R in the left lanes
+				vst1q_f32(data + 2 * i, vtrn1q_f32(d, d));
+			}
+			centerCancelScalar(data + 2 * i, frames - i);
+		}
+#endif
+
+		/// All kernels that the current CPU can run, slowest first.
+		inline std::vector<Kernel> available() {
+			std::vector<Kernel> ret{ { "scalar", stereoScalar, monoScalar, centerCancelScalar } };
+#if defined(DA_X86)
+			if (cpu::sse3()) ret.push_back({ "sse3", stereoSSE3, monoSSE3, centerCancelSSE3 });
+			if (cpu::avx()) ret.push_back({ "avx", stereoAVX, monoAVX, centerCancelAVX });
+#endif
+#if defined(DA_NEON)
+			ret.push_back({ "neon", stereoNEON, monoNEON, centerCancelNEON });
+#endif
+			return ret;
+		}
+
+		/// The fastest kernel for the current CPU (detected once).
+		inline Kernel best() {
+			static const Kernel kernel = available().back();
+			return kernel;
+		}
+	}
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+/**
+ * @file resampler.hpp Polyphase sample rate conversion and clock drift compensation.
+ */
+
+#include "cpu.hpp"
+#include "sample.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if defined(DA_X86)
+#include <immintrin.h>
+#elif defined(DA_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace da {
+
+	/**
+	 * Inner loops of Resampler: the dot products of a window of input with two neighbouring
+	 * filter phases. The kernels add in different orders, so results differ in the last bits.
+	 */
+	namespace resample_kernels {
+		/// d0 = x·h0 and d1 = x·h1 over n values (a multiple of 8).
+		/// There is no AVX kernel: with TAPS values it has only four iterations, and its longer horizontal sum
+		/// made it slower than SSE3 on some CPUs.
+		using Dot2 = void (*)(float const* x, float const* h0, float const* h1, std::size_t n, float& d0, float& d1);
+
+		struct Kernel {
+			char const* name;
+			Dot2 dot2;
+		};
+
+		inline void dot2Scalar(float const* x, float const* h0, float const* h1, std::size_t n, float& d0, float& d1) {
+			float s0 = 0.0f, s1 = 0.0f;
+			for (std::size_t i = 0; i < n; ++i) {
+				s0 += x[i] * h0[i];
+				s1 += x[i] * h1[i];
+			}
+			d0 = s0;
+			d1 = s1;
+		}
+
+#if defined(DA_X86)
+		DA_TARGET("sse3") inline void dot2SSE3(float const* x, float const* h0, float const* h1, std::size_t n, float& d0, float& d1) {
+			__m128 a0 = _mm_setzero_ps();
+			__m128 a1 = _mm_setzero_ps();
+			for (std::size_t i = 0; i < n; i += 4) {
+				__m128 v = _mm_loadu_ps(x + i);
+				a0 = _mm_add_ps(a0, _mm_mul_ps(v, _mm_loadu_ps(h0 + i)));
+				a1 = _mm_add_ps(a1, _mm_mul_ps(v, _mm_loadu_ps(h1 + i)));
+			}
+			__m128 s = _mm_hadd_ps(a0, a1);  // Pairs of a0, pairs of a1
+			s = _mm_hadd_ps(s, s);  // a0, a1, a0, a1
+			d0 = _mm_cvtss_f32(s);
+			d1 = _mm_cvtss_f32(_mm_shuffle_ps(s, s, 1));
+		}
+#endif
+
+#if defined(DA_NEON)
+		inline void dot2NEON(float const* x, float const* h0, float const* h1, std::size_t n, float& d0, float& d1) {
+			float32x4_t a0 = vdupq_n_f32(0.0f);
+			float32x4_t a1 = vdupq_n_f32(0.0f);
+			for (std::size_t i = 0; i < n; i += 4) {
+				float32x4_t v = vld1q_f32(x + i);
+				a0 = vmlaq_f32(a0, v, vld1q_f32(h0 + i));
+				a1 = vmlaq_f32(a1, v, vld1q_f32(h1 + i));
+			}
+			d0 = vaddvq_f32(a0);
+			d1 = vaddvq_f32(a1);
+		}
+#endif
+
+		/// All kernels that the current CPU can run, slowest first.
+		inline std::vector<Kernel> available() {
+			std::vector<Kernel> ret{ { "scalar", dot2Scalar } };
+#if defined(DA_X86)
+			if (cpu::sse3()) ret.push_back({ "sse3", dot2SSE3 });
+#endif
+#if defined(DA_NEON)
+			ret.push_back({ "neon", dot2NEON });
+#endif
+			return ret;
+		}
+
+		/// The fastest kernel for the current CPU (detected once).
+		inline Kernel best() {
+			static const Kernel kernel = available().back();
+			return kernel;
+		}
+	}
+
+	/**
+	 * Streaming sample rate converter for mono float audio with a variable ratio.
+	 *
+	 * A Kaiser-windowed sinc low-pass (cut off below the lower of the two Nyquist frequencies) is
+	 * precomputed for PHASES fractional positions, and each output sample interpolates linearly
+	 * between the two nearest phases, so no trigonometry is done while processing. Input is pushed
+	 * into a buffer allocated once, and output is pulled as far as the input reaches. Output sample
+	 * j corresponds to input time j * ratio (from the start or the last reset), and is available
+	 * once the input has reached TAPS / 2 samples past that (the latency of the filter).
+	 */
+	class Resampler {
+	  public:
+		static constexpr std::size_t TAPS = 32;  ///< Input samples per output sample
+		static constexpr std::size_t PHASES = 64;  ///< Filter phases per input sample
+		static constexpr double CUTOFF = 0.85;  ///< Half-amplitude point of the filter, relative to the lower Nyquist frequency
+		static constexpr double BETA = 7.0;  ///< Kaiser window shape (about 70 dB of stop band attenuation)
+
+		/**
+		 * @param ratio input rate / output rate
+		 * @param capacity input samples that can be waiting in the buffer
+		 */
+		explicit Resampler(double ratio = 1.0, std::size_t capacity = 4096, resample_kernels::Kernel kernel = resample_kernels::best()):
+		  m_dot2(kernel.dot2), m_bank((PHASES + 1) * TAPS), m_buf(capacity + TAPS)
+		{
+			configure(ratio);
+		}
+
+		/// Design the filter for a new nominal ratio and reset. Does not allocate.
+		void configure(double ratio) {
+			m_nominal = ratio;
+			double const fc = CUTOFF * std::min(1.0, 1.0 / ratio);
+			for (std::size_t p = 0; p <= PHASES; ++p) {
+				float* row = &m_bank[p * TAPS];
+				double const frac = double(p) / PHASES;
+				double sum = 0.0;
+				for (std::size_t k = 0; k < TAPS; ++k) {
+					double const t = double(k) - double(TAPS / 2 - 1) - frac;  // Distance from the output position
+					double const w = t / (TAPS / 2);
+					double const window = std::abs(w) < 1.0 ? bessel0(BETA * std::sqrt(1.0 - w * w)) / bessel0(BETA) : 0.0;
+					double const h = sinc(fc * t) * window;
+					row[k] = static_cast<float>(h);
+					sum += h;
+				}
+				for (std::size_t k = 0; k < TAPS; ++k) row[k] = static_cast<float>(row[k] / sum);  // Unity gain at DC
+			}
+			reset();
+		}
+
+		/// Forget all input and restart at the nominal ratio.
+		void reset() {
+			std::fill(m_buf.begin(), m_buf.end(), 0.0f);
+			m_size = TAPS / 2 - 1;  // Silence before the first sample, so that output starts at input time 0
+			m_start = 0;
+			m_frac = 0.0;
+			m_ratio = m_nominal;
+		}
+
+		double nominal() const { return m_nominal; }
+		double ratio() const { return m_ratio; }
+		/// Change the ratio (e.g. the nominal ratio times a drift correction) without redesigning the filter.
+		void setRatio(double ratio) { m_ratio = ratio; }
+
+		/// Input samples waiting (including those of the filter look-ahead), fractional.
+		double buffered() const { return double(m_size - m_start) - m_frac - double(TAPS / 2 - 1); }
+		/// How many more input samples pull(n) needs for producing n samples at the current ratio.
+		std::size_t needed(std::size_t n) const {
+			if (n == 0) return 0;
+			auto const total = m_start + static_cast<std::size_t>(m_frac + double(n - 1) * m_ratio) + TAPS + 1 /* rounding */;
+			return total > m_size ? total - m_size : 0;
+		}
+
+		/// Append input, as much as fits. Returns the number of samples taken.
+		std::size_t push(float const* in, std::size_t n) {
+			n = std::min(n, m_buf.size() - m_size);
+			std::copy(in, in + n, m_buf.begin() + static_cast<std::ptrdiff_t>(m_size));
+			m_size += n;
+			return n;
+		}
+
+		/// Produce up to n samples, as far as the input reaches. Returns the number produced.
+		std::size_t pull(float* out, std::size_t n) {
+			std::size_t i = 0;
+			for (; i < n && m_start + TAPS <= m_size; ++i) {
+				double const phase = m_frac * PHASES;
+				auto const p = std::min(static_cast<std::size_t>(phase), PHASES - 1);  // Rounding may give PHASES
+				float const t = static_cast<float>(phase - double(p));
+				float d0, d1;
+				m_dot2(&m_buf[m_start], &m_bank[p * TAPS], &m_bank[(p + 1) * TAPS], TAPS, d0, d1);
+				out[i] = d0 + (d1 - d0) * t;
+				// Keeping the whole part apart makes the rounding (and so the output) independent of block sizes
+				m_frac += m_ratio;
+				auto const whole = static_cast<std::size_t>(m_frac);
+				m_start += whole;
+				m_frac -= double(whole);
+			}
+			// Drop the input that no later output needs
+			auto const drop = std::min(m_start, m_size);
+			std::memmove(m_buf.data(), m_buf.data() + drop, (m_size - drop) * sizeof(float));
+			m_size -= drop;
+			m_start -= drop;
+			return i;
+		}
+
+	  private:
+		/// Modified Bessel function of the first kind, order zero
+		static double bessel0(double x) {
+			double sum = 1.0, term = 1.0;
+			for (unsigned k = 1; term > 1e-12 * sum; ++k) {
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		}
+
+		resample_kernels::Dot2 m_dot2;
+		std::vector<float> m_bank;  ///< PHASES + 1 rows of TAPS coefficients, the last one for interpolating past the last phase
+		std::vector<float> m_buf;
+		std::size_t m_size = 0;  ///< Samples in m_buf
+		std::size_t m_start = 0;  ///< Start of the window of the next output sample in m_buf
+		double m_frac = 0.0;  ///< Position of the next output sample between m_start and the next input sample, [0, 1)
+		double m_nominal = 1.0;
+		double m_ratio = 1.0;
+	};
+
+	/**
+	 * Keeps the fill level of a buffer between two audio clocks (e.g. a microphone and the playback
+	 * device) at a target, by correcting the resampling ratio of the consumer. This is a PI controller
+	 * on the smoothed fill level: update() once per consumed block, and multiply the nominal ratio
+	 * by its result. The correction is limited to range either way, to keep pitch changes inaudible.
+	 */
+	class DriftCompensator {
+	  public:
+		static constexpr double SMOOTHING = 0.05;  ///< Weight of a new fill level in the average
+		static constexpr double KP = 0.005;  ///< Correction per relative error of the fill level
+		static constexpr double KI = 0.00001;  ///< Accumulated correction per update per relative error
+
+		explicit DriftCompensator(double target, double range = 0.01): m_target(target), m_range(range) {}
+
+		/// Correction factor for the ratio, given the fill level (in input samples) before consuming a block.
+		double update(double fill) {
+			m_level = m_first ? fill : m_level + SMOOTHING * (fill - m_level);
+			m_first = false;
+			double const error = (m_level - m_target) / m_target;
+			m_integral = std::clamp(m_integral + KI * error, -m_range, m_range);
+			m_factor = std::clamp(1.0 + KP * error + m_integral, 1.0 - m_range, 1.0 + m_range);
+			return m_factor;
+		}
+		/// Start over (e.g. after the buffer has been skipped back to the target).
+		void reset() { m_first = true; m_integral = 0.0; m_factor = 1.0; }
+
+		double target() const { return m_target; }
+		double factor() const { return m_factor; }
+		/// Smoothed fill level
+		double level() const { return m_level; }
+
+	  private:
+		double m_target;
+		double m_range;
+		double m_level = 0.0;
+		double m_integral = 0.0;
+		double m_factor = 1.0;
+		bool m_first = true;
+	};
+}
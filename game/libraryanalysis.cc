@@ -0,0 +1,212 @@
+#include "libraryanalysis.hh"
+
+#include "beattracker.hh"
+#include "chrono.hh"
+#include "database.hh"
+#include "ffmpeg.hh"
+#include "libda/loudness.hpp"
+#include "libda/mix.hpp"
+#include "song.hh"
+#include "songs.hh"
+#include "trace.hh"
+#include "workerpool.hh"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+	constexpr auto CHECKPOINT = 60s;  ///< Longest time between writes of the song cache
+	constexpr unsigned BATCH_PER_THREAD = 2;  ///< Songs per thread in each batch
+	constexpr std::size_t CHUNK = 2 * 8192;  ///< Samples (interleaved stereo) mixed and measured at a time
+
+	volatile std::sig_atomic_t interrupted = 0;
+
+	/// Start of the first sung note, from a copy of the song of its own (so that the library's Song is left alone)
+	double firstSungNote(fs::path const& file) {
+		Song song(file);
+		song.loadNotes(false);
+		double first = getNaN();
+		for (auto const& [name, track]: song.vocalTracks) {
+			auto it = std::find_if(track.notes.begin(), track.notes.end(), [](Note const& n) { return n.type != Note::Type::SLEEP; });
+			if (it != track.notes.end() && !(it->begin >= first)) first = it->begin;
+		}
+		return first;
+	}
+
+	std::string clock(double seconds) {
+		auto const s = static_cast<long long>(std::max(seconds, 0.0));
+		return fmt::format("{}:{:02}:{:02}", s / 3600, s / 60 % 60, s % 60);
+	}
+}
+
+fs::path SongAnalysis::mainMusic(Song const& song) {
+	auto it = song.music.find(TrackName::BGMUSIC);
+	if (it != song.music.end() && !it->second.empty()) return it->second;
+	for (auto const& [name, file]: song.music) if (!file.empty()) return file;
+	return fs::path();
+}
+
+bool SongAnalysis::current(Song const& song) {
+	return song.analysis.music != FileStamp() && song.analysis.music == FileStamp::of(mainMusic(song));
+}
+
+SongAnalysis SongAnalysis::analyze(Song const& song) {
+	TRACE_ZONE("analyze/song");
+	constexpr unsigned rate = BeatTracker::RATE;
+	SongAnalysis a;
+	a.music = FileStamp::of(mainMusic(song));
+	// All tracks mixed, as they are played, a chunk at a time, so that a whole song is never in memory
+	struct Track {
+		std::vector<float> queue;  ///< Decoded and not mixed yet
+		std::unique_ptr<AudioFFmpeg> ffmpeg;
+		bool eof = false;
+	};
+	std::list<Track> tracks;
+	for (auto const& [name, file]: song.music) {
+		if (file.empty()) continue;
+		Track& t = tracks.emplace_back();
+		t.ffmpeg = std::make_unique<AudioFFmpeg>(file, rate, [&queue = t.queue](std::int16_t const* data, std::int64_t count, std::int64_t) {
+			std::transform(data, data + count, std::back_inserter(queue), da::conv_from_s16);
+		});
+	}
+	std::vector<float> mix(CHUNK), mono(CHUNK / 2);
+	da::LoudnessMeter meter(rate, 2);
+	BeatTracker::Detector beats(0.0);
+	std::size_t frames = 0;
+	while (true) {
+		std::size_t samples = 0;  // Mixed in this chunk; tracks that have ended are silent
+		for (Track& t: tracks) {
+			TRACE_ZONE("analyze/decode");
+			try {
+				while (!t.eof && t.queue.size() < CHUNK) t.ffmpeg->handleOneFrame();
+			} catch (FFmpeg::Eof const&) {
+				t.eof = true;
+			}
+			samples = std::max(samples, std::min(t.queue.size(), CHUNK));
+		}
+		if (samples == 0) break;
+		std::fill_n(mix.begin(), samples, 0.0f);
+		for (Track& t: tracks) {
+			std::size_t const n = std::min(t.queue.size(), samples);
+			da::mix_kernels::best().stereo(mix.data(), t.queue.data(), n / 2, 1.0f, 0.0f);
+			t.queue.erase(t.queue.begin(), t.queue.begin() + static_cast<std::ptrdiff_t>(n));
+		}
+		{
+			TRACE_ZONE("analyze/loudness");
+			meter.process(mix.data(), samples / 2);
+		}
+		for (std::size_t i = 0; i < samples / 2; ++i) mono[i] = 0.5f * (mix[2 * i] + mix[2 * i + 1]);
+		beats.process(mono.data(), samples / 2);
+		frames += samples / 2;
+	}
+	a.duration = double(frames) / rate;
+	a.loudness = meter.integrated();
+	a.beats = beats.finish();
+	try {
+		a.firstVocal = firstSungNote(song.filename);
+	} catch (std::exception const& e) {
+		a.firstVocal = getNaN();
+		std::clog << "analyze/warning: Cannot load the notes of " << song.filename << ": " << e.what() << std::endl;
+	}
+	return a;
+}
+
+void SongAnalysis::apply(Song& song) const {
+	song.analysis.music = music;
+	song.analysis.loudness = loudness;
+	song.analysis.firstVocal = firstVocal;
+	if (duration > 0.0) song.m_duration = duration;
+}
+
+void analyzeLibrary(AnalyzeOptions const& options) {
+	Database database(getConfigDir() / "database.xml");
+	Songs songs(database);
+	std::clog << "analyze/notice: Waiting for the song scan to finish." << std::endl;
+	while (!songs.doneLoading) std::this_thread::sleep_for(100ms);
+	auto const all = songs.allSongs();
+	std::vector<std::shared_ptr<Song>> todo;
+	for (auto const& song: all) {
+		if (SongAnalysis::mainMusic(*song).empty()) continue;
+		if (options.force || !SongAnalysis::current(*song)) todo.push_back(song);
+	}
+	unsigned const threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::cout << fmt::format("Analyzing {} of {} songs using {} threads ({} analyzed before).", todo.size(), all.size(), threads, all.size() - todo.size()) << std::endl;
+	fs::path const beatsDir = getCacheDir() / "beats";
+	fs::create_directories(beatsDir);
+
+	WorkerPool pool(threads - 1);
+	std::vector<std::pair<std::shared_ptr<Song>, SongAnalysis>> pending;  ///< Results not in the song cache yet
+	auto checkpoint = [&] {
+		if (pending.empty()) return;
+		songs.updateCache([&] { for (auto const& [song, result]: pending) result.apply(*song); });
+		std::clog << "analyze/info: Checkpoint: " << pending.size() << " songs stored in the song cache." << std::endl;
+		pending.clear();
+	};
+	interrupted = 0;
+	auto const previous = std::signal(SIGINT, [](int) { interrupted = 1; std::signal(SIGINT, SIG_DFL); });  // A second Ctrl+C quits at once
+	Time const begin = Clock::now();
+	Time lastCheckpoint = begin;
+	std::size_t done = 0, failed = 0;
+	double audio = 0.0;  ///< Seconds of music analyzed
+	std::size_t const batch = std::size_t(threads) * BATCH_PER_THREAD;
+	std::vector<SongAnalysis> results;
+	std::vector<std::string> errors;
+	for (std::size_t first = 0; first < todo.size() && !interrupted; first += batch) {
+		std::size_t const count = std::min(batch, todo.size() - first);
+		results.assign(count, SongAnalysis());
+		errors.assign(count, std::string());
+		pool.run(count, [&](std::size_t i) {
+			Song const& song = *todo[first + i];
+			try {
+				results[i] = SongAnalysis::analyze(song);
+			} catch (std::exception const& e) {
+				errors[i] = e.what();
+				// Recorded as analyzed anyway, so that a resumed run does not try again until the file changes
+				results[i] = SongAnalysis();
+				results[i].music = FileStamp::of(SongAnalysis::mainMusic(song));
+				results[i].loudness = results[i].firstVocal = getNaN();
+				return;
+			}
+			// Without the beat grid the song is still analyzed; previews then detect their beats themselves
+			fs::path const grid = beatsDir / BeatGrid::fileName(SongAnalysis::mainMusic(song));
+			try {
+				results[i].beats.save(grid, results[i].music);
+			} catch (std::exception const& e) {
+				std::clog << "analyze/warning: Cannot save beats " << grid << ": " << e.what() << std::endl;
+			}
+		});
+		for (std::size_t i = 0; i < count; ++i) {
+			if (!errors[i].empty()) {
+				++failed;
+				std::clog << "analyze/warning: " << todo[first + i]->filename.string() << ": " << errors[i] << std::endl;
+			}
+			audio += results[i].duration;
+			pending.emplace_back(todo[first + i], std::move(results[i]));
+		}
+		done += count;
+		double const elapsed = Seconds(Clock::now() - begin).count();
+		double const eta = elapsed / double(done) * double(todo.size() - done);
+		std::cout << fmt::format("[{}/{}] {:.1f} %, {:.0f}x real time, {} elapsed, {} left: {}", done, todo.size(), 100.0 * double(done) / double(todo.size()),
+		  audio / std::max(elapsed, 1e-3), clock(elapsed), clock(eta), todo[first + count - 1]->str()) << std::endl;
+		if (Clock::now() - lastCheckpoint >= CHECKPOINT) {
+			checkpoint();
+			lastCheckpoint = Clock::now();
+		}
+	}
+	std::signal(SIGINT, previous);
+	checkpoint();
+	double const elapsed = Seconds(Clock::now() - begin).count();
+	std::cout << fmt::format("{} {} songs ({} failed, {} of music) in {}.", interrupted ? "Interrupted after" : "Analyzed", done, failed, clock(audio), clock(elapsed)) << std::endl;
+	if (interrupted) std::cout << "Run again to continue where this run stopped." << std::endl;
+}
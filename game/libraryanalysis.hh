@@ -0,0 +1,42 @@
+#pragma once
+
+#include "beatgrid.hh"
+#include "fs.hh"
+
+#include <string>
+
+class Song;
+
+/// Settings of a library analysis run (--analyze-library)
+struct AnalyzeOptions {
+	unsigned threads = 0;  ///< Songs analyzed at once (0 = one per CPU core)
+	bool force = false;  ///< Also analyze the songs that have been analyzed before
+};
+
+/// What the library analysis measures of a song by decoding all of its music
+struct SongAnalysis {
+	FileStamp music;  ///< Of the main music file, when it was analyzed
+	double duration = 0.0;  ///< Seconds of audio in the longest track
+	double loudness = 0.0;  ///< Integrated loudness of the mix of all tracks (LUFS, -inf if silent)
+	double firstVocal = 0.0;  ///< Start of the first sung note (NaN if the song has none)
+	BeatGrid beats;  ///< Of the mix, from the start of the song
+
+	/// Decode and measure the music of a song. Throws if the music cannot be decoded.
+	static SongAnalysis analyze(Song const& song);
+	/// The music file that analyses and beat grids are keyed by (the background track, or else the first one)
+	static fs::path mainMusic(Song const& song);
+	/// Is there an analysis of the current version of the music of the song?
+	static bool current(Song const& song);
+	/// Store the results in the song (apart from the beats, which go to the beat grid cache)
+	void apply(Song& song) const;
+};
+
+/**
+* Analyze all songs of the library without a window or a sound card, storing the results in the song cache.
+*
+* The songs are analyzed in parallel batches on a WorkerPool. Progress is printed after each batch, and the results
+* are written to the song cache every CHECKPOINT seconds and when the run ends (also when it is interrupted with
+* Ctrl+C). Songs whose music has not changed since it was analyzed are skipped, so an interrupted run resumes
+* where the last checkpoint left it.
+**/
+void analyzeLibrary(AnalyzeOptions const& options);
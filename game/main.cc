@@ -1,4 +1,5 @@
 #include "backgrounds.hh"
+#include "bench.hh"
 #include "chrono.hh"
 #include "config.hh"
 #include "controllers.hh"
@@ -6,12 +7,16 @@
 #include "engine.hh"
 #include "fs.hh"
 #include "graphic/glutil.hh"
+#include "graphic/text_renderer.hh"
 #include "i18n.hh"
+#include "libraryanalysis.hh"
 #include "log.hh"
 #include "platform.hh"
 #include "profiler.hh"
 #include "screen.hh"
 #include "songs.hh"
+#include "svg.hh"
+#include "trace.hh"
 #include "graphic/window.hh"
 #include "webcam.hh"
 #include "webserver.hh"
@@ -28,11 +33,15 @@
 
 #include <fmt/format.h>
 #include <boost/program_options.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <cstdint>
 #include <csignal>
+#include <future>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 // Disable main level exception handling for debug builds (because gdb cannot properly catch throwing otherwise)
@@ -41,6 +50,27 @@
 
 bool g_take_screenshot = false;
 
+/// Write the recorded trace next to the screenshots
+static void saveTrace(Game& gm) {
+	if (!trace::enabled()) {
+		gm.flashMessage(_("Tracing is not enabled"));
+		return;
+	}
+	fs::path filename;
+	for (unsigned i = 1; i < 1000; ++i) {
+		filename = getHomeDir() / ("Performous_trace_" + std::to_string(i) + ".json");
+		if (!fs::exists(filename)) break;
+	}
+	try {
+		trace::writeChromeTrace(filename);
+		std::clog << "trace/info: Saved " << filename << std::endl;
+		gm.flashMessage(_("Trace saved!"));
+	} catch (std::exception& e) {
+		std::clog << "trace/error: " << e.what() << std::endl;
+		gm.flashMessage(_("Saving trace failed!"));
+	}
+}
+
 static void checkEvents(Game& gm, Time eventTime) {
 	Window& window = gm.window();
 	SDL_Event event;
@@ -63,6 +93,10 @@ static void checkEvents(Game& gm, Time eventTime) {
 				g_take_screenshot = true;
 				continue; // Already handled here...
 			}
+			if (key == SDL_SCANCODE_F9 && (mod & Platform::shortcutModifier())) {
+				saveTrace(gm);
+				continue; // Already handled here...
+			}
 			if (key == SDL_SCANCODE_F4 && mod & KMOD_ALT) {
 				gm.finished();
 				continue; // Already handled here...
@@ -97,12 +131,16 @@ static void checkEvents(Game& gm, Time eventTime) {
 
 void mainLoop(std::string const& songlist) {
 	Window window{};
+	trace::setThreadName("main");
 
 	Platform platform;
+	// Render the theme while the rest is loading, so that the screens find it in the cache
+	auto svgs = std::async(std::launch::async, prewarmSVG);
 	std::clog << "core/notice: Starting the audio subsystem (errors printed on console may be ignored)." << std::endl;
 	std::clog << "core/info: Loading assets." << std::endl;
 	TranslationEngine localization;
 	TextureLoader m_loader;
+	TextCache textCache;
 	Backgrounds backgrounds;
 	Database database(getConfigDir() / "database.xml");
 	Songs songs(database, songlist);
@@ -131,6 +169,8 @@ void mainLoop(std::string const& songlist) {
 	audio.loadSample("notice.ogg",findFile("notice.ogg"));
 	// Load screens
 	gm.loading(_("Creating screens..."), 0.7f);
+	svgs.get();
+	auto const screensStart = Clock::now();
 	gm.addScreen(std::make_unique<ScreenIntro>(gm, "Intro", audio));
 	gm.addScreen(std::make_unique<ScreenSongs>(gm, "Songs", audio, songs, database));
 	gm.addScreen(std::make_unique<ScreenSing>(gm, "Sing", audio, database, backgrounds));
@@ -143,13 +183,22 @@ void mainLoop(std::string const& songlist) {
 	gm.loading(_("Entering main menu..."), 0.8f);
 	gm.updateScreen();  // exit/enter, any exception is fatal error
 	gm.loading(_("Loading complete!"), 1.0f);
+	std::clog << "core/info: Screens created in " << Seconds(Clock::now() - screensStart).count() << " s." << std::endl;
 	// Main loop
 	auto time = Clock::now();
 	unsigned frames = 0;
+	auto traceReported = Clock::now();
 	std::clog << "core/info: Assets loaded, entering main loop." << std::endl;
 	while (!gm.isFinished()) {
 		Profiler prof("mainloop");
+		TRACE_ZONE("main/frame");
 		bool benchmarking = config["graphic/fps"].b();
+		trace::enable(config["game/trace"].b());
+		if (trace::enabled() && Clock::now() - traceReported > 10s) {
+			traceReported = Clock::now();
+			std::string const report = trace::report();
+			if (!report.empty()) std::clog << "trace/info: " << report << std::endl;
+		}
 		if (songs.doneLoading == true && songs.displayedAlert == false) {
 			gm.dialog(fmt::format(_("Done Loading!\n Loaded {0} songs."), songs.loadedSongs()));
 			songs.displayedAlert = true;
@@ -167,21 +216,34 @@ void mainLoop(std::string const& songlist) {
 		gm.updateScreen();  // exit/enter, any exception is fatal error
 		if (benchmarking) prof("misc");
 		try {
-			window.blank();
-			// Draw
-			window.render(gm, [&gm]{ gm.drawScreen(); });
-			if (benchmarking) { glFinish(); prof("draw"); }
-			// Display (and wait until next frame)
-			window.swap();
-			if (benchmarking) { glFinish(); prof("swap"); }
-			updateTextures();
-			gm.prepareScreen();
-			if (benchmarking) { glFinish(); prof("textures"); }
+			{
+				TRACE_ZONE("main/draw");
+				window.blank();
+				// Draw
+				window.render(gm, [&gm]{ gm.drawScreen(); });
+				if (benchmarking) { glFinish(); prof("draw"); }
+			}
+			{
+				TRACE_ZONE("main/swap");
+				// Display (and wait until next frame)
+				window.swap();
+				if (benchmarking) { glFinish(); prof("swap"); }
+			}
+			{
+				TRACE_ZONE("main/prepare");
+				updateTextures();
+				TextCache::endFrame();
+				gm.prepareScreen();
+				if (benchmarking) { glFinish(); prof("textures"); }
+			}
 			if (benchmarking) {
 				++frames;
 				if (Clock::now() - time > 1s) {
+					auto const draws = std::exchange(glutil::drawStats(), glutil::DrawStats());
 					std::ostringstream oss;
-					oss << frames << " FPS";
+					oss << frames << " FPS, " << draws.draws / std::max(frames, 1u) << " draws and "
+					  << (draws.bytes / std::max(frames, 1u) + 512) / 1024 << " KiB of vertices per frame";
+					std::clog << "video/info: " << oss.str() << ", " << draws.orphans << " vertex buffer renewals" << std::endl;
 					gm.flashMessage(oss.str());
 					time += 1s;
 					frames = 0;
@@ -193,9 +255,11 @@ void mainLoop(std::string const& songlist) {
 			}
 			if (benchmarking) prof("fpsctrl");
 			// Process events for the next frame
+			TRACE_ZONE("main/events");
 			auto eventTime = Clock::now();
 			gm.controllers.process(eventTime);
 			checkEvents(gm, eventTime);
+			audio.publishParams();  // Volume changes etc. reach the audio callback
 			if (benchmarking) prof("events");
 			} catch (RUNTIME_ERROR& e) {
 				std::cerr << "ERROR: " << e.what() << std::endl;
@@ -292,6 +356,22 @@ int main(int argc, char** argv) try {
 	  ("audio", po::value<std::vector<std::string> >(&devices)->composing(), "specify an audio device to use")
 	  ("audiohelp", "print audio related information")
 	  ("jstest", "utility to get joystick button mappings");
+	po::options_description opt4("Benchmark options");
+	std::string benchSong, benchReport, benchTrace;
+	std::vector<std::string> benchMics;
+	double benchSpeed = 1.0;
+	opt4.add_options()
+	  ("bench", po::value<std::string>(&benchSong), "play the song file without a window or sound card and report timings as JSON")
+	  ("bench-mic", po::value<std::vector<std::string> >(&benchMics)->composing(), "audio file to sing into a virtual microphone (repeat for more singers)")
+	  ("bench-speed", po::value<double>(&benchSpeed), "playback speed relative to real time, 0 for as fast as possible (default 1)")
+	  ("bench-report", po::value<std::string>(&benchReport), "write the JSON report to a file instead of standard output")
+	  ("bench-trace", po::value<std::string>(&benchTrace), "also write a Chrome trace of the run to a file");
+	po::options_description opt5("Library analysis options");
+	AnalyzeOptions analyze;
+	opt5.add_options()
+	  ("analyze-library", "measure duration, loudness, beats and first vocal of all songs into the song cache, then quit (resumes interrupted runs)")
+	  ("analyze-threads", po::value<unsigned>(&analyze.threads), "songs analyzed at once (default: one per CPU core)")
+	  ("analyze-force", "also analyze the songs that have been analyzed before");
 	po::options_description opt3("Hidden options");
 	opt3.add_options()
 	  ("songdir", po::value<std::vector<std::string> >(&songdirs)->composing(), "");
@@ -299,7 +379,7 @@ int main(int argc, char** argv) try {
 	po::positional_options_description p;
 	p.add("songdir", -1);
 	po::options_description cmdline;
-	cmdline.add(opt1).add(opt2);
+	cmdline.add(opt1).add(opt2).add(opt4).add(opt5);
 	po::variables_map vm;
 	// Load the arguments
 	try {
@@ -312,6 +392,11 @@ int main(int argc, char** argv) try {
 		return EXIT_FAILURE;
 	}
 	po::notify(vm);
+	if (!(benchSpeed >= 0.0)) {  // Also NaN
+		std::cerr << cmdline << std::endl;
+		std::cerr << "ERROR: --bench-speed must be 0 (as fast as possible) or more, not " << benchSpeed << std::endl;
+		return EXIT_FAILURE;
+	}
 
 	if (vm.count("version")) {
 		std::cout << PACKAGE " " VERSION << std::endl;
@@ -345,6 +430,31 @@ int main(int argc, char** argv) try {
 	confOverride(songdirs, "paths/songs");
 	confOverride(devices, "audio/devices");
 	getPaths(); // Initialize paths before other threads start
+	if (vm.count("bench")) { // Headless benchmark
+		BenchOptions options;
+		options.song = benchSong;
+		for (auto const& mic: benchMics) options.mics.emplace_back(mic);
+		options.speed = benchSpeed;
+		options.report = benchReport;
+		options.trace = benchTrace;
+		try {
+			runBench(options);
+		} catch (EXCEPTION& e) {
+			std::cerr << "ERROR: " << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	if (vm.count("analyze-library")) { // Headless library analysis
+		analyze.force = vm.count("analyze-force") > 0;
+		try {
+			analyzeLibrary(analyze);
+		} catch (EXCEPTION& e) {
+			std::cerr << "ERROR: " << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 	if (vm.count("jstest")) { // Joystick test program
 		std::clog << "core/notice: Starting jstest input test utility." << std::endl;
 		std::cout << std::endl << "Joystick utility - Touch your joystick to see buttons here" << std::endl
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/// Settings read by the audio callback. Published as a whole by the UI thread, so the callback never looks up config.
+struct MixParams {
+	float musicVolume = 0.9f;  ///< audio/music_volume as a gain factor
+	float previewVolume = 0.7f;  ///< audio/preview_volume as a gain factor
+	float failVolume = 0.9f;  ///< audio/fail_volume as a gain factor
+	bool passThrough = false;  ///< audio/pass-through
+	float passThroughRatio = 2.0f;  ///< audio/pass-through_ratio
+
+	bool operator==(MixParams const& other) const {
+		return musicVolume == other.musicVolume && previewVolume == other.previewVolume && failVolume == other.failVolume
+		  && passThrough == other.passThrough && passThroughRatio == other.passThroughRatio;
+	}
+	bool operator!=(MixParams const& other) const { return !(*this == other); }
+};
+
+/**
+* Scratch buffer used for mixing inside the audio callback.
+* The storage is allocated once when the stream is opened, so that the callback itself never touches the heap.
+* Blocks larger than the bus are processed in several passes (see process).
+**/
+class MixBus {
+  public:
+	explicit MixBus(std::size_t samples = 0): m_buf(samples & ~std::size_t(1)) {}
+	/// Maximum number of samples (not frames) available for one mixing pass. Always even (stereo).
+	std::size_t capacity() const { return m_buf.size(); }
+	/// Get the bus zeroed for the given number of samples (must not exceed capacity).
+	float* clear(std::size_t samples) {
+		std::fill_n(m_buf.data(), samples, 0.0f);
+		return m_buf.data();
+	}
+	/// Call func(chunkBegin, chunkEnd) for consecutive pieces of [begin, end) no larger than the bus.
+	template <typename Func> void process(float* begin, float* end, Func&& func) {
+		if (capacity() == 0) return;
+		while (begin < end) {
+			float* chunkEnd = begin + std::min<std::ptrdiff_t>(end - begin, static_cast<std::ptrdiff_t>(capacity()));
+			func(begin, chunkEnd);
+			begin = chunkEnd;
+		}
+	}
+
+  private:
+	std::vector<float> m_buf;
+};
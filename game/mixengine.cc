@@ -0,0 +1,60 @@
+#include "mixengine.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace {
+	/// Profiler zone of a stem. Zones live as long as the program, so there is one per stem name.
+	trace::Site& stemSite(std::string const& name) {
+		static std::mutex mutex;
+		static std::map<std::string, std::unique_ptr<trace::Site>> sites;
+		std::lock_guard<std::mutex> l(mutex);
+		auto it = sites.find(name);
+		if (it == sites.end()) {
+			it = sites.emplace(name, nullptr).first;
+			it->second = std::make_unique<trace::Site>(it->first.c_str());  // The key stays in place
+		}
+		return *it->second;
+	}
+}
+
+MixEngine::MixEngine(std::size_t blockFrames, da::mix_kernels::Kernel kernel): m_block(std::max<std::size_t>(blockFrames, 1)), m_kernel(kernel) {}
+
+std::size_t MixEngine::addStem(std::string const& name, float gain) {
+	GainRamp ramp;
+	ramp.gain = ramp.target = gain;
+	m_stems.push_back({ name, ramp, &stemSite("audio/stem/" + name) });
+	return m_stems.size() - 1;
+}
+
+bool MixEngine::fade(float* out, float const* mix, std::size_t frames, float volume) {
+	// Frame k gets fadeLevel + (k + 1) * fadeRate, up to 1
+	double const start = fadeLevel;
+	std::size_t ramped = frames;  // Frames before the fade ends
+	bool ended = false;
+	if (fadeRate > 0.0) ramped = static_cast<std::size_t>(std::clamp(std::floor((1.0 - start) / fadeRate), 0.0, double(frames)));
+	else {
+		// Frames that still have a positive level
+		double const left = fadeRate < 0.0 ? std::ceil(start / -fadeRate) - 1.0 : start > 0.0 ? double(frames) : 0.0;
+		if (left < double(frames)) {
+			ramped = static_cast<std::size_t>(std::max(left, 0.0));
+			ended = true;
+		}
+	}
+	m_kernel.stereo(out, mix, ramped, static_cast<float>((start + fadeRate) * volume), static_cast<float>(fadeRate * volume));
+	fadeLevel = start + double(ramped) * fadeRate;
+	if (ended) {
+		fadeLevel = 0.0;
+		return false;
+	}
+	if (ramped < frames) {
+		// Faded in
+		m_kernel.stereo(out + 2 * ramped, mix + 2 * ramped, frames - ramped, volume, 0.0f);
+		fadeLevel = 1.0;
+		fadeRate = 0.0;
+	}
+	return true;
+}
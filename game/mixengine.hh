@@ -0,0 +1,98 @@
+#pragma once
+
+#include "libda/mix.hpp"
+#include "mixbus.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// Gain that glides linearly to its target over one block, so that changes do not click
+struct GainRamp {
+	/// Gain of the first frame of a block and its change per frame
+	struct Ramp {
+		float gain;
+		float step;
+	};
+	float gain = 1.0f;
+	float target = 1.0f;
+	/// The ramp for the next block of frames, reaching the target at its end
+	Ramp next(std::size_t frames) {
+		Ramp r{ gain, frames > 0 ? (target - gain) / static_cast<float>(frames) : 0.0f };
+		if (frames > 0) gain = target;
+		return r;
+	}
+};
+
+/**
+* Mixes the stems of a song (e.g. the separate instruments of Rock Band songs) into the output, a block at a time.
+*
+* Each stem has a gain that ramps to the value set by setGain over the next block, and the whole mix has a fade
+* level that changes linearly by fadeRate per frame. The stems are summed to the MixBus with SIMD kernels (see
+* libda/mix.hpp), optionally center-cancelled, and added to the output at the fade level and volume. The time
+* spent on each stem goes to the profiler as the zone audio/stem/<name>.
+**/
+class MixEngine {
+  public:
+	static constexpr std::size_t DEFAULT_BLOCK = 256;  ///< Frames
+
+	/// @param blockFrames frames mixed at a time (also limited by the bus), for the smoothness of gain ramps against overhead
+	explicit MixEngine(std::size_t blockFrames = DEFAULT_BLOCK, da::mix_kernels::Kernel kernel = da::mix_kernels::best());
+
+	std::size_t blockFrames() const { return m_block; }
+	/// Add a stem (not from the audio callback) and return its index
+	std::size_t addStem(std::string const& name, float gain = 1.0f);
+	std::size_t stems() const { return m_stems.size(); }
+	std::string const& name(std::size_t stem) const { return m_stems[stem].name; }
+	/// Set the gain that the stem ramps to during the next block
+	void setGain(std::size_t stem, float gain) { m_stems[stem].gain.target = gain; }
+	/// The gain that the stem has reached
+	float gain(std::size_t stem) const { return m_stems[stem].gain.gain; }
+	/// Callback time of the stem, as measured by the profiler while it is enabled (of all stems that had the name)
+	trace::Histogram::Summary cost(std::size_t stem) const { return m_stems[stem].site->histogram.summary(); }
+
+	bool centerCancel = false;  ///< Suppress the center channel (usually vocals) of the mix
+	double fadeLevel = 0.0;  ///< Gain of the whole mix, stopping at 1
+	double fadeRate = 0.0;  ///< Change of fadeLevel per frame; fading out ends the mix when fadeLevel reaches 0
+
+	/**
+	* Add the mix to [begin, end) (interleaved stereo) at volume, using bus for scratch space.
+	* read(stem, mix, samples, offset, ramp) must add the samples of the stem starting offset samples from begin to
+	* mix, with the gain of frame k being ramp.gain + k * ramp.step, and return whether the stem has audio left.
+	* Returns false when no stem has audio left or when the fade out is complete.
+	**/
+	template <typename Read> bool mix(float* begin, float* end, MixBus& bus, float volume, Read&& read);
+
+  private:
+	struct Stem {
+		std::string name;
+		GainRamp gain;
+		trace::Site* site;
+	};
+	/// Add frames of mix to out with the fade level, returning false if the fade out ended (partway)
+	bool fade(float* out, float const* mix, std::size_t frames, float volume);
+
+	std::size_t m_block;
+	da::mix_kernels::Kernel m_kernel;
+	std::vector<Stem> m_stems;
+};
+
+template <typename Read> bool MixEngine::mix(float* begin, float* end, MixBus& bus, float volume, Read&& read) {
+	std::size_t const blockSamples = std::min(2 * m_block, bus.capacity());
+	if (blockSamples == 0) return false;
+	bool playing = false;
+	for (float* out = begin; out < end; out += blockSamples) {
+		std::size_t const samples = std::min(static_cast<std::size_t>(end - out), blockSamples);
+		std::size_t const frames = samples / 2;
+		float* mix = bus.clear(samples);
+		for (std::size_t s = 0; s < m_stems.size(); ++s) {
+			trace::Zone zone(*m_stems[s].site);
+			if (read(s, mix, samples, static_cast<std::size_t>(out - begin), m_stems[s].gain.next(frames))) playing = true;
+		}
+		if (centerCancel) m_kernel.centerCancel(mix, frames);
+		if (!fade(out, mix, frames, volume)) return false;
+	}
+	return playing;
+}
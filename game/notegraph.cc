@@ -32,36 +32,40 @@ void NoteGraph::reset() {
 }
 
 namespace {
-	void drawNotebar(Window& window, Texture const& texture, float x, float ybeg, float yend, float w, float h_x, float h_y) {
-		glutil::VertexArray va;
-		UseTexture tblock(window, texture);
-
+	/// Add a note bar to va as a strip of its own, with the given alpha
+	void addNotebar(glutil::VertexArray& va, float alpha, float x, float ybeg, float yend, float w, float h_x, float h_y) {
+		glmath::vec4 const c(1.0f, 1.0f, 1.0f, alpha);
+		va.split();
 		// The front cap begins
-		va.texCoord(0.0f, 0.0f).vertex(x, ybeg);
-		va.texCoord(0.0f, 1.0f).vertex(x, ybeg + h_y);
+		va.texCoord(0.0f, 0.0f).color(c).vertex(x, ybeg);
+		va.texCoord(0.0f, 1.0f).color(c).vertex(x, ybeg + h_y);
 		if (w >= 2.0f * h_x) {
 			// Calculate the y coordinates of the middle part
 			float tmp = h_x / w;  // h_x = cap size (because it is a h_x by h_x square)
 			float y1 = (1.0f - tmp) * ybeg + tmp * yend;
 			float y2 = tmp * ybeg + (1.0f - tmp) * yend;
 			// The middle part between caps
-			va.texCoord(0.5f, 0.0f).vertex(x + h_x, y1);
-			va.texCoord(0.5f, 1.0f).vertex(x + h_x, y1 + h_y);
-			va.texCoord(0.5f, 0.0f).vertex(x + w - h_x, y2);
-			va.texCoord(0.5f, 1.0f).vertex(x + w - h_x, y2 + h_y);
+			va.texCoord(0.5f, 0.0f).color(c).vertex(x + h_x, y1);
+			va.texCoord(0.5f, 1.0f).color(c).vertex(x + h_x, y1 + h_y);
+			va.texCoord(0.5f, 0.0f).color(c).vertex(x + w - h_x, y2);
+			va.texCoord(0.5f, 1.0f).color(c).vertex(x + w - h_x, y2 + h_y);
 		} else {
 			// Note is too short to even fit caps, crop to fit.
 			float ymid = 0.5f * (ybeg + yend);
 			float crop = 0.25f * w / h_x;
-			va.texCoord(crop, 0.0f).vertex(x + 0.5f * w, ymid);
-			va.texCoord(crop, 1.0f).vertex(x + 0.5f * w, ymid + h_y);
-			va.texCoord(1.0f - crop, 0.0f).vertex(x + 0.5f * w, ymid);
-			va.texCoord(1.0f - crop, 1.0f).vertex(x + 0.5f * w, ymid + h_y);
+			va.texCoord(crop, 0.0f).color(c).vertex(x + 0.5f * w, ymid);
+			va.texCoord(crop, 1.0f).color(c).vertex(x + 0.5f * w, ymid + h_y);
+			va.texCoord(1.0f - crop, 0.0f).color(c).vertex(x + 0.5f * w, ymid);
+			va.texCoord(1.0f - crop, 1.0f).color(c).vertex(x + 0.5f * w, ymid + h_y);
 		}
 		// The rear cap ends
-		va.texCoord(1.0f, 0.0f).vertex(x + w, yend);
-		va.texCoord(1.0f, 1.0f).vertex(x + w, yend + h_y);
+		va.texCoord(1.0f, 0.0f).color(c).vertex(x + w, yend);
+		va.texCoord(1.0f, 1.0f).color(c).vertex(x + w, yend + h_y);
+	}
 
+	void drawNotebars(Window& window, Texture const& texture, glutil::VertexArray& va) {
+		if (va.empty()) return;
+		UseTexture tblock(window, texture);
 		va.draw();
 	}
 }
@@ -150,16 +154,16 @@ void NoteGraph::drawNotes(Window& window) {
 	for (auto it = m_songit; it != m_vocal.notes.end() && it->begin < m_time - (baseLine - 0.5f) / pixUnit; ++it) {
 		if (it->type == Note::Type::SLEEP) continue;
 		float alpha = it->power;
-		Texture* t1;
-		Texture* t2;
+		glutil::VertexArray* va1;
+		glutil::VertexArray* va2;
 		switch (it->type) {
 			case Note::Type::NORMAL:
 			case Note::Type::SLIDE:
-				t1 = &m_notebar; t2 = &m_notebar_hl;
+				va1 = &bars; va2 = &barsHl;
 			break;
 			case Note::Type::GOLDEN:
 			case Note::Type::GOLDENRAP: //fallthrough
-				t1 = &m_notebargold; t2 = &m_notebargold_hl;
+				va1 = &gold; va2 = &goldHl;
 			break;
 			case Note::Type::FREESTYLE:  // Freestyle notes use custom handling
 			case Note::Type::RAP: //handle RAP notes like freestyle for now
@@ -191,12 +195,13 @@ void NoteGraph::drawNotes(Window& window) {
 		float w = static_cast<float>(it->end - it->begin) * pixUnit - m_noteUnit * 2.0f; // width: including borders on both sides
 		float h_x = -m_noteUnit * 2.0f; // height: 0.5 border + 1.0 bar + 0.5 border = 2.0
 		float h_y = h_x * bar_height; //
-		drawNotebar(window, *t1, x, ybeg, yend, w, h_x, h_y);
-		if (alpha > 0.0f) {
-			ColorTrans c(window, Color::alpha(alpha));
-			drawNotebar(window, *t2, x, ybeg, yend, w, h_x, h_y);
-		}
+		addNotebar(*va1, 1.0f, x, ybeg, yend, w, h_x, h_y);
+		if (alpha > 0.0f) addNotebar(*va2, alpha, x, ybeg, yend, w, h_x, h_y);
 	}
+	drawNotebars(window, m_notebar, bars);
+	drawNotebars(window, m_notebargold, gold);
+	drawNotebars(window, m_notebar_hl, barsHl);
+	drawNotebars(window, m_notebargold_hl, goldHl);
 }
 
 float NoteGraph::barHeight() {
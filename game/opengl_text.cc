@@ -39,18 +39,19 @@ void loadFonts() {
 	}
 }
 
-OpenGLText::OpenGLText(std::string const& text, std::unique_ptr<Texture>& texture, float width, float height)
-: m_text(text), m_texture(std::move(texture)), m_width(width), m_height(height) {
+OpenGLText::OpenGLText(std::string const& text, std::shared_ptr<Texture> texture, float width, float height)
+: m_text(text), m_texture(std::move(texture)), m_dimensions(Dimensions(m_texture->width() / m_texture->height()).fixedWidth(1.0f)), m_width(width), m_height(height) {
 }
 
 OpenGLText::OpenGLText(OpenGLText&& other)
-: m_text(std::move(other.m_text)), m_texture(std::move(other.m_texture)), m_width(other.m_width), m_height(other.m_height) {
+: m_text(std::move(other.m_text)), m_texture(std::move(other.m_texture)), m_dimensions(other.m_dimensions), m_width(other.m_width), m_height(other.m_height) {
 	other.m_width = other.m_height = 0.f;
 }
 
 OpenGLText& OpenGLText::operator=(OpenGLText&& other) {
 	m_text = std::move(other.m_text);
 	m_texture = std::move(other.m_texture);
+	m_dimensions = other.m_dimensions;
 	m_width = other.m_width;
 	m_height = other.m_height;
 
@@ -60,10 +61,13 @@ OpenGLText& OpenGLText::operator=(OpenGLText&& other) {
 }
 
 void OpenGLText::draw(Window& window) {
+	m_texture->dimensions = m_dimensions;
+	m_texture->tex = TexCoords();
 	m_texture->draw(window);
 }
 
 void OpenGLText::draw(Window& window, Dimensions &_dim, TexCoords &_tex) {
+	m_dimensions = _dim;
 	m_texture->dimensions = _dim;
 	m_texture->tex = _tex;
 	m_texture->draw(window);
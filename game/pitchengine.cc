@@ -0,0 +1,286 @@
+#include "pitchengine.hh"
+
+#include "libda/fft.hpp"
+#include "util.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	/// Harmonic analysis of a Hamming windowed spectrum, with frequencies refined by the phase change over a step
+	class FftPitchEngine: public PitchEngine {
+	  public:
+		FftPitchEngine(double rate, unsigned step): m_rate(rate), m_step(step), m_window(FFT_N), m_fft(decltype(m_fftEngine)::BINS), m_fftLastPhase(FFT_N / 2) {
+			// Hamming window
+			for (size_t i=0; i < FFT_N; i++) {
+				m_window[i] = static_cast<float>(0.53836 - 0.46164 * std::cos(TAU * static_cast<double>(i) / (FFT_N - 1)));
+			}
+		}
+		Type type() const override { return Type::FFT; }
+		std::size_t window() const override { return FFT_N; }
+		std::vector<std::complex<float>> const& spectrum() const override { return m_fft; }
+		void analyze(float const* pcm, std::list<Tone>& tones) override;
+
+	  private:
+		// Limit the range to avoid noise and useless computation
+		static constexpr double MINFREQ = 45.0;
+		static constexpr double MAXFREQ = 5000.0;
+
+		struct Peak {
+			double freq;
+			double db;
+			Peak(double _freq = 0.0, double _db = -getInf()):
+			  freq(_freq), db(_db) {}
+			void clear() {
+				freq = 0.0;
+				db = -getInf();
+			}
+		};
+
+		static Peak& match(std::vector<Peak>& peaks, std::size_t pos) {
+			std::size_t best = pos;
+			if (peaks[pos - 1].db > peaks[best].db) best = pos - 1;
+			if (peaks[pos + 1].db > peaks[best].db) best = pos + 1;
+			return peaks[best];
+		}
+
+		double m_rate;
+		unsigned m_step;
+		std::vector<float> m_window;
+		da::RealFFT<FFT_P> m_fftEngine;
+		std::vector<std::complex<float>> m_fft;  ///< Output of m_fftEngine, allocated once
+		std::vector<float> m_fftLastPhase;
+	};
+
+	void FftPitchEngine::analyze(float const* pcm, std::list<Tone>& tones) {
+		m_fftEngine(pcm, m_window, m_fft.data());
+		// Precalculated constants
+		const double freqPerBin = m_rate / FFT_N;
+		const double stepRate = m_rate / m_step;  // Steps per second
+		const double phaseStep = double(m_step) / FFT_N;
+		const double normCoeff = 1.0 / FFT_N;
+		const double minMagnitude = pow(10, -80.0 / 20.0) / normCoeff; // -80 dB
+		// Limit frequency range of processing
+		const size_t kMin = std::max(size_t(1), size_t(MINFREQ / freqPerBin));
+		const size_t kMax = std::min(FFT_N / 2, size_t(MAXFREQ / freqPerBin));
+		std::vector<Peak> peaks(kMax + 1); // One extra to simplify loops
+		for (size_t k = 1; k <= kMax; ++k) {
+			double magnitude = std::abs(m_fft[k]);
+			double phase = std::arg(m_fft[k]) / TAU;
+			double delta = phase - m_fftLastPhase[k];
+			m_fftLastPhase[k] = static_cast<float>(phase);
+			// Use phase difference over a step to calculate what the frequency must be
+			double freq = stepRate * (std::round(static_cast<double>(k) * phaseStep - delta) + delta);
+			if (freq > 1.0 && magnitude > minMagnitude) {
+				peaks[k].freq = freq;
+				peaks[k].db = 20.0 * log10(normCoeff * magnitude);
+			}
+		}
+		// Prefilter peaks
+		double prevdb = peaks[0].db;
+		for (size_t k = 1; k < kMax; ++k) {
+			double db = peaks[k].db;
+			if (db > prevdb) peaks[k - 1].clear();
+			if (db < prevdb) peaks[k].clear();
+			prevdb = db;
+		}
+		// Find the tones (collections of harmonics) from the array of peaks
+		for (size_t k = kMax - 1; k >= kMin; --k) {
+			if (peaks[k].db < -60.0) continue;
+			// Find the best divider for getting the fundamental from peaks[k]
+			std::size_t bestDiv = 1;
+			int bestScore = 0;
+			for (std::size_t div = 2; div <= Tone::MAXHARM && k / div > 1; ++div) {
+				double freq = peaks[k].freq / static_cast<double>(div); // Fundamental
+				int score = 0;
+				for (std::size_t n = 1; n < div && n < 8; ++n) {
+					Peak& p = match(peaks, k * n / div);
+					--score;
+					if (p.db < -80.0 || std::abs(p.freq / static_cast<double>(n) / freq - 1.0) > .03) continue;
+					if (n == 1) score += 4; // Extra for fundamental
+					score += 2;
+				}
+				if (score > bestScore) {
+					bestScore = score;
+					bestDiv = div;
+				}
+			}
+			// Construct a Tone by combining the fundamental frequency (freq) and all harmonics
+			Tone t;
+			std::size_t count = 0;
+			double freq = peaks[k].freq / static_cast<double>(bestDiv);
+			t.db = peaks[k].db;
+			for (std::size_t n = 1; n <= bestDiv; ++n) {
+				// Find the peak for n'th harmonic
+				Peak& p = match(peaks, k * n / bestDiv);
+				if (std::abs(p.freq / static_cast<double>(n) / freq - 1.0) > .03) continue; // Does it match the fundamental freq?
+				if (p.db > t.db - 10.0) {
+					t.db = std::max(t.db, p.db);
+					++count;
+					t.freq += p.freq / static_cast<double>(n);
+				}
+				t.harmonics[n - 1] = p.db;
+				p.clear();
+			}
+			t.freq /= static_cast<double>(count);
+			// If the tone seems strong enough, add it (-3 dB compensation for each harmonic)
+			if (t.db > -40.0 - 3.0 * static_cast<double>(count)) {
+				t.stabledb = t.db;
+				tones.push_back(t);
+			}
+		}
+	}
+
+	/**
+	* McLeod pitch method (McLeod & Wyvill, "A smarter way to find pitch", 2005).
+	*
+	* The normalized square difference function nsdf(lag) = 2 r(lag) / m(lag) is 1 at lags where the waveform repeats
+	* itself exactly, whatever the harmonics are, so a single unwindowed frame gives a precise period even for
+	* low voices (the FFT engine has bins 47 Hz apart). The autocorrelation r is computed with FFTs of the frame
+	* padded to twice its length: the inverse transform of the power spectrum, which is real and even, is its
+	* forward transform.
+	*
+	* The newest half of the frame is analyzed first, and the whole frame only if that finds no period that fits in
+	* it twice (lower voices). Higher voices are thus found as soon as they have sung for half a frame, and more
+	* cheaply. Only the dominant tone is reported, at the level of the frame.
+	**/
+	class MpmPitchEngine: public PitchEngine {
+	  public:
+		MpmPitchEngine(double rate): m_rate(rate), m_ones(2 * FFT_N, 1.0f), m_frame(2 * FFT_N), m_spectrum(FFT_N + 1),
+		  m_power(2 * FFT_N), m_nsdf(FFT_N) {}
+		Type type() const override { return Type::MPM; }
+		std::size_t window() const override { return FFT_N; }
+		void analyze(float const* pcm, std::list<Tone>& tones) override;
+
+	  private:
+		static constexpr double MAXFREQ = 1500.0;
+		static constexpr double CUTOFF = 0.93;  ///< The first peak this close to the highest one is the period
+		static constexpr double MINCLARITY = 0.6;  ///< Weaker peaks are noise or several voices
+		static constexpr double SURE = 0.9;  ///< Clarity of a tone that needs no confirmation by the following frames
+		static constexpr double MINDB = -50.0;
+
+		struct Period {
+			double samples = 0.0;  ///< 0 if there is none
+			double clarity = 0.0;  ///< nsdf at the period
+			double db = -getInf();  ///< Level of the samples
+		};
+		/// Period of the M samples at pcm
+		template <unsigned P> Period period(da::RealFFT<P> const& fft, float const* pcm);
+
+		double m_rate;
+		std::vector<float> m_ones;  ///< Rectangular window
+		std::vector<float> m_frame;  ///< Frame without DC, zero padded to the FFT size
+		da::RealFFT<FFT_P> m_fftHalf;  ///< For the newest half of the frame
+		da::RealFFT<FFT_P + 1> m_fftFull;
+		std::vector<std::complex<float>> m_spectrum;
+		std::vector<float> m_power;  ///< Power spectrum, mirrored to the full FFT size
+		std::vector<double> m_nsdf;
+	};
+
+	template <unsigned P> MpmPitchEngine::Period MpmPitchEngine::period(da::RealFFT<P> const& fft, float const* pcm) {
+		constexpr std::size_t n = da::RealFFT<P>::M;  // Samples, zero padded to twice that
+		constexpr std::size_t lags = 3 * n / 4;  // Enough overlap is left for a reliable nsdf
+		double mean = 0.0;
+		for (std::size_t i = 0; i < n; ++i) mean += pcm[i];
+		mean /= n;
+		double energy = 0.0;
+		for (std::size_t i = 0; i < n; ++i) {
+			float const s = static_cast<float>(pcm[i] - mean);
+			m_frame[i] = s;
+			energy += double(s) * s;
+		}
+		std::fill(m_frame.begin() + n, m_frame.begin() + 2 * n, 0.0f);
+		Period ret;
+		ret.db = 10.0 * std::log10(energy / n);
+		if (!(ret.db > MINDB)) return ret;
+		// Autocorrelation r(lag) * 2n as the real part of the transform of the power spectrum
+		fft(m_frame.data(), m_ones, m_spectrum.data());
+		for (std::size_t k = 0; k <= n; ++k) m_power[k] = std::norm(m_spectrum[k]);
+		for (std::size_t k = 1; k < n; ++k) m_power[2 * n - k] = m_power[k];
+		fft(m_power.data(), m_ones, m_spectrum.data());
+		double const scale = 1.0 / (2 * n);
+		// m(lag) is the energy of both overlapping parts, shrinking as the lag grows
+		double m = 2.0 * energy;
+		for (std::size_t lag = 0; lag < lags; ++lag) {
+			if (lag > 0) {
+				double const a = m_frame[lag - 1], b = m_frame[n - lag];
+				m -= a * a + b * b;
+			}
+			m_nsdf[lag] = m > 0.0 ? 2.0 * scale * m_spectrum[lag].real() / m : 0.0;
+		}
+		// Key maxima: the highest point between each upward and downward zero crossing, after the first downward one
+		std::size_t const minLag = std::max<std::size_t>(2, static_cast<std::size_t>(m_rate / MAXFREQ));
+		std::size_t lag = 1;
+		while (lag < lags && m_nsdf[lag] > 0.0) ++lag;
+		std::size_t best = 0;
+		double highest = 0.0;
+		struct Key { std::size_t lag; double value; };
+		Key keys[64];
+		std::size_t keyCount = 0;
+		while (lag < lags) {
+			while (lag < lags && m_nsdf[lag] <= 0.0) ++lag;
+			std::size_t top = lag;
+			while (lag < lags && m_nsdf[lag] > 0.0) {
+				if (m_nsdf[lag] > m_nsdf[top]) top = lag;
+				++lag;
+			}
+			// Peaks cut off by the end of the range are not trusted
+			if (top >= lags - 1 || top < minLag || keyCount == std::size(keys)) continue;
+			keys[keyCount++] = { top, m_nsdf[top] };
+			highest = std::max(highest, m_nsdf[top]);
+		}
+		for (std::size_t i = 0; i < keyCount && !best; ++i) {
+			if (keys[i].value >= CUTOFF * highest) best = keys[i].lag;
+		}
+		if (!best || m_nsdf[best] < MINCLARITY) return ret;
+		// Parabolic interpolation of the peak
+		double const a = m_nsdf[best - 1], b = m_nsdf[best], c = m_nsdf[best + 1];
+		double const denom = a - 2.0 * b + c;
+		ret.samples = static_cast<double>(best) + (denom < 0.0 ? 0.5 * (a - c) / denom : 0.0);
+		ret.clarity = b;
+		return ret;
+	}
+
+	void MpmPitchEngine::analyze(float const* pcm, std::list<Tone>& tones) {
+		Period p = period(m_fftHalf, pcm + FFT_N / 2);
+		// A longer period could be a multiple of it that only the whole frame shows
+		if (p.samples == 0.0 || p.samples > 3 * FFT_N / 16) p = period(m_fftFull, pcm);
+		if (p.samples == 0.0) return;
+		Tone t;
+		t.freq = m_rate / p.samples;
+		t.db = p.db;
+		t.stabledb = p.db;
+		t.harmonics[0] = p.db;
+		if (p.clarity >= SURE) t.age = Tone::MINAGE;
+		tones.push_back(t);
+	}
+}
+
+std::vector<std::complex<float>> const& PitchEngine::spectrum() const {
+	static const std::vector<std::complex<float>> none;
+	return none;
+}
+
+char const* PitchEngine::name(Type type) {
+	switch (type) {
+		case Type::FFT: return "fft";
+		case Type::MPM: return "mpm";
+	}
+	throw std::logic_error("Internal error: unknown type in PitchEngine::name");
+}
+
+PitchEngine::Type PitchEngine::parse(std::string const& name) {
+	for (Type type: { Type::FFT, Type::MPM }) {
+		if (name == PitchEngine::name(type)) return type;
+	}
+	throw std::invalid_argument("Unknown pitch engine \"" + name + "\"");
+}
+
+std::unique_ptr<PitchEngine> PitchEngine::create(Type type, double rate, unsigned step) {
+	switch (type) {
+		case Type::FFT: return std::make_unique<FftPitchEngine>(rate, step);
+		case Type::MPM: return std::make_unique<MpmPitchEngine>(rate);
+	}
+	throw std::logic_error("Internal error: unknown type in PitchEngine::create");
+}
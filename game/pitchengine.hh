@@ -0,0 +1,42 @@
+#pragma once
+
+#include "tone.hh"
+
+#include <complex>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const unsigned FFT_P = 10;
+static const std::size_t FFT_N = 1 << FFT_P;  ///< Samples per frame of the pitch engines
+
+/**
+* Finds the tones in one frame of microphone input, for Analyzer.
+*
+* Analyzer feeds each engine windows of window() samples that are Analyzer's step apart (the newest sample last)
+* and takes care of levels, tracking tones over frames and choosing the sung tone.
+**/
+class PitchEngine {
+  public:
+	enum class Type {
+		FFT,  ///< Harmonics from the peaks of a spectrum (the original analyzer)
+		MPM  ///< McLeod pitch method: normalized autocorrelation of the waveform
+	};
+	/// Name used in the config (lower case), and the other way around (throws std::invalid_argument)
+	static char const* name(Type type);
+	static Type parse(std::string const& name);
+	static std::unique_ptr<PitchEngine> create(Type type, double rate, unsigned step);
+
+	virtual ~PitchEngine() = default;
+	virtual Type type() const = 0;
+	/// Samples per frame
+	virtual std::size_t window() const = 0;
+	/**
+	* Find the tones of a frame (window() samples) and add them to tones, in any order. A new tone is only used once
+	* it has been found in Tone::MINAGE more frames, unless the engine is sure of it and gives it that age.
+	**/
+	virtual void analyze(float const* pcm, std::list<Tone>& tones) = 0;
+	/// The spectrum of the last frame, if the engine makes one (empty otherwise)
+	virtual std::vector<std::complex<float>> const& spectrum() const;
+};
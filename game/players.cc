@@ -42,6 +42,10 @@ void Players::save(xmlpp::Element *players) {
 	}
 }
 
+void Players::save(DatabaseSnapshot& snapshot) const {
+	for (auto const& p: m_players) snapshot.add(PlayerRecord{ p.id, p.name, p.picture.string() });
+}
+
 void Players::update() {
 	if (m_dirty) filter_internal();
 }
@@ -61,7 +65,7 @@ std::optional<std::string> Players::lookup(const PlayerId& id) const {
 	return it->name;
 }
 
-void Players::addPlayer (std::string const& name, std::string const& picture, std::optional<PlayerId> id) {
+PlayerId Players::addPlayer (std::string const& name, std::string const& picture, std::optional<PlayerId> id) {
 	PlayerItem pi;
 	pi.name = name;
 	pi.picture = picture;
@@ -85,6 +89,7 @@ void Players::addPlayer (std::string const& name, std::string const& picture, st
 		pi.id = assign_id_internal();
 		m_players.insert(pi); // now do the insert with the fresh id
 	}
+	return pi.id;
 }
 
 void Players::setFilter(std::string const& val) {
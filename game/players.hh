@@ -8,6 +8,7 @@
 #include <stdexcept>
 
 
+#include "databasestore.hh"
 #include "player.hh"
 #include "unicode.hh"
 #include "animvalue.hh"
@@ -45,6 +46,7 @@ class Players {
 
 	void load(xmlpp::NodeSet const& n);
 	void save(xmlpp::Element *players);
+	void save(DatabaseSnapshot& snapshot) const;
 
 	void update();
 
@@ -56,8 +58,8 @@ class Players {
 	  */
 	std::optional<std::string> lookup(const PlayerId &id) const;
 
-	/// add a player with a displayed name and an optional picture; if no id is given one will be assigned
-	void addPlayer (std::string const& name, std::string const& picture = "", std::optional<PlayerId> id = std::nullopt);
+	/// add a player with a displayed name and an optional picture; if no id is given (or it is taken) one will be assigned
+	PlayerId addPlayer (std::string const& name, std::string const& picture = "", std::optional<PlayerId> id = std::nullopt);
 
 	/// const array access
 	PlayerItem operator[](unsigned pos) const;
@@ -2,7 +2,10 @@
 #include "unicode.hh"
 #include "game.hh"
 
+#include <algorithm>
 #include <cstdint>
+#include <stdexcept>
+#include <vector>
 
 #ifdef USE_WEBSERVER
 RequestHandler::RequestHandler(Game& game, Songs& songs)
@@ -86,41 +89,29 @@ void RequestHandler::Get(web::http::http_request request)
 		HandleFile(request, findFile("index.html").string());
 	}
 	else if (path == "/api/getDataBase.json") { //get database
-		m_songs.setFilter("");
-		if (query == "sort=artist&order=ascending") {
-			m_songs.sortSpecificChange(2);
-		}
-		else if (query == "sort=artist&order=descending") {
-			m_songs.sortSpecificChange(2, true);
-		}
-		else if (query == "sort=title&order=ascending") {
-			m_songs.sortSpecificChange(1);
-		}
-		else if (query == "sort=title&order=descending") {
-			m_songs.sortSpecificChange(1, true);
-		}
-		else if (query == "sort=language&order=ascending") {
-			m_songs.sortSpecificChange(6);
-		}
-		else if (query == "sort=language&order=descending") {
-			m_songs.sortSpecificChange(6, true);
-		}
-		else if (query == "sort=edition&order=ascending") {
-			m_songs.sortSpecificChange(3);
+		SongListSnapshot::Query songQuery;
+		try {
+			songQuery.parse(query);
 		}
-		else if (query == "sort=edition&order=descending") {
-			m_songs.sortSpecificChange(3, true);
+		catch (std::invalid_argument const& e) {
+			request.reply(web::http::status_codes::BadRequest, e.what());
+			return;
 		}
-		else if (query == "sort=creator&order=ascending") {
-			m_songs.sortSpecificChange(10);
+		ReplySongs(request, songQuery);
+		return;
+	}
+	else if (path == "/api/songs") { // one page of songs, e.g. ?sort=artist&search=queen&offset=100&limit=50&fields=Title,Artist
+		SongListSnapshot::Query songQuery;
+		songQuery.envelope = true;
+		songQuery.limit = 100;
+		try {
+			songQuery.parse(query);
 		}
-		else if (query == "sort=creator&order=descending") {
-			m_songs.sortSpecificChange(10, true);
+		catch (std::invalid_argument const& e) {
+			request.reply(web::http::status_codes::BadRequest, e.what());
+			return;
 		}
-		// make sure to apply the filtering
-		m_songs.update();
-		web::json::value jsonRoot = SongsToJsonObject();
-		request.reply(web::http::status_codes::OK, jsonRoot);
+		ReplySongs(request, songQuery);
 		return;
 	}
 	else if (path == "/api/language") {
@@ -188,7 +179,6 @@ void RequestHandler::Post(web::http::http_request request)
 	}
 
 	if (path == "/api/add") {
-		m_songs.setFilter("");
 		std::shared_ptr<Song> songPointer = GetSongFromJSON(jsonPostBody);
 		if (!songPointer) {
 			auto artist = utility::conversions::to_utf8string(jsonPostBody[utility::conversions::to_string_t("Artist")].as_string());
@@ -264,22 +254,21 @@ void RequestHandler::Post(web::http::http_request request)
 		}
 	}
 	else if (path == "/api/search") {
-		auto query = utility::conversions::to_utf8string(jsonPostBody[utility::conversions::to_string_t("query")].as_string());
-		m_songs.setFilter(query);
-		web::json::value jsonRoot = web::json::value::array();
-		for (size_t i = 0; i < m_songs.size(); i++) {
-			web::json::value songObject = web::json::value::object();
-			songObject[utility::conversions::to_string_t("Title")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->title));
-			songObject[utility::conversions::to_string_t("Artist")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->artist));
-			songObject[utility::conversions::to_string_t("Edition")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->edition));
-			songObject[utility::conversions::to_string_t("Language")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->language));
-			songObject[utility::conversions::to_string_t("Creator")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->creator));
-			songObject[utility::conversions::to_string_t("HasError")] = web::json::value::boolean(m_songs[i]->loadStatus == Song::LoadStatus::ERROR);
-			songObject[utility::conversions::to_string_t("ProvidedBy")] = web::json::value(utility::conversions::to_string_t(m_songs[i]->providedBy));
-			songObject[utility::conversions::to_string_t("Comment")] = web::json::value(utility::conversions::to_string_t(m_songs[i]->comment));
-			jsonRoot[i] = songObject;
+		SongListSnapshot::Query songQuery;
+		songQuery.fields &= ~(1u << static_cast<unsigned>(SongListSnapshot::Field::NAME));
+		try {
+			songQuery.parse(query);
+			songQuery.search = utility::conversions::to_utf8string(jsonPostBody[utility::conversions::to_string_t("query")].as_string());
 		}
-		request.reply(web::http::status_codes::OK, jsonRoot);
+		catch (std::invalid_argument const& e) {
+			request.reply(web::http::status_codes::BadRequest, e.what());
+			return;
+		}
+		catch (web::json::json_exception const& e) {
+			request.reply(web::http::status_codes::BadRequest, std::string("JSON Exception: ") + e.what());
+			return;
+		}
+		ReplySongs(request, songQuery);
 		return;
 	}
 	else {
@@ -316,38 +305,76 @@ web::json::value RequestHandler::ExtractJsonFromRequest(web::http::http_request
 }
 
 
-web::json::value RequestHandler::SongsToJsonObject() {
-	web::json::value jsonRoot = web::json::value::array();
-	for (size_t i = 0; i < m_songs.size(); i++) {
-		web::json::value songObject = web::json::value::object();
-		songObject[utility::conversions::to_string_t("Title")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->title));
-		songObject[utility::conversions::to_string_t("Artist")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->artist));
-		songObject[utility::conversions::to_string_t("Edition")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->edition));
-		songObject[utility::conversions::to_string_t("Language")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->language));
-		songObject[utility::conversions::to_string_t("Creator")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->creator));
-		songObject[utility::conversions::to_string_t("name")] = web::json::value::string(utility::conversions::to_string_t(m_songs[i]->artist + " " + m_songs[i]->title));
-		songObject[utility::conversions::to_string_t("HasError")] = web::json::value::boolean(m_songs[i]->loadStatus == Song::LoadStatus::ERROR);
-		songObject[utility::conversions::to_string_t("ProvidedBy")] = web::json::value(utility::conversions::to_string_t(m_songs[i]->providedBy));
-		songObject[utility::conversions::to_string_t("Comment")] = web::json::value(utility::conversions::to_string_t(m_songs[i]->comment));
-		jsonRoot[i] = songObject;
+std::shared_ptr<SongListSnapshot const> RequestHandler::GetSnapshot() {
+	unsigned const levels = config["game/case-sorting"].b() ? 3 : 2;
+	std::lock_guard<std::mutex> l(m_snapshotMutex);
+	auto const generation = m_songs.generation();
+	if (m_snapshot && m_snapshot->generation() == generation && m_snapshot->levels() == levels) return m_snapshot;
+	std::vector<SongListSnapshot::Entry> entries;
+	for (auto const& song: m_songs.allSongs()) {
+		SongListSnapshot::Entry entry;
+		entry.song = song;
+		entry.title = song->title;
+		entry.artist = song->artist;
+		entry.edition = song->edition;
+		entry.language = song->language;
+		entry.creator = song->creator;
+		entry.providedBy = song->providedBy;
+		entry.comment = song->comment;
+		entry.hasError = song->loadStatus == Song::LoadStatus::ERROR;
+		auto key = [&](SongListSnapshot::Sort sort, Song::SortKey songKey) { entry.sortKeys[static_cast<std::size_t>(sort)] = song->sortKey(songKey); };
+		key(SongListSnapshot::Sort::TITLE, Song::SortKey::TITLE);
+		key(SongListSnapshot::Sort::ARTIST, Song::SortKey::ARTIST);
+		key(SongListSnapshot::Sort::EDITION, Song::SortKey::EDITION);
+		key(SongListSnapshot::Sort::LANGUAGE, Song::SortKey::LANGUAGE);
+		key(SongListSnapshot::Sort::CREATOR, Song::SortKey::CREATOR);
+		entry.searchText = song->strFull();
+		entries.push_back(std::move(entry));
 	}
+	m_snapshot = std::make_shared<SongListSnapshot const>(generation, std::move(entries), levels, UnicodeUtil::m_searchCollator.get());
+	std::clog << "webserver/debug: Song list snapshot of " << m_snapshot->entries().size() << " songs made." << std::endl;
+	return m_snapshot;
+}
 
-	return jsonRoot;
+void RequestHandler::ReplySongs(web::http::http_request request, SongListSnapshot::Query const& query) {
+	auto const response = GetSnapshot()->respond(query);
+	auto const& headers = request.headers();
+	web::http::http_response reply(web::http::status_codes::OK);
+	reply.headers().add(web::http::header_names::etag, utility::conversions::to_string_t(response->etag));
+	reply.headers().add(web::http::header_names::cache_control, utility::conversions::to_string_t("no-cache"));
+	reply.headers().add(web::http::header_names::vary, web::http::header_names::accept_encoding);
+	if (headers.has(web::http::header_names::if_none_match)
+	  && SongListSnapshot::matches(utility::conversions::to_utf8string(headers.find(web::http::header_names::if_none_match)->second), response->etag)) {
+		reply.set_status_code(web::http::status_codes::NotModified);
+		request.reply(reply);
+		return;
+	}
+	bool gzip = false;
+	if (!response->gzip.empty() && headers.has(web::http::header_names::accept_encoding)) {
+		auto accept = utility::conversions::to_utf8string(headers.find(web::http::header_names::accept_encoding)->second);
+		accept.erase(std::remove(accept.begin(), accept.end(), ' '), accept.end());
+		auto const pos = accept.find("gzip");
+		gzip = pos != std::string::npos && accept.compare(pos, 10, "gzip;q=0,") != 0 && accept.substr(pos) != "gzip;q=0";
+	}
+	if (gzip) {
+		reply.headers().add(web::http::header_names::content_encoding, utility::conversions::to_string_t("gzip"));
+		reply.set_body(std::vector<unsigned char>(response->gzip.begin(), response->gzip.end()));
+		reply.headers().set_content_type(utility::conversions::to_string_t("application/json"));
+	}
+	else reply.set_body(response->json, "application/json");
+	request.reply(reply);
 }
 
 std::shared_ptr<Song> RequestHandler::GetSongFromJSON(web::json::value jsonDoc) {
-	m_songs.setFilter("");
-
-	for (size_t i = 0; i < m_songs.size(); i++) {
-		if (m_songs[i]->title == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Title")].as_string()) &&
-			m_songs[i]->artist == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Artist")].as_string()) &&
-			m_songs[i]->edition == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Edition")].as_string()) &&
-			m_songs[i]->language == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Language")].as_string()) &&
-			m_songs[i]->creator == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Creator")].as_string()) &&
-			m_songs[i]->providedBy == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("ProvidedBy")].as_string()) &&
-			m_songs[i]->comment == utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t("Comment")].as_string())) {
+	auto field = [&](char const* name) { return utility::conversions::to_utf8string(jsonDoc[utility::conversions::to_string_t(name)].as_string()); };
+	std::string const title = field("Title"), artist = field("Artist"), edition = field("Edition"), language = field("Language"),
+	  creator = field("Creator"), providedBy = field("ProvidedBy"), comment = field("Comment");
+	auto const snapshot = GetSnapshot();
+	for (auto const& entry: snapshot->entries()) {
+		if (entry.title == title && entry.artist == artist && entry.edition == edition && entry.language == language
+		  && entry.creator == creator && entry.providedBy == providedBy && entry.comment == comment) {
 			std::clog << "webserver/info: Found requested song." << std::endl;
-			return m_songs[i];
+			return entry.song;
 		}
 	}
 
@@ -5,6 +5,10 @@
 #include <cpprest/filestream.h>
 
 #include "screen_playlist.hh"
+#include "songlistsnapshot.hh"
+
+#include <memory>
+#include <mutex>
 
 class RequestHandler
 {
@@ -26,7 +30,10 @@ class RequestHandler
 	web::json::value ExtractJsonFromRequest(web::http::http_request request);
 
 	void HandleFile(web::http::http_request request, std::string filePath = "");
-	web::json::value SongsToJsonObject();
+	/// The snapshot of the current song library, made again if the library has changed
+	std::shared_ptr<SongListSnapshot const> GetSnapshot();
+	/// Reply with the songs of the query, or 304 if the client has them already
+	void ReplySongs(web::http::http_request request, SongListSnapshot::Query const& query);
 	std::map<std::string, std::string> GenerateLocaleDict();
 	std::vector<std::string> GetTranslationKeys();
 	std::shared_ptr<Song> GetSongFromJSON(web::json::value);
@@ -35,6 +42,8 @@ class RequestHandler
 
 	Game& m_game;
 	Songs& m_songs;
+	std::mutex m_snapshotMutex;
+	std::shared_ptr<SongListSnapshot const> m_snapshot;
 };
 #else
 class Songs;
@@ -51,7 +51,7 @@ void ScreenPlayers::exit() {
 	m_playing.clear();
 	m_playReq.clear();
 
-	m_database.save();
+	m_database.flush();
 }
 
 void ScreenPlayers::manageEvent(input::NavEvent const& event) {
@@ -62,7 +62,7 @@ void ScreenPlayers::manageEvent(input::NavEvent const& event) {
 		else { m_search.text.clear(); m_players.setFilter(m_search.text); }
 	} else if (nav == input::NavButton::START) {
 		if (m_players.isEmpty()) {
-			m_players.addPlayer(m_search.text);
+			m_database.addPlayer(m_search.text);
 			m_players.setFilter(m_search.text);
 			m_players.update();
 			// the current player is the new created one
@@ -14,12 +14,12 @@
 #include "playlist.hh"
 #include "graphic/video_driver.hh"
 
-#include "aubio/aubio.h"
-
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <mutex>
 #include <sstream>
+#include <vector>
 
 static const double IDLE_TIMEOUT = 35.0; // seconds
 
@@ -39,6 +39,7 @@ void ScreenSongs::enter() {
 	m_menuPos = 1;
 	m_infoPos = 0;
 	m_jukebox = false;
+	m_beatTracker = std::make_unique<BeatTracker>();
 	reloadGL();
 }
 
@@ -52,10 +53,13 @@ void ScreenSongs::reloadGL() {
 	m_bandCover = std::make_unique<Texture>(findFile("band_cover.svg"));
 	m_danceCover = std::make_unique<Texture>(findFile("dance_cover.svg"));
 	m_instrumentList = std::make_unique<Texture>(findFile("instruments.svg"));
+	m_coverCache = std::make_unique<CoverCache>();
 }
 
 void ScreenSongs::exit() {
 	m_covers.clear();
+	m_coverCache.reset();
+	m_beatTracker.reset();
 	m_menu.clear();
 	m_menuTheme.reset();
 	m_singCover.reset();
@@ -198,17 +202,17 @@ void ScreenSongs::update() {
 	if (m_playing != music) songChange = true;
 	// Switch songs if needed, only when the user is not browsing for a moment
 	if (!songChange) return;
-	ScreenSongs::previewBeatsBuffer.reset(new_fvec(1));
-	{
-	std::lock_guard<std::recursive_mutex> l(Audio::aubio_mutex);
-	Audio::aubioTempo.reset(new_aubio_tempo("default", Audio::aubio_win_size, Audio::aubio_hop_size, static_cast<uint_t>(Audio::getSR())));
-	}
 	if (song && song->hasControllers()) { song->loadNotes(); } // Needed for BPM info.
 	m_playing = music;
 	// Clear the old content and load new content if available
 	m_songbg.reset(); m_video.reset();
 	double pstart = (!m_jukebox && song ? song->getPreviewStart() : 0.0);
 	m_audio.playMusic(getGame(), music, true, 1.0, pstart);
+	if (song && !song->hasControllers() && m_beatTracker) {
+		auto it = music.find("background");
+		song->beats.clear();  // Until the tracker has the beats of this preview
+		if (it != music.end()) m_beatTracker->request(it->second, pstart);
+	}
 	if (song) {
 		fs::path const& background = song->background.empty() ? song->cover : song->background;
 		if (!background.empty()) try { m_songbg = std::make_unique<Texture>(background); } catch (std::exception const&) {}
@@ -239,6 +243,17 @@ void ScreenSongs::sing() {
 void ScreenSongs::prepare() {
 	double time = m_audio.getPosition() - config["audio/video_delay"].f();
 	if (m_video) m_video->prepare(time);
+	if (m_coverCache) m_coverCache->update();
+	trimCovers();
+	++m_frame;
+	if (auto result = m_beatTracker ? m_beatTracker->poll() : nullptr) {
+		// Only for the song that is still playing, as the user may have moved on
+		auto song = m_songs.currentPtr();
+		if (song && song->music == m_playing && !song->hasControllers()) {
+			auto it = m_playing.find("background");
+			if (it != m_playing.end() && it->second == result->music) song->beats = result->grid.beats;
+		}
+	}
 }
 
 void ScreenSongs::drawJukebox() {
@@ -429,10 +444,12 @@ void ScreenSongs::drawCovers() {
 	beat = 1.0 + std::pow(std::abs(std::cos(0.5 * TAU * beat)), 10.0);  // Overdrive pulse
 	// Draw covers and reflections
 	int idx = static_cast<int>(baseidx);
+	prefetchCovers(idx);
 	for (int i = -2; i < 6; ++i) {
 		if (idx + i < 0 || idx + i >= ss) continue;
 		Song& song = *m_songs[static_cast<unsigned>(idx + i)];
-		Texture& s = getCover(song);
+		// Only the selected song gets its full size cover, the others are drawn from the thumbnail atlas
+		CoverImage s = idx + i == currentId ? CoverImage{ &getCover(song) } : getThumbnail(song);
 		// Calculate dimensions for cover and instrument markers
 		float pos = static_cast<float>(static_cast<double>(i) - shift);
 		// Function for highlight effect (offset = 0 for current cover), returns 0..1 highlight level
@@ -450,7 +467,7 @@ void ScreenSongs::drawCovers() {
 		using namespace glmath;
 		Transform trans(window, translate(vec3(x, y, z)) * rotate(angle, vec3(0.0f, 1.0f, 0.0f)));
 		ColorTrans c1(window, Color(c, c, c));
-		s.dimensions.middle().screenCenter().bottom().fitInside(0.17f, 0.17f);
+		s.dimensions().middle().screenCenter().bottom().fitInside(0.17f, 0.17f);
 		// Draw the cover normally
 		s.draw(window);
 		// Draw the reflection
@@ -463,26 +480,71 @@ void ScreenSongs::drawCovers() {
 	float c = static_cast<float>(m_menuPos == 0 /* Playlist */ ? beat : 1.0);
 	ColorTrans c1(window, Color(c, c, c));
 	for (size_t i = playlist.size() - 1; i < playlist.size(); --i) {
-		Texture& s = getCover(*playlist[i]);
+		CoverImage s = getThumbnail(*playlist[i]);
 		float pos =  static_cast<float>(i) / std::max<float>(5.0f, static_cast<float>(playlist.size()));
 		using namespace glmath;
 		Transform trans(window,
 		  translate(vec3(-0.35f + 0.06f * pos, 0.0f, 0.3f - 0.2f * pos))
 		  * rotate(-0.0f, vec3(0.0f, 1.0f, 0.0f))
 		);
-		s.dimensions.middle().screenBottom(-0.06f).fitInside(0.08f, 0.08f);
+		s.dimensions().middle().screenBottom(-0.06f).fitInside(0.08f, 0.08f);
 		s.draw(window);
 	}
 }
 
-Texture* ScreenSongs::loadTextureFromMap(fs::path path) {
-	if(m_covers.find(path) == m_covers.end()) {
-		m_covers.insert({ path, std::make_unique<Texture>(path) });
+Texture* ScreenSongs::loadTextureFromMap(fs::path path, Texture::Priority priority) {
+	auto it = m_covers.find(path);
+	if (it == m_covers.end()) {
+		try {
+			it = m_covers.emplace(path, LoadedCover{ std::make_unique<Texture>(path, priority), m_frame }).first;
+		} catch (std::exception const&) { return nullptr; }
+	} else it->second.texture->prioritize(priority);
+	it->second.frame = m_frame;
+	return it->second.texture.get();
+}
+
+void ScreenSongs::trimCovers() {
+	// Full size covers are only needed for the selected song and its neighbours (the browser draws thumbnails).
+	// Those drawn in the previous frame (m_frame) are kept, as they will likely be drawn again.
+	constexpr std::size_t MAX_COVERS = 16;
+	if (m_covers.size() <= MAX_COVERS) return;
+	std::vector<std::pair<unsigned, fs::path>> unused;
+	for (auto const& [path, cover]: m_covers) if (cover.frame != m_frame) unused.emplace_back(cover.frame, path);
+	std::size_t const count = std::min(unused.size(), m_covers.size() - MAX_COVERS);
+	std::partial_sort(unused.begin(), unused.begin() + static_cast<std::ptrdiff_t>(count), unused.end());
+	for (std::size_t i = 0; i < count; ++i) m_covers.erase(unused[i].second);
+}
+
+void ScreenSongs::prefetchCovers(int idx) {
+	int const ss = static_cast<int>(m_songs.size());
+	auto song = [&](int j) -> Song const* { return j < 0 || j >= ss ? nullptr : m_songs[static_cast<unsigned>(j)].get(); };
+	// The neighbours of the selected song become full size covers when selected
+	std::ptrdiff_t const currentId = m_songs.currentId();
+	for (std::ptrdiff_t j: { currentId + 1, currentId - 1 }) {
+		Song const* s = song(static_cast<int>(j));
+		if (!s) continue;
+		if (!s->cover.empty()) loadTextureFromMap(s->cover, Texture::Priority::PREFETCH);
+		else if (!s->background.empty()) loadTextureFromMap(s->background, Texture::Priority::PREFETCH);
+	}
+	// Thumbnails of the covers that scrolling will show next, nearest first
+	if (!m_coverCache) return;
+	for (int i = 6; i < 20; ++i) {
+		for (int j: { idx + i, idx - i + 3 }) {
+			Song const* s = song(j);
+			if (!s) continue;
+			fs::path const& path = s->cover.empty() ? s->background : s->cover;
+			if (!path.empty() && CoverCache::supports(path)) m_coverCache->prefetch(path);
+		}
 	}
-	try {
-		return m_covers.at(path).get();
-	} catch (std::exception const&) {}
-	return nullptr;
+}
+
+ScreenSongs::CoverImage ScreenSongs::getThumbnail(Song const& song) {
+	fs::path const& path = song.cover.empty() ? song.background : song.cover;
+	if (!m_coverCache || path.empty() || !CoverCache::supports(path)) return CoverImage{ &getCover(song) };
+	CoverImage cover;
+	cover.thumbnail = m_coverCache->get(path);
+	if (!cover.thumbnail) cover.texture = &getDefaultCover(song);  // Until the thumbnail is ready
+	return cover;
 }
 
 Texture& ScreenSongs::getCover(Song const& song) {
@@ -492,20 +554,17 @@ Texture& ScreenSongs::getCover(Song const& song) {
 	// Fallback to background image as cover if needed
 	if (!cover && !song.background.empty()) cover = loadTextureFromMap(song.background);
 	// Use empty cover
-	if (!cover) {
-		if(song.hasDance()) {
-			cover = m_danceCover.get();
-		} else if(song.hasDrums()) {
-			cover = m_bandCover.get();
-		} else {
-			size_t tracks = song.instrumentTracks.size();
-			if (tracks == 0) cover = m_singCover.get();
-			else cover = m_instrumentCover.get();
-		}
-	}
+	if (!cover) cover = &getDefaultCover(song);
 	return *cover;
 }
 
+Texture& ScreenSongs::getDefaultCover(Song const& song) {
+	if (song.hasDance()) return *m_danceCover;
+	if (song.hasDrums()) return *m_bandCover;
+	if (song.instrumentTracks.empty()) return *m_singCover;
+	return *m_instrumentCover;
+}
+
 namespace {
 	float getIconTex(int i) {
 		static int iconcount = 8;
@@ -599,8 +658,6 @@ void ScreenSongs::drawMenu() {
 	m_menu.dimensions.stretch(w, h);
 }
 
-std::unique_ptr<fvec_t, void(*)(fvec_t*)> ScreenSongs::previewBeatsBuffer = std::unique_ptr<fvec_t, void(*)(fvec_t*)>(new_fvec(1), [](fvec_t* p){del_fvec(p);});
-
 void ScreenSongs::createPlaylistMenu() {
 	m_menu.clear();
 	m_menu.add(MenuOption(_("Play"), "")).call([this]() {
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "animvalue.hh"
+#include "beattracker.hh"
 #include "controllers.hh"
+#include "covercache.hh"
 #include "screen.hh"
 #include "theme.hh"
 #include "song.hh" // for MusicFiles class
@@ -10,7 +12,6 @@
 #include "video.hh"
 #include "playlist.hh"
 #include "menu.hh"
-#include "aubio/aubio.h"
 #include <unordered_map>
 
 class Audio;
@@ -38,8 +39,8 @@ public:
 	void draw();
 	void drawCovers(); ///< draw the cover browser
 	Texture& getCover(Song const& song); ///< get appropriate cover image for the song (incl. no cover)
+	Texture& getDefaultCover(Song const& song); ///< get the cover shown for songs without a cover image
 	void drawJukebox(); ///< draw the songbrowser in jukebox mode (fullscreen, full previews, ...)
-	static std::unique_ptr<fvec_t, void(*)(fvec_t*)> previewBeatsBuffer;
 private:
 	void manageSharedKey(input::NavEvent const& event); ///< same behaviour for jukebox and normal mode
 	void drawInstruments(Dimensions dim) const;
@@ -49,7 +50,16 @@ private:
 	bool addSong(); ///< Add current song to playlist. Returns true if the playlist was empty.
 	void sing(); ///< Enter singing screen with current playlist.
 	void createPlaylistMenu();
-	Texture* loadTextureFromMap(fs::path path);
+	Texture* loadTextureFromMap(fs::path path, Texture::Priority priority = Texture::Priority::VISIBLE);
+	void prefetchCovers(int idx);  ///< Start loading the covers around the visible ones
+	/// Cover of a song in the browser: an atlas thumbnail, or a texture when there is no thumbnail (yet)
+	struct CoverImage {
+		Texture* texture = nullptr;
+		CoverCache::Image* thumbnail = nullptr;
+		Dimensions& dimensions() { return thumbnail ? thumbnail->dimensions : texture->dimensions; }
+		void draw(Window& window) { if (thumbnail) thumbnail->draw(window); else texture->draw(window); }
+	};
+	CoverImage getThumbnail(Song const& song);
 	std::string getHighScoreText() const;
 
 	Audio& m_audio;
@@ -68,7 +78,16 @@ private:
 	std::unique_ptr<Texture> m_danceCover;
 	std::unique_ptr<Texture> m_instrumentList;
 	std::unique_ptr<ThemeInstrumentMenu> m_menuTheme;
-	std::unordered_map<fs::path, std::unique_ptr<Texture>, FsPathHash> m_covers;
+	/// A full size cover and the frame that last used it
+	struct LoadedCover {
+		std::unique_ptr<Texture> texture;
+		unsigned frame;
+	};
+	std::unordered_map<fs::path, LoadedCover, FsPathHash> m_covers;
+	unsigned m_frame = 0;  ///< Counts prepare() calls, for evicting the covers not used recently
+	void trimCovers();  ///< Drop the least recently used covers over the limit
+	std::unique_ptr<CoverCache> m_coverCache;
+	std::unique_ptr<BeatTracker> m_beatTracker;  ///< Beats of the previews of songs without notes of their own
 	unsigned m_menuPos;
 	int m_infoPos;
 	bool m_jukebox;
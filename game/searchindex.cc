@@ -0,0 +1,144 @@
+#include "searchindex.hh"
+
+#include <unicode/errorcode.h>
+#include <unicode/normalizer2.h>
+#include <unicode/stsearch.h>
+#include <unicode/uchar.h>
+#include <unicode/unistr.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+	bool isAscii(std::string_view str) {
+		return std::all_of(str.begin(), str.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+	}
+
+	/// Letters that collators treat like other letters at primary strength but that do not decompose
+	char const* expansion(UChar32 c) {
+		switch (c) {
+			case 0xE6: return "ae";  // æ
+			case 0x153: return "oe";  // œ
+			case 0xF8: return "o";  // ø
+			case 0x111: return "d";  // đ
+			case 0x142: return "l";  // ł
+			case 0x127: return "h";  // ħ
+			case 0x131: return "i";  // dotless i
+			default: return nullptr;
+		}
+	}
+}
+
+std::string SearchIndex::fold(std::string_view text) {
+	if (isAscii(text)) {
+		std::string result(text);
+		std::transform(result.begin(), result.end(), result.begin(), [](char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; });
+		return result;
+	}
+	icu::ErrorCode error;
+	static icu::Normalizer2 const* nfkd = icu::Normalizer2::getNFKDInstance(error);
+	icu::UnicodeString str = icu::UnicodeString::fromUTF8(icu::StringPiece(text.data(), static_cast<int32_t>(text.size())));
+	if (nfkd) str = nfkd->normalize(str, error);
+	str.foldCase();
+	icu::UnicodeString stripped;
+	for (int32_t i = 0; i < str.length(); ) {
+		UChar32 c = str.char32At(i);
+		i += U16_LENGTH(c);
+		if (u_charType(c) == U_NON_SPACING_MARK || u_hasBinaryProperty(c, UCHAR_DEFAULT_IGNORABLE_CODE_POINT)) continue;
+		if (char const* ascii = expansion(c)) stripped.append(icu::UnicodeString(ascii, -1, US_INV));
+		else stripped.append(c);
+	}
+	std::string result;
+	stripped.toUTF8String(result);
+	return result;
+}
+
+std::vector<std::uint32_t> SearchIndex::trigrams(std::string_view folded) {
+	// Trigrams of UTF-8 bytes: a substring match always shares all of them, and no decoding is needed
+	std::vector<std::uint32_t> result;
+	if (folded.size() < 3) return result;
+	result.reserve(folded.size() - 2);
+	for (std::size_t i = 0; i + 3 <= folded.size(); ++i) {
+		auto byte = [&](std::size_t j) { return static_cast<std::uint32_t>(static_cast<unsigned char>(folded[i + j])); };
+		result.push_back(byte(0) << 16 | byte(1) << 8 | byte(2));
+	}
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+	return result;
+}
+
+SearchIndex::Id SearchIndex::add(std::string_view text) {
+	Id const id = static_cast<Id>(m_texts.size());
+	Text t;
+	t.folded = fold(text);
+	if (!isAscii(text)) t.original = text;
+	for (std::uint32_t trigram: trigrams(t.folded)) m_postings[trigram].push_back(id);
+	m_texts.push_back(std::move(t));
+	++m_size;
+	return id;
+}
+
+void SearchIndex::remove(Id id) {
+	if (id >= m_texts.size() || m_texts[id].removed) return;
+	Text& t = m_texts[id];
+	for (std::uint32_t trigram: trigrams(t.folded)) {
+		auto& ids = m_postings[trigram];
+		auto it = std::lower_bound(ids.begin(), ids.end(), id);
+		if (it != ids.end() && *it == id) ids.erase(it);
+	}
+	t = Text();
+	t.removed = true;
+	--m_size;
+}
+
+void SearchIndex::clear() {
+	m_texts.clear();
+	m_postings.clear();
+	m_size = 0;
+}
+
+std::vector<SearchIndex::Id> SearchIndex::find(std::string_view query, icu::RuleBasedCollator* collator) const {
+	std::string const folded = fold(query);
+	std::vector<Id> candidates;
+	auto const grams = trigrams(folded);
+	if (grams.empty()) {
+		// Too short for trigrams, check every text
+		candidates.reserve(m_size);
+		for (Id id = 0; id < m_texts.size(); ++id) if (!m_texts[id].removed) candidates.push_back(id);
+	} else {
+		// Intersect the posting lists, shortest first
+		std::vector<std::vector<Id> const*> lists;
+		for (std::uint32_t trigram: grams) {
+			auto it = m_postings.find(trigram);
+			if (it == m_postings.end() || it->second.empty()) return {};
+			lists.push_back(&it->second);
+		}
+		std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+		candidates = *lists.front();
+		std::vector<Id> tmp;
+		for (std::size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+			tmp.clear();
+			std::set_intersection(candidates.begin(), candidates.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(tmp));
+			candidates.swap(tmp);
+		}
+	}
+	if (folded.empty()) return candidates;
+	bool const asciiQuery = isAscii(query);
+	icu::UnicodeString const pattern = icu::UnicodeString::fromUTF8(icu::StringPiece(query.data(), static_cast<int32_t>(query.size())));
+	std::unique_ptr<icu::StringSearch> search;  // Created for the first text that needs it and reused
+	std::vector<Id> result;
+	for (Id id: candidates) {
+		Text const& t = m_texts[id];
+		if (t.folded.find(folded) == std::string::npos) continue;
+		if (collator && (!asciiQuery || !t.original.empty())) {
+			icu::ErrorCode error;
+			std::string const& text = t.original.empty() ? t.folded : t.original;
+			icu::UnicodeString const target = icu::UnicodeString::fromUTF8(icu::StringPiece(text.data(), static_cast<int32_t>(text.size())));
+			if (!search) search = std::make_unique<icu::StringSearch>(pattern, target, collator, nullptr, error);
+			else search->setText(target, error);
+			if (error.isFailure() || search->first(error) == USEARCH_DONE) continue;
+		}
+		result.push_back(id);
+	}
+	return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unicode/uversion.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+U_NAMESPACE_BEGIN class RuleBasedCollator; U_NAMESPACE_END
+
+/**
+* Substring search over many short texts (the song list filter).
+*
+* Texts are stored folded (compatibility decomposed, case folded, without accents and ignorable characters) and every
+* trigram of the folded text points to the texts containing it. A query only looks at the texts that contain all of
+* its trigrams and then checks those for the folded query. Folding makes the index at least as permissive as matching
+* with a primary-strength collator, so when a collator is given, the remaining candidates are confirmed with an exact
+* ICU StringSearch. That is skipped for ASCII-only texts and queries, where both ways of matching agree.
+**/
+class SearchIndex {
+  public:
+	using Id = std::uint32_t;
+	/// Fold text for matching (see class description)
+	static std::string fold(std::string_view text);
+
+	/// Add a text, returning its id. Ids are assigned in increasing order.
+	Id add(std::string_view text);
+	/// Remove a text (its id is not reused until clear)
+	void remove(Id id);
+	void clear();
+	/// Number of texts (not counting removed ones)
+	std::size_t size() const { return m_size; }
+	/// Ids of the texts containing query, in increasing order. Without a collator only folded matching is done.
+	std::vector<Id> find(std::string_view query, icu::RuleBasedCollator* collator = nullptr) const;
+
+  private:
+	struct Text {
+		std::string folded;
+		std::string original;  ///< Only kept for non-ASCII texts (for ASCII, folded is equivalent for collator matching)
+		bool removed = false;
+	};
+	static std::vector<std::uint32_t> trigrams(std::string_view folded);
+
+	std::vector<Text> m_texts;
+	std::unordered_map<std::uint32_t, std::vector<Id>> m_postings;  ///< Trigram to the ids containing it, ascending
+	std::size_t m_size = 0;
+};
@@ -2,6 +2,7 @@
 #include "config.hh"
 #include "screen_sing.hh"
 #include "songparser.hh"
+#include "sortkey.hh"
 #include "unicode.hh"
 #include "util.hh"
 
@@ -58,36 +59,144 @@ Song::Song(nlohmann::json const& song) : dummyVocal(TrackName::VOCAL_LEAD), rand
 	collateByArtist = getJsonEntry<std::string>(song, "collateByArtist").value_or("");
 	collateByArtistOnly = getJsonEntry<std::string>(song, "collateByArtistOnly").value_or("");
 
-    for (size_t i = 0; i < getJsonEntry<size_t>(song, "vocalTracks").value_or(0); i++) {
-        std::string track = "DummyTrack" + std::to_string(i);
-        insertVocalTrack(track, VocalTrack(track));
-    }
-
-    if (getJsonEntry<bool>(song, "keyboardTracks").value_or(false)) {
-        instrumentTracks.insert(make_pair(TrackName::KEYBOARD, InstrumentTrack(TrackName::KEYBOARD)));
-    }
-
-    if (getJsonEntry<bool>(song, "drumTracks").value_or(false)) {
-        instrumentTracks.insert(make_pair(TrackName::DRUMS, InstrumentTrack(TrackName::DRUMS)));
-        instrumentTracks.insert(make_pair(TrackName::DRUMS_SNARE, InstrumentTrack(TrackName::DRUMS_SNARE)));
-        instrumentTracks.insert(make_pair(TrackName::DRUMS_CYMBALS, InstrumentTrack(TrackName::DRUMS_CYMBALS)));
-        instrumentTracks.insert(make_pair(TrackName::DRUMS_TOMS, InstrumentTrack(TrackName::DRUMS_TOMS)));
-    }
-    if (getJsonEntry<bool>(song, "danceTracks").value_or(false)) {
-        DanceDifficultyMap danceDifficultyMap;
-        danceTracks.insert(std::make_pair("dance-single", danceDifficultyMap));
-    }
-    if (getJsonEntry<bool>(song, "guitarTracks").value_or(false)) {
-        instrumentTracks.insert(std::make_pair(TrackName::GUITAR, InstrumentTrack(TrackName::GUITAR)));
-    }
+    addTrackPlaceholders(getJsonEntry<size_t>(song, "vocalTracks").value_or(0), getJsonEntry<bool>(song, "keyboardTracks").value_or(false),
+      getJsonEntry<bool>(song, "drumTracks").value_or(false), getJsonEntry<bool>(song, "danceTracks").value_or(false),
+      getJsonEntry<bool>(song, "guitarTracks").value_or(false));
     if (song.contains("bpm")) {
         m_bpms.push_back(BPM(0, 0, song.at("bpm").get<float>()));
     }
     collateUpdate();
 }
 
+Song::Song(SongCache const& cache, std::size_t index) : dummyVocal(TrackName::VOCAL_LEAD), randomIdx(rand()) {
+	using Field = SongCache::Field;
+	auto str = [&](Field f) { return std::string(cache.string(index, f)); };
+	SongCache::Record const& rec = cache.record(index);
+	path = str(Field::PATH);
+	filename = str(Field::FILENAME);
+	fileStamp = rec.stamp;
+	title = str(Field::TITLE);
+	artist = str(Field::ARTIST);
+	edition = str(Field::EDITION);
+	genre = str(Field::GENRE);
+	tags = str(Field::TAGS);
+	version = str(Field::SONG_VERSION);
+	language = str(Field::LANGUAGE);
+	creator = str(Field::CREATOR);
+	providedBy = str(Field::PROVIDED_BY);
+	comment = str(Field::COMMENT);
+	cover = str(Field::COVER);
+	background = str(Field::BACKGROUND);
+	video = str(Field::VIDEO);
+	midifilename = str(Field::MIDI);
+	// Music files are stored as track name and file name pairs, all separated by NUL
+	std::string_view files = cache.string(index, Field::MUSIC);
+	while (!files.empty()) {
+		auto const nameEnd = files.find('\0');
+		if (nameEnd == std::string_view::npos) break;
+		auto const fileEnd = std::min(files.find('\0', nameEnd + 1), files.size());
+		music[std::string(files.substr(0, nameEnd))] = std::string(files.substr(nameEnd + 1, fileEnd - nameEnd - 1));
+		files.remove_prefix(std::min(fileEnd + 1, files.size()));
+	}
+	collateByTitle = str(Field::COLLATE_TITLE);
+	collateByTitleOnly = str(Field::COLLATE_TITLE_ONLY);
+	collateByArtist = str(Field::COLLATE_ARTIST);
+	collateByArtistOnly = str(Field::COLLATE_ARTIST_ONLY);
+	for (std::size_t i = 0; i < sortKeys.size(); ++i) sortKeys[i] = str(static_cast<Field>(static_cast<std::size_t>(Field::SORT_TITLE) + i));
+	videoGap = rec.videoGap;
+	start = rec.start;
+	end = rec.end;
+	preview_start = rec.previewStart;
+	m_duration = rec.duration;
+	analysis.music = rec.analyzed;
+	analysis.loudness = rec.loudness;
+	analysis.firstVocal = rec.firstVocal;
+	year = rec.year;
+	type = static_cast<Type>(rec.type);
+	loadStatus = static_cast<LoadStatus>(rec.loadStatus);
+	if (!std::isnan(rec.bpm)) m_bpms.push_back(BPM(0, 0, static_cast<float>(rec.bpm)));
+	addTrackPlaceholders(rec.vocalTracks, rec.flags & SongCache::KEYBOARD, rec.flags & SongCache::DRUMS,
+	  rec.flags & SongCache::DANCE, rec.flags & SongCache::GUITARS);
+}
+
+SongCache::Entry Song::cacheEntry() const {
+	using Field = SongCache::Field;
+	SongCache::Entry entry;
+	SongCache::Record& rec = entry.record;
+	entry[Field::PATH] = path.string();
+	entry[Field::FILENAME] = filename.string();
+	entry[Field::TITLE] = title;
+	entry[Field::ARTIST] = artist;
+	entry[Field::EDITION] = edition;
+	entry[Field::GENRE] = genre;
+	entry[Field::TAGS] = tags;
+	entry[Field::SONG_VERSION] = version;
+	entry[Field::LANGUAGE] = language;
+	entry[Field::CREATOR] = creator;
+	entry[Field::PROVIDED_BY] = providedBy;
+	entry[Field::COMMENT] = comment;
+	entry[Field::COVER] = cover.string();
+	entry[Field::BACKGROUND] = background.string();
+	entry[Field::VIDEO] = video.string();
+	entry[Field::MIDI] = midifilename.string();
+	for (auto const& [track, file]: music) {
+		if (file.empty()) continue;
+		if (!entry[Field::MUSIC].empty()) entry[Field::MUSIC] += '\0';
+		entry[Field::MUSIC] += track + '\0' + file.string();
+	}
+	entry[Field::COLLATE_TITLE] = collateByTitle;
+	entry[Field::COLLATE_TITLE_ONLY] = collateByTitleOnly;
+	entry[Field::COLLATE_ARTIST] = collateByArtist;
+	entry[Field::COLLATE_ARTIST_ONLY] = collateByArtistOnly;
+	for (std::size_t i = 0; i < sortKeys.size(); ++i) entry[static_cast<Field>(static_cast<std::size_t>(Field::SORT_TITLE) + i)] = sortKeys[i].str();
+	rec.stamp = fileStamp;
+	rec.videoGap = videoGap;
+	rec.start = start;
+	rec.end = end;
+	rec.previewStart = preview_start;
+	rec.duration = m_duration;
+	rec.analyzed = analysis.music;
+	rec.loudness = analysis.loudness;
+	rec.firstVocal = analysis.firstVocal;
+	rec.bpm = m_bpms.empty() ? getNaN() : 15.0 / m_bpms.front().step;
+	rec.year = year;
+	rec.type = static_cast<std::uint32_t>(type);
+	// Notes are never cached, so a fully loaded song is stored with its headers only
+	rec.loadStatus = static_cast<std::int32_t>(loadStatus == LoadStatus::FULL ? LoadStatus::HEADER : loadStatus);
+	rec.vocalTracks = static_cast<std::uint32_t>(vocalTracks.size());
+	rec.flags = 0;
+	if (hasKeyboard()) rec.flags |= SongCache::KEYBOARD;
+	if (hasDrums()) rec.flags |= SongCache::DRUMS;
+	if (hasDance()) rec.flags |= SongCache::DANCE;
+	if (hasGuitars()) rec.flags |= SongCache::GUITARS;
+	return entry;
+}
+
+void Song::addTrackPlaceholders(std::size_t vocals, bool keyboard, bool drums, bool dance, bool guitars) {
+	for (std::size_t i = 0; i < vocals; i++) {
+		std::string track = "DummyTrack" + std::to_string(i);
+		insertVocalTrack(track, VocalTrack(track));
+	}
+	if (keyboard) {
+		instrumentTracks.insert(make_pair(TrackName::KEYBOARD, InstrumentTrack(TrackName::KEYBOARD)));
+	}
+	if (drums) {
+		instrumentTracks.insert(make_pair(TrackName::DRUMS, InstrumentTrack(TrackName::DRUMS)));
+		instrumentTracks.insert(make_pair(TrackName::DRUMS_SNARE, InstrumentTrack(TrackName::DRUMS_SNARE)));
+		instrumentTracks.insert(make_pair(TrackName::DRUMS_CYMBALS, InstrumentTrack(TrackName::DRUMS_CYMBALS)));
+		instrumentTracks.insert(make_pair(TrackName::DRUMS_TOMS, InstrumentTrack(TrackName::DRUMS_TOMS)));
+	}
+	if (dance) {
+		DanceDifficultyMap danceDifficultyMap;
+		danceTracks.insert(std::make_pair("dance-single", danceDifficultyMap));
+	}
+	if (guitars) {
+		instrumentTracks.insert(std::make_pair(TrackName::GUITAR, InstrumentTrack(TrackName::GUITAR)));
+	}
+}
+
 Song::Song(fs::path const& filename):
-  dummyVocal(TrackName::VOCAL_LEAD), path(filename.parent_path()), filename(filename), randomIdx(rand())
+  dummyVocal(TrackName::VOCAL_LEAD), path(filename.parent_path()), filename(filename), fileStamp(FileStamp::of(filename)), randomIdx(rand())
 {
     SongParser(*this);
     collateUpdate();
@@ -126,6 +235,16 @@ void Song::collateUpdate() {
 
     collateByArtist = collateInfo["artist"] + "__" + collateInfo["title"] + "__" + filename.string();
     collateByArtistOnly = collateInfo["artist"];
+
+    auto const* collator = UnicodeUtil::m_sortCollator.get();
+    if (!collator) return;
+    auto key = [&](SortKey k, std::string const& str) { sortKeys[static_cast<std::size_t>(k)] = ::sortKey(*collator, str); };
+    key(SortKey::TITLE, collateByTitle);
+    key(SortKey::ARTIST, collateByArtist);
+    key(SortKey::EDITION, edition);
+    key(SortKey::CREATOR, creator);
+    key(SortKey::LANGUAGE, language);
+    key(SortKey::GENRE, genre);
 }
 
 Song::Status Song::status(double time, ScreenSing* song) {
@@ -4,8 +4,11 @@
 #include "i18n.hh"
 #include "json.hh"
 #include "notes.hh"
+#include "songcache.hh"
+#include "sortkey.hh"
 #include "util.hh"
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include <stdexcept>
@@ -51,6 +54,7 @@ public:
 	fs::path path; ///< path of songfile
 	fs::path filename; ///< name of songfile
 	fs::path midifilename; ///< name of midi file in FoF format
+	FileStamp fileStamp; ///< size and modification time of songfile when it was parsed
 	struct BPM {
 		BPM (double _begin, double _ts, float bpm) :
 		begin (_begin), step (0.25 * 60.0 / bpm), ts (_ts) {}
@@ -80,12 +84,21 @@ public:
 	std::string collateByTitleOnly;  ///< String for sorting by title only
 	std::string collateByArtist;  ///< String for sorting by artist, title
 	std::string collateByArtistOnly;  ///< String for sorting by artist only
+	/// Strings that songs are sorted by, with precomputed ICU sort keys
+	enum class SortKey { TITLE, ARTIST, EDITION, CREATOR, LANGUAGE, GENRE, COUNT };
+	std::array<CollationKey, static_cast<std::size_t>(SortKey::COUNT)> sortKeys;  ///< Tertiary strength keys (see sortkey.hh)
 	double videoGap = 0.0; ///< gap with video
 	double start = 0.0; ///< start of song
 	double end = 0.0; ///< end of song
 	int year = 0; ///< year of the song
 	double preview_start = getNaN(); ///< starting time for the preview
 	double m_duration = 0.0;
+	/// Measured by the library analysis (--analyze-library); see LibraryAnalysis
+	struct Analysis {
+		FileStamp music;  ///< Main music file when it was analyzed (zero if it has not been)
+		double loudness = getNaN();  ///< Integrated loudness of all tracks mixed (LUFS)
+		double firstVocal = getNaN();  ///< Start of the first sung note (seconds)
+	} analysis;
 	using Stops = std::vector<std::pair<double,double> >;
 	Stops stops; ///< related to dance
 	using Beats = std::vector<double>;
@@ -101,7 +114,9 @@ public:
 	int randomIdx = 0; ///< sorting index used for random order
 
 	// Functions only below this line
-	Song(nlohmann::json const& song);  ///< Load song from cache.
+	Song(nlohmann::json const& song);  ///< Load song from JSON cache.
+	Song(SongCache const& cache, std::size_t index);  ///< Load song from a record of the binary cache.
+	SongCache::Entry cacheEntry() const;  ///< Song headers for storing in the binary cache
 	Song(fs::path const& filename);  ///< Load song from specified path and filename
 	void reload(bool errorIgnore = true);  ///< Reset and reload the entire song from file
 	void loadNotes(bool errorIgnore = true);  ///< Load note data (called when entering singing screen, headers preloaded).
@@ -130,9 +145,11 @@ public:
 
 	bool isBroken() const;
 	void setBroken(bool broken = true);
+	void collateUpdate();   ///< Rebuild collate variables and sort keys (used for sorting) from other strings
+	CollationKey const& sortKey(SortKey key) const { return sortKeys[static_cast<std::size_t>(key)]; }
 
 private:
-	void collateUpdate();   ///< Rebuild collate variables (used for sorting) from other strings
+	void addTrackPlaceholders(std::size_t vocals, bool keyboard, bool drums, bool dance, bool guitars);  ///< Track flags of cached songs (notes are loaded later)
 
 	bool m_broken = false;
 };
@@ -0,0 +1,271 @@
+#include "songcache.hh"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
+
+static_assert(std::is_trivially_copyable<SongCache::Record>::value, "Records are written as raw bytes");
+static_assert(sizeof(SongCache::Record) == 336, "Record layout must not contain padding (it is compared with memcmp)");
+
+namespace {
+	constexpr std::size_t GENERATION_BYTES = sizeof(std::uint64_t);  ///< songs.str starts with the generation
+
+	template <typename T> void writeRaw(std::ostream& os, T const& value) {
+		os.write(reinterpret_cast<char const*>(&value), sizeof(T));
+	}
+}
+
+SongCache::SongCache(fs::path const& dir): m_binFile(dir / "songs.bin"), m_strFile(dir / "songs.str") {}
+
+SongCache::~SongCache() = default;
+
+bool SongCache::load() {
+	close();
+	if (!fs::is_regular_file(m_binFile) || !fs::is_regular_file(m_strFile)) {
+		std::clog << "songs/info: No binary song cache in " << m_binFile.parent_path() << std::endl;
+		return false;
+	}
+	try {
+		if (validate()) return true;
+	} catch (std::exception const& e) {
+		std::clog << "songs/warning: Cannot read song cache " << m_binFile << ": " << e.what() << std::endl;
+	}
+	close();
+	return false;
+}
+
+bool SongCache::validate() {
+	auto reject = [this](char const* reason) {
+		std::clog << "songs/warning: Ignoring song cache " << m_binFile << " (" << reason << ")." << std::endl;
+		return false;
+	};
+	m_binMap = std::make_unique<boost::iostreams::mapped_file_source>(m_binFile.string());
+	if (m_binMap->size() < sizeof(Header)) return reject("truncated header");
+	std::memcpy(&m_header, m_binMap->data(), sizeof(Header));
+	if (std::memcmp(m_header.magic, Header().magic, sizeof(m_header.magic)) != 0) return reject("not a song cache");
+	if (m_header.version != FORMAT_VERSION || m_header.recordSize != sizeof(Record)) return reject("different version");
+	if (m_header.records > (m_binMap->size() - sizeof(Header)) / sizeof(Record)) return reject("truncated records");
+	m_strMap = std::make_unique<boost::iostreams::mapped_file_source>(m_strFile.string());
+	if (m_header.stringBytes < GENERATION_BYTES || m_strMap->size() < m_header.stringBytes) return reject("truncated strings");
+	std::uint64_t generation;
+	std::memcpy(&generation, m_strMap->data(), sizeof(generation));
+	if (generation != m_header.generation) return reject("strings do not belong to records");
+	m_records = reinterpret_cast<Record const*>(m_binMap->data() + sizeof(Header));
+	m_strings = m_strMap->data();
+	m_size = static_cast<std::size_t>(m_header.records);
+	m_index.reserve(m_size);
+	for (std::size_t i = 0; i < m_size; ++i) {
+		Record const& rec = m_records[i];
+		for (auto const& ref: rec.strings) {
+			if (std::uint64_t(ref.offset) + ref.length > m_header.stringBytes) return reject("string out of bounds");
+		}
+		if (rec.flags & DELETED) continue;
+		m_index[string(i, Field::FILENAME)] = i;  // Later records supersede earlier ones
+	}
+	return true;
+}
+
+void SongCache::close() {
+	m_index.clear();
+	m_records = nullptr;
+	m_strings = nullptr;
+	m_size = 0;
+	m_binMap.reset();
+	m_strMap.reset();
+}
+
+std::optional<std::size_t> SongCache::find(fs::path const& filename) const {
+	auto it = m_index.find(filename.string());
+	if (it == m_index.end()) return std::nullopt;
+	return it->second;
+}
+
+std::string_view SongCache::string(std::size_t index, Field f) const {
+	StringRef const& ref = m_records[index].strings[static_cast<std::size_t>(f)];
+	return std::string_view(m_strings + ref.offset, ref.length);
+}
+
+std::uint64_t SongCache::hash(std::string_view str) {
+	std::uint64_t h = 14695981039346656037ULL;
+	for (unsigned char c: str) {
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+void SongCache::store(std::vector<Entry> const& entries, std::uint64_t collation, bool removeMissing, std::vector<std::string> const& removed) {
+	if (!loaded()) load();
+	if (!loaded()) return rewrite(entries, collation);
+
+	struct Patch {
+		std::size_t index;
+		Record record;
+	};
+	Header header = m_header;
+	std::vector<Patch> patches;  // Records marked deleted in place
+	std::vector<Record> appended;  // New songs and new versions of changed ones
+	std::string strings;  // Appended to songs.str
+	std::vector<bool> seen(m_size);
+	std::unordered_set<std::string_view> stored;
+	bool overflow = false;
+	auto put = [&](std::string const& str) {
+		StringRef ref;
+		if (header.stringBytes + str.size() > std::numeric_limits<std::uint32_t>::max()) { overflow = true; return ref; }
+		ref.offset = static_cast<std::uint32_t>(header.stringBytes);
+		ref.length = static_cast<std::uint32_t>(str.size());
+		strings += str;
+		header.stringBytes += str.size();
+		return ref;
+	};
+	std::size_t changed = 0;
+	for (Entry const& entry: entries) {
+		if (!stored.insert(entry[Field::FILENAME]).second) continue;  // The same file found twice
+		Record rec = entry.record;
+		rec.flags &= ~DELETED;
+		auto found = m_index.find(entry[Field::FILENAME]);
+		if (found == m_index.end()) {
+			for (std::size_t f = 0; f < FIELDS; ++f) rec.strings[f] = put(entry.strings[f]);
+			appended.push_back(rec);
+			continue;
+		}
+		std::size_t const index = found->second;
+		seen[index] = true;
+		Record const& old = m_records[index];
+		std::uint64_t garbage = 0;
+		for (std::size_t f = 0; f < FIELDS; ++f) {
+			if (string(index, Field(f)) == entry.strings[f]) {
+				rec.strings[f] = old.strings[f];
+			} else {
+				garbage += old.strings[f].length;
+				rec.strings[f] = put(entry.strings[f]);
+			}
+		}
+		if (std::memcmp(&rec, &old, sizeof(Record)) == 0) continue;
+		// The new version supersedes the old record once the header counts it (see validate)
+		header.garbageBytes += garbage;
+		++header.deleted;
+		++changed;
+		appended.push_back(rec);
+	}
+	auto live = [&](std::size_t index) {
+		return !(m_records[index].flags & DELETED) && m_index.find(string(index, Field::FILENAME))->second == index;
+	};
+	auto remove = [&](std::size_t index) {
+		if (seen[index] || !live(index)) return;
+		seen[index] = true;
+		Record rec = m_records[index];
+		rec.flags |= DELETED;
+		for (auto const& ref: rec.strings) header.garbageBytes += ref.length;
+		++header.deleted;
+		patches.push_back({ index, rec });
+	};
+	if (removeMissing) for (std::size_t i = 0; i < m_size; ++i) remove(i);
+	for (auto const& filename: removed) {
+		auto found = m_index.find(filename);
+		if (found != m_index.end()) remove(found->second);
+	}
+	if (patches.empty() && appended.empty() && header.collation == collation) return;
+	header.records += appended.size();
+	header.collation = collation;
+	std::uint64_t const oldStringBytes = m_header.stringBytes;
+	std::uint64_t const oldRecords = m_header.records;
+	// A rewrite only writes what it is given, so the songs that were not scanned this time must be taken along
+	auto rewriteAll = [&] {
+		if (removeMissing) return rewrite(entries, collation);
+		std::vector<Entry> all = entries;
+		for (std::size_t i = 0; i < m_size; ++i) {
+			if (seen[i] || !live(i)) continue;
+			Entry& entry = all.emplace_back();
+			entry.record = m_records[i];
+			for (std::size_t f = 0; f < FIELDS; ++f) entry.strings[f] = string(i, Field(f));
+		}
+		rewrite(all, collation);
+	};
+	if (overflow || header.garbageBytes > header.stringBytes / 2 || header.deleted > header.records / 2) return rewriteAll();
+	close();
+	try {
+		// Everything but the deleted flags goes past the end that the old header knows of, and the header goes
+		// last, so an interrupted update leaves the old cache, at worst without the songs that were removed
+		std::fstream str(m_strFile, std::ios::binary | std::ios::in | std::ios::out);
+		str.seekp(static_cast<std::streamoff>(oldStringBytes));
+		str.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+		str.flush();
+		if (!str) throw std::runtime_error("Cannot write " + m_strFile.string());
+		std::fstream bin(m_binFile, std::ios::binary | std::ios::in | std::ios::out);
+		for (Patch const& p: patches) {
+			bin.seekp(static_cast<std::streamoff>(sizeof(Header) + p.index * sizeof(Record)));
+			writeRaw(bin, p.record);
+		}
+		bin.seekp(static_cast<std::streamoff>(sizeof(Header) + oldRecords * sizeof(Record)));
+		for (Record const& rec: appended) writeRaw(bin, rec);
+		bin.flush();
+		bin.seekp(0);
+		writeRaw(bin, header);
+		bin.flush();
+		if (!bin) throw std::runtime_error("Cannot write " + m_binFile.string());
+	} catch (std::exception const& e) {
+		std::clog << "songs/warning: " << e.what() << ", rewriting the song cache." << std::endl;
+		// The records up to the old end are unchanged, apart from deleted flags, so seen still applies to them
+		if (!removeMissing) load();
+		seen.resize(m_size);
+		return rewriteAll();
+	}
+	std::clog << "songs/info: Song cache updated: " << appended.size() - changed << " added, " << changed << " changed, " << patches.size() << " removed." << std::endl;
+	load();
+}
+
+void SongCache::rewrite(std::vector<Entry> const& entries, std::uint64_t collation) {
+	close();
+	Header header;
+	header.generation = static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+	header.collation = collation;
+	header.stringBytes = GENERATION_BYTES;
+	fs::path const binTmp = m_binFile.string() + ".tmp";
+	fs::path const strTmp = m_strFile.string() + ".tmp";
+	try {
+		fs::create_directories(m_binFile.parent_path());
+		std::ofstream str(strTmp, std::ios::binary);
+		std::ofstream bin(binTmp, std::ios::binary);
+		writeRaw(str, header.generation);
+		writeRaw(bin, header);  // Placeholder, rewritten once the counts are known
+		std::unordered_set<std::string_view> stored;
+		for (Entry const& entry: entries) {
+			if (!stored.insert(entry[Field::FILENAME]).second) continue;
+			Record rec = entry.record;
+			rec.flags &= ~DELETED;
+			for (std::size_t f = 0; f < FIELDS; ++f) {
+				std::string const& s = entry.strings[f];
+				if (header.stringBytes + s.size() > std::numeric_limits<std::uint32_t>::max()) throw std::runtime_error("String table too large");
+				rec.strings[f].offset = static_cast<std::uint32_t>(header.stringBytes);
+				rec.strings[f].length = static_cast<std::uint32_t>(s.size());
+				str.write(s.data(), static_cast<std::streamsize>(s.size()));
+				header.stringBytes += s.size();
+			}
+			writeRaw(bin, rec);
+			++header.records;
+		}
+		bin.seekp(0);
+		writeRaw(bin, header);
+		str.close();
+		bin.close();
+		if (!str || !bin) throw std::runtime_error("Cannot write cache files");
+		fs::rename(strTmp, m_strFile);
+		fs::rename(binTmp, m_binFile);
+	} catch (std::exception const& e) {
+		std::clog << "songs/error: Could not save song cache " << m_binFile << ": " << e.what() << std::endl;
+		std::error_code ec;
+		fs::remove(strTmp, ec);
+		fs::remove(binTmp, ec);
+		return;
+	}
+	std::clog << "songs/info: Song cache written with " << header.records << " songs." << std::endl;
+	load();
+}
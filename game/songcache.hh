@@ -0,0 +1,132 @@
+#pragma once
+
+#include "fs.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace boost { namespace iostreams { class mapped_file_source; } }
+
+/**
+* Binary song metadata cache.
+*
+* The cache consists of two files: songs.bin holds a header and an array of fixed-width records,
+* songs.str is the string table that the records point into. Both are memory-mapped by load(),
+* which only builds an index of file names; the Song objects are created from their records when
+* the song scanner actually finds the files (see Song(SongCache const&, std::size_t)).
+*
+* store() appends new songs and new versions of changed ones (a later record of a file supersedes
+* earlier ones) and only marks removed songs deleted in place. Both files are only rewritten
+* when more than half of them has become garbage or the existing files cannot be used.
+**/
+class SongCache {
+  public:
+	static constexpr std::uint32_t FORMAT_VERSION = 3;
+	/// Strings stored for each song
+	enum class Field : unsigned {
+		PATH, FILENAME, TITLE, ARTIST, EDITION, GENRE, TAGS, SONG_VERSION, LANGUAGE, CREATOR, PROVIDED_BY, COMMENT,
+		COVER, BACKGROUND, VIDEO, MIDI, MUSIC, COLLATE_TITLE, COLLATE_TITLE_ONLY, COLLATE_ARTIST, COLLATE_ARTIST_ONLY,
+		// ICU sort keys, in the order of Song::SortKey
+		SORT_TITLE, SORT_ARTIST, SORT_EDITION, SORT_CREATOR, SORT_LANGUAGE, SORT_GENRE,
+		COUNT
+	};
+	static constexpr std::size_t FIELDS = static_cast<std::size_t>(Field::COUNT);
+	enum Flags : std::uint32_t { KEYBOARD = 1, DRUMS = 2, DANCE = 4, GUITARS = 8, DELETED = 0x80000000 };
+	/// Location of a string in the string table
+	struct StringRef {
+		std::uint32_t offset = 0;
+		std::uint32_t length = 0;
+	};
+	/// One song as stored in songs.bin. Doubles that a song does not set are NaN.
+	struct Record {
+		FileStamp stamp;  ///< Song file when the record was written
+		double videoGap = 0.0;
+		double start = 0.0;
+		double end = 0.0;
+		double previewStart = 0.0;
+		double duration = 0.0;
+		double bpm = 0.0;
+		FileStamp analyzed;  ///< Main music file when the library analysis measured the song (zero if it has not)
+		double loudness = 0.0;  ///< Integrated loudness (LUFS) by the library analysis
+		double firstVocal = 0.0;  ///< Start of the first sung note by the library analysis
+		std::int32_t year = 0;
+		std::int32_t loadStatus = 0;
+		std::uint32_t type = 0;
+		std::uint32_t vocalTracks = 0;
+		std::uint32_t flags = 0;  ///< Combination of Flags
+		std::uint32_t reserved = 0;
+		std::array<StringRef, FIELDS> strings{};
+	};
+	/// A song to be stored: the record (string references are filled in by store) and its strings
+	struct Entry {
+		Record record;
+		std::array<std::string, FIELDS> strings;
+		std::string& operator[](Field f) { return strings[static_cast<std::size_t>(f)]; }
+		std::string const& operator[](Field f) const { return strings[static_cast<std::size_t>(f)]; }
+	};
+
+	/// Use songs.bin and songs.str in the given folder
+	explicit SongCache(fs::path const& dir);
+	~SongCache();
+	SongCache(SongCache const&) = delete;
+	SongCache& operator=(SongCache const&) = delete;
+
+	/// Map the cache files and index them. Returns false, leaving the cache empty, if they are missing, outdated or damaged.
+	bool load();
+	/// Release the files
+	void close();
+	/// True if load() succeeded and close() has not been called since
+	bool loaded() const { return m_records != nullptr; }
+	/// Number of records (including deleted ones)
+	std::size_t size() const { return m_size; }
+	/// Find the record of a song file
+	std::optional<std::size_t> find(fs::path const& filename) const;
+	Record const& record(std::size_t index) const { return m_records[index]; }
+	/// Get a string of a record. The view stays valid until the cache is closed.
+	std::string_view string(std::size_t index, Field f) const;
+	/// Collation tag that was passed to store() (see Songs)
+	std::uint64_t collation() const { return m_header.collation; }
+
+	/**
+	* Bring the cache files up to date with the given songs.
+	* Records are matched by file name: unchanged ones are left alone, changed and new ones appended.
+	* If removeMissing is set, songs that are not among the entries are marked deleted, as are the song files
+	* listed in removed. The cache is closed and reloaded in the process.
+	**/
+	void store(std::vector<Entry> const& entries, std::uint64_t collation, bool removeMissing, std::vector<std::string> const& removed = {});
+
+	/// 64-bit FNV-1a, used for collation tags
+	static std::uint64_t hash(std::string_view str);
+
+  private:
+	/// Header of songs.bin
+	struct Header {
+		char magic[8] = { 'P', 'E', 'R', 'F', 'S', 'O', 'N', 'G' };
+		std::uint32_t version = FORMAT_VERSION;
+		std::uint32_t recordSize = sizeof(Record);
+		std::uint64_t generation = 0;  ///< Must match the first eight bytes of songs.str
+		std::uint64_t records = 0;  ///< Number of records, including deleted ones
+		std::uint64_t deleted = 0;  ///< Number of records marked deleted or superseded
+		std::uint64_t stringBytes = 0;  ///< Used length of songs.str
+		std::uint64_t garbageBytes = 0;  ///< Bytes in songs.str no longer referenced by any record
+		std::uint64_t collation = 0;
+	};
+
+	bool validate();
+	void rewrite(std::vector<Entry> const& entries, std::uint64_t collation);
+
+	fs::path m_binFile, m_strFile;
+	std::unique_ptr<boost::iostreams::mapped_file_source> m_binMap, m_strMap;
+	Header m_header;
+	Record const* m_records = nullptr;
+	char const* m_strings = nullptr;
+	std::size_t m_size = 0;
+	std::unordered_map<std::string_view, std::size_t> m_index;  ///< File name (in the mapped string table) to record
+};
@@ -3,6 +3,8 @@
 #include "unicode.hh"
 #include "libxml++-impl.hh"
 
+#include <unicode/unistr.h>
+
 #include <algorithm>
 #include <memory>
 #include <string>
@@ -41,6 +43,10 @@ void SongItems::save(xmlpp::Element* songs) {
     }
 }
 
+void SongItems::save(DatabaseSnapshot& snapshot) const {
+    for (auto const& song : m_songs) snapshot.add(SongRecord{ song.id, song.artist, song.title, song.isBroken() });
+}
+
 SongId SongItems::addSongItem(std::string const& artist, std::string const& title, bool broken, std::optional<SongId> _id) {
     SongItem si;
     si.id = _id.value_or(assign_id_internal());
@@ -55,6 +61,8 @@ SongId SongItems::addSongItem(std::string const& artist, std::string const& titl
         si.id = assign_id_internal();
         m_songs.insert(si); // now do the insert with the fresh id
     }
+    auto [it, added] = m_byName.try_emplace(nameKey(si.artist, si.title), si.id);
+    if (!added && si.id < it->second) it->second = si.id;
     return si.id;
 }
 
@@ -76,37 +84,33 @@ void SongItems::addSong(SongPtr song) {
 
     m_songs.erase(it);
     m_songs.insert(si);
+    m_byFile[song->filename.string()] = si.id;
 }
 
 std::optional<SongId> SongItems::lookup(Song const& song) const {
-    auto const si = std::find_if(m_songs.begin(), m_songs.end(), [&song](SongItem const& si) {
-
-        // This is not always really correct but in most cases these inputs should have been normalized into unicode at one point during their life time.
-        if (song.collateByArtistOnly.length() != si.artist.length() ||
-            song.collateByTitleOnly.length() != si.title.length()) return false;
-
-        return UnicodeUtil::caseEqual(song.collateByArtistOnly, si.artist, true) && UnicodeUtil::caseEqual(song.collateByTitleOnly, si.title, true);
-        });
-    if (si != m_songs.end()) return si->id;
+    auto const it = m_byName.find(nameKey(song.collateByArtistOnly, song.collateByTitleOnly));
+    if (it != m_byName.end()) return it->second;
     return std::nullopt;
 }
 
 SongId SongItems::getSongId(SongPtr const& song) const {
-    auto const it = std::find_if(m_songs.begin(), m_songs.end(), [song](auto const& item) { return item.getSong() == song; });
+    auto const it = m_byFile.find(song->filename.string());
 
-    if (it == m_songs.end())
+    if (it == m_byFile.end())
         throw std::logic_error("SongItems::getSongId: Did not find an item matching to song!");
 
-    return it->id;
+    return it->second;
 }
 
 SongPtr SongItems::getSong(SongId id) const
 {
-	auto const it = std::find_if(m_songs.begin(), m_songs.end(), [id](auto const& item) { return item.id == id; });
+	SongItem si;
+	si.id = id;
+	auto const it = m_songs.find(si);
 
 	if (it == m_songs.end())
 		return {};
-		
+
 	return it->getSong();
 }
 
@@ -123,12 +127,18 @@ std::optional<std::string> SongItems::lookup(const SongId& id) const {
 
 SongId SongItems::assign_id_internal() const {
     // use the last one with highest id
-    auto it = std::max_element(m_songs.begin(), m_songs.end());
-    if (it != m_songs.end())
-        return it->id + 1;
+    if (!m_songs.empty())
+        return m_songs.rbegin()->id + 1;
     return 0; // empty set
 }
 
+std::string SongItems::nameKey(std::string const& artist, std::string const& title) {
+    // Case folded, so that equal keys mean case insensitive equality (this is what lookup needs)
+    std::string key;
+    icu::UnicodeString::fromUTF8(artist + '\0' + title).foldCase(U_FOLD_CASE_DEFAULT).toUTF8String(key);
+    return key;
+}
+
 
 std::shared_ptr<Song> SongItem::getSong() const {
     return m_song;
@@ -1,11 +1,13 @@
 #pragma once
 
+#include "databasestore.hh"
 #include "song.hh"
 
 #include "libxml++.hh"
 
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -54,16 +56,14 @@ private:
   This class was introduced to hide the implementation
   detail which data structure is used for the list away.
 
-  Currently a std::set is used, which makes both addSongItem()
-  and addSong() slow. The only advantage is that the id is
-  unique and it is cheap to get a new unique id.
-
-  When one of the methods is to slow, it can be optimized
-  easily. */
+  The items are kept in a std::set ordered by id. Hash indexes
+  by case folded artist and title and by song file make lookups and
+  addSong() constant time, so linking a whole library is linear. */
 class SongItems {
 public:
 	void load(xmlpp::NodeSet const& n);
 	void save(xmlpp::Element *players);
+	void save(DatabaseSnapshot& snapshot) const;
 
 	/**Adds a song item.
 	  If the id does not exist or is not unique, a new one will be assigned.
@@ -101,7 +101,10 @@ public:
 
 private:
 	SongId assign_id_internal() const;
+	static std::string nameKey(std::string const& artist, std::string const& title);
 
 	using songs_t = std::set<SongItem>;
 	songs_t m_songs;
+	std::unordered_map<std::string, SongId> m_byName;  ///< nameKey of collated artist and title to the lowest id with them
+	std::unordered_map<std::string, SongId> m_byFile;  ///< Song file to its id (not the Song, which is replaced when the file changes)
 };
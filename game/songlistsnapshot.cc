@@ -0,0 +1,268 @@
+#include "songlistsnapshot.hh"
+
+#include "sortkey.hh"
+
+#include <unicode/tblcoll.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+	constexpr std::size_t MAX_RESPONSES = 64;  ///< Cached responses per snapshot
+	constexpr std::size_t MIN_GZIP = 1024;  ///< Smaller responses are sent uncompressed
+
+	std::string urlDecode(std::string_view str) {
+		std::string ret;
+		ret.reserve(str.size());
+		for (std::size_t i = 0; i < str.size(); ++i) {
+			char c = str[i];
+			if (c == '+') c = ' ';
+			else if (c == '%') {
+				auto hex = [&](std::size_t pos) -> int {
+					if (pos >= str.size()) return -1;
+					char h = str[pos];
+					if (h >= '0' && h <= '9') return h - '0';
+					if (h >= 'a' && h <= 'f') return h - 'a' + 10;
+					if (h >= 'A' && h <= 'F') return h - 'A' + 10;
+					return -1;
+				};
+				int hi = hex(i + 1), lo = hex(i + 2);
+				if (hi < 0 || lo < 0) throw std::invalid_argument("Invalid percent-encoding in the query");
+				c = static_cast<char>(hi << 4 | lo);
+				i += 2;
+			}
+			ret += c;
+		}
+		return ret;
+	}
+
+	std::size_t number(std::string const& name, std::string const& value) {
+		if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+			throw std::invalid_argument("Invalid " + name + " \"" + value + "\"");
+		}
+		return std::stoul(value);
+	}
+
+	void writeString(std::string& out, std::string_view str) {
+		out += '"';
+		for (char c: str) {
+			if (c == '"' || c == '\\') { out += '\\'; out += c; }
+			else if (c == '\n') out += "\\n";
+			else if (c == '\t') out += "\\t";
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				char buf[8];
+				std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+				out += buf;
+			}
+			else out += c;
+		}
+		out += '"';
+	}
+
+	/// 64-bit FNV-1a
+	std::uint64_t hash(std::string_view data) {
+		std::uint64_t h = 14695981039346656037ull;
+		for (unsigned char c: data) { h ^= c; h *= 1099511628211ull; }
+		return h;
+	}
+
+	char const* const sortNames[] = { "", "title", "artist", "edition", "language", "creator" };
+	static_assert(std::size(sortNames) == static_cast<std::size_t>(SongListSnapshot::Sort::COUNT));
+}
+
+char const* SongListSnapshot::fieldName(Field field) {
+	switch (field) {
+		case Field::TITLE: return "Title";
+		case Field::ARTIST: return "Artist";
+		case Field::EDITION: return "Edition";
+		case Field::LANGUAGE: return "Language";
+		case Field::CREATOR: return "Creator";
+		case Field::NAME: return "name";
+		case Field::HAS_ERROR: return "HasError";
+		case Field::PROVIDED_BY: return "ProvidedBy";
+		case Field::COMMENT: return "Comment";
+		case Field::COUNT: break;
+	}
+	throw std::logic_error("Internal error: unknown field in SongListSnapshot::fieldName");
+}
+
+void SongListSnapshot::Query::parse(std::string_view urlQuery) {
+	while (!urlQuery.empty()) {
+		auto const amp = urlQuery.find('&');
+		std::string_view param = urlQuery.substr(0, amp);
+		urlQuery = amp == std::string_view::npos ? std::string_view() : urlQuery.substr(amp + 1);
+		if (param.empty()) continue;
+		auto const eq = param.find('=');
+		std::string const name = urlDecode(param.substr(0, eq));
+		std::string const value = eq == std::string_view::npos ? std::string() : urlDecode(param.substr(eq + 1));
+		if (name == "sort") {
+			auto it = std::find(std::begin(sortNames) + 1, std::end(sortNames), value);
+			if (it == std::end(sortNames)) throw std::invalid_argument("Unknown sort \"" + value + "\"");
+			sort = static_cast<Sort>(it - std::begin(sortNames));
+		}
+		else if (name == "order") {
+			if (value != "ascending" && value != "descending") throw std::invalid_argument("Unknown order \"" + value + "\"");
+			descending = value == "descending";
+		}
+		else if (name == "search") search = value;
+		else if (name == "offset") offset = number(name, value);
+		else if (name == "limit") limit = number(name, value);
+		else if (name == "fields") {
+			fields = 0;
+			for (std::size_t pos = 0; pos <= value.size(); ) {
+				auto const comma = std::min(value.find(',', pos), value.size());
+				std::string const key = value.substr(pos, comma - pos);
+				pos = comma + 1;
+				if (key.empty()) continue;
+				unsigned f = 0;
+				while (f < static_cast<unsigned>(Field::COUNT) && key != fieldName(static_cast<Field>(f))) ++f;
+				if (f == static_cast<unsigned>(Field::COUNT)) throw std::invalid_argument("Unknown field \"" + key + "\"");
+				fields |= 1u << f;
+			}
+			if (fields == 0) throw std::invalid_argument("No fields requested");
+		}
+	}
+}
+
+std::string SongListSnapshot::Query::key() const {
+	return std::to_string(static_cast<unsigned>(sort)) + (descending ? "d" : "a") + std::to_string(offset) + "+" + std::to_string(limit)
+	  + "/" + std::to_string(fields) + (envelope ? "e" : "") + ":" + search;
+}
+
+SongListSnapshot::SongListSnapshot(std::uint64_t generation, std::vector<Entry> entries, unsigned levels, icu::RuleBasedCollator const* collator)
+  : m_generation(generation), m_entries(std::move(entries)), m_levels(levels), m_collator(collator ? collator->clone() : nullptr)
+{
+	for (auto const& entry: m_entries) m_index.add(entry.searchText);
+}
+
+SongListSnapshot::~SongListSnapshot() = default;
+
+std::vector<std::size_t> const& SongListSnapshot::order(Sort sort) const {
+	auto& order = m_orders[static_cast<std::size_t>(sort)];
+	if (order.size() == m_entries.size()) return order;
+	order.resize(m_entries.size());
+	std::iota(order.begin(), order.end(), std::size_t());
+	if (sort != Sort::NONE) {
+		std::size_t const k = static_cast<std::size_t>(sort);
+		std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+			return sortKeyLess(m_entries[a].sortKeys[k], m_entries[b].sortKeys[k], m_levels);
+		});
+	}
+	return order;
+}
+
+std::vector<std::size_t> SongListSnapshot::select(Query const& query, std::size_t* total) const {
+	std::vector<std::size_t> selected;
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto const& sorted = order(query.sort);
+	std::vector<bool> found;
+	if (!query.search.empty()) {
+		found.resize(m_entries.size());
+		for (auto id: m_index.find(query.search, m_collator.get())) found[id] = true;
+	}
+	std::size_t matching = 0;
+	auto take = [&](std::size_t i) {
+		if (!found.empty() && !found[i]) return;
+		if (matching++ < query.offset) return;
+		if (query.limit == 0 || selected.size() < query.limit) selected.push_back(i);
+	};
+	if (query.descending) std::for_each(sorted.rbegin(), sorted.rend(), take);
+	else std::for_each(sorted.begin(), sorted.end(), take);
+	if (total) *total = matching;
+	return selected;
+}
+
+std::shared_ptr<SongListSnapshot::Response const> SongListSnapshot::respond(Query const& query) const {
+	std::string const key = query.key();
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto it = m_responses.begin(); it != m_responses.end(); ++it) {
+			if (it->first != key) continue;
+			m_responses.splice(m_responses.begin(), m_responses, it);
+			return it->second;
+		}
+	}
+	// Concurrent requests for the same query may both build it, which is harmless
+	auto response = build(query);
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_responses.emplace_front(key, response);
+	if (m_responses.size() > MAX_RESPONSES) m_responses.pop_back();
+	return response;
+}
+
+std::shared_ptr<SongListSnapshot::Response const> SongListSnapshot::build(Query const& query) const {
+	auto response = std::make_shared<Response>();
+	auto const selected = select(query, &response->total);
+	std::string& out = response->json;
+	if (query.envelope) out += "{\"total\":" + std::to_string(response->total) + ",\"offset\":" + std::to_string(query.offset) + ",\"songs\":";
+	out += '[';
+	for (std::size_t i: selected) {
+		Entry const& e = m_entries[i];
+		if (out.back() != '[') out += ',';
+		char sep = '{';
+		for (unsigned f = 0; f < static_cast<unsigned>(Field::COUNT); ++f) {
+			if (!(query.fields & 1u << f)) continue;
+			out += sep;
+			sep = ',';
+			writeString(out, fieldName(static_cast<Field>(f)));
+			out += ':';
+			switch (static_cast<Field>(f)) {
+				case Field::TITLE: writeString(out, e.title); break;
+				case Field::ARTIST: writeString(out, e.artist); break;
+				case Field::EDITION: writeString(out, e.edition); break;
+				case Field::LANGUAGE: writeString(out, e.language); break;
+				case Field::CREATOR: writeString(out, e.creator); break;
+				case Field::NAME: writeString(out, e.artist + " " + e.title); break;
+				case Field::HAS_ERROR: out += e.hasError ? "true" : "false"; break;
+				case Field::PROVIDED_BY: writeString(out, e.providedBy); break;
+				case Field::COMMENT: writeString(out, e.comment); break;
+				case Field::COUNT: break;
+			}
+		}
+		out += '}';
+	}
+	out += ']';
+	if (query.envelope) out += '}';
+	char etag[24];
+	std::snprintf(etag, sizeof(etag), "W/\"%016llx\"", static_cast<unsigned long long>(hash(out)));
+	response->etag = etag;
+	if (out.size() >= MIN_GZIP) response->gzip = gzip(out);
+	return response;
+}
+
+bool SongListSnapshot::matches(std::string_view ifNoneMatch, std::string_view etag) {
+	auto weak = [](std::string_view tag) {
+		auto const begin = tag.find_first_not_of(" \t");
+		if (begin == std::string_view::npos) return std::string_view();
+		tag = tag.substr(begin, tag.find_last_not_of(" \t") - begin + 1);
+		if (tag.substr(0, 2) == "W/") tag.remove_prefix(2);
+		return tag;
+	};
+	etag = weak(etag);
+	while (true) {
+		auto const comma = ifNoneMatch.find(',');
+		auto const tag = weak(ifNoneMatch.substr(0, comma));
+		if (tag == "*" || (!tag.empty() && tag == etag)) return true;
+		if (comma == std::string_view::npos) return false;
+		ifNoneMatch.remove_prefix(comma + 1);
+	}
+}
+
+std::string SongListSnapshot::gzip(std::string_view data) {
+	z_stream zs{};
+	// 15 bits of window, + 16 for a gzip header rather than zlib
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw std::runtime_error("deflateInit2 failed");
+	std::string out(deflateBound(&zs, static_cast<uLong>(data.size())), '\0');
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	zs.avail_in = static_cast<uInt>(data.size());
+	zs.next_out = reinterpret_cast<Bytef*>(out.data());
+	zs.avail_out = static_cast<uInt>(out.size());
+	int const ret = deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	if (ret != Z_STREAM_END) throw std::runtime_error("deflate failed");
+	return out;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "searchindex.hh"
+#include "sortkey.hh"
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+U_NAMESPACE_BEGIN class RuleBasedCollator; U_NAMESPACE_END
+
+class Song;
+
+/**
+* Read-only copy of the song library for the web API, made once per library generation (see Songs::generation).
+*
+* Sorting, searching and paging work on this copy, so that requests never change the filter or order of the song
+* screen. Sort orders are computed on first use and responses are cached by query, so that many clients polling
+* an unchanged library only cost a cache lookup. Every response carries an ETag derived from its content.
+**/
+class SongListSnapshot {
+  public:
+	/// Fields of a song in responses, in the order they are written
+	enum class Field { TITLE, ARTIST, EDITION, LANGUAGE, CREATOR, NAME, HAS_ERROR, PROVIDED_BY, COMMENT, COUNT };
+	static constexpr unsigned ALL_FIELDS = (1u << static_cast<unsigned>(Field::COUNT)) - 1;
+	/// JSON key of a field
+	static char const* fieldName(Field field);
+
+	enum class Sort { NONE, TITLE, ARTIST, EDITION, LANGUAGE, CREATOR, COUNT };
+
+	/// What the API shows of a song
+	struct Entry {
+		std::shared_ptr<Song> song;  ///< For requests that act on the song (e.g. adding it to the playlist)
+		std::string title, artist, edition, language, creator, providedBy, comment;
+		bool hasError = false;
+		std::array<CollationKey, static_cast<std::size_t>(Sort::COUNT)> sortKeys;  ///< Tertiary sort key for each Sort (see sortkey.hh)
+		std::string searchText;  ///< Text that searches look into
+	};
+
+	/// Songs and fields wanted by a request
+	struct Query {
+		Sort sort = Sort::NONE;
+		bool descending = false;
+		std::string search;  ///< Only songs containing this (empty = all)
+		std::size_t offset = 0;
+		std::size_t limit = 0;  ///< At most this many songs (0 = no limit)
+		unsigned fields = ALL_FIELDS;  ///< Bit mask of Field
+		bool envelope = false;  ///< Give {"total", "offset", "songs": [...]} rather than just the array of songs
+		/**
+		* Read sort, order (ascending/descending), search, offset, limit and fields (comma-separated JSON keys) from a
+		* URL query string, leaving the other members as they are. Throws std::invalid_argument on bad values.
+		**/
+		void parse(std::string_view urlQuery);
+		/// Identifies the response of the query
+		std::string key() const;
+	};
+
+	struct Response {
+		std::string etag;  ///< Weak entity tag, quoted
+		std::string json;
+		std::string gzip;  ///< json compressed, or empty if it is too small to be worth it
+		std::size_t total = 0;  ///< Songs matching, before offset and limit
+	};
+
+	/**
+	* @param levels collation levels that sorting considers (2 ignores case, 3 doesn't; see sortKeyLess)
+	* @param collator for confirming search matches like the song screen does (copied), or null for folded matching only
+	**/
+	SongListSnapshot(std::uint64_t generation, std::vector<Entry> entries, unsigned levels, icu::RuleBasedCollator const* collator = nullptr);
+	~SongListSnapshot();
+	std::uint64_t generation() const { return m_generation; }
+	unsigned levels() const { return m_levels; }
+	std::vector<Entry> const& entries() const { return m_entries; }
+
+	/// Indices of the entries selected by the query (sorted, searched and paged)
+	std::vector<std::size_t> select(Query const& query, std::size_t* total = nullptr) const;
+	/// JSON of the query, cached
+	std::shared_ptr<Response const> respond(Query const& query) const;
+
+	/// Does an If-None-Match header value match the entity tag (weak comparison)?
+	static bool matches(std::string_view ifNoneMatch, std::string_view etag);
+	/// Compress data to the gzip format
+	static std::string gzip(std::string_view data);
+
+  private:
+	std::vector<std::size_t> const& order(Sort sort) const;
+	std::shared_ptr<Response const> build(Query const& query) const;
+
+	std::uint64_t const m_generation;
+	std::vector<Entry> const m_entries;
+	unsigned const m_levels;
+	SearchIndex m_index;
+	mutable std::mutex m_mutex;  ///< Guards everything below
+	std::unique_ptr<icu::RuleBasedCollator> m_collator;  ///< ICU searching changes the collator, so it is not shared
+	mutable std::array<std::vector<std::size_t>, static_cast<std::size_t>(Sort::COUNT)> m_orders;  ///< Ascending, empty until used
+	mutable std::list<std::pair<std::string, std::shared_ptr<Response const>>> m_responses;  ///< Most recently used first
+};
@@ -0,0 +1,12 @@
+#include "songorder.hh"
+
+#include "configuration.hh"
+#include "sortkey.hh"
+
+void CollatedSongOrder::prepare(SongCollection const&, Database const&) {
+	m_levels = config["game/case-sorting"].b() ? 3 : 2;
+}
+
+bool CollatedSongOrder::operator()(Song const& a, Song const& b) const {
+	return sortKeyLess(a.sortKey(m_key), b.sortKey(m_key), m_levels);
+}
@@ -16,4 +16,17 @@ struct SongOrder {
 	virtual bool operator()(Song const& a, Song const& b) const = 0;
 };
 
+/// Order by one of the collated strings of songs, comparing their precomputed sort keys
+struct CollatedSongOrder : public SongOrder {
+	CollatedSongOrder(Song::SortKey key): m_key(key) {}
+
+	void prepare(SongCollection const&, Database const&) override;
+
+	bool operator()(Song const& a, Song const& b) const override;
+
+  private:
+	Song::SortKey m_key;
+	unsigned m_levels = 2;  ///< Sort key levels to compare (case is the third one)
+};
+
 using SongOrderPtr = std::shared_ptr<SongOrder>;
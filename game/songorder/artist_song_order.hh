@@ -2,10 +2,8 @@
 
 #include "songorder.hh"
 
-struct ArtistSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct ArtistSongOrder : public CollatedSongOrder {
+	ArtistSongOrder(): CollatedSongOrder(Song::SortKey::ARTIST) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
@@ -2,11 +2,9 @@
 
 #include "songorder.hh"
 
-struct CreatorSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct CreatorSongOrder : public CollatedSongOrder {
+	CreatorSongOrder(): CollatedSongOrder(Song::SortKey::CREATOR) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
 
@@ -2,11 +2,9 @@
 
 #include "songorder.hh"
 
-struct EditionSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct EditionSongOrder : public CollatedSongOrder {
+	EditionSongOrder(): CollatedSongOrder(Song::SortKey::EDITION) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
 
@@ -2,11 +2,9 @@
 
 #include "songorder.hh"
 
-struct GenreSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct GenreSongOrder : public CollatedSongOrder {
+	GenreSongOrder(): CollatedSongOrder(Song::SortKey::GENRE) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
 
@@ -2,11 +2,9 @@
 
 #include "songorder.hh"
 
-struct LanguageSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct LanguageSongOrder : public CollatedSongOrder {
+	LanguageSongOrder(): CollatedSongOrder(Song::SortKey::LANGUAGE) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
 
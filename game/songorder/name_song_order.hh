@@ -2,11 +2,9 @@
 
 #include "songorder.hh"
 
-struct NameSongOrder : public SongOrder {
-	std::string getDescription() const override;
-
-	void prepare(SongCollection const&, Database const&) override;
+struct NameSongOrder : public CollatedSongOrder {
+	NameSongOrder(): CollatedSongOrder(Song::SortKey::TITLE) {}
 
-	bool operator()(Song const& a, Song const& b) const override;
+	std::string getDescription() const override;
 };
 
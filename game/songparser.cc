@@ -56,6 +56,14 @@ namespace SongParserUtil {
 	}
 }
 
+bool isSongFile(fs::path const& file) {
+	std::string const name = toLower(file.filename().string());
+	auto endsWith = [&name](std::string const& suffix) {
+		return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	return endsWith(".txt") || endsWith(".sm") || name == "song.ini" || name == "notes.xml";
+}
+
 SongParser::SongParser(Song& s) : m_song(s) {
 	try {
 		// Read the file, determine the type and do some initial validation checks
@@ -68,6 +68,9 @@ namespace SongParserUtil {
 	void eraseLast(std::string& s, char ch = ' ');
 }
 
+/// True for the files that SongParser reads (*.txt, *.sm, song.ini and notes.xml, in any case)
+bool isSongFile(fs::path const& file);
+
 /// Parse a song file; this object is only used while parsing and is discarded once done.
 /// Format-specific member functions are implemented in songparser-*.cc.
 class SongParser {
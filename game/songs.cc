@@ -3,12 +3,17 @@
 #include "database.hh"
 #include "fs.hh"
 #include "i18n.hh"
+#include "boundedqueue.hh"
 #include "json.hh"
 #include "libxml++-impl.hh"
 #include "log.hh"
 #include "platform.hh"
 #include "profiler.hh"
 #include "song.hh"
+#include "songcache.hh"
+#include "songparser.hh"
+#include "songwatcher.hh"
+#include "trace.hh"
 
 #include "songorder/artist_song_order.hh"
 #include "songorder/creator_song_order.hh"
@@ -23,15 +28,17 @@
 #include "songorder/score_song_order.hh"
 
 #include <fmt/format.h>
-#include <unicode/stsearch.h>
 
 #include <algorithm>
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <map>
 #include <regex>
+#include <set>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace {
 	void initializeSongOrders(Songs& songs) {
@@ -47,8 +54,33 @@ namespace {
 		songs.addSongOrder(std::make_shared<FileTimeSongOrder>());
 		songs.addSongOrder(std::make_shared<CreatorSongOrder>());
 	}
+
+	/// True if file is dir or anything below it
+	bool isUnder(fs::path const& file, fs::path const& dir) {
+		return std::mismatch(dir.begin(), dir.end(), file.begin(), file.end()).first == dir.end();
+	}
+
+	const std::size_t SCAN_QUEUE_SIZE = 1024;  ///< Song files waiting for parsing
+	const std::size_t PUBLISH_BATCH = 256;  ///< Songs added to the list at once
+	const auto PUBLISH_INTERVAL = 250ms;  ///< ... or after this much time, so that the song screen fills up while scanning
 }
 
+/// Song file found by the scanner that needs parsing
+struct Songs::ScanJob {
+	fs::path file;
+	std::size_t root;  ///< Index of the song folder (in ScanStats)
+};
+
+/// Counters of one song folder
+struct Songs::ScanStats {
+	std::atomic<unsigned> files{ 0 };  ///< Song files found
+	std::atomic<unsigned> cached{ 0 };  ///< Unchanged songs loaded from cache
+	std::atomic<unsigned> parsed{ 0 };
+	std::atomic<unsigned> failed{ 0 };
+	std::atomic<std::int64_t> parseMicros{ 0 };  ///< Total parsing time of all workers
+	double enumeration = 0.0;  ///< Seconds spent walking the folder (including cache lookups)
+};
+
 Songs::Songs(Database & database, std::string const& songlist)
  : m_songlist(songlist),  m_database(database) {
 	m_updateTimer.setTarget(getInf()); // Using this as a simple timer counting seconds
@@ -63,6 +95,7 @@ Songs::Songs(Database & database, std::string const& songlist)
 Songs::~Songs() {
 	m_loading = false; // Terminate song loading if currently in progress
 	m_thread->join();
+	m_watcher.reset();
 }
 
 void Songs::reload() {
@@ -80,18 +113,28 @@ void Songs::reload() {
 const std::string SONGS_CACHE_JSON_FILE = "songs.json";
 
 void Songs::reload_internal() {
+	trace::setThreadName("song scanner");
+	m_watcher.reset();  // A full scan finds all changes anyway
+	std::lock_guard<std::mutex> writer(m_writerMutex);
 	{
 		std::unique_lock<std::shared_mutex> l(m_mutex);
 		m_songs.clear();
+		m_searchIndex.clear();
+		m_indexed.clear();
+		m_indexIds.clear();
 		m_dirty = true;
+		++m_generation;
 	}
 	std::clog << "songs/notice: Starting to load all songs from cache." << std::endl;
 
 	Profiler prof("songloader");
 
-	auto cache = loadCache();
+	{
+		TRACE_ZONE("songs/load cache");
+		loadCache();
+	}
 
-    prof("load-cache");
+	prof("load-cache");
 
 	std::clog << "songs/notice: Done loading the cache." << std::endl;
 	std::clog << "songs/notice: Starting to load all songs from disk, to update the cache." << std::endl;
@@ -100,41 +143,135 @@ void Songs::reload_internal() {
 	Paths paths = getPathsConfig("paths/songs");
 	paths.insert(paths.begin(), systemSongs.begin(), systemSongs.end());
 
-	for (auto it = paths.begin(); m_loading && it != paths.end(); ++it) { //loop through stored directories from config
+	// The directory walk runs here and feeds the song files that need parsing to the parser threads
+	unsigned threads = config["songs/scanner_threads"].ui();
+	if (threads == 0) threads = std::max(2u, std::thread::hardware_concurrency());
+	std::vector<ScanStats> stats(paths.size());
+	BoundedQueue<ScanJob> queue(SCAN_QUEUE_SIZE);
+	std::vector<std::thread> parsers;
+	for (unsigned i = 0; i < threads; ++i) parsers.emplace_back([this, &queue, &stats] { parseSongs_internal(queue, stats); });
+	Time const scanBegin = Clock::now();
+	std::size_t root = 0;
+	for (auto it = paths.begin(); m_loading && it != paths.end(); ++it, ++root) { //loop through stored directories from config
 		try {
 			if (!fs::is_directory(*it)) { std::clog << "songs/info: >>> Not scanning: " << *it << " (no such directory)\n"; continue; }
 			std::clog << "songs/info: >>> Scanning " << *it << std::endl;
-			size_t count = loadedSongs();
-			reload_internal(*it, cache);
-			size_t diff = loadedSongs() - count;
-			if (diff > 0 && m_loading) std::clog << "songs/info: " << diff << " songs loaded\n";
+			TRACE_ZONE("songs/walk");
+			Time const begin = Clock::now();
+			reload_internal(*it, root, queue, stats[root]);
+			stats[root].enumeration = Seconds(Clock::now() - begin).count();
 		} catch (std::exception& e) {
 			std::clog << "songs/error: >>> Error scanning " << *it << ": " << e.what() << '\n';
 		}
 	}
+	queue.close();
+	for (auto& t: parsers) t.join();
+	publish_internal();
+	double const scanTime = Seconds(Clock::now() - scanBegin).count();
+	unsigned files = 0, parsed = 0;
+	root = 0;
+	for (auto it = paths.begin(); it != paths.end(); ++it, ++root) {
+		ScanStats const& st = stats[root];
+		if (st.files == 0) continue;
+		files += st.files;
+		parsed += st.parsed;
+		std::clog << fmt::format("songs/info: {}: {} files ({} cached, {} parsed, {} failed), walking {:.2f} s, parsing {:.2f} s",
+		  it->string(), st.files.load(), st.cached.load(), st.parsed.load(), st.failed.load(), st.enumeration, static_cast<double>(st.parseMicros.load()) * 1e-6) << std::endl;
+	}
+	std::clog << fmt::format("songs/info: Scanned {} song files in {:.2f} s ({:.0f} files/s), {} parsed using {} threads.",
+	  files, scanTime, static_cast<double>(files) / std::max(scanTime, 1e-3), parsed, threads) << std::endl;
 	prof("build-list");
 
 	if (m_loading) dumpSongs_internal(); // Dump the songlist to file (if requested)
 	std::clog << std::flush;
+	bool const complete = m_loading;  // Songs missing from an interrupted scan must stay in the cache
 	m_loading = false;
 	std::clog << "songs/notice: Done Loading. Loaded " << loadedSongs() << " Songs." << std::endl;
-	CacheSonglist();
+	CacheSonglist(complete);
 	std::clog << "songs/notice: Done Caching." << std::endl;
+	if (complete && config["songs/watch"].b()) {
+		auto onChange = [this](std::vector<SongWatcher::Change> const& changes) { applyChanges_internal(changes); };
+		m_watcher = std::make_unique<SongWatcher>(paths, onChange, Seconds(config["songs/watch_interval"].ui()));
+	}
 	doneLoading = true;
 }
 
-Songs::Cache Songs::loadCache() {
+void Songs::loadCache() {
+	// Collate strings depend on game/sorting_ignore, sort keys on the sort collator and the ICU version
+	std::string collation;
+	for (auto const& term: config["game/sorting_ignore"].sl()) collation += term + '\n';
+	collation += U_ICU_VERSION;
+	if (auto const* collator = UnicodeUtil::m_sortCollator.get()) {
+		icu::ErrorCode error;
+		collation += std::string("\n") + collator->getLocale(ULOC_ACTUAL_LOCALE, error).getName();
+	}
+	m_collation = SongCache::hash(collation);
+	m_imported.clear();
+	if (!m_cache) m_cache = std::make_unique<SongCache>(getCacheDir());
+	if (m_cache->load()) {
+		std::clog << "songs/info: Song cache has " << m_cache->size() << " records." << std::endl;
+		return;
+	}
+	// No binary cache yet, import the old JSON cache if there is one
 	const fs::path songsMetaFile = getCacheDir() / SONGS_CACHE_JSON_FILE;
+	if (!fs::is_regular_file(songsMetaFile)) return;
 	auto jsonRoot = readJSON(songsMetaFile);
-	Cache cache;
 	for (auto const& songData : jsonRoot) {
 		auto song = std::make_shared<Song> (songData);
-		cache[song->filename.string()] = std::move(song);
+		m_imported[song->filename.string()] = std::move(song);
+	}
+	std::clog << "songs/notice: Imported " << m_imported.size() << " songs from " << songsMetaFile.string() << std::endl;
+}
+
+std::shared_ptr<Song> Songs::cachedSong(fs::path const& filename) {
+	if (auto index = m_cache->find(filename)) {
+		if (m_cache->record(*index).stamp != FileStamp::of(filename)) {
+			std::clog << "songs/info: Song changed since it was cached: " << filename.string() << std::endl;
+			return nullptr;
+		}
+		auto song = std::make_shared<Song>(*m_cache, *index);
+		if (m_cache->collation() != m_collation) song->collateUpdate();  // game/sorting_ignore or the sort collator has changed
+		return song;
 	}
-	return cache;
+	auto match = m_imported.find(filename.string());
+	if (match == m_imported.end()) return nullptr;
+	// songs.json does not know file stamps; trust it like before and record the current one
+	match->second->fileStamp = FileStamp::of(filename);
+	return match->second;
 }
 
-void Songs::CacheSonglist() {
+void Songs::CacheSonglist(bool complete) {
+	std::vector<SongCache::Entry> entries;
+	{
+		std::shared_lock<std::shared_mutex> l(m_mutex);
+		entries.reserve(m_songs.size());
+		for (auto const& song : m_songs) entries.push_back(song->cacheEntry());
+	}
+	m_cache->store(entries, m_collation, complete);
+	m_cache->close();  // Songs have their own copies of everything, no need to keep the files mapped
+	m_imported.clear();
+	if (config["songs/export-json"].b()) exportJSON(getCacheDir() / SONGS_CACHE_JSON_FILE);
+}
+
+void Songs::cacheChanges(SongCollection const& changed, std::vector<std::string> const& removed) {
+	std::vector<SongCache::Entry> entries;
+	entries.reserve(changed.size());
+	for (auto const& song: changed) entries.push_back(song->cacheEntry());
+	m_cache->store(entries, m_collation, false, removed);
+	m_cache->close();
+	if (config["songs/export-json"].b()) exportJSON(getCacheDir() / SONGS_CACHE_JSON_FILE);
+}
+
+void Songs::updateCache(std::function<void()> const& change) {
+	std::lock_guard<std::mutex> writer(m_writerMutex);
+	{
+		std::unique_lock<std::shared_mutex> l(m_mutex);
+		change();
+	}
+	CacheSonglist(false);
+}
+
+void Songs::exportJSON(fs::path const& filename) const {
 	auto jsonRoot = nlohmann::json::array();
 	std::shared_lock<std::shared_mutex> l(m_mutex);
 	for (auto const& song : m_songs) {
@@ -270,13 +407,11 @@ void Songs::CacheSonglist() {
 		}
 	}
 
-	fs::path cacheDir = getCacheDir() / SONGS_CACHE_JSON_FILE;
-	writeJSON(jsonRoot, cacheDir);
-	}
+	writeJSON(jsonRoot, filename);
+}
 
-void Songs::reload_internal(fs::path const& parent, Cache cache) {
+void Songs::reload_internal(fs::path const& parent, std::size_t root, BoundedQueue<ScanJob>& queue, ScanStats& stats) {
 	try {
-		std::regex expression(R"((\.txt|^song\.ini|^notes\.xml|\.sm)$)", std::regex_constants::icase);
 		if (fs::is_empty(parent)) {
 			std::clog << "songs/notice: Directory " << parent << " is empty. Skipping directory. " << '\n';
 			return;
@@ -293,24 +428,16 @@ void Songs::reload_internal(fs::path const& parent, Cache cache) {
 				continue;
 			}
 			fs::path p = dir.path();
-			if (!regex_search(p.filename().string(), expression)) {
+			if (!isSongFile(p)) {
 				continue; //if the folder does not contain any of the requested files, ignore it
 			}
-			try { //found song file, make a new song with it.
-				auto song = std::shared_ptr<Song>{};
-				auto match = cache.find(p.string());
-				if ( match != cache.end()) {
-					song = match->second;
-				} else {
-					std::clog << "songs/notice: Found song which was not in the cache: " << p.string() << std::endl;
-					song = std::make_shared<Song> (p);
-				}
-				std::unique_lock<std::shared_mutex> l(m_mutex);
-				m_songs.emplace_back(song); //put it in the database, if found twice will appear in double
-				m_database.addSong(song);
-				m_dirty = true;
-			} catch (SongParserException& e) {
-				std::clog << e;
+			++stats.files;
+			// Unchanged songs come from the cache without parsing, the rest is left for the parser threads
+			if (auto song = cachedSong(p)) {
+				++stats.cached;
+				addSong_internal(std::move(song));
+			} else if (!queue.push(ScanJob{ p, root })) {
+				return;
 			}
 		}
 	} catch (std::exception const& e) {
@@ -318,6 +445,158 @@ void Songs::reload_internal(fs::path const& parent, Cache cache) {
 	}
 }
 
+void Songs::parseSongs_internal(BoundedQueue<ScanJob>& queue, std::vector<ScanStats>& stats) {
+	trace::setThreadName("song parser");
+	ScanJob job;
+	while (queue.pop(job)) {
+		if (!m_loading) continue;  // Loading was cancelled, just empty the queue
+		TRACE_ZONE("songs/parse");
+		ScanStats& st = stats[job.root];
+		Time const begin = Clock::now();
+		try { //found song file, make a new song with it.
+			std::clog << "songs/notice: Found song which was not in the cache: " << job.file.string() << std::endl;
+			auto song = std::make_shared<Song>(job.file);
+			++st.parsed;
+			addSong_internal(std::move(song));
+		} catch (SongParserException& e) {
+			++st.failed;
+			std::clog << e;
+		} catch (std::exception const& e) {
+			++st.failed;
+			std::clog << "songs/error: Error loading " << job.file << ": " << e.what() << '\n';
+		}
+		st.parseMicros += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+	}
+}
+
+void Songs::addSong_internal(SongPtr song) {
+	{
+		std::lock_guard<std::mutex> l(m_pendingMutex);
+		m_pending.push_back(std::move(song));
+		if (m_pending.size() < PUBLISH_BATCH && Clock::now() - m_lastPublish < PUBLISH_INTERVAL) return;
+	}
+	publish_internal();
+}
+
+void Songs::publish_internal() {
+	SongCollection batch;
+	{
+		std::lock_guard<std::mutex> l(m_pendingMutex);
+		batch.swap(m_pending);
+		m_lastPublish = Clock::now();
+	}
+	if (batch.empty()) return;
+	std::unique_lock<std::shared_mutex> l(m_mutex);
+	for (auto const& song: batch) {
+		m_songs.push_back(song); //put it in the database, if found twice will appear in double
+		index_internal(song);
+		m_database.addSong(song);
+	}
+	m_dirty = true;
+	++m_generation;
+}
+
+void Songs::index_internal(std::shared_ptr<Song> const& song) {
+	auto id = m_searchIndex.add(song->strFull());
+	if (m_indexed.size() <= id) m_indexed.resize(id + 1);
+	m_indexed[id] = song;
+	m_indexIds[song.get()] = id;
+}
+
+void Songs::unindex_internal(Song const* song) {
+	auto it = m_indexIds.find(song);
+	if (it == m_indexIds.end()) return;
+	m_searchIndex.remove(it->second);
+	m_indexed[it->second].reset();
+	m_indexIds.erase(it);
+}
+
+void Songs::applyChanges_internal(std::vector<SongWatcher::Change> const& changes) {
+	std::lock_guard<std::mutex> writer(m_writerMutex);
+	SongCollection songs;
+	{
+		std::shared_lock<std::shared_mutex> l(m_mutex);
+		songs = m_songs;
+	}
+	std::error_code ec;
+	// Folders to look at again. Recursive ones (new folder trees) only reparse songs whose files have changed,
+	// the others were touched directly and reparse all their songs, as any file in a song folder may affect it.
+	std::map<fs::path, bool> folders;
+	std::set<Song const*> removed;
+	for (auto const& change: changes) {
+		if (fs::is_directory(change.path, ec)) {
+			folders[change.path] |= change.recursive;
+			continue;
+		}
+		if (!fs::exists(change.path, ec)) {
+			for (auto const& song: songs) if (isUnder(song->filename, change.path)) removed.insert(song.get());
+		}
+		fs::path const parent = change.path.parent_path();
+		if (fs::is_directory(parent, ec)) folders.try_emplace(parent, false);
+	}
+	std::unordered_map<std::string, SongPtr> byFile;
+	for (auto const& song: songs) byFile[song->filename.string()] = song;
+	SongCollection added;
+	std::vector<std::pair<SongPtr, SongPtr>> replaced;  // Old and new version
+	std::set<fs::path> parsed;
+	for (auto const& [folder, recursive]: folders) {
+		for (auto const& song: songs) {
+			bool inFolder = recursive ? isUnder(song->filename, folder) : song->filename.parent_path() == folder;
+			if (inFolder && !fs::exists(song->filename, ec)) removed.insert(song.get());
+		}
+		std::vector<fs::path> files;
+		auto collect = [&](fs::directory_entry const& entry) {
+			std::error_code typeError;
+			if (entry.is_regular_file(typeError) && isSongFile(entry.path())) files.push_back(entry.path());
+		};
+		if (recursive) {
+			auto it = fs::recursive_directory_iterator(folder, fs::directory_options::follow_directory_symlink | fs::directory_options::skip_permission_denied, ec);
+			for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) collect(*it);
+		} else {
+			for (auto it = fs::directory_iterator(folder, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) collect(*it);
+		}
+		for (auto const& file: files) {
+			if (!parsed.insert(file).second) continue;
+			auto match = byFile.find(file.string());
+			SongPtr old = match == byFile.end() ? nullptr : match->second;
+			if (old && recursive && old->fileStamp == FileStamp::of(file)) continue;
+			try {
+				auto song = std::make_shared<Song>(file);
+				if (old) replaced.emplace_back(old, song);
+				else added.push_back(song);
+			} catch (SongParserException& e) {
+				std::clog << e;
+				if (old) removed.insert(old.get());
+			}
+		}
+	}
+	if (removed.empty() && added.empty() && replaced.empty()) return;
+	std::vector<std::string> removedFiles;
+	for (auto const& song: songs) if (removed.count(song.get())) removedFiles.push_back(song->filename.string());
+	{
+		std::unique_lock<std::shared_mutex> l(m_mutex);
+		m_songs.erase(std::remove_if(m_songs.begin(), m_songs.end(), [&](SongPtr const& s) { return removed.count(s.get()) > 0; }), m_songs.end());
+		for (Song const* song: removed) unindex_internal(song);
+		for (auto const& [old, song]: replaced) {
+			auto it = std::find(m_songs.begin(), m_songs.end(), old);
+			if (it != m_songs.end()) *it = song;
+			unindex_internal(old.get());
+			index_internal(song);
+			m_database.addSong(song);
+		}
+		for (auto const& song: added) {
+			m_songs.push_back(song);
+			index_internal(song);
+			m_database.addSong(song);
+		}
+		m_dirty = true;
+		++m_generation;
+	}
+	std::clog << "songs/info: Song folders changed: " << added.size() << " songs added, " << replaced.size() << " updated, " << removed.size() << " removed." << std::endl;
+	for (auto const& [old, song]: replaced) added.push_back(song);
+	cacheChanges(added, removedFiles);
+}
+
 /// Store currently selected song on construction and restore the selection on destruction
 /// Assumes that m_filtered has been modified and finds the old selection by pointer value.
 /// Sets up math_cover so that the old selection is restored if possible, otherwise the first song is selected.
@@ -362,28 +641,22 @@ void Songs::filter_internal() {
 			std::shared_lock<std::shared_mutex> l(m_mutex);
 			filtered = m_songs;
 		} else {
-			auto filter = icu::UnicodeString::fromUTF8(
-				UnicodeUtil::convertToUTF8(m_filter)
-			);
-			icu::ErrorCode icuError;
-
 			std::shared_lock<std::shared_mutex> l(m_mutex);
-			std::copy_if (m_songs.begin(), m_songs.end(), std::back_inserter(filtered), [&](std::shared_ptr<Song> it){
-			// Filter by type first.
+			// The search index finds the songs matching the search term, in the order they were added
+			SongCollection candidates;
+			if (m_filter.empty()) candidates = m_songs;
+			else {
+				for (auto id: m_searchIndex.find(UnicodeUtil::convertToUTF8(m_filter), UnicodeUtil::m_searchCollator.get())) {
+					candidates.push_back(m_indexed[id]);
+				}
+			}
+			std::copy_if (candidates.begin(), candidates.end(), std::back_inserter(filtered), [&](std::shared_ptr<Song> it){
 				if (m_type == 1 && !(*it).hasDance()) return false;
 				if (m_type == 2 && !(*it).hasVocals()) return false;
 				if (m_type == 3 && !(*it).hasDuet()) return false;
 				if (m_type == 4 && !(*it).hasGuitars()) return false;
 				if (m_type == 5 && !(*it).hasDrums() && !(*it).hasKeyboard()) return false;
 				if (m_type == 6 && (!(*it).hasVocals() || !(*it).hasGuitars() || (!(*it).hasDrums() && !(*it).hasKeyboard()))) return false;
-
-		  // If search is not empty, filter by search term.
-				if (!m_filter.empty()) {
-					icu::StringSearch search = icu::StringSearch(filter, icu::UnicodeString::fromUTF8((*it).strFull()), UnicodeUtil::m_searchCollator.get(), nullptr, icuError);
-					return (search.first(icuError) != USEARCH_DONE);
-					}
-
-		// If we still haven't returned, it must be a type match with an empty search string.
 				return true;
 			});
 		}
@@ -396,52 +669,6 @@ void Songs::filter_internal() {
 }
 
 namespace {
-
-	/// A functor that compares songs based on a selected member field of them.
-	template<typename Field> class CmpByField {
-		Field Song::* m_field;
-		bool m_ascending;
-	  public:
-		/** @param field a pointer to the field to use (pointer to member) **/
-		CmpByField(Field Song::* field, bool ascending): m_field(field), m_ascending(ascending) {}
-		/// Compare left < right
-		bool operator()(Song const& left , Song const& right) {
-			return left.*m_field < right.*m_field;
-		}
-		/// Compare *left < *right
-		bool operator()(std::shared_ptr<Song> const& left, std::shared_ptr<Song> const& right) {
-			return operator()(*left, *right);
-		}
-	};
-
-	template<> class CmpByField<std::string> {
-		std::string Song::* m_field;
-		bool m_ascending;
-	  public:
-		/** @param field a pointer to the field to use (pointer to member) **/
-		CmpByField(std::string Song::* field, bool ascending): m_field(field), m_ascending(ascending) {}
-		/// Compare left < right
-		bool operator()(Song const& left , Song const& right) {
-			icu::UnicodeString leftVal = icu::UnicodeString::fromUTF8(left.*m_field);
-			icu::UnicodeString rightVal = icu::UnicodeString::fromUTF8(right.*m_field);
-			icu::ErrorCode sortError;
-			UCollationResult result = UnicodeUtil::m_sortCollator->compare(leftVal, rightVal, sortError);
-			if (sortError.isSuccess()) {
-				return result == UCOL_LESS ? m_ascending : !m_ascending;
-			}
-			else {
-				throw std::runtime_error("unicode/error: Sorting comparison error in CmpByField<std::string> ");
-			}
-		}
-		/// Compare *left < *right
-		bool operator()(std::shared_ptr<Song> const& left, std::shared_ptr<Song> const& right) {
-			return operator()(*left, *right);
-		}
-	};
-
-	/// A helper for easily constructing CmpByField objects
-	template <typename T> CmpByField<T> customComparator(T Song::*field, bool ascending) { return CmpByField<T>(field, ascending); }
-
 	static const unsigned short types = 7;
 }
 
@@ -585,7 +812,8 @@ namespace {
 void Songs::dumpSongs_internal() const {
 	if (m_songlist.empty()) return;
 	SongCollection svec = [&] { std::shared_lock<std::shared_mutex> l(m_mutex); return m_songs; }();
-	std::sort(svec.begin(), svec.end(), customComparator(&Song::collateByArtist, true));
+	ArtistSongOrder order;
+	std::sort(svec.begin(), svec.end(), [&](SongPtr const& a, SongPtr const& b) { return order(*a, *b); });
 	fs::path coverpath = fs::path(m_songlist) / "covers";
 	fs::create_directories(coverpath);
 	dumpXML(svec, m_songlist + "/songlist.xml");
@@ -1,14 +1,18 @@
 #pragma once
 
 #include "animvalue.hh"
+#include "chrono.hh"
 #include "fs.hh"
 #include "screen.hh"
+#include "searchindex.hh"
 #include "songorder.hh"
+#include "songwatcher.hh"
 #include "utils/cycle.hh"
 
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -17,8 +21,10 @@
 #include <vector>
 #include <shared_mutex>
 
+template <typename T> class BoundedQueue;
 class Game;
 class Song;
+class SongCache;
 class Database;
 
 /// songs class for songs screen
@@ -84,15 +90,33 @@ class Songs {
 	std::atomic<bool> doneLoading{ false };
 	std::atomic<bool> displayedAlert{ false };
 	size_t loadedSongs() const { std::shared_lock<std::shared_mutex> l(m_mutex); return m_songs.size(); }
+	/// All songs in the library (unfiltered, in the order they were found), for readers other than the song screen
+	SongCollection allSongs() const { std::shared_lock<std::shared_mutex> l(m_mutex); return m_songs; }
+	/// Changes whenever songs are added to or removed from the library
+	std::uint64_t generation() const { return m_generation; }
 	void addSongOrder(SongOrderPtr);
+	/// Run change with the songs locked against the scanner, the watcher and readers, then store them in the cache
+	void updateCache(std::function<void()> const& change);
 
   private:
-	Cache loadCache();
-	void CacheSonglist();
+	void loadCache();
+	std::shared_ptr<Song> cachedSong(fs::path const& filename);
+	void CacheSonglist(bool complete);
+	/// Store only the given songs in the cache and mark the removed song files deleted
+	void cacheChanges(SongCollection const& changed, std::vector<std::string> const& removed);
+	void exportJSON(fs::path const& filename) const;
 
 	void dumpSongs_internal() const;
 	void reload_internal();
-	void reload_internal(fs::path const& p, Cache cache);
+	struct ScanJob;
+	struct ScanStats;
+	void reload_internal(fs::path const& p, std::size_t root, BoundedQueue<ScanJob>& queue, ScanStats& stats);
+	void parseSongs_internal(BoundedQueue<ScanJob>& queue, std::vector<ScanStats>& stats);
+	void addSong_internal(std::shared_ptr<Song> song);
+	void publish_internal();
+	void applyChanges_internal(std::vector<SongWatcher::Change> const& changes);
+	void index_internal(std::shared_ptr<Song> const& song);
+	void unindex_internal(Song const* song);
 	void randomize_internal();
 	void filter_internal();
 	void sort_internal(bool descending = false);
@@ -100,9 +124,13 @@ class Songs {
 	class RestoreSel;
 	std::string m_songlist;
 	// Careful the m_songs needs to be correctly locked when accessed, and
-	// especially, the reload_internal thread expects to be the only thread
-	// to modify this member (any other thread may read it).
+	// especially, only the thread holding m_writerMutex (reload_internal or
+	// the watcher applying changes) may modify this member (any other thread may read it).
 	SongCollection m_songs, m_filtered;
+	// Search index of m_songs, kept up to date (and locked) together with it
+	SearchIndex m_searchIndex;
+	SongCollection m_indexed;  ///< Song of each search index id (null once removed)
+	std::unordered_map<Song const*, SearchIndex::Id> m_indexIds;
 	AnimValue m_updateTimer;
 	AnimAcceleration math_cover;
 	std::string m_filter;
@@ -110,8 +138,19 @@ class Songs {
 	unsigned short m_type = 0;
 	Cycle<unsigned short> m_order;  // Set by constructor
 	std::atomic<bool> m_dirty{ false };
+	std::atomic<std::uint64_t> m_generation{ 0 };
 	std::atomic<bool> m_loading{ false };
 	std::unique_ptr<std::thread> m_thread;
 	mutable std::shared_mutex m_mutex;
 	std::vector<SongOrderPtr> m_songOrders;
+	std::mutex m_writerMutex;  ///< Held while scanning or applying changes of song folders
+	std::unique_ptr<SongWatcher> m_watcher;  ///< Created and destroyed by the reload_internal thread
+	// Only used while holding m_writerMutex
+	std::unique_ptr<SongCache> m_cache;  ///< Binary song cache
+	Cache m_imported;  ///< Songs imported from songs.json when there is no usable binary cache
+	std::uint64_t m_collation = 0;  ///< Tag of the collation settings that collate strings are built with
+	// Songs found by the scanner threads, added to m_songs in batches
+	std::mutex m_pendingMutex;
+	SongCollection m_pending;
+	Time m_lastPublish;
 };
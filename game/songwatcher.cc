@@ -0,0 +1,205 @@
+#include "songwatcher.hh"
+
+#include <boost/predef/os.h>
+
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#if BOOST_OS_LINUX
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const Seconds MAX_DELAY = 10s;  ///< Report changes at least this often, even if events keep coming
+	const int MAX_DEPTH = 10;  ///< Same limit as the song scanner, for cyclic symlinks
+
+	/// Call func for every folder below root (not root itself)
+	template <typename Func> void forEachFolder(fs::path const& root, Func const& func) {
+		std::error_code ec;
+		auto it = fs::recursive_directory_iterator(root, fs::directory_options::follow_directory_symlink | fs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+			if (it.depth() >= MAX_DEPTH) it.disable_recursion_pending();
+			std::error_code typeError;
+			if (it->is_directory(typeError) && !func(it->path())) return;
+		}
+	}
+
+#if BOOST_OS_LINUX
+	/// inotify watches for folder trees
+	class Inotify {
+	  public:
+		Inotify(): m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+		~Inotify() { if (m_fd >= 0) ::close(m_fd); }
+		bool valid() const { return m_fd >= 0; }
+		/// Watch a folder and everything below it. Returns false if the watch limit is reached.
+		bool watchTree(fs::path const& root) {
+			if (!watch(root)) return false;
+			bool ok = true;
+			forEachFolder(root, [&](fs::path const& dir) { return ok = watch(dir); });
+			return ok;
+		}
+		/// Wait up to timeoutMs for events and call func(path, isFolder, created) for each
+		template <typename Func> void read(int timeoutMs, Func const& func) {
+			pollfd pfd{ m_fd, POLLIN, 0 };
+			if (::poll(&pfd, 1, timeoutMs) <= 0) return;
+			alignas(inotify_event) char buf[64 * 1024];
+			ssize_t len;
+			while ((len = ::read(m_fd, buf, sizeof(buf))) > 0) {
+				for (char* p = buf; p < buf + len; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+					auto const* ev = reinterpret_cast<inotify_event const*>(p);
+					if (ev->mask & IN_Q_OVERFLOW) { func(fs::path(), true, true); continue; }
+					auto it = m_watches.find(ev->wd);
+					if (it == m_watches.end()) continue;
+					if (ev->mask & IN_IGNORED) { m_watches.erase(it); continue; }
+					if (ev->len == 0) continue;
+					func(it->second / ev->name, (ev->mask & IN_ISDIR) != 0, (ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0);
+				}
+			}
+		}
+		std::size_t size() const { return m_watches.size(); }
+
+	  private:
+		bool watch(fs::path const& dir) {
+			int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+			if (wd >= 0) m_watches[wd] = dir;
+			return wd >= 0 || errno != ENOSPC;  // Unreadable folders are skipped, only the watch limit is fatal
+		}
+		int m_fd;
+		std::unordered_map<int, fs::path> m_watches;
+	};
+
+	/// Changes made by other machines to network shares are invisible to inotify
+	bool isNetworkFileSystem(fs::path const& dir) {
+		struct statfs info;
+		if (statfs(dir.c_str(), &info) != 0) return false;
+		switch (static_cast<unsigned long>(info.f_type)) {
+			case 0x6969:  // NFS
+			case 0x517B:  // SMB
+			case 0xFF534D42:  // CIFS
+			case 0xFE534D42:  // SMB2
+			case 0x65735546:  // FUSE (sshfs etc.)
+				return true;
+			default:
+				return false;
+		}
+	}
+#endif
+}
+
+SongWatcher::SongWatcher(Paths const& roots, Callback callback, Seconds pollInterval, Seconds quietTime):
+  m_callback(std::move(callback)), m_pollInterval(pollInterval), m_quietTime(quietTime)
+{
+	std::error_code ec;
+	for (auto const& root: roots) if (fs::is_directory(root, ec)) m_roots.push_back(root);
+	m_thread = std::thread([this] { run(); });
+}
+
+SongWatcher::~SongWatcher() {
+	m_quit = true;
+	m_thread.join();
+}
+
+void SongWatcher::run() {
+	Paths polled = m_roots;
+#if BOOST_OS_LINUX
+	auto inotify = std::make_unique<Inotify>();
+	if (inotify->valid()) {
+		polled.clear();
+		for (auto const& root: m_roots) {
+			if (isNetworkFileSystem(root)) polled.push_back(root);
+			else if (!inotify->watchTree(root)) {
+				std::clog << "songs/warning: Too many song folders for inotify (see fs.inotify.max_user_watches), polling instead." << std::endl;
+				inotify.reset();
+				polled = m_roots;
+				break;
+			}
+		}
+	} else {
+		std::clog << "songs/warning: inotify not available (" << std::strerror(errno) << "), polling song folders instead." << std::endl;
+		inotify.reset();
+	}
+	if (inotify) std::clog << "songs/info: Watching " << inotify->size() << " song folders for changes." << std::endl;
+#endif
+	for (auto const& root: polled) std::clog << "songs/info: Polling " << root << " for changes every " << m_pollInterval.count() << " s." << std::endl;
+	Snapshot files;
+	snapshot(polled, files);
+	Time nextPoll = Clock::now() + clockDur(m_pollInterval);
+	while (!m_quit) {
+#if BOOST_OS_LINUX
+		if (inotify) {
+			inotify->read(100, [&](fs::path const& path, bool folder, bool created) {
+				if (path.empty()) {  // Events were lost
+					for (auto const& root: m_roots) add(root, true);
+					return;
+				}
+				// Events from a new folder tree may have been missed before it was watched, so all of it is reported
+				if (folder && created) {
+					if (!inotify->watchTree(path)) std::clog << "songs/warning: Cannot watch " << path << " (inotify watch limit reached)." << std::endl;
+					add(path, true);
+				} else add(path, false);
+			});
+		} else std::this_thread::sleep_for(100ms);
+#else
+		std::this_thread::sleep_for(100ms);
+#endif
+		if (!polled.empty() && Clock::now() >= nextPoll) {
+			Snapshot current;
+			snapshot(polled, current);
+			for (auto const& [path, stamp]: current) {
+				auto it = files.find(path);
+				if (it == files.end() || it->second != stamp) add(path, false);
+			}
+			for (auto const& entry: files) if (!current.count(entry.first)) add(entry.first, false);
+			files.swap(current);
+			nextPoll = Clock::now() + clockDur(m_pollInterval);
+		}
+		flush();
+	}
+}
+
+void SongWatcher::snapshot(Paths const& roots, Snapshot& files) const {
+	for (auto const& root: roots) {
+		std::error_code ec;
+		auto it = fs::recursive_directory_iterator(root, fs::directory_options::follow_directory_symlink | fs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != fs::recursive_directory_iterator() && !m_quit; it.increment(ec)) {
+			if (it.depth() >= MAX_DEPTH) it.disable_recursion_pending();
+			std::error_code typeError;
+			if (it->is_regular_file(typeError)) files[it->path()] = FileStamp::of(it->path());
+		}
+	}
+}
+
+void SongWatcher::add(fs::path const& path, bool recursive) {
+	Time now = Clock::now();
+	if (m_pending.empty()) m_firstEvent = now;
+	m_lastEvent = now;
+	m_pending[path] |= recursive;
+}
+
+void SongWatcher::flush() {
+	if (m_pending.empty()) return;
+	Time now = Clock::now();
+	if (now - m_lastEvent < m_quietTime && now - m_firstEvent < MAX_DELAY) return;
+	std::vector<Change> changes;
+	for (auto const& [path, recursive]: m_pending) {
+		// Skip paths that are already covered by a recursive change of a parent folder
+		bool covered = false;
+		for (fs::path parent = path.parent_path(); !covered && !parent.empty() && parent != parent.parent_path(); parent = parent.parent_path()) {
+			auto it = m_pending.find(parent);
+			covered = it != m_pending.end() && it->second;
+		}
+		if (!covered) changes.push_back(Change{ path, recursive });
+	}
+	m_pending.clear();
+	try {
+		m_callback(changes);
+	} catch (std::exception const& e) {
+		std::clog << "songs/error: Updating songs failed: " << e.what() << std::endl;
+	}
+}
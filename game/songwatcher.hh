@@ -0,0 +1,50 @@
+#pragma once
+
+#include "chrono.hh"
+#include "fs.hh"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+
+/**
+* Watches the song folders and reports changed paths, so that the song list can be updated without a full rescan.
+*
+* On Linux, local folders are watched with inotify. Network file systems (where inotify does not see changes made by
+* other machines), other platforms and folder trees exceeding the inotify watch limit are polled instead, by comparing
+* the sizes and modification times of all files every poll interval.
+*
+* Events come in bursts (a song folder being copied produces dozens of them), so they are collected until nothing has
+* happened for a moment and then reported together from the watcher thread.
+**/
+class SongWatcher {
+  public:
+	struct Change {
+		fs::path path;  ///< File or folder that was created, modified or removed
+		bool recursive = false;  ///< Everything below path may have changed (new folder tree, lost events)
+	};
+	using Callback = std::function<void(std::vector<Change> const&)>;
+
+	SongWatcher(Paths const& roots, Callback callback, Seconds pollInterval, Seconds quietTime = 1s);
+	~SongWatcher();
+	SongWatcher(SongWatcher const&) = delete;
+	SongWatcher& operator=(SongWatcher const&) = delete;
+
+  private:
+	using Snapshot = std::map<fs::path, FileStamp>;
+	void run();
+	void snapshot(Paths const& roots, Snapshot& files) const;
+	void add(fs::path const& path, bool recursive);
+	void flush();
+
+	Paths m_roots;
+	Callback m_callback;
+	Seconds m_pollInterval;
+	Seconds m_quietTime;
+	std::atomic<bool> m_quit{ false };
+	std::map<fs::path, bool> m_pending;  ///< Changed paths not yet reported (value is Change::recursive)
+	Time m_firstEvent, m_lastEvent;
+	std::thread m_thread;
+};
@@ -0,0 +1,41 @@
+#include "sortkey.hh"
+
+#include <unicode/coll.h>
+#include <unicode/unistr.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+std::string sortKey(icu::Collator const& collator, std::string_view utf8) {
+	icu::UnicodeString const str = icu::UnicodeString::fromUTF8(icu::StringPiece(utf8.data(), static_cast<int32_t>(utf8.size())));
+	std::string key(std::max<std::size_t>(32, 2 * utf8.size() + 8), '\0');
+	int32_t length = collator.getSortKey(str, reinterpret_cast<uint8_t*>(key.data()), static_cast<int32_t>(key.size()));
+	if (length > static_cast<int32_t>(key.size())) {
+		key.resize(static_cast<std::size_t>(length));
+		length = collator.getSortKey(str, reinterpret_cast<uint8_t*>(key.data()), length);
+	}
+	key.resize(length > 0 ? static_cast<std::size_t>(length - 1) : 0);  // The length includes the NUL
+	return key;
+}
+
+CollationKey::CollationKey(std::string key): m_key(std::move(key)) {
+	std::size_t pos = 0;
+	for (auto& end: m_ends) {
+		pos = std::min(m_key.find('\x01', pos), m_key.size());
+		end = static_cast<std::uint32_t>(pos);
+		if (pos < m_key.size()) ++pos;
+	}
+}
+
+std::string_view CollationKey::levels(unsigned count) const {
+	std::string_view key = m_key;
+	return count - 1 < m_ends.size() ? key.substr(0, m_ends[count - 1]) : key;
+}
+
+bool sortKeyLess(CollationKey const& a, CollationKey const& b, unsigned levels) {
+	std::string_view const x = a.levels(levels), y = b.levels(levels);
+	int const result = std::memcmp(x.data(), y.data(), std::min(x.size(), y.size()));
+	return result < 0 || (result == 0 && x.size() < y.size());
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <unicode/uversion.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+U_NAMESPACE_BEGIN class Collator; U_NAMESPACE_END
+
+/**
+* Binary ICU sort key of a UTF-8 string, without the terminating NUL.
+* Comparing sort keys with memcmp orders the strings like the collator would, so songs keep their keys instead of
+* converting and collating strings in every comparison. Keys depend on the collator and the ICU version.
+**/
+std::string sortKey(icu::Collator const& collator, std::string_view utf8);
+
+/**
+* A sort key with the ends of its levels found once, so that comparing it at any strength is a single memcmp.
+* The levels of a key are separated by 0x01 bytes, so keys made at tertiary strength may be compared as if they
+* were made at secondary strength (ignoring case).
+**/
+class CollationKey {
+  public:
+	CollationKey() = default;
+	CollationKey(std::string key);  ///< Implicit, so that keys from sortKey() can be assigned
+	std::string const& str() const { return m_key; }
+	/// The first levels of the key (1 = primary, 2 = secondary, ...)
+	std::string_view levels(unsigned count) const;
+
+  private:
+	std::string m_key;
+	std::array<std::uint32_t, 2> m_ends{};  ///< End of the first and second levels
+};
+
+/// Compare sort keys byte-wise (a < b), considering only their first levels
+bool sortKeyLess(CollationKey const& a, CollationKey const& b, unsigned levels);
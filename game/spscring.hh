@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/**
+* Wait-free single-producer/single-consumer ring of items addressed by their position in a stream.
+*
+* The producer writes items to positions it knows the consumer is done with and then publishes how far the
+* stream has been written; the consumer reads positions below that and reports how far it has consumed.
+* Both positions are exchanged with acquire/release atomics, so neither side ever blocks or allocates.
+* The capacity is a power of two, which makes the position to slot mapping a mask, and a range of positions
+* maps to at most two contiguous segments that are copied in bulk.
+**/
+template <typename T> class SpscRing {
+	static_assert(std::is_trivially_copyable<T>::value, "Items are copied with memcpy");
+  public:
+	/// Allocate room for at least minCapacity items (rounded up to a power of two)
+	explicit SpscRing(std::size_t minCapacity): m_data(roundUp(minCapacity)), m_mask(m_data.size() - 1) {}
+	SpscRing(SpscRing const&) = delete;
+	SpscRing& operator=(SpscRing const&) = delete;
+
+	std::size_t capacity() const { return m_data.size(); }
+
+	/// Copy items to positions [pos, pos + count) (producer). They must not be readable or needed by the consumer.
+	void write(std::int64_t pos, T const* data, std::size_t count) {
+		forSegments(pos, count, [&](std::size_t slot, std::size_t n) {
+			std::memcpy(&m_data[slot], data, n * sizeof(T));
+			data += n;
+		});
+	}
+	/// Make the stream readable up to (not including) end (producer)
+	void publish(std::int64_t end) { m_written.store(end, std::memory_order_release); }
+	/// End of the readable stream
+	std::int64_t written() const { return m_written.load(std::memory_order_acquire); }
+
+	/// Copy items from positions [pos, pos + count) (consumer)
+	void read(std::int64_t pos, T* out, std::size_t count) const {
+		segments(pos, count, [&](T const* data, std::size_t n) {
+			std::memcpy(out, data, n * sizeof(T));
+			out += n;
+		});
+	}
+	/// Call func(T const* data, std::size_t count) for the one or two contiguous segments holding [pos, pos + count)
+	template <typename Func> void segments(std::int64_t pos, std::size_t count, Func&& func) const {
+		forSegments(pos, count, [&](std::size_t slot, std::size_t n) { func(&m_data[slot], n); });
+	}
+	T const& at(std::int64_t pos) const { return m_data[static_cast<std::size_t>(pos) & m_mask]; }
+	/// Positions before pos are no longer needed and may be overwritten (consumer).
+	/// Sequentially consistent, so that a producer that flags itself as waiting and then checks consumed() cannot
+	/// miss a consume() whose caller did not see the flag.
+	void consume(std::int64_t pos) { m_consumed.store(pos, std::memory_order_seq_cst); }
+	std::int64_t consumed() const { return m_consumed.load(std::memory_order_seq_cst); }
+
+  private:
+	static std::size_t roundUp(std::size_t n) {
+		std::size_t capacity = 1;
+		while (capacity < n) capacity <<= 1;
+		return capacity;
+	}
+	template <typename Func> void forSegments(std::int64_t pos, std::size_t count, Func&& func) const {
+		count = std::min(count, m_data.size());
+		std::size_t const slot = static_cast<std::size_t>(pos) & m_mask;
+		std::size_t const first = std::min(count, m_data.size() - slot);
+		if (first > 0) func(slot, first);
+		if (count > first) func(std::size_t{ 0 }, count - first);
+	}
+
+	std::vector<T> m_data;
+	std::size_t const m_mask;
+	// On separate cache lines, as each is written by a different thread
+	alignas(64) std::atomic<std::int64_t> m_written{ 0 };
+	alignas(64) std::atomic<std::int64_t> m_consumed{ 0 };
+};
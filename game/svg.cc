@@ -1,22 +1,46 @@
 ﻿#include "svg.hh"
 
 #include "cache.hh"
+#include "chrono.hh"
 #include "configuration.hh"
+#include "fs.hh"
 #include "image.hh"
+#include "swizzle.hh"
+#include "util.hh"
+#include "workerpool.hh"
 
 #include <librsvg/rsvg.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <iostream>
+#include <set>
+#include <thread>
 
 // Avoid deprecation messages with new versions since Ubuntu 12.10.
 #if LIBRSVG_MAJOR_VERSION * 10000 + LIBRSVG_MINOR_VERSION * 100 + LIBRSVG_MICRO_VERSION < 23602
 #include <librsvg/rsvg-cairo.h>
 #endif
 
+namespace {
+	/// Load a raster of the SVG from the cache, if there is one of the current file
+	bool loadCached(Bitmap& bitmap, fs::path const& filename, float factor) {
+		if (bitmap.ptr) return false;
+		unsigned width, height;
+		if (!cache::readRaster(cache::constructSVGCacheFileName(filename, factor), FileStamp::of(filename), width, height, bitmap.buf)) return false;
+		bitmap.width = width;
+		bitmap.height = height;
+		bitmap.ar = float(width) / float(height);
+		bitmap.fmt = pix::Format::CHAR_RGBA;
+		bitmap.linearPremul = true;
+		return true;
+	}
+}
+
 void loadSVG(Bitmap& bitmap, fs::path const& filename) {
 	float factor = config["graphic/svg_lod"].f();
-	// Try to load a cached PNG instead
-	if (cache::loadSVG(bitmap, filename, factor)) return;
+	// Try to load a cached raster instead
+	if (loadCached(bitmap, filename, factor)) return;
 	std::clog << "image/debug: Loading SVG: " + filename.string() << std::endl;
 	// Open the SVG file in librsvg
 #if !GLIB_CHECK_VERSION(2, 36, 0)   // Avoid deprecation warnings
@@ -56,15 +80,40 @@ void loadSVG(Bitmap& bitmap, fs::path const& filename) {
 	rsvg_handle_render_cairo(svgHandle.get(), dc.get());
 #endif
 	// Change byte order from BGRA to RGBA
-	for (std::uint32_t *ptr = reinterpret_cast<std::uint32_t*>(bitmap.buf.data()), *end = ptr + bitmap.buf.size() / 4; ptr < end; ++ptr) {
-		std::uint8_t* pixel = reinterpret_cast<std::uint8_t*>(ptr);
-		std::uint8_t r = pixel[2], g = pixel[1], b = pixel[0], a = pixel[3];
-		pixel[0] = r; pixel[1] = g; pixel[2] = b; pixel[3] = a;
-	}
+	pix::swapRedBlue(bitmap.buf.data(), bitmap.buf.size() / 4);
 	bitmap.fmt = pix::Format::CHAR_RGBA;
 	// Write to cache so that it can be loaded faster the next time
 	fs::path cache_filename = cache::constructSVGCacheFileName(filename, factor);
 	fs::create_directories(cache_filename.parent_path());
-	writePNG(cache_filename, bitmap);
+	cache::writeRaster(cache_filename, FileStamp::of(filename), bitmap.width, bitmap.height, bitmap.buf.data());
+}
 
+void prewarmSVG() {
+	float const factor = config["graphic/svg_lod"].f();
+	// The SVG files that findFile would find, the current theme first
+	std::vector<fs::path> files;
+	std::set<fs::path> names;
+	for (fs::path const& dir: getThemePaths()) {
+		std::error_code ec;
+		for (auto const& entry: fs::directory_iterator(dir, ec)) {
+			fs::path const& p = entry.path();
+			if (toLower(p.extension().string()) == ".svg" && names.insert(p.filename()).second) files.push_back(p);
+		}
+	}
+	auto const start = Clock::now();
+	std::atomic<unsigned> rendered{ 0 };
+	unsigned const threads = std::max(1u, std::thread::hardware_concurrency());
+	WorkerPool pool(threads - 1);
+	pool.run(files.size(), [&](std::size_t i) {
+		try {
+			if (cache::hasRaster(cache::constructSVGCacheFileName(files[i], factor), FileStamp::of(files[i]))) return;
+			Bitmap bitmap;
+			loadSVG(bitmap, files[i]);
+			++rendered;
+		} catch (std::exception const& e) {
+			std::clog << "image/warning: " << files[i] << ": " << e.what() << std::endl;
+		}
+	});
+	std::clog << "image/info: Theme SVGs ready in " << Seconds(Clock::now() - start).count() << " s: " << rendered << " rendered, "
+	  << files.size() - rendered << " from cache, " << threads << " threads." << std::endl;
 }
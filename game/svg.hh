@@ -5,3 +5,5 @@
 struct Bitmap;
 
 void loadSVG(Bitmap& bitmap, fs::path const& filename);
+/// Render all SVG images of the theme into the cache (in parallel), unless they are already there
+void prewarmSVG();
@@ -0,0 +1,43 @@
+#include "swizzle.hh"
+
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PIX_SWIZZLE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIX_SWIZZLE_NEON
+#endif
+
+void pix::swapRedBlue(std::uint8_t* pixels, std::size_t count) {
+	std::size_t i = 0;
+#if defined(PIX_SWIZZLE_SSE2)
+	// Pixels as little endian 32-bit words: keep bytes 1 and 3, move byte 0 up and byte 2 down
+	__m128i const keep = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+	__m128i const low = _mm_set1_epi32(0xFF);
+	auto swap4 = [&](__m128i v) {
+		__m128i const down = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+		__m128i const up = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+		return _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(down, up));
+	};
+	for (; i + 8 <= count; i += 8) {
+		__m128i* p = reinterpret_cast<__m128i*>(pixels + i * 4);
+		__m128i const a = _mm_loadu_si128(p);
+		__m128i const b = _mm_loadu_si128(p + 1);
+		_mm_storeu_si128(p, swap4(a));
+		_mm_storeu_si128(p + 1, swap4(b));
+	}
+#elif defined(PIX_SWIZZLE_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x4_t v = vld4q_u8(pixels + i * 4);  // Deinterleaved into one register per channel
+		std::swap(v.val[0], v.val[2]);
+		vst4q_u8(pixels + i * 4, v);
+	}
+#endif
+	swapRedBlueScalar(pixels + i * 4, count - i);
+}
+
+void pix::swapRedBlueScalar(std::uint8_t* pixels, std::size_t count) {
+	for (std::uint8_t* end = pixels + count * 4; pixels < end; pixels += 4) std::swap(pixels[0], pixels[2]);
+}
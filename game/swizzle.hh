@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pix {
+	/// Swap the first and third byte of each 4-byte pixel in place (BGRA <-> RGBA), several pixels at a time where SIMD is available
+	void swapRedBlue(std::uint8_t* pixels, std::size_t count);
+	/// The same one pixel at a time, for comparison
+	void swapRedBlueScalar(std::uint8_t* pixels, std::size_t count);
+}
@@ -5,14 +5,18 @@
 #include "screen.hh"
 #include "svg.hh"
 #include "game.hh"
+#include "trace.hh"
 #include "util.hh"
 
 #include <atomic>
 #include <cctype>
 #include <condition_variable>
+#include <map>
 #include <stdexcept>
 #include <sstream>
 #include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 Shader& getShader(Window& window, std::string const& name) {
@@ -28,15 +32,6 @@ float Dimensions::screenY() const {
 	throw std::logic_error("Dimensions::screenY(): unknown m_screenAnchor value");
 }
 
-struct Job {
-	fs::path name;
-	typedef std::function<void (Bitmap& bitmap)> ApplyFunc;
-	ApplyFunc apply;
-	Bitmap bitmap;
-	Job() {}
-	Job(fs::path const& n, ApplyFunc const& a): name(n), apply(a) {}
-};
-
 class TextureLoader::Impl {
 	/// Load a file from disk into a buffer
 	static void load(Bitmap& bitmap, fs::path const& name) {
@@ -56,68 +51,212 @@ class TextureLoader::Impl {
 			std::clog << "image/error: " << e.what() << std::endl;
 		}
 	}
-	std::atomic<bool> m_quit{ false };
+	/// Order of the work: most urgent priority first, then in the order requested
+	struct Key {
+		Texture::Priority priority;
+		std::uint64_t seq;
+		bool operator<(Key const& other) const { return std::tie(priority, seq) < std::tie(other.priority, other.seq); }
+	};
+	struct Job {
+		Texture* target = nullptr;
+		fs::path name;
+		Key key{};
+		Bitmap bitmap;
+	};
+	using Jobs = std::map<Texture const*, Job>;
+
 	std::mutex m_mutex;
 	std::condition_variable m_condition;
-	typedef std::map<void const*, Job> Jobs;
+	bool m_quit = false;
+	std::uint64_t m_seq = 0;
 	Jobs m_jobs;
-	std::thread m_thread;
-public:
-	Impl(): m_quit(), m_thread(&Impl::run, this) {}
-	~Impl() { m_quit = true; m_condition.notify_one(); m_thread.join(); }
-	/// The loader main loop: poll for image load jobs and load into RAM
+	std::map<Key, Texture*> m_queue;  ///< Jobs waiting for a worker
+	std::map<Key, Texture*> m_ready;  ///< Decoded jobs waiting for upload
+	std::vector<std::thread> m_threads;
+	Stats m_stats;
+	std::mutex m_statsMutex;  ///< Protects the timing stats, which workers update without holding m_mutex
+	// Only used on the GL thread
+	std::uint64_t m_frame = 1;
+	std::map<Texture*, std::size_t> m_resident;  ///< Memory of each texture loaded from a file
+	Time m_reported = Clock::now();
+	unsigned m_reportedLoaded = 0;
+
+	static unsigned workerCount() {
+		unsigned threads = config["graphic/texture_threads"].ui();
+		if (threads == 0) threads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+		return threads;
+	}
+
+	/// The loader main loop: take the most urgent image load job and load it into RAM
 	void run() {
-		while (!m_quit) {
-			void const* target = nullptr;
-			fs::path name;
-			{
-				// Poll for jobs to be done
-				std::unique_lock<std::mutex> l(m_mutex);
-				for (auto& job: m_jobs) {
-					if (job.second.name.empty()) continue;  // Job already done
-					name = job.second.name;
-					target = job.first;
-					break;
-				}
-				// If not found, wait for one
-				if (!target) {
-					m_condition.wait(l);
-					continue;
-				}
-			}
+		trace::setThreadName("texture loader");
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (true) {
+			m_condition.wait(l, [this] { return m_quit || !m_queue.empty(); });
+			if (m_quit) return;
+			auto const [key, target] = *m_queue.begin();
+			m_queue.erase(m_queue.begin());
+			fs::path name = m_jobs.at(target).name;
 			// Load image file into buffer
 			Bitmap bitmap;
-			load(bitmap, name);
-			// Store the result
-			std::lock_guard<std::mutex> l(m_mutex);
+			{
+				UnlockGuard<decltype(l)> unlocked(l);
+				TRACE_ZONE("texture/decode");
+				auto start = Clock::now();
+				load(bitmap, name);
+				double t = Seconds(Clock::now() - start).count();
+				std::lock_guard<std::mutex> l2(m_statsMutex);
+				m_stats.decode.add(t);
+			}
+			// Store the result, unless the job was cancelled (or replaced) meanwhile
 			auto it = m_jobs.find(target);
-			if (it == m_jobs.end()) continue;  // The job has been removed already
-			it->second.name.clear();  // Mark the job completed
-			it->second.bitmap.swap(bitmap);  // Store the bitmap (if we got any)
+			if (it == m_jobs.end() || it->second.key.seq != key.seq) continue;
+			it->second.bitmap.swap(bitmap);
+			m_ready.emplace(it->second.key, target);
+		}
+	}
+	/// Upload one decoded job (GL thread, not holding m_mutex, so that the workers can go on meanwhile)
+	void upload(Job& job) {
+		job.target->load(job.bitmap);
+		std::size_t bytes = std::size_t(job.bitmap.width) * job.bitmap.height * 4 * 4 / 3;  // RGBA with mipmaps
+		// Prefetched textures count as drawn now, so that they can be evicted if they are never drawn
+		if (job.key.priority == Texture::Priority::PREFETCH && job.target->m_lastDrawn == 0) job.target->m_lastDrawn = m_frame;
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_stats.bytes += bytes - std::exchange(m_resident[job.target], bytes);
+		++m_stats.loaded;
+	}
+	/// Unload the least recently drawn textures while over the memory limit (GL thread, holding m_mutex)
+	void evict() {
+		std::size_t const limit = static_cast<std::size_t>(config["graphic/texture_memory"].ui()) << 20;
+		if (m_stats.bytes <= limit) return;
+		// Only textures that are known to be drawn with draw() (which reloads them) or were prefetched for
+		// it, and that were not drawn for a while (a few seconds at typical frame rates)
+		std::vector<Texture*> candidates;
+		for (auto const& [texture, bytes]: m_resident) {
+			if (texture->m_lastDrawn != 0 && texture->m_lastDrawn + 300 < m_frame && bytes > 0) candidates.push_back(texture);
+		}
+		std::sort(candidates.begin(), candidates.end(), [](Texture* a, Texture* b) { return a->m_lastDrawn < b->m_lastDrawn; });
+		for (Texture* texture: candidates) {
+			if (m_stats.bytes <= limit) break;
+			texture->load(placeholder());
+			texture->m_evicted = true;
+			m_stats.bytes -= std::exchange(m_resident[texture], 0);
+			++m_stats.evicted;
 		}
 	}
-	/// Add a new job, using calling Texture's address as unique ID.
-	void push(void const* t, Job const& job) {
+	void report() {
+		if (m_stats.loaded == m_reportedLoaded || Clock::now() - m_reported < 10s) return;
+		m_reported = Clock::now();
+		m_reportedLoaded = m_stats.loaded;
+		std::lock_guard<std::mutex> l(m_statsMutex);
+		std::clog << "texture/debug: " << m_stats.loaded << " loaded, " << m_stats.evicted << " evicted, " << (m_stats.bytes >> 20)
+		  << " MiB, queue " << m_queue.size() << "+" << m_ready.size() << ", decode " << m_stats.decode << ", upload per frame " << m_stats.upload << std::endl;
+	}
+public:
+	Impl() {
+		for (unsigned i = workerCount(); i > 0; --i) m_threads.emplace_back(&Impl::run, this);
+	}
+	~Impl() {
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_quit = true;
+		}
+		m_condition.notify_all();
+		for (auto& thread: m_threads) thread.join();
+	}
+	/// A 1x1 pixel black texture shown while the real image is loading
+	static Bitmap const& placeholder() {
+		static Bitmap const bitmap = [] {
+			Bitmap b;
+			b.fmt = pix::Format::RGB;
+			b.resize(1, 1);
+			return b;
+		}();
+		return bitmap;
+	}
+	/// Add a new job, replacing any earlier one of the same texture
+	void push(Texture* target, fs::path const& name, Texture::Priority priority) {
 		std::lock_guard<std::mutex> l(m_mutex);
-		m_jobs[t] = job;
+		auto it = m_jobs.find(target);
+		if (it != m_jobs.end()) {
+			// A worker still loading the old job drops its result, as the sequence number no longer matches
+			m_queue.erase(it->second.key);
+			m_ready.erase(it->second.key);
+		}
+		Key key{ priority, ++m_seq };
+		m_jobs[target] = Job{ target, name, key };
+		m_queue.emplace(key, target);
 		m_condition.notify_one();
 	}
-	/// Cancel a job in progress (no effect if the job has already completed)
-	void remove(void const* t) {
+	/// Make a waiting job more urgent
+	void prioritize(Texture* target, Texture::Priority priority) {
 		std::lock_guard<std::mutex> l(m_mutex);
-		m_jobs.erase(t);
+		auto it = m_jobs.find(target);
+		if (it == m_jobs.end() || !(priority < it->second.key.priority)) return;
+		Job& job = it->second;
+		bool const queued = m_queue.erase(job.key) > 0;
+		bool const ready = m_ready.erase(job.key) > 0;
+		job.key.priority = priority;
+		if (queued) m_queue.emplace(job.key, target);
+		if (ready) m_ready.emplace(job.key, target);
 	}
-	/// Upload all completed jobs to OpenGL (must be called from a valid OpenGL context)
-	void apply() {
+	/// Cancel a job in progress (no effect if the job has already completed) and forget the texture
+	void remove(Texture* target) {
 		std::lock_guard<std::mutex> l(m_mutex);
-		for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+		auto it = m_jobs.find(target);
+		if (it != m_jobs.end()) {
+			m_queue.erase(it->second.key);
+			m_ready.erase(it->second.key);
+			m_jobs.erase(it);
+		}
+		auto res = m_resident.find(target);
+		if (res != m_resident.end()) {
+			m_stats.bytes -= res->second;
+			m_resident.erase(res);
+		}
+	}
+	/// Note that a texture is being drawn, loading it again if it had been evicted (GL thread)
+	void touch(Texture* target) {
+		target->m_lastDrawn = m_frame;
+		if (!target->m_evicted) return;
+		target->m_evicted = false;
+		push(target, target->m_filename, Texture::Priority::VISIBLE);
+	}
+	/// Upload completed jobs to OpenGL, most urgent first, until the time budget of the frame runs out
+	/// (must be called from a valid OpenGL context)
+	void apply() {
+		TRACE_ZONE("texture/upload");
+		++m_frame;
+		auto const start = Clock::now();
+		Seconds const budget(config["graphic/texture_upload_budget"].f());
+		bool uploaded = false;
+		while (!uploaded || Clock::now() - start < budget) {
+			Job job;
 			{
-				Job& j = it->second;
-				if (!j.name.empty()) { ++it; continue; }  // Job incomplete, skip it
-				j.apply(j.bitmap);  // Upload to OpenGL
+				std::lock_guard<std::mutex> l(m_mutex);
+				if (m_ready.empty()) break;
+				auto node = m_jobs.extract(m_ready.begin()->second);
+				m_ready.erase(m_ready.begin());
+				job = std::move(node.mapped());
 			}
-			m_jobs.erase(it++);
+			upload(job);
+			uploaded = true;
 		}
+		std::lock_guard<std::mutex> l(m_mutex);
+		evict();
+		if (uploaded) {
+			std::lock_guard<std::mutex> l2(m_statsMutex);
+			m_stats.upload.add(Seconds(Clock::now() - start).count());
+		}
+		report();
+	}
+	Stats stats() {
+		std::lock_guard<std::mutex> l(m_mutex);
+		std::lock_guard<std::mutex> l2(m_statsMutex);
+		Stats s = m_stats;
+		s.queued = m_queue.size();
+		s.ready = m_ready.size();
+		return s;
 	}
 };
 
@@ -130,20 +269,17 @@ TextureLoader::TextureLoader() {
 
 TextureLoader::~TextureLoader() { ldr.reset(); }
 
+TextureLoader::Stats TextureLoader::stats() { return ldr->stats(); }
+
 void updateTextures() { ldr->apply(); }
 
-template <typename T> void loader(T* target, fs::path const& name) {
-	// Temporarily add 1x1 pixel black texture
-	Bitmap bitmap;
-	bitmap.fmt = pix::Format::RGB;
-	bitmap.resize(1, 1);
-	target->load(bitmap);
-	// Ask the loader to retrieve the image
-	ldr->push(target, Job(name, [target](Bitmap& bitmap){ target->load(bitmap); }));
+Texture::Texture(fs::path const& filename, Priority priority): m_filename(filename) {
+	load(TextureLoader::Impl::placeholder());  // Shown until the image is loaded
+	ldr->push(this, filename, priority);
 }
+Texture::~Texture() { if (!m_filename.empty()) ldr->remove(this); }
 
-Texture::Texture(fs::path const& filename) { loader(this, filename); }
-Texture::~Texture() { ldr->remove(this); }
+void Texture::prioritize(Priority priority) { if (!m_filename.empty()) ldr->prioritize(this, priority); }
 
 // Stuff for converting pix::Format into OpenGL enum values & other flags
 namespace {
@@ -207,6 +343,7 @@ void Texture::load(Bitmap const& bitmap, bool isText) {
 }
 
 void Texture::draw(Window& window) const {
+	if (!m_filename.empty()) ldr->touch(const_cast<Texture*>(this));
 	if (empty()) return;
 	// FIXME: This gets image alpha handling right but our ColorMatrix system always assumes premultiplied alpha
 	// (will produce incorrect results for fade effects)
@@ -215,6 +352,7 @@ void Texture::draw(Window& window) const {
 }
 
 void Texture::draw(Window& window, glmath::mat3 const& matrix) const {
+	if (!m_filename.empty()) ldr->touch(const_cast<Texture*>(this));
 	if (empty()) return;
 	// FIXME: This gets image alpha handling right but our ColorMatrix system always assumes premultiplied alpha
 	// (will produce incorrect results for fade effects)
@@ -3,10 +3,13 @@
 #include "graphic/glutil.hh"
 #include "image.hh"
 #include "graphic/window.hh"
+#include "profiler.hh"
 
 #include <cairo.h>
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -207,11 +210,32 @@ template <GLenum Type> void OpenGLTexture<Type>::drawCropped(Window& window, Dim
 
 void updateTextures();
 
+/// A RAII wrapper for texture loading worker threads. There must be exactly one (global) instance whenever any Textures exist.
+class TextureLoader {
+public:
+	TextureLoader();
+	~TextureLoader();
+	class Impl;
+	/// Counters for tuning the loader
+	struct Stats {
+		std::size_t queued = 0;  ///< Jobs waiting for a worker
+		std::size_t ready = 0;  ///< Decoded images waiting for upload
+		unsigned loaded = 0;  ///< Images uploaded so far
+		unsigned evicted = 0;  ///< Textures unloaded to stay under the memory limit
+		std::size_t bytes = 0;  ///< Estimated memory of the textures loaded from files
+		ProfCP decode;  ///< Time of loading one image
+		ProfCP upload;  ///< Time of the uploads of one frame
+	};
+	static Stats stats();
+};
+
 /**
 * @short High level texture/image wrapper on top of OpenGLTexture
 **/
 class Texture: public OpenGLTexture<GL_TEXTURE_2D> {
 public:
+	/// How urgently a texture loaded from a file is needed; the loader works on the most urgent first
+	enum class Priority { VISIBLE, PREFETCH, BACKGROUND };
 	struct Impl;
 	/// dimensions
 	Dimensions dimensions;
@@ -219,9 +243,11 @@ public:
 	TexCoords tex;
 	Texture() = default;
 	/// creates texture from file
-	Texture(fs::path const& filename);
+	Texture(fs::path const& filename, Priority priority = Priority::VISIBLE);
 	~Texture();
 	bool empty() const { return m_width * m_height == 0.f; } ///< Test if the loading has failed
+	/// Make the pending load of the file more urgent (never less)
+	void prioritize(Priority priority);
 	/// draws texture
 	void draw(Window&) const;
 	void draw(Window&, glmath::mat3 const&) const;
@@ -232,17 +258,13 @@ public:
 	float width() const { return m_width; }
 	float height() const { return m_height; }
 private:
+	friend class TextureLoader::Impl;
 	float m_width = 0.f;
 	float m_height = 0.f;
 	bool m_premultiplied = true;
 	OpenGLTexture<GL_TEXTURE_2D> m_texture;
+	// Bookkeeping of the loader for textures loaded from files (GL thread only)
+	fs::path m_filename;
+	mutable std::uint64_t m_lastDrawn = 0;  ///< Loader frame of the last draw(), 0 if never drawn
+	bool m_evicted = false;  ///< Unloaded to save memory, loaded again when drawn
 };
-
-/// A RAII wrapper for texture loading worker thread. There must be exactly one (global) instance whenever any Textures exist.
-class TextureLoader {
-public:
-	TextureLoader();
-	~TextureLoader();
-	class Impl;
-};
-
@@ -0,0 +1,91 @@
+#include "thumbnail.hh"
+
+#include "songcache.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+Thumbnail Thumbnail::scale(std::uint8_t const* pixels, unsigned width, unsigned height, unsigned stride, unsigned channels, unsigned size) {
+	if (channels < 3) throw std::logic_error("Thumbnail::scale needs RGB or RGBA pixels");
+	Thumbnail t;
+	if (width == 0 || height == 0) return t;
+	double const factor = std::min(1.0, double(size) / double(std::max(width, height)));
+	t.width = std::max(1u, static_cast<unsigned>(width * factor + 0.5));
+	t.height = std::max(1u, static_cast<unsigned>(height * factor + 0.5));
+	t.rgb.resize(std::size_t(t.width) * t.height * 3);
+	std::vector<std::uint32_t> sums(std::size_t(t.width) * 3);
+	std::uint8_t* out = t.rgb.data();
+	for (unsigned y = 0; y < t.height; ++y) {
+		// Source rows [y0, y1) and, for each output column, source columns [x0, x1)
+		unsigned const y0 = static_cast<unsigned>(std::uint64_t(y) * height / t.height);
+		unsigned const y1 = std::max(y0 + 1, static_cast<unsigned>(std::uint64_t(y + 1) * height / t.height));
+		std::fill(sums.begin(), sums.end(), 0u);
+		for (unsigned sy = y0; sy < y1; ++sy) {
+			std::uint8_t const* row = pixels + std::size_t(sy) * stride;
+			for (unsigned x = 0; x < t.width; ++x) {
+				unsigned const x0 = static_cast<unsigned>(std::uint64_t(x) * width / t.width);
+				unsigned const x1 = std::max(x0 + 1, static_cast<unsigned>(std::uint64_t(x + 1) * width / t.width));
+				std::uint32_t* sum = &sums[std::size_t(x) * 3];
+				for (unsigned sx = x0; sx < x1; ++sx) {
+					std::uint8_t const* p = row + std::size_t(sx) * channels;
+					sum[0] += p[0];
+					sum[1] += p[1];
+					sum[2] += p[2];
+				}
+			}
+		}
+		for (unsigned x = 0; x < t.width; ++x) {
+			unsigned const x0 = static_cast<unsigned>(std::uint64_t(x) * width / t.width);
+			unsigned const x1 = std::max(x0 + 1, static_cast<unsigned>(std::uint64_t(x + 1) * width / t.width));
+			std::uint32_t const count = (x1 - x0) * (y1 - y0);
+			for (unsigned c = 0; c < 3; ++c) *out++ = static_cast<std::uint8_t>((sums[std::size_t(x) * 3 + c] + count / 2) / count);
+		}
+	}
+	return t;
+}
+
+fs::path thumbnailName(fs::path const& image, FileStamp const& stamp, unsigned size) {
+	std::string key = image.string();
+	key += '\0';
+	key += std::to_string(stamp.time) + ' ' + std::to_string(stamp.size) + ' ' + std::to_string(size);
+	char name[32];
+	std::uint64_t const h = SongCache::hash(key);
+	std::snprintf(name, sizeof(name), "%016llx.jpg", static_cast<unsigned long long>(h));
+	// Spread over subdirectories named by the first two digits, to keep directories small
+	return fs::path(std::string(name, 2)) / name;
+}
+
+AtlasSlots::AtlasSlots(unsigned pages, unsigned cellsPerPage): m_capacity(std::size_t(pages) * cellsPerPage) {
+	m_free.reserve(m_capacity);
+	// Taken from the back, so that the first page fills up first
+	for (unsigned page = pages; page-- > 0; ) {
+		for (unsigned cell = cellsPerPage; cell-- > 0; ) m_free.push_back(Slot{ page, cell });
+	}
+}
+
+std::optional<AtlasSlots::Slot> AtlasSlots::find(std::string const& key) {
+	auto it = m_index.find(key);
+	if (it == m_index.end()) return std::nullopt;
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	return it->second->second;
+}
+
+std::pair<AtlasSlots::Slot, std::string> AtlasSlots::insert(std::string const& key) {
+	if (m_capacity == 0) throw std::logic_error("AtlasSlots::insert without any cells");
+	std::string evicted;
+	Slot slot;
+	if (!m_free.empty()) {
+		slot = m_free.back();
+		m_free.pop_back();
+	} else {
+		auto last = std::prev(m_lru.end());
+		slot = last->second;
+		evicted = std::move(last->first);
+		m_index.erase(evicted);
+		m_lru.erase(last);
+	}
+	m_lru.emplace_front(key, slot);
+	m_index[key] = m_lru.begin();
+	return { slot, evicted };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "fs.hh"
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// Small, pre-scaled version of an image: tightly packed RGB rows
+struct Thumbnail {
+	unsigned width = 0;
+	unsigned height = 0;
+	std::vector<std::uint8_t> rgb;
+
+	/**
+	* Scale an image down to fit in size x size (keeping the aspect ratio), averaging the pixels that fall into each
+	* output pixel. Images that already fit are only copied. Channels beyond RGB (alpha) are dropped.
+	* @param stride bytes per row of the source image
+	* @param channels bytes per pixel of the source image (3 or 4)
+	**/
+	static Thumbnail scale(std::uint8_t const* pixels, unsigned width, unsigned height, unsigned stride, unsigned channels, unsigned size);
+};
+
+/// File name (relative to the thumbnail directory) of the cached thumbnail of an image; it changes whenever the file does
+fs::path thumbnailName(fs::path const& image, FileStamp const& stamp, unsigned size);
+
+/**
+* Assigns the cells of texture atlas pages to images, reusing the cell of the least recently used image when all
+* cells are taken.
+**/
+class AtlasSlots {
+  public:
+	struct Slot {
+		unsigned page;
+		unsigned cell;
+	};
+	AtlasSlots(unsigned pages, unsigned cellsPerPage);
+	/// Slot of key (marking it the most recently used), if it has one
+	std::optional<Slot> find(std::string const& key);
+	/// Give key a slot (it must not have one). Returns the slot and the key that lost it (empty if the slot was free).
+	std::pair<Slot, std::string> insert(std::string const& key);
+	std::size_t size() const { return m_index.size(); }
+	std::size_t capacity() const { return m_capacity; }
+
+  private:
+	using Lru = std::list<std::pair<std::string, Slot>>;  ///< Most recently used first
+	Lru m_lru;
+	std::unordered_map<std::string, Lru::iterator> m_index;
+	std::vector<Slot> m_free;
+	std::size_t m_capacity;
+};
@@ -0,0 +1,47 @@
+#include "thumbnailfile.hh"
+
+#include "fs.hh"
+#include "image.hh"
+#include "util.hh"
+
+#include <iostream>
+#include <system_error>
+
+Thumbnail loadThumbnail(fs::path const& image, fs::path const& dir, unsigned size, bool& cached) {
+	fs::path const file = dir / thumbnailName(image, FileStamp::of(image), size);
+	Bitmap bitmap;
+	cached = false;
+	if (fs::is_regular_file(file)) {
+		try {
+			loadJPEG(bitmap, file);
+			cached = true;
+			return Thumbnail::scale(bitmap.data(), bitmap.width, bitmap.height, (bitmap.width * 3 + 3) & ~3u, 3, size);
+		} catch (std::exception const& e) {
+			std::clog << "covers/warning: Ignoring broken thumbnail " << file << ": " << e.what() << std::endl;
+		}
+	}
+	auto const ext = toLower(image.extension().string());
+	unsigned channels = 3, stride = 0;
+	if (ext == ".png") {
+		loadPNG(bitmap, image);
+		channels = 4;
+		stride = bitmap.width * 4;
+	} else {
+		loadJPEG(bitmap, image);
+		stride = (bitmap.width * 3 + 3) & ~3u;  // loadJPEG pads rows to whole words
+	}
+	Thumbnail t = Thumbnail::scale(bitmap.data(), bitmap.width, bitmap.height, stride, channels, size);
+	try {
+		fs::create_directories(file.parent_path());
+		Bitmap out(t.rgb.data());
+		out.fmt = pix::Format::RGB;
+		out.width = t.width;
+		out.height = t.height;
+		writeJPEG(file, out, 90);
+	} catch (std::exception const& e) {
+		std::clog << "covers/warning: Cannot cache thumbnail " << file << ": " << e.what() << std::endl;
+		std::error_code ec;
+		fs::remove(file, ec);  // Do not leave a partial file behind
+	}
+	return t;
+}
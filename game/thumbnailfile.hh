@@ -0,0 +1,12 @@
+#pragma once
+
+#include "fs.hh"
+#include "thumbnail.hh"
+
+/**
+* Thumbnail of an image file (JPEG or PNG) that fits in size x size. It is read from the thumbnail cache in dir
+* when there, otherwise made from the image and written to the cache (a failure to write is only logged).
+* @param cached set to whether the thumbnail came from the cache
+* @throws std::exception if the image cannot be read
+**/
+Thumbnail loadThumbnail(fs::path const& image, fs::path const& dir, unsigned size, bool& cached);
@@ -0,0 +1,295 @@
+#include "trace.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace trace {
+	std::atomic<bool> g_enabled{ false };
+
+	namespace {
+		/// Events kept per thread: several seconds of a busy thread
+		constexpr std::uint64_t RING = 1 << 14;
+		/// Threads that get a ring; rings of finished threads are given to new ones, oldest first
+		constexpr std::size_t MAX_THREADS = 64;
+
+		struct Event {
+			std::atomic<std::uint64_t> begin{ 0 };
+			std::atomic<std::uint64_t> end{ 0 };
+			std::atomic<std::uint32_t> site{ 0 };
+		};
+	}
+
+	/// Recent events of one thread. Only the owner writes them; a reader copies the ring and then drops the
+	/// positions that the owner may have overwritten meanwhile (they are below writing - RING).
+	struct ThreadRing {
+		std::array<Event, RING> events;
+		std::atomic<std::uint64_t> writing{ 0 };  ///< Position being written + 1
+		std::atomic<std::uint64_t> head{ 0 };  ///< Positions below this are complete
+		std::atomic<char const*> name{ nullptr };
+		// Owner details, guarded by Registry::mutex
+		std::uint64_t start = 0;  ///< Positions below this belong to a previous owner or were cleared
+		std::uint32_t tid = 0;
+		bool retired = false;
+		std::uint64_t retiredAt = 0;
+	};
+
+	namespace {
+		struct Registry {
+			std::mutex mutex;
+			std::vector<Site*> sites;  ///< Indexed by Site::id
+			std::vector<std::unique_ptr<ThreadRing>> rings;
+			std::uint32_t nextTid = 1;
+			std::uint64_t retirements = 0;
+		};
+
+		Registry& registry() {
+			static Registry reg;
+			return reg;
+		}
+
+		void retire(ThreadRing& ring) {
+			Registry& reg = registry();
+			std::lock_guard<std::mutex> l(reg.mutex);
+			ring.retired = true;
+			ring.retiredAt = ++reg.retirements;
+		}
+
+		/// The ring that the calling thread acquired itself, released for reuse when the thread ends
+		struct Owner {
+			ThreadRing* ring = nullptr;
+			~Owner() { if (ring) retire(*ring); }
+		};
+		thread_local Owner t_owner;
+		// Trivially destructible, so that a thread that uses a reserved ring never registers a destructor
+		thread_local ThreadRing* t_ring = nullptr;  ///< The ring that this thread records to
+		thread_local bool t_untraced = false;  ///< All rings were in use, this thread is not traced
+		thread_local char const* t_name = nullptr;
+
+		ThreadRing* acquire() {
+			Registry& reg = registry();
+			std::lock_guard<std::mutex> l(reg.mutex);
+			ThreadRing* ring = nullptr;
+			if (reg.rings.size() < MAX_THREADS) {
+				ring = reg.rings.emplace_back(std::make_unique<ThreadRing>()).get();
+			} else {
+				for (auto const& r: reg.rings) {
+					if (r->retired && (!ring || r->retiredAt < ring->retiredAt)) ring = r.get();
+				}
+				if (!ring) return nullptr;
+			}
+			ring->start = ring->head.load(std::memory_order_relaxed);
+			ring->tid = reg.nextTid++;
+			ring->name = t_name;
+			ring->retired = false;
+			return ring;
+		}
+
+		struct Copied {
+			std::uint64_t begin;
+			std::uint64_t end;
+			std::uint32_t site;
+		};
+
+		void writeString(std::ostream& os, char const* str) {
+			os << '"';
+			for (; *str; ++str) {
+				char c = *str;
+				if (c == '"' || c == '\\') os << '\\' << c;
+				else if (static_cast<unsigned char>(c) < 0x20) os << ' ';
+				else os << c;
+			}
+			os << '"';
+		}
+	}
+
+	void Histogram::add(std::uint64_t ns) {
+		m_counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+		m_total.fetch_add(ns, std::memory_order_relaxed);
+		std::uint64_t max = m_max.load(std::memory_order_relaxed);
+		while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+	}
+
+	Histogram::Summary Histogram::summary() const {
+		std::array<std::uint32_t, BUCKETS> counts;
+		Summary s;
+		for (unsigned i = 0; i < BUCKETS; ++i) s.count += counts[i] = m_counts[i].load(std::memory_order_relaxed);
+		if (s.count == 0) return s;
+		std::uint64_t const max = m_max.load(std::memory_order_relaxed);
+		auto percentile = [&](std::uint64_t permille) {
+			std::uint64_t const rank = (s.count * permille + 999) / 1000;  // Rounded up, at least 1
+			std::uint64_t seen = 0;
+			unsigned i = 0;
+			for (; i < BUCKETS - 1; ++i) if ((seen += counts[i]) >= rank) break;
+			return static_cast<double>(std::min(upper(i), max)) * 1e-9;
+		};
+		s.p50 = percentile(500);
+		s.p99 = percentile(990);
+		s.max = static_cast<double>(max) * 1e-9;
+		s.total = static_cast<double>(m_total.load(std::memory_order_relaxed)) * 1e-9;
+		return s;
+	}
+
+	void Histogram::reset() {
+		for (auto& count: m_counts) count.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+		m_total.store(0, std::memory_order_relaxed);
+	}
+
+	unsigned Histogram::bucket(std::uint64_t ns) {
+		if (ns < 16) return static_cast<unsigned>(ns);
+#if defined(__GNUC__)
+		unsigned const e = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+#else
+		unsigned e = 4;
+		while (e < 63 && (ns >> (e + 1)) != 0) ++e;
+#endif
+		// The three bits after the leading one select the bucket within the power of two
+		return 16 + (e - 4) * 8 + static_cast<unsigned>((ns >> (e - 3)) & 7);
+	}
+
+	std::uint64_t Histogram::upper(unsigned bucket) {
+		if (bucket < 16) return bucket;
+		unsigned const e = 4 + (bucket - 16) / 8;
+		std::uint64_t const m = (bucket - 16) % 8;
+		return ((8 + m) << (e - 3)) + ((std::uint64_t{ 1 } << (e - 3)) - 1);
+	}
+
+	Site::Site(char const* name): name(name), id([this] {
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> l(reg.mutex);
+		reg.sites.push_back(this);
+		return static_cast<std::uint32_t>(reg.sites.size() - 1);
+	}()) {}
+
+	void enable(bool on) {
+		if (on == g_enabled.exchange(on)) return;
+		std::clog << "trace/info: Tracing " << (on ? "enabled." : "disabled.") << std::endl;
+	}
+
+	std::uint64_t now() {
+		using namespace std::chrono;
+		return static_cast<std::uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+	}
+
+	void record(Site& site, std::uint64_t begin, std::uint64_t end) {
+		site.histogram.add(end - begin);
+		if (!t_ring) {
+			if (t_untraced) return;
+			t_ring = t_owner.ring = acquire();  // Once per thread
+			if (!t_ring) { t_untraced = true; return; }
+		}
+		ThreadRing& ring = *t_ring;
+		std::uint64_t const pos = ring.head.load(std::memory_order_relaxed);
+		ring.writing.store(pos + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		Event& e = ring.events[pos & (RING - 1)];
+		e.begin.store(begin, std::memory_order_relaxed);
+		e.end.store(end, std::memory_order_relaxed);
+		e.site.store(site.id, std::memory_order_relaxed);
+		ring.head.store(pos + 1, std::memory_order_release);
+	}
+
+	void setThreadName(char const* name) {
+		t_name = name;
+		if (t_ring) t_ring->name.store(name, std::memory_order_relaxed);
+	}
+
+	RingReservation::RingReservation(): m_ring(acquire()) {
+		if (m_ring) m_ring->name = nullptr;  // Named by the thread that uses it
+	}
+
+	RingReservation::~RingReservation() { if (m_ring) retire(*m_ring); }
+
+	void RingReservation::use() const {
+		if (m_ring) t_ring = m_ring;
+		else t_untraced = true;
+	}
+
+	void writeChromeTrace(std::ostream& os) {
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> l(reg.mutex);
+		os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		auto separator = [&] { os << (first ? "\n" : ",\n"); first = false; };
+		os << std::fixed << std::setprecision(3);
+		std::vector<Copied> events;
+		for (auto const& ring: reg.rings) {
+			std::uint64_t const head = ring->head.load(std::memory_order_acquire);
+			std::uint64_t from = std::max(ring->start, head > RING ? head - RING : 0);
+			events.clear();
+			for (std::uint64_t pos = from; pos < head; ++pos) {
+				Event const& e = ring->events[pos & (RING - 1)];
+				events.push_back({ e.begin.load(std::memory_order_relaxed), e.end.load(std::memory_order_relaxed), e.site.load(std::memory_order_relaxed) });
+			}
+			// Positions that the owner started writing over while they were copied are not valid
+			std::atomic_thread_fence(std::memory_order_acquire);
+			std::uint64_t const writing = ring->writing.load(std::memory_order_relaxed);
+			std::uint64_t const valid = writing > RING ? writing - RING : 0;
+			std::size_t const skip = static_cast<std::size_t>(std::min<std::uint64_t>(valid > from ? valid - from : 0, events.size()));
+			if (events.size() == skip) continue;
+			separator();
+			char const* name = ring->name.load(std::memory_order_relaxed);
+			os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+			writeString(os, name ? name : "thread");
+			os << "}}";
+			for (auto it = events.begin() + static_cast<std::ptrdiff_t>(skip); it != events.end(); ++it) {
+				if (it->site >= reg.sites.size() || it->end < it->begin) continue;
+				char const* zone = reg.sites[it->site]->name;
+				separator();
+				os << "{\"name\":";
+				writeString(os, zone);
+				// The subsystem (before the slash) is the category, so that subsystems can be filtered in the viewer
+				std::string const category(zone, std::find(zone, zone + std::char_traits<char>::length(zone), '/'));
+				os << ",\"cat\":";
+				writeString(os, category.c_str());
+				os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid << ",\"ts\":" << static_cast<double>(it->begin) * 1e-3
+				  << ",\"dur\":" << static_cast<double>(it->end - it->begin) * 1e-3 << "}";
+			}
+		}
+		os << "\n]}\n";
+	}
+
+	void writeChromeTrace(fs::path const& filename) {
+		std::ofstream file(filename, std::ios::binary);
+		if (!file) throw std::runtime_error("Cannot write " + filename.string());
+		writeChromeTrace(file);
+		if (!file) throw std::runtime_error("Error writing " + filename.string());
+	}
+
+	std::vector<ZoneSummary> summaries(bool reset) {
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> l(reg.mutex);
+		std::vector<ZoneSummary> result;
+		for (Site* site: reg.sites) {
+			auto const s = site->histogram.summary();
+			if (reset) site->histogram.reset();
+			if (s.count > 0) result.push_back({ site->name, s });
+		}
+		std::stable_sort(result.begin(), result.end(), [](ZoneSummary const& a, ZoneSummary const& b) { return a.summary.p99 > b.summary.p99; });
+		return result;
+	}
+
+	std::string report() {
+		std::ostringstream oss;
+		oss << std::fixed << std::setprecision(2);
+		for (auto const& [name, s]: summaries(true)) {
+			oss << (oss.tellp() > 0 ? ", " : "") << name << " " << s.count << "x p50 " << s.p50 * 1e3 << " p99 " << s.p99 * 1e3 << " max " << s.max * 1e3 << " ms";
+		}
+		return oss.str();
+	}
+
+	void clear() {
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> l(reg.mutex);
+		for (auto const& ring: reg.rings) ring->start = ring->head.load(std::memory_order_acquire);
+		for (Site* site: reg.sites) site->histogram.reset();
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "fs.hh"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+* Tracing of where the time goes, for finding the cause of stutter.
+*
+* Code marks scopes with TRACE_ZONE("subsystem/what"), which registers its site on first use; code that must
+* not lock (the audio callback) defines its Sites at namespace scope and uses trace::Zone instead. While tracing is enabled (game/trace), each zone that ends
+* is written to a ring of recent events owned by the thread that ran it (without locks or allocation after the
+* first event of the thread) and its duration is added to a latency histogram of the zone. The rings can be
+* exported as Chrome trace-event JSON (for chrome://tracing or ui.perfetto.dev) and the histograms summarized as
+* percentiles. While tracing is disabled, a zone costs one relaxed atomic load.
+**/
+namespace trace {
+	/// Latency histogram with logarithmic buckets (12.5 % apart), that several threads may add to at once
+	class Histogram {
+	  public:
+		/// Buckets of 0 to 15 ns, then 8 per power of two up to 2^64 ns
+		static constexpr unsigned BUCKETS = 16 + 60 * 8;
+		struct Summary {
+			std::uint64_t count = 0;
+			double p50 = 0.0;  ///< Seconds
+			double p99 = 0.0;
+			double max = 0.0;
+			double total = 0.0;  ///< Sum of all durations
+		};
+		void add(std::uint64_t ns);
+		/// Percentiles of what was added (the upper bound of the bucket, so rounded up by at most 12.5 %)
+		Summary summary() const;
+		void reset();
+		static unsigned bucket(std::uint64_t ns);
+		/// The largest duration that goes to the bucket
+		static std::uint64_t upper(unsigned bucket);
+
+	  private:
+		std::array<std::atomic<std::uint32_t>, BUCKETS> m_counts{};
+		std::atomic<std::uint64_t> m_max{ 0 };
+		std::atomic<std::uint64_t> m_total{ 0 };
+	};
+
+	/// A place in the code that is timed, created once by each TRACE_ZONE
+	struct Site {
+		explicit Site(char const* name);
+		Site(Site const&) = delete;
+		Site& operator=(Site const&) = delete;
+		char const* const name;  ///< A string literal
+		std::uint32_t const id;
+		Histogram histogram;
+	};
+
+	extern std::atomic<bool> g_enabled;
+	inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+	void enable(bool on);
+	/// Nanoseconds since the program started
+	std::uint64_t now();
+	/// Add a completed zone to the ring of this thread and to the histogram of the site
+	void record(Site& site, std::uint64_t begin, std::uint64_t end);
+	/// Name the calling thread in exported traces (a string literal; cheap enough to call repeatedly)
+	void setThreadName(char const* name);
+
+	struct ThreadRing;
+	/**
+	* A ring taken in advance for a thread that must not lock or allocate, such as the audio callback (which
+	* would otherwise get its ring on its first event). The thread calls use() before its zones; the ring is
+	* released when the reservation is destroyed, so the thread must not record anything after that.
+	**/
+	class RingReservation {
+	  public:
+		RingReservation();
+		~RingReservation();
+		RingReservation(RingReservation const&) = delete;
+		RingReservation& operator=(RingReservation const&) = delete;
+		/// Record the events of the calling thread to the reserved ring (never locks or allocates)
+		void use() const;
+
+	  private:
+		ThreadRing* m_ring;  ///< Null if all rings were in use
+	};
+
+	/// Times its own lifetime (use TRACE_ZONE)
+	class Zone {
+	  public:
+		explicit Zone(Site& site): m_site(enabled() ? &site : nullptr), m_begin(m_site ? now() : 0) {}
+		~Zone() { if (m_site) record(*m_site, m_begin, now()); }
+		Zone(Zone const&) = delete;
+		Zone& operator=(Zone const&) = delete;
+
+	  private:
+		Site* m_site;
+		std::uint64_t m_begin;
+	};
+
+	/// Write the events still in the thread rings as Chrome trace-event JSON
+	void writeChromeTrace(std::ostream& os);
+	void writeChromeTrace(fs::path const& filename);
+
+	struct ZoneSummary {
+		std::string name;
+		Histogram::Summary summary;
+	};
+	/// Percentiles of the zones that ran since the previous reset, slowest p99 first
+	std::vector<ZoneSummary> summaries(bool reset);
+	/// One line of summaries for the log (empty if nothing ran), resetting the histograms
+	std::string report();
+	/// Forget all events and histograms
+	void clear();
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+/// Time the rest of the enclosing scope as a zone called name (a string literal)
+#define TRACE_ZONE(name) \
+	static ::trace::Site TRACE_CONCAT(traceSite_, __LINE__)(name); \
+	::trace::Zone TRACE_CONCAT(traceZone_, __LINE__)(TRACE_CONCAT(traceSite_, __LINE__))
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+/**
+* Wait-free single-writer/single-reader value exchange.
+* The writer publishes complete snapshots of T and the reader always sees the most recently published one.
+* Neither side ever blocks or allocates, which makes this suitable for passing settings into the audio callback.
+**/
+template <typename T> class TripleBuffer {
+  public:
+	TripleBuffer(T const& init = T()) { m_slots.fill(init); }
+	TripleBuffer(TripleBuffer const&) = delete;
+	TripleBuffer& operator=(TripleBuffer const&) = delete;
+
+	/// Publish a new value (writer thread only).
+	void write(T const& value) {
+		m_slots[m_back] = value;
+		m_back = m_middle.exchange(m_back | DIRTY, std::memory_order_acq_rel) & INDEX;
+	}
+	/// Get the latest published value (reader thread only). The reference stays valid until the next read().
+	T const& read() {
+		if (m_middle.load(std::memory_order_relaxed) & DIRTY)
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+		return m_slots[m_front];
+	}
+
+  private:
+	static constexpr unsigned INDEX = 3;
+	static constexpr unsigned DIRTY = 4;  ///< Set on m_middle when it holds a value that the reader has not seen yet
+
+	std::array<T, 3> m_slots;
+	std::atomic<unsigned> m_middle{ 1 };  ///< Slot index shared by both threads (plus DIRTY flag)
+	unsigned m_back = 2;  ///< Slot owned by the writer
+	unsigned m_front = 0;  ///< Slot owned by the reader
+};
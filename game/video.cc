@@ -1,11 +1,36 @@
 #include "video.hh"
 
+#include "configuration.hh"
 #include "ffmpeg.hh"
+#include "trace.hh"
 #include "util.hh"
 #include "graphic/color_trans.hh"
 
 #include <cmath>
 
+namespace {
+	/// Matrix converting (Y, U, V, 1) into non-linear RGB
+	glmath::mat4 yuvToRgb(bool bt709, bool fullRange) {
+		float kr = bt709 ? 0.2126f : 0.299f;
+		float kb = bt709 ? 0.0722f : 0.114f;
+		float kg = 1.0f - kr - kb;
+		// Limited range video uses 16-235 for Y and 16-240 for U and V
+		float ys = fullRange ? 1.0f : 255.0f / 219.0f;
+		float cs = fullRange ? 1.0f : 255.0f / 224.0f;
+		float yo = fullRange ? 0.0f : 16.0f / 255.0f;
+		float rv = 2.0f * (1.0f - kr) * cs;
+		float gu = -2.0f * kb * (1.0f - kb) / kg * cs;
+		float gv = -2.0f * kr * (1.0f - kr) / kg * cs;
+		float bu = 2.0f * (1.0f - kb) * cs;
+		glmath::mat4 m(1.0f);  // Column-major: one column per input
+		m[0] = glmath::vec4(ys, ys, ys, 0.0f);
+		m[1] = glmath::vec4(0.0f, gu, bu, 0.0f);
+		m[2] = glmath::vec4(rv, gv, 0.0f, 0.0f);
+		m[3] = glmath::vec4(-ys * yo - 0.5f * rv, -ys * yo - 0.5f * (gu + gv), -ys * yo - 0.5f * bu, 1.0f);
+		return m;
+	}
+}
+
 bool Video::tryPop(Bitmap& f, double timestamp) {
 	std::unique_lock<std::mutex> l(m_mutex);
 
@@ -20,25 +45,53 @@ bool Video::tryPop(Bitmap& f, double timestamp) {
 	// When seeking needed to wake up thread if waiting for rooms.
 	if (!m_queue.empty() || m_seek_asked) m_cond.notify_all();
 
-	if (m_seek_asked) return false;
+	if (m_seek_asked) {
+		m_starvedUntil = -getInf();  // Frames from the new position are not late for the old one
+		return false;
+	}
 
 	// discard outdated frames retaining only the most recent frame that is _before_ timestamp
-	while (!m_queue.empty() && std::next(m_queue.begin()) != m_queue.end() && std::next(m_queue.begin())->timestamp < timestamp) m_queue.pop_front();
+	while (!m_queue.empty() && std::next(m_queue.begin()) != m_queue.end() && std::next(m_queue.begin())->timestamp < timestamp) {
+		if (m_queue.front().timestamp <= m_starvedUntil) ++m_stats.late;
+		m_pool.put(std::move(m_queue.front()));
+		m_queue.pop_front();
+		++m_stats.dropped;
+	}
 
-	if (m_queue.empty() || m_queue.front().timestamp > timestamp) return false; // Nothing to deliver
+	if (m_queue.empty()) {
+		// The frames due now are late, unless the video has ended (or not started yet)
+		if (!m_eof && m_stats.shown > 0) m_starvedUntil = timestamp;
+		return false;
+	}
+	if (m_queue.front().timestamp > timestamp) return false; // Nothing to deliver
 
 	f = std::move(m_queue.front());
 	m_queue.pop_front();
+	if (!f.buf.empty()) {
+		++m_stats.shown;
+		if (f.timestamp <= m_starvedUntil) ++m_stats.late;
+	}
 	return true;
 }
 
 void Video::push(Bitmap&& f) {
 	std::unique_lock<std::mutex> l(m_mutex);
 	m_cond.wait(l, [this]{ return m_quit || m_seek_asked || m_queue.size() < m_max; });
-	if (m_quit || m_seek_asked) return; // Drop frame when seek/quit asked
+	if (m_quit || m_seek_asked) {
+		// Drop frame when seek/quit asked
+		m_pool.put(std::move(f));
+		return;
+	}
+	if (f.buf.empty()) m_eof = true;
+	else ++m_stats.decoded;
 	m_queue.emplace_back(std::move(f));
 }
 
+Video::Stats Video::stats() const {
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_stats;
+}
+
 Video::~Video() {
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -46,21 +99,32 @@ Video::~Video() {
 	}
 	m_cond.notify_all();
 	m_grabber.get();
+	if (m_stats.decoded > 0) {
+		std::clog << "video/info: Frames: " << m_stats.decoded << " decoded, " << m_stats.shown << " shown, "
+		  << m_stats.dropped << " dropped, " << m_stats.late << " late" << std::endl;
+	}
 }
 
 Video::Video(fs::path const& _videoFile, double videoGap): m_videoGap(videoGap), m_textureTime(), m_alpha(-0.5f, 1.5f) {
-	m_grabber = std::async(std::launch::async, [this, file = _videoFile] {
+	bool allowYuv = config["graphic/video_yuv"].b();
+	m_grabber = std::async(std::launch::async, [this, file = _videoFile, allowYuv] {
+		trace::setThreadName("video decoder");
 		try {
-			auto ffmpeg = std::make_unique<VideoFFmpeg>(file, [this](auto f) { this->push(std::move(f)); });
+			auto ffmpeg = std::make_unique<VideoFFmpeg>(file, [this](auto f) { this->push(std::move(f)); }, m_pool, allowYuv);
 			int errors = 0;
 			std::unique_lock<std::mutex> l(m_mutex);
+			// Set before any frames are queued, read by the render thread after taking a frame
+			m_bt709 = ffmpeg->bt709();
+			m_fullRange = ffmpeg->fullRange();
 			while (!m_quit) {
 				if (m_seek_asked) {
 					m_seek_asked = false;
 
 					auto seek_pos = m_readPosition;
 					// discard all outdated frame. To avoid races between clean and push, clean and push are done in this thread.
+					for (auto& f: m_queue) m_pool.put(std::move(f));
 					m_queue.clear();
+					m_eof = false;
 
 					UnlockGuard<decltype(l)> unlocked(l);  // release lock during seek
 					ffmpeg->seek(seek_pos);
@@ -101,9 +165,63 @@ void Video::prepare(double time) {
 
 	Bitmap videoFrame;
 	if (tryPop(videoFrame, time) && !videoFrame.buf.empty()) {
-		m_texture.load(videoFrame);
+		m_yuv = videoFrame.fmt == pix::Format::YUV420P;
+		if (m_yuv) loadYuv(videoFrame);
+		else m_texture.load(videoFrame);
 		m_textureTime = videoFrame.timestamp;
+		m_pool.put(std::move(videoFrame));
+	}
+}
+
+void Video::loadYuv(Bitmap const& f) {
+	glutil::GLErrorChecker glerror("Video::loadYuv");
+	m_texture.dimensions = Dimensions(f.ar).fixedWidth(1.0f);
+	unsigned const cw = (f.width + 1) / 2, ch = (f.height + 1) / 2;
+	bool const resize = m_planeWidth != f.width || m_planeHeight != f.height;
+	m_planeWidth = f.width;
+	m_planeHeight = f.height;
+	unsigned char const* data = f.data();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // Rows are not padded
+	for (unsigned i = 0; i < 3; ++i) {
+		GLsizei w = static_cast<GLsizei>(i ? cw : f.width), h = static_cast<GLsizei>(i ? ch : f.height);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, m_planes[i].id());
+		if (resize) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+		} else {
+			// Same size as before, update in place instead of reallocating
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RED, GL_UNSIGNED_BYTE, data);
+		}
+		data += std::ptrdiff_t(w) * h;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glerror.check("upload");
+}
+
+void Video::drawYuv(Window& window) {
+	glutil::GLErrorChecker glerror("Video::drawYuv");
+	UseShader shader(getShader(window, "yuv"));
+	for (unsigned i = 3; i-- > 0; ) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, m_planes[i].id());
 	}
+	shader()["texU"].set(1);
+	shader()["texV"].set(2);
+	shader()["yuvMatrix"].setMat4(yuvToRgb(m_bt709, m_fullRange));
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Dimensions const& dim = m_texture.dimensions;
+	glutil::VertexArray va;
+	va.texCoord(0.0f, 0.0f).vertex(dim.x1(), dim.y1());
+	va.texCoord(1.0f, 0.0f).vertex(dim.x2(), dim.y1());
+	va.texCoord(0.0f, 1.0f).vertex(dim.x1(), dim.y2());
+	va.texCoord(1.0f, 1.0f).vertex(dim.x2(), dim.y2());
+	va.draw();
+	glActiveTexture(GL_TEXTURE0);
+	glerror.check("draw");
 }
 
 void Video::render(Window& window, double time) {
@@ -113,5 +231,6 @@ void Video::render(Window& window, double time) {
 	float alpha = static_cast<float>(clamp(m_alpha.get()));
 	if (alpha == 0.0f) return;
 	ColorTrans c(window, Color::alpha(alpha));
-	m_texture.draw(window);
+	if (m_yuv) drawYuv(window);
+	else m_texture.draw(window);
 }
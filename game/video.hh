@@ -1,7 +1,9 @@
 #pragma once
 
 #include "animvalue.hh"
+#include "framepool.hh"
 #include "texture.hh"
+#include "util.hh"
 #include <deque>
 #include <future>
 #include <string>
@@ -9,6 +11,13 @@
 /// class for playing videos
 class Video {
   public:
+	/// Frame counters, for spotting videos that the decoder cannot keep up with
+	struct Stats {
+		unsigned decoded = 0;  ///< Frames received from the decoder
+		unsigned shown = 0;  ///< Frames taken for display
+		unsigned dropped = 0;  ///< Decoded frames skipped because a newer one was already due
+		unsigned late = 0;  ///< Shown or dropped frames that were already due when the decoder delivered them
+	};
 	/// opens given video file
 	Video(fs::path const& videoFile, double videoGap = 0.0);
 	~Video();
@@ -16,6 +25,8 @@ class Video {
 	void render(Window&, double time);  ///< Render the prepared video frame
 	/// returns Dimensions of video clip
 	Dimensions const& dimensions() const { return m_texture.dimensions; }
+	/// returns the frame counters so far
+	Stats stats() const;
 
   private:
 	const double m_videoGap;
@@ -32,6 +43,11 @@ class Video {
 	void push(Bitmap&& f);
 	/// Clear and unlock the queue
 	void reset();
+	/// Upload the planes of a YUV420P frame
+	void loadYuv(Bitmap const& f);
+	/// Draw the YUV planes, converting them to RGB in the shader
+	void drawYuv(Window& window);
+
 	/// return timestamp of next frame to read
 	double headPosition() const { return m_queue.front().timestamp; }
 	/// return timestamp of next frame to read
@@ -42,5 +58,16 @@ class Video {
 	std::condition_variable m_cond;
 	static const unsigned m_max = 20;
 	bool m_seek_asked{false};
+	bool m_eof{false};  ///< Has the decoder reached the end (no more frames until a seek)?
+	double m_starvedUntil = -getInf();  ///< Last time that a frame was due but the queue was empty
+	Stats m_stats;
+	FramePool m_pool;
+
+	bool m_yuv{false};  ///< Is the current frame in m_planes (instead of m_texture)?
+	bool m_bt709{false};
+	bool m_fullRange{false};
+	OpenGLTexture<GL_TEXTURE_2D> m_planes[3];  ///< Y, U, V
+	unsigned m_planeWidth = 0;
+	unsigned m_planeHeight = 0;
 };
 
@@ -0,0 +1,47 @@
+#include "wakeup.hh"
+
+#include <stdexcept>
+
+#if BOOST_OS_LINUX
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+Wakeup::Wakeup(): m_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+	if (m_fd < 0) throw std::runtime_error(std::string("eventfd: ") + std::strerror(errno));
+}
+
+Wakeup::~Wakeup() { ::close(m_fd); }
+
+void Wakeup::post() {
+	std::uint64_t one = 1;
+	[[maybe_unused]] auto ret = ::write(m_fd, &one, sizeof(one));  // Can only fail if the counter overflows
+}
+
+void Wakeup::wait(Seconds timeout) {
+	pollfd pfd{ m_fd, POLLIN, 0 };
+	if (::poll(&pfd, 1, static_cast<int>(timeout.count() * 1000.0)) <= 0) return;
+	std::uint64_t count;
+	[[maybe_unused]] auto ret = ::read(m_fd, &count, sizeof(count));  // Reset the counter
+}
+
+#else
+
+Wakeup::Wakeup() {}
+
+Wakeup::~Wakeup() {}
+
+void Wakeup::post() {
+	m_posted = true;
+	m_cond.notify_one();
+}
+
+void Wakeup::wait(Seconds timeout) {
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_cond.wait_for(l, timeout, [this] { return m_posted.exchange(false); });
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "chrono.hh"
+
+#include <boost/predef/os.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/**
+* Lets a real-time thread wake up a worker thread without ever blocking.
+*
+* On Linux this is an eventfd, so post() is a single non-blocking write. Elsewhere post() only sets a flag and
+* notifies a condition variable without taking its mutex; a wakeup that races with the worker going to sleep is
+* then only noticed when wait() times out, so workers should use short timeouts.
+**/
+class Wakeup {
+  public:
+	Wakeup();
+	~Wakeup();
+	Wakeup(Wakeup const&) = delete;
+	Wakeup& operator=(Wakeup const&) = delete;
+
+	/// Wake up the waiting thread, or make its next wait() return immediately. Never blocks.
+	void post();
+	/// Wait until post() is called or the timeout expires
+	void wait(Seconds timeout);
+
+  private:
+#if BOOST_OS_LINUX
+	int m_fd = -1;
+#else
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::atomic<bool> m_posted{ false };
+#endif
+};
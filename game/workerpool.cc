@@ -0,0 +1,61 @@
+#include "workerpool.hh"
+
+WorkerPool::WorkerPool(unsigned workers) {
+	for (unsigned i = 0; i < workers; ++i) m_threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& t: m_threads) t.join();
+}
+
+void WorkerPool::run(std::size_t count, Task const& task) {
+	if (count == 0) return;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_error = nullptr;
+		++m_batch;
+	}
+	if (count > 1) m_wake.notify_all();
+	drain();
+	// Barrier: wait until no worker is touching this batch anymore, so that the next one can safely reuse the state
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_idle.wait(l, [this]{ return m_active == 0; });
+	m_task = nullptr;
+	m_count = 0;
+	if (m_error) std::rethrow_exception(m_error);
+}
+
+void WorkerPool::drain() {
+	for (std::size_t i; (i = m_next++) < m_count;) {
+		try {
+			(*m_task)(i);
+		} catch (...) {
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (!m_error) m_error = std::current_exception();
+		}
+	}
+}
+
+void WorkerPool::work() {
+	std::uint64_t seen = 0;
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true) {
+		m_wake.wait(l, [&]{ return m_quit || m_batch != seen; });
+		if (m_quit) return;
+		seen = m_batch;
+		if (!m_task) continue;  // Batch already finished before this worker woke up
+		++m_active;
+		l.unlock();
+		drain();
+		l.lock();
+		if (--m_active == 0) m_idle.notify_all();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* A small pool of threads for running batches of independent tasks.
+* Each call to run() is a barrier: it returns only when every task of the batch has completed.
+* The calling thread works on the batch too, so a pool without worker threads simply runs everything serially.
+**/
+class WorkerPool {
+  public:
+	using Task = std::function<void(std::size_t)>;
+	/// Start the given number of worker threads (in addition to the calling thread)
+	explicit WorkerPool(unsigned workers);
+	~WorkerPool();
+	WorkerPool(WorkerPool const&) = delete;
+	WorkerPool& operator=(WorkerPool const&) = delete;
+	/// Call task(i) for every i in [0, count) and wait for all of them. The first exception thrown by a task is rethrown here.
+	void run(std::size_t count, Task const& task);
+	/// Number of threads working on each batch, including the caller
+	unsigned threads() const { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+  private:
+	void work();
+	void drain();
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;  ///< Signals workers that a new batch is available (or quit)
+	std::condition_variable m_idle;  ///< Signals the caller that all workers left the batch
+	std::vector<std::thread> m_threads;
+	Task const* m_task = nullptr;
+	std::size_t m_count = 0;
+	std::atomic<std::size_t> m_next{ 0 };
+	std::uint64_t m_batch = 0;
+	unsigned m_active = 0;  ///< Workers currently inside drain()
+	bool m_quit = false;
+	std::exception_ptr m_error;
+};
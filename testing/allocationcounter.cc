@@ -0,0 +1,29 @@
+#include "allocationcounter.hh"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+	thread_local std::size_t t_allocations = 0;
+	thread_local unsigned t_counters = 0;
+
+	void* countedAlloc(std::size_t size) {
+		if (t_counters) ++t_allocations;
+		if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+		throw std::bad_alloc();
+	}
+}
+
+// Replacing the global allocation functions affects the whole test binary but only counts while an AllocationCounter is active.
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+AllocationCounter::AllocationCounter(): m_start(t_allocations) { ++t_counters; }
+
+AllocationCounter::~AllocationCounter() { --t_counters; }
+
+std::size_t AllocationCounter::count() const { return t_allocations - m_start; }
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+/// Counts heap allocations made by the current thread while an instance is alive (see allocationcounter.cc).
+class AllocationCounter {
+  public:
+	AllocationCounter();
+	~AllocationCounter();
+	AllocationCounter(AllocationCounter const&) = delete;
+	AllocationCounter& operator=(AllocationCounter const&) = delete;
+	/// Number of operator new calls since construction
+	std::size_t count() const;
+
+  private:
+	std::size_t m_start;
+};
@@ -1,7 +1,10 @@
 #include "common.hh"
 #include "printer.hh"
+#include "sungvowel.hh"
 
 #include "game/analyzer.hh"
+#include "game/util.hh"
+
 
 struct UnitTest_Analyzer : public testing::Test {
 	float makeWave(float n, float frequency) {
@@ -203,3 +206,73 @@ TEST_F(UnitTest_Analyzer, findTone_1760_A) {
 
 	EXPECT_THAT(result, IsNull()); // 1760 is outside used ranged
 }
+
+
+namespace {
+	/// Analyzer with the MPM engine, fed like UnitTest_Analyzer
+	struct UnitTest_AnalyzerMPM : public testing::Test {
+		void fill(std::set<float> const& frequencies) {
+			auto data = std::vector<float>(8192);
+			for (std::size_t n = 0; n < data.size(); ++n) {
+				for (auto const& frequency : frequencies) data[n] += 0.25f * std::sin(static_cast<float>(n) * frequency * pi2 / 48000.f);
+			}
+			analyzer.input(data.begin(), data.end());
+			analyzer.process();
+		}
+
+		Analyzer analyzer{48000, "id", PitchEngine::Type::MPM};
+	};
+}
+
+TEST_F(UnitTest_AnalyzerMPM, getEngine) {
+	EXPECT_EQ(PitchEngine::Type::MPM, analyzer.getEngine());
+	EXPECT_EQ(PitchEngine::Type::FFT, Analyzer(48000, "id").getEngine());
+	EXPECT_EQ(PitchEngine::Type::MPM, PitchEngine::parse(PitchEngine::name(PitchEngine::Type::MPM)));
+	EXPECT_THROW(PitchEngine::parse("yin"), std::invalid_argument);
+	EXPECT_TRUE(analyzer.getFFT().empty());
+}
+
+TEST_F(UnitTest_AnalyzerMPM, findTone_silence) {
+	fill({});
+	EXPECT_THAT(analyzer.findTone(), IsNull());
+}
+
+TEST_F(UnitTest_AnalyzerMPM, findTone_65_4_C) {
+	fill({65.4f});
+	EXPECT_THAT(analyzer.findTone(), AllOf(NotNull(), Pointee(65.4)));
+}
+
+TEST_F(UnitTest_AnalyzerMPM, findTone_82_4_E) {
+	fill({82.4f});
+	EXPECT_THAT(analyzer.findTone(), AllOf(NotNull(), Pointee(82.4)));
+}
+
+TEST_F(UnitTest_AnalyzerMPM, findTone_220) {
+	fill({220});
+	EXPECT_THAT(analyzer.findTone(), AllOf(NotNull(), Pointee(220)));
+}
+
+TEST_F(UnitTest_AnalyzerMPM, findTone_880) {
+	fill({880});
+	EXPECT_THAT(analyzer.findTone(), AllOf(NotNull(), Pointee(880)));
+}
+
+TEST_F(UnitTest_AnalyzerMPM, cost_is_measured) {
+	fill({220});
+	auto const cost = analyzer.getCost();
+	EXPECT_GT(cost.count, 0u);
+	EXPECT_GT(cost.p50, 0.0);
+}
+
+TEST(UnitTest_PitchEngines, sung_vowels) {
+	// A weak fundamental, a middle voice and a high one; benchmarks/pitchenginebench.cc has the full range
+	std::vector<SungVowel> const voices{ { "bass", 82.4, 0.2 }, { "tenor", 196.0 }, { "soprano", 660.0 } };
+	for (auto const& voice: voices) {
+		PitchResult const fft = measurePitch(voice, PitchEngine::Type::FFT);
+		PitchResult const mpm = measurePitch(voice, PitchEngine::Type::MPM);
+		EXPECT_GT(mpm.correct, 0.95) << voice.name << " " << voice.f0;
+		EXPECT_LT(mpm.cents, 10.0) << voice.name << " " << voice.f0;
+		EXPECT_LT(mpm.latency, 0.05) << voice.name << " " << voice.f0;
+		if (!std::isnan(fft.latency)) EXPECT_LE(mpm.latency, fft.latency) << voice.name << " " << voice.f0;
+	}
+}
@@ -0,0 +1,153 @@
+#include "common.hh"
+#include "allocationcounter.hh"
+
+#include "game/audiooutput.hh"
+#include "game/util.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+	constexpr unsigned rate = 48000;
+	constexpr std::size_t frames = 256;  ///< Per callback
+	constexpr std::size_t ringSize = 1 << 16;  ///< Samples buffered per track
+
+	/// Decodes a sine tone of the given length instead of a file
+	struct SineDecoder: AudioBuffer::Decoder {
+		AudioBuffer& buffer;
+		double freq;
+		std::int64_t total;  ///< Samples
+		std::int64_t pos = 0;
+		SineDecoder(AudioBuffer& buffer, double freq, double seconds): buffer(buffer), freq(freq), total(2 * static_cast<std::int64_t>(seconds * rate)) {}
+		double duration() const override { return static_cast<double>(total) / 2.0 / rate; }
+		void seek(std::int64_t sample) override { pos = sample; }
+		void decode() override {
+			if (pos >= total) throw Eof();
+			std::array<std::int16_t, 1024> data;
+			auto const count = std::min<std::int64_t>(static_cast<std::int64_t>(data.size()), total - pos);
+			for (std::int64_t i = 0; i < count; ++i) {
+				double const t = static_cast<double>((pos + i) / 2) / rate;
+				data[static_cast<std::size_t>(i)] = static_cast<std::int16_t>(8000.0 * std::sin(TAU * freq * t));
+			}
+			buffer(data.data(), count, pos);
+			pos += count;
+		}
+	};
+
+	std::unique_ptr<AudioBuffer> sine(double freq, double seconds) {
+		return std::make_unique<AudioBuffer>([=](AudioBuffer& buffer) { return std::make_unique<SineDecoder>(buffer, freq, seconds); }, rate, ringSize);
+	}
+
+	std::shared_ptr<Music> music(unsigned stems, double seconds, double fadeTime) {
+		Music::Tracks tracks;
+		for (unsigned n = 0; n < stems; ++n) tracks.emplace_back("stem" + std::to_string(n), sine(110.0 * (n + 1), seconds));
+		auto m = std::make_shared<Music>(std::move(tracks), rate, false);
+		m->mixer.fadeRate = 1.0 / rate / fadeTime;
+		return m;
+	}
+
+	/// Plays like the Device of an output does, with the bus sized the same way
+	struct Card {
+		Output output;
+		MixBus bus{ 2 * std::max<std::size_t>(8192, static_cast<std::size_t>(4.0 * rate * 0.075)) };
+		std::vector<float> block = std::vector<float>(2 * frames);
+		std::size_t allocations = 0;
+		/// Run one callback, returning the peak level of the block
+		float operator()() {
+			AllocationCounter counter;
+			bus.process(block.data(), block.data() + block.size(), [this](float* b, float* e) { output.callback(b, e, rate, bus); });
+			allocations += counter.count();
+			float peak = 0.0f;
+			for (float s: block) peak = std::max(peak, std::abs(s));
+			return peak;
+		}
+		/// Run callbacks (giving the decoders time to buffer) until the music has reached state
+		void until(Music const& m, Music::State state) {
+			for (unsigned i = 0; i < 5000 && m.state() != state; ++i) {
+				(*this)();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			ASSERT_EQ(state, m.state());
+		}
+	};
+}
+
+TEST(UnitTest_AudioOutput, callback_does_not_allocate_with_13_stems) {
+	Card card;
+	card.output.loadSample("beep", std::make_shared<Sample>(sine(880.0, 0.1)));
+	auto m = music(13, 5.0, 0.01);
+	card.output.play(m);
+	std::atomic<bool> done{ false };
+	std::thread ui([&] {
+		// Change settings, levels and the program while the callback plays, as the UI thread does
+		for (unsigned i = 0; !done; ++i) {
+			MixParams p;
+			p.musicVolume = static_cast<float>(i % 101) / 100.0f;
+			card.output.params.write(p);
+			m->trackFade("stem" + std::to_string(i % 13), (i % 7) / 6.0);
+			if (i % 50 == 0) card.output.playSample("beep");
+			if (i % 200 == 0) card.output.setSynth(i % 400 ? nullptr : std::make_shared<Synth>(std::vector<Synth::Tone>{ { 0.0, 10.0, 60.0f } }, rate));
+			if (auto current = card.output.current()) {
+				EXPECT_THAT(current->pos(), Ge(0.0));
+			}
+			std::this_thread::yield();
+		}
+	});
+
+	card.until(*m, Music::State::PLAYING);
+	float peak = 0.0f;
+	for (unsigned i = 0; i < 200; ++i) peak = std::max(peak, card());
+	done = true;
+	ui.join();
+
+	EXPECT_EQ(0u, card.allocations);
+	EXPECT_THAT(peak, Gt(0.0f));
+	EXPECT_EQ(Music::State::PLAYING, m->state());
+}
+
+TEST(UnitTest_AudioOutput, new_music_fades_out_the_old) {
+	Card card;
+	auto first = music(2, 5.0, 0.01);
+	card.output.play(first);
+	card.until(*first, Music::State::PLAYING);
+	auto second = music(2, 5.0, 0.05);
+	card.output.play(second);
+
+	card.until(*second, Music::State::PLAYING);
+	EXPECT_THAT(first->mixer.fadeRate, Lt(0.0));
+	card.until(*first, Music::State::DONE);
+
+	EXPECT_EQ(second, card.output.current());
+	EXPECT_EQ(1u, card.output.playing().size());
+	EXPECT_TRUE(card.output.busy());
+	EXPECT_EQ(0u, card.allocations);
+}
+
+TEST(UnitTest_AudioOutput, music_still_loading_is_cancelled) {
+	Card card;
+	auto first = music(2, 5.0, 0.01);
+	card.output.play(first);
+	auto second = music(2, 5.0, 0.01);
+	card.output.play(second);
+
+	card.until(*second, Music::State::PLAYING);
+
+	EXPECT_EQ(Music::State::CANCELLED, first->state());
+	EXPECT_EQ(second, card.output.current());
+}
+
+TEST(UnitTest_AudioOutput, music_ends) {
+	Card card;
+	auto m = music(1, 0.05, 0.01);
+	card.output.play(m);
+
+	card.until(*m, Music::State::DONE);
+
+	EXPECT_FALSE(card.output.busy());
+	EXPECT_EQ(nullptr, card.output.current());
+}
@@ -0,0 +1,67 @@
+#include "common.hh"
+
+#include "game/beatgrid.hh"
+#include "game/fs.hh"
+
+#include <fstream>
+#include <vector>
+
+TEST(UnitTest_BeatGrid, file_name) {
+	fs::path const name = BeatGrid::fileName("/songs/a/song.ogg");
+	EXPECT_EQ(name, BeatGrid::fileName("/songs/a/song.ogg"));
+	EXPECT_EQ(".beats", name.extension());
+	EXPECT_NE(name, BeatGrid::fileName("/songs/b/song.ogg"));
+}
+
+TEST(UnitTest_BeatGrid, file) {
+	TempDir dir;
+	fs::path const file = dir.path / BeatGrid::fileName("/songs/a/song.ogg");
+	FileStamp const stamp{ 1000, 2000 };
+	BeatGrid grid;
+	grid.start = 30.0;
+	grid.beats = { 30.5, 31.0, 31.5 };
+	grid.save(file, stamp);
+	EXPECT_EQ(sizeof(BeatGrid::Header) + 3 * sizeof(double), fs::file_size(file));
+	BeatGrid read;
+	ASSERT_TRUE(read.load(file, stamp, 30.0));
+	EXPECT_EQ(grid.beats, read.beats);
+	EXPECT_EQ(30.0, read.start);
+	// The music has changed, or the preview starts elsewhere
+	EXPECT_FALSE(read.load(file, FileStamp{ 1001, 2000 }, 30.0));
+	EXPECT_FALSE(read.load(file, FileStamp{ 1000, 2001 }, 30.0));
+	EXPECT_FALSE(read.load(file, stamp, 5.0));
+	EXPECT_FALSE(read.load(dir.path / "missing.beats", stamp, 30.0));
+	EXPECT_EQ(grid.beats, read.beats);  // Failures leave it alone
+	// Truncated file
+	fs::resize_file(file, fs::file_size(file) - 1);
+	EXPECT_FALSE(read.load(file, stamp, 30.0));
+	// Not a beats file
+	std::ofstream(file, std::ios::binary) << "OggS and then some more bytes to fill a header of a beats file";
+	EXPECT_FALSE(read.load(file, stamp, 30.0));
+	// No beats found is a valid result too, and replacing a file leaves no temporary files behind
+	BeatGrid empty;
+	empty.start = 30.0;
+	empty.save(file, stamp);
+	read.beats = { 1.0 };
+	ASSERT_TRUE(read.load(file, stamp, 30.0));
+	EXPECT_TRUE(read.beats.empty());
+	EXPECT_EQ(1, std::distance(fs::directory_iterator(dir.path), fs::directory_iterator()));
+}
+
+TEST(UnitTest_BeatGrid, extend_backwards) {
+	BeatGrid grid;
+	grid.start = 10.0;
+	grid.beats = { 11.25, 11.75 };
+	grid.extendBackwards(0.5);
+	EXPECT_EQ((std::vector<double>{ 10.25, 10.75, 11.25, 11.75 }), grid.beats);
+	// Not within 20 ms of the start
+	grid.beats = { 11.01 };
+	grid.extendBackwards(0.5);
+	EXPECT_EQ((std::vector<double>{ 10.51, 11.01 }), grid.beats);
+	grid.beats.clear();
+	grid.extendBackwards(0.5);
+	EXPECT_TRUE(grid.beats.empty());
+	grid.beats = { 11.0 };
+	grid.extendBackwards(0.0);
+	EXPECT_EQ(std::vector<double>{ 11.0 }, grid.beats);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <chrono>
+
+/// Wall-clock time of the steps of a benchmark
+class Stopwatch {
+  public:
+	/// Milliseconds since the stopwatch was made or the previous lap
+	double lap() {
+		auto const now = Clock::now();
+		double const ms = std::chrono::duration<double, std::milli>(now - m_start).count();
+		m_start = now;
+		return ms;
+	}
+
+  private:
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point m_start = Clock::now();
+};
@@ -0,0 +1,42 @@
+#include "benchmark.hh"
+
+#include "game/databasestore.hh"
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+
+TEST(Benchmark_DatabaseStore, million_scores) {
+	unsigned const scores = 1000000, players = 2000, songs = 20000;
+	char const* const tracks[] = { "vocals", "Harmony 1", "Guitar", "Drums" };
+	fs::path const dir = fs::temp_directory_path() / "performous-dbstore-benchmark";
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+	fs::path const file = dir / "database.bin";
+	Stopwatch watch;
+	{
+		DatabaseSnapshot snapshot(file);
+		snapshot.begin(1);
+		for (unsigned i = 0; i < players; ++i) snapshot.add(PlayerRecord{ i, "Player " + std::to_string(i), "" });
+		for (unsigned i = 0; i < songs; ++i) snapshot.add(SongRecord{ i, "Artist " + std::to_string(i / 10), "Song " + std::to_string(i), false });
+		for (unsigned i = 0; i < scores; ++i) {
+			snapshot.add(HiscoreItem(2000 + (i * 7919u) % 8000, i % players, (i * 31u) % songs, static_cast<unsigned short>(i % 3), tracks[i % 4], std::chrono::seconds(1600000000 + i)));
+		}
+		snapshot.commit();
+	}
+	double const saved = watch.lap();
+	std::size_t loaded = 0;
+	DatabaseSnapshot(file).load([&](DatabaseRecord&&) { ++loaded; });
+	double const load = watch.lap();
+	EXPECT_EQ(players + songs + scores, loaded);
+	// Journaling the scores of one song is a single small write
+	DatabaseJournal journal(dir / "database.journal");
+	journal.replay(1, [](DatabaseRecord&&) {});
+	watch.lap();
+	journal.append(HiscoreItem(9000, 1, 2, 0, "vocals"));
+	journal.flush();
+	double const appended = watch.lap();
+	std::cout << "1M scores: snapshot of " << fs::file_size(file) / 1024 / 1024 << " MiB saved in " << saved << " ms, loaded in " << load
+	  << " ms; one score journaled in " << appended << " ms" << std::endl;
+}
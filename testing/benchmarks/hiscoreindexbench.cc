@@ -0,0 +1,41 @@
+#include "benchmark.hh"
+
+#include "game/hiscoreindex.hh"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+TEST(Benchmark_HiscoreIndex, best_scores) {
+	// 50k songs, most of them with a few scores on different levels and tracks
+	unsigned const songs = 50000;
+	char const* const tracks[] = { "vocals", "harmonic 1", "guitar", "drums" };
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<unsigned> score(2000, 10000), count(0, 6), track(0, 3), level(0, 2);
+	HiscoreIndex index;
+	Stopwatch watch;
+	for (unsigned song = 0; song < songs; ++song) {
+		for (unsigned i = count(rng); i > 0; --i) index.add({ score(rng), i, song, static_cast<unsigned short>(level(rng)), tracks[track(rng)] });
+	}
+	std::cout << "Added " << index.size() << " scores in " << watch.lap() << " ms" << std::endl;
+	// What sorting by score needs: the best score of every song
+	std::vector<unsigned> best(songs);
+	for (unsigned song = 0; song < songs; ++song) {
+		if (auto const* levelTracks = index.tracks(song, 1)) {
+			for (auto const& [name, bucket]: *levelTracks) if (!bucket.empty()) best[song] = std::max(best[song], bucket.front()->score);
+		}
+	}
+	double const buckets = watch.lap();
+	// The way Hiscore::getHiscore used to find them, estimated from a few songs
+	unsigned const sample = 50;
+	for (unsigned song = 0; song < sample; ++song) {
+		unsigned found = 0;
+		for (auto const& item: index.items()) if (item.songid == song && item.level == 1) { found = item.score; break; }
+		EXPECT_EQ(found, best[song]) << "song " << song;
+	}
+	double const scan = watch.lap() * songs / sample;
+	std::cout << "Best scores of " << songs << " songs: buckets " << buckets << " ms, scanning all scores ~" << scan << " ms (estimated from " << sample << " songs)" << std::endl;
+}
@@ -0,0 +1,61 @@
+#include "benchmark.hh"
+
+#include "game/libda/mix.hpp"
+#include "game/mixengine.hh"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(Benchmark_MixEngine, callback_13_stems) {
+	constexpr unsigned stems = 13;
+	constexpr std::size_t frames = 256, blocks = 1000;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	std::vector<std::vector<float>> song(stems, std::vector<float>(2 * 48000));
+	for (auto& stem: song) for (auto& s: stem) s = dist(rng);
+	std::vector<float> out(2 * frames), mixbuf(2 * frames);
+	auto usPerCallback = [&](double ms) { return ms * 1e3 / blocks; };
+	// What Music did before: stems summed a sample at a time, then the fade with a channel branch and the center suppressor
+	double fadeLevel = 1.0, fadeRate = 0.0;
+	Stopwatch watch;
+	for (std::size_t b = 0; b < blocks; ++b) {
+		std::size_t const pos = b * 2 * frames % (song[0].size() - 2 * frames);
+		std::fill(mixbuf.begin(), mixbuf.end(), 0.0f);
+		for (auto const& stem: song) for (std::size_t i = 0; i < 2 * frames; ++i) mixbuf[i] += 0.8f * stem[pos + i];
+		for (std::size_t i = 0; i < 2 * frames; ++i) {
+			if (i % 2 == 0) {
+				fadeLevel += fadeRate;
+				if (fadeLevel > 1.0f) { fadeLevel = 1.0f; fadeRate = 0.0f; }
+			}
+			out[i] += static_cast<float>(mixbuf[i] * fadeLevel * 0.9f);
+		}
+		for (std::size_t i = 0; i < 2 * frames; i += 2) out[i] = out[i + 1] = out[i] - out[i + 1];
+	}
+	std::cout << stems << " stems, " << frames << " frames at 48 kHz (budget " << 1e6 * frames / 48000.0 << " us): per-sample " << usPerCallback(watch.lap()) << " us";
+	MixBus bus(8192);
+	for (auto const& kernel: da::mix_kernels::available()) {
+		for (std::size_t block: { std::size_t(64), MixEngine::DEFAULT_BLOCK }) {
+			MixEngine e(block, kernel);
+			for (unsigned n = 0; n < stems; ++n) e.addStem("bench" + std::to_string(n), 0.8f);
+			e.fadeLevel = 1.0;
+			e.centerCancel = true;
+			watch.lap();
+			for (std::size_t b = 0; b < blocks; ++b) {
+				std::size_t const pos = b * 2 * frames % (song[0].size() - 2 * frames);
+				e.mix(out.data(), out.data() + out.size(), bus, 0.9f, [&](std::size_t stem, float* mix, std::size_t samples, std::size_t offset, GainRamp::Ramp ramp) {
+					kernel.stereo(mix, song[stem].data() + pos + offset, samples / 2, ramp.gain, ramp.step);
+					return true;
+				});
+			}
+			std::cout << ", " << kernel.name << "/" << block << " " << usPerCallback(watch.lap()) << " us";
+		}
+	}
+	std::cout << std::endl;
+	EXPECT_TRUE(std::all_of(out.begin(), out.end(), [](float s) { return std::isfinite(s); }));
+}
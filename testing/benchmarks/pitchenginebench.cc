@@ -0,0 +1,22 @@
+#include "../sungvowel.hh"
+
+#include <gtest/gtest.h>
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+TEST(Benchmark_PitchEngines, sung_vowels) {
+	std::vector<SungVowel> const voices{ { "bass", 65.4, 0.2 }, { "bass", 82.4, 0.2 }, { "baritone", 110.0, 0.5 }, { "tenor", 196.0 },
+	  { "alto", 330.0 }, { "soprano", 660.0 } };
+	std::cout << "voice     f0 Hz | engine  correct  error   latency  cpu/frame" << std::endl << std::fixed << std::setprecision(1);
+	for (auto const& voice: voices) {
+		for (auto engine: { PitchEngine::Type::FFT, PitchEngine::Type::MPM }) {
+			PitchResult const r = measurePitch(voice, engine, 1.5);
+			std::cout << std::left << std::setw(9) << voice.name << std::right << std::setw(6) << voice.f0 << " | " << std::left << std::setw(6)
+			  << PitchEngine::name(engine) << std::right << std::setw(7) << 100.0 * r.correct << " %" << std::setw(5) << r.cents << " ct"
+			  << std::setw(7) << 1e3 * r.latency << " ms" << std::setw(7) << 1e6 * r.cpu << " us" << std::endl;
+		}
+	}
+	std::cout << std::defaultfloat;
+}
@@ -0,0 +1,47 @@
+#include "benchmark.hh"
+
+#include "game/libda/resampler.hpp"
+#include "game/libda/sample.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+TEST(Benchmark_Resampler, kernels) {
+	constexpr std::size_t frames = 256, blocks = 2000;
+	constexpr double ratio = 48000.0 / 44100.0;
+	std::vector<float> in(4096), out(frames);
+	for (std::size_t i = 0; i < in.size(); ++i) in[i] = 0.5f * static_cast<float>(std::sin(da::tau * 440.0 * double(i) / 48000.0));
+	auto nsPerSample = [&](double ms) { return ms * 1e6 / (frames * blocks); };
+	// What mic pass-through did before: Lanczos evaluated for every tap of every sample
+	float sink = 0.0f;
+	Stopwatch watch;
+	for (std::size_t b = 0; b < blocks; ++b) {
+		double pos = 0.0;
+		for (std::size_t i = 0; i < frames; ++i) {
+			constexpr unsigned a = 2;
+			double s = 0.0;
+			unsigned k = static_cast<unsigned>(pos);
+			double x = pos - k;
+			for (unsigned j = 0; j <= 2 * a; ++j) s += in[k + j] * da::lanc<a>(x - j + a);
+			out[i] = static_cast<float>(s);
+			pos += ratio;
+		}
+		sink += out[b % frames];
+	}
+	std::cout << "Resampling 48 -> 44.1 kHz: lanczos<2> " << nsPerSample(watch.lap()) << " ns/sample";
+	for (auto const& kernel: da::resample_kernels::available()) {
+		da::Resampler resampler(ratio, 4096, kernel);
+		watch.lap();
+		for (std::size_t b = 0; b < blocks; ++b) {
+			resampler.push(in.data(), resampler.needed(frames));
+			resampler.pull(out.data(), frames);
+			sink += out[b % frames];
+		}
+		std::cout << ", " << kernel.name << " " << nsPerSample(watch.lap()) << " ns/sample";
+	}
+	std::cout << " (" << da::Resampler::TAPS << " taps)" << std::endl;
+	EXPECT_TRUE(std::isfinite(sink));
+}
@@ -0,0 +1,28 @@
+#include "../searchcorpus.hh"
+#include "benchmark.hh"
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <string>
+
+TEST(Benchmark_SearchIndex, typing) {
+	auto collator = searchCollator();
+	auto texts = library(100000);
+	SearchIndex index;
+	Stopwatch watch;
+	for (auto const& text: texts) index.add(text);
+	std::cout << "Indexed " << texts.size() << " songs in " << watch.lap() << " ms" << std::endl;
+	// Typing a search term, one keystroke at a time
+	std::string const term = "dream 4242";
+	for (std::size_t i = 1; i <= term.size(); ++i) {
+		auto found = index.find(term.substr(0, i), collator.get());
+		std::cout << "  \"" << term.substr(0, i) << "\": " << found.size() << " songs in " << watch.lap() << " ms" << std::endl;
+	}
+	auto expected = naiveFind(texts, term, collator.get());
+	double const naive = watch.lap();
+	auto found = index.find(term, collator.get());
+	double const indexed = watch.lap();
+	std::cout << "Full term: index " << indexed << " ms, StringSearch per song " << naive << " ms" << std::endl;
+	EXPECT_EQ(expected, found);
+}
@@ -0,0 +1,43 @@
+#include "benchmark.hh"
+
+#include "game/songlistsnapshot.hh"
+#include "game/sortkey.hh"
+
+#include <gtest/gtest.h>
+#include <unicode/errorcode.h>
+#include <unicode/tblcoll.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST(Benchmark_SongListSnapshot, polling_clients) {
+	icu::ErrorCode error;
+	std::unique_ptr<icu::Collator> sort(icu::Collator::createInstance(icu::Locale::getRoot(), error));
+	std::vector<SongListSnapshot::Entry> entries;
+	for (unsigned i = 0; i < 20000; ++i) {
+		SongListSnapshot::Entry e;
+		e.artist = "Artist " + std::to_string(i / 10);
+		e.title = "Song " + std::to_string(i * 7919 % 20000);
+		e.language = "English";
+		e.edition = "Edition";
+		e.searchText = e.artist + "\n" + e.title;
+		e.sortKeys[static_cast<std::size_t>(SongListSnapshot::Sort::TITLE)] = sortKey(*sort, e.title);
+		e.sortKeys[static_cast<std::size_t>(SongListSnapshot::Sort::ARTIST)] = sortKey(*sort, e.artist);
+		e.sortKeys[static_cast<std::size_t>(SongListSnapshot::Sort::LANGUAGE)] = sortKey(*sort, e.language);
+		entries.push_back(std::move(e));
+	}
+	Stopwatch watch;
+	SongListSnapshot const snapshot(1, std::move(entries), 2);
+	double const made = watch.lap();
+	SongListSnapshot::Query query;
+	query.sort = SongListSnapshot::Sort::TITLE;
+	auto const first = snapshot.respond(query);
+	double const built = watch.lap();
+	// 20 phones polling every few seconds for a while
+	for (unsigned i = 0; i < 1000; ++i) EXPECT_EQ(first, snapshot.respond(query));
+	double const polled = watch.lap();
+	std::cout << "20k songs: snapshot made in " << made << " ms, " << first->json.size() / 1024 << " KiB of JSON (" << first->gzip.size() / 1024
+	  << " KiB gzipped) built in " << built << " ms, 1000 cached responses in " << polled << " ms" << std::endl;
+}
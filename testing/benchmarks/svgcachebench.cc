@@ -0,0 +1,38 @@
+#include "benchmark.hh"
+
+#include "game/cache.hh"
+#include "game/fs.hh"
+#include "game/swizzle.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+TEST(Benchmark_SvgCache, background) {
+	// A full screen background at svg_lod 1.5
+	unsigned const width = 2880, height = 1620;
+	std::vector<std::uint8_t> data(std::size_t(width) * height * 4);
+	std::mt19937 rng(2);
+	for (auto& b: data) b = static_cast<std::uint8_t>(rng());
+	Stopwatch watch;
+	pix::swapRedBlueScalar(data.data(), std::size_t(width) * height);
+	double const scalar = watch.lap();
+	pix::swapRedBlue(data.data(), std::size_t(width) * height);
+	double const simd = watch.lap();
+	fs::path const dir = fs::temp_directory_path() / "performous-svgcache-benchmark";
+	fs::create_directories(dir);
+	fs::path const file = dir / "background.raw";
+	watch.lap();
+	cache::writeRaster(file, FileStamp{ 1, 2 }, width, height, data.data());
+	double const write = watch.lap();
+	unsigned w, h;
+	std::vector<unsigned char> read;
+	ASSERT_TRUE(cache::readRaster(file, FileStamp{ 1, 2 }, w, h, read));
+	double const load = watch.lap();
+	std::cout << width << "x" << height << " RGBA: swizzle " << scalar << " ms scalar, " << simd << " ms SIMD; raster cache write "
+	  << write << " ms, load " << load << " ms" << std::endl;
+	fs::remove_all(dir);
+}
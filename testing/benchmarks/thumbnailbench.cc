@@ -0,0 +1,53 @@
+#include "benchmark.hh"
+
+#include "game/image.hh"
+#include "game/thumbnailfile.hh"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(Benchmark_Thumbnail, cache_against_originals) {
+	// The covers of 50 songs as 1000x1000 JPEGs, thumbnailed the way CoverCache does
+	unsigned const songs = 50, size = 1000, cell = 128;
+	fs::path const dir = fs::temp_directory_path() / "performous-thumbnail-benchmark";
+	fs::remove_all(dir);
+	fs::create_directories(dir / "songs");
+	std::vector<std::uint8_t> rgb(std::size_t(size) * size * 3);
+	std::mt19937 rng(1);
+	std::vector<fs::path> covers;
+	for (unsigned song = 0; song < songs; ++song) {
+		for (std::size_t i = 0; i < rgb.size(); ++i) rgb[i] = static_cast<std::uint8_t>(i % 3 == 2 ? rng() & 0xFF : (i / 3 % size + song) & 0xFF);
+		Bitmap bitmap(rgb.data());
+		bitmap.fmt = pix::Format::RGB;
+		bitmap.width = bitmap.height = size;
+		covers.push_back(dir / "songs" / ("cover" + std::to_string(song) + ".jpg"));
+		writeJPEG(covers.back(), bitmap, 90);
+	}
+	fs::path const cache = dir / "covers";
+	unsigned fromCache = 0;
+	Stopwatch watch;
+	// Cold: each original is decoded, scaled and the thumbnail written to the cache
+	for (auto const& cover: covers) {
+		bool cached = false;
+		loadThumbnail(cover, cache, cell, cached);
+		fromCache += cached;
+	}
+	double const cold = watch.lap();
+	EXPECT_EQ(0u, fromCache);
+	// Warm: each thumbnail is read from the cache
+	for (auto const& cover: covers) {
+		bool cached = false;
+		EXPECT_EQ(std::size_t(cell) * cell * 3, loadThumbnail(cover, cache, cell, cached).rgb.size());
+		fromCache += cached;
+	}
+	double const warm = watch.lap();
+	EXPECT_EQ(songs, fromCache);
+	fs::remove_all(dir);
+	std::cout << songs << " covers of " << size << "x" << size << ": from the originals " << cold / songs << " ms each, from the thumbnail cache "
+	  << warm / songs << " ms each" << std::endl;
+}
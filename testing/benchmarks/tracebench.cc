@@ -0,0 +1,26 @@
+#include "benchmark.hh"
+
+#include "game/trace.hh"
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+
+namespace {
+	void zone() { TRACE_ZONE("benchmark/zone"); }
+}
+
+TEST(Benchmark_Trace, zone_overhead) {
+	unsigned const n = 1000000;
+	trace::enable(false);
+	Stopwatch watch;
+	for (unsigned i = 0; i < n; ++i) zone();
+	double const disabled = watch.lap();
+	trace::enable(true);
+	for (unsigned i = 0; i < n; ++i) zone();
+	double const enabled = watch.lap();
+	trace::enable(false);
+	std::cout << "Zone overhead: " << disabled * 1e6 / n << " ns disabled, " << enabled * 1e6 / n << " ns enabled" << std::endl;
+	trace::clear();
+	trace::summaries(true);
+}
@@ -0,0 +1,30 @@
+#include "benchmark.hh"
+
+#include "game/graphic/vertexstream.hh"
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace glutil;
+
+TEST(Benchmark_VertexStream, packing) {
+	// A busy frame of note bars, lyrics and menus: about 20k vertices
+	std::size_t const count = 20000;
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	std::vector<float> colors(count * 4);
+	for (auto& c: colors) c = value(rng) * 0.5f + 0.5f;
+	std::vector<CompactVertex> out(count);
+	Stopwatch watch;
+	for (std::size_t i = 0; i < count; ++i) {
+		out[i].normal = packNormal(0.0f, 0.0f, 1.0f);
+		for (unsigned j = 0; j < 4; ++j) out[i].color[j] = toHalf(colors[i * 4 + j]);
+	}
+	double const packing = watch.lap();
+	std::cout << "Packed " << count << " vertices (" << count * 48 / 1024 << " KiB as floats, " << count * sizeof(CompactVertex) / 1024
+	  << " KiB compact) in " << packing << " ms" << std::endl;
+	for (std::size_t i = 0; i < 100; ++i) EXPECT_NEAR(colors[i * 4], fromHalf(out[i].color[0]), 1.0 / 1024.0);
+}
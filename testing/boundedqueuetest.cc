@@ -0,0 +1,54 @@
+#include "common.hh"
+
+#include "game/boundedqueue.hh"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(UnitTest_BoundedQueue, fifo) {
+	BoundedQueue<int> queue(4);
+	EXPECT_TRUE(queue.push(1));
+	EXPECT_TRUE(queue.push(2));
+	int value = 0;
+	EXPECT_TRUE(queue.pop(value));
+	EXPECT_EQ(1, value);
+	EXPECT_TRUE(queue.pop(value));
+	EXPECT_EQ(2, value);
+}
+
+TEST(UnitTest_BoundedQueue, close_drains_remaining_items) {
+	BoundedQueue<int> queue(4);
+	queue.push(1);
+	queue.close();
+	EXPECT_FALSE(queue.push(2));
+	int value = 0;
+	EXPECT_TRUE(queue.pop(value));
+	EXPECT_EQ(1, value);
+	EXPECT_FALSE(queue.pop(value));
+}
+
+TEST(UnitTest_BoundedQueue, close_wakes_waiting_consumers) {
+	BoundedQueue<int> queue(1);
+	std::thread consumer([&] { int value; while (queue.pop(value)) {} });
+	queue.close();
+	consumer.join();
+}
+
+TEST(UnitTest_BoundedQueue, producers_and_consumers) {
+	// Shape of the song scanner: one producer, several consumers, small queue
+	BoundedQueue<int> queue(8);
+	std::atomic<long> sum{ 0 };
+	std::atomic<int> count{ 0 };
+	std::vector<std::thread> consumers;
+	for (int i = 0; i < 4; ++i) consumers.emplace_back([&] {
+		int value;
+		while (queue.pop(value)) { sum += value; ++count; }
+	});
+	for (int i = 1; i <= 10000; ++i) queue.push(i);
+	queue.close();
+	for (auto& t: consumers) t.join();
+
+	EXPECT_EQ(10000, count.load());
+	EXPECT_EQ(50005000, sum.load());
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "game/fs.hh"
+
 #include <cmath>
+#include <random>
+#include <string>
+#include <system_error>
 
 #ifdef WIN32
 static constexpr float pi = 3.14159265359f;
@@ -28,3 +33,9 @@ using ::testing::Not;
 using ::testing::NotNull;
 using ::testing::Pointee;
 
+/// A fresh folder below the system temporary folder, removed with everything in it at the end of the test
+struct TempDir {
+	fs::path path = fs::temp_directory_path() / ("performous_test_" + std::to_string(std::random_device()()));
+	TempDir() { fs::create_directories(path); }
+	~TempDir() { std::error_code ec; fs::remove_all(path, ec); }
+};
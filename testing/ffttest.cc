@@ -0,0 +1,82 @@
+#include "common.hh"
+
+#include "game/libda/fft.hpp"
+
+#include <algorithm>
+#include <complex>
+#include <random>
+#include <vector>
+
+namespace {
+	constexpr unsigned P = 10;
+	constexpr std::size_t N = 1 << P;
+
+	std::vector<float> makeSignal() {
+		auto signal = std::vector<float>(N);
+		auto rng = std::mt19937(1234);
+		auto dist = std::uniform_real_distribution<float>(-1.f, 1.f);
+		for (size_t i = 0; i < N; ++i) signal[i] = 0.5f * std::sin(static_cast<float>(i) * 0.07f) + 0.1f * dist(rng);
+		return signal;
+	}
+
+	std::vector<float> makeWindow() {
+		auto window = std::vector<float>(N);
+		for (size_t i = 0; i < N; ++i) window[i] = static_cast<float>(0.53836 - 0.46164 * std::cos(da::TAU * static_cast<double>(i) / (N - 1)));
+		return window;
+	}
+
+	std::vector<std::complex<float>> transform(da::RealFFT<P> const& fft, std::vector<float> const& signal, std::vector<float> const& window) {
+		auto out = std::vector<std::complex<float>>(da::RealFFT<P>::BINS);
+		fft(signal.data(), window, out.data());
+		return out;
+	}
+}
+
+TEST(UnitTest_FFT, real_fft_matches_complex_fft) {
+	auto const signal = makeSignal();
+	auto const window = makeWindow();
+	auto const expected = da::fft<P>(signal.data(), window);
+	auto const result = transform(da::RealFFT<P>(), signal, window);
+
+	float peak = 0.f;
+	for (auto const& bin: expected) peak = std::max(peak, std::abs(bin));
+	ASSERT_EQ(N / 2 + 1, result.size());
+	for (size_t k = 0; k < result.size(); ++k) {
+		EXPECT_NEAR(expected[k].real(), result[k].real(), 1e-5f * peak) << "bin " << k;
+		EXPECT_NEAR(expected[k].imag(), result[k].imag(), 1e-5f * peak) << "bin " << k;
+	}
+}
+
+TEST(UnitTest_FFT, real_fft_small_size) {
+	auto const signal = std::vector<float>{ 1.f, 2.f, 3.f, 4.f, 0.f, -1.f, 0.5f, 2.f };
+	auto const window = std::vector<float>(8, 1.f);
+	auto expected = std::vector<std::complex<float>>(signal.begin(), signal.end());
+	da::fft<3>(expected.data());
+	auto result = std::vector<std::complex<float>>(5);
+
+	da::RealFFT<3>()(signal.data(), window, result.data());
+
+	for (size_t k = 0; k < result.size(); ++k) {
+		EXPECT_NEAR(expected[k].real(), result[k].real(), 1e-5f) << "bin " << k;
+		EXPECT_NEAR(expected[k].imag(), result[k].imag(), 1e-5f) << "bin " << k;
+	}
+}
+
+TEST(UnitTest_FFT, kernels_are_bit_identical) {
+	auto const signal = makeSignal();
+	auto const window = makeWindow();
+	auto const kernels = da::fft_kernels::available();
+	auto const reference = transform(da::RealFFT<P>(kernels.front()), signal, window);
+
+	EXPECT_STREQ("scalar", kernels.front().name);
+	for (auto const& kernel: kernels) {
+		auto const result = transform(da::RealFFT<P>(kernel), signal, window);
+		EXPECT_TRUE(std::equal(reference.begin(), reference.end(), result.begin())) << kernel.name;
+	}
+}
+
+TEST(UnitTest_FFT, best_kernel_is_available) {
+	auto const kernels = da::fft_kernels::available();
+
+	EXPECT_STREQ(kernels.back().name, da::fft_kernels::best().name);
+}
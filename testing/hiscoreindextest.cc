@@ -0,0 +1,70 @@
+#include "common.hh"
+
+#include "game/hiscoreindex.hh"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<unsigned> scores(HiscoreIndex::Bucket const* bucket) {
+		std::vector<unsigned> result;
+		if (bucket) for (auto const& it: *bucket) result.push_back(it->score);
+		return result;
+	}
+
+	/// Best score of a song on a level, the way Hiscore::getHiscore used to find it
+	unsigned scanBest(HiscoreIndex const& index, unsigned songid, unsigned short level) {
+		for (auto const& item: index.items()) if (item.songid == songid && item.level == level) return item.score;
+		return 0;
+	}
+
+	/// Best score of a song on a level using the buckets
+	unsigned bucketBest(HiscoreIndex const& index, unsigned songid, unsigned short level) {
+		unsigned best = 0;
+		if (auto const* tracks = index.tracks(songid, level)) {
+			for (auto const& [track, bucket]: *tracks) if (!bucket.empty()) best = std::max(best, bucket.front()->score);
+		}
+		return best;
+	}
+}
+
+TEST(UnitTest_HiscoreIndex, buckets) {
+	HiscoreIndex index;
+	index.add({ 5000, 1, 7, 0, "vocals" });
+	index.add({ 8000, 2, 7, 0, "vocals" });
+	index.add({ 6000, 3, 7, 0, "guitar" });
+	index.add({ 9000, 1, 7, 1, "vocals" });
+	index.add({ 7000, 1, 8, 0, "vocals" });
+	index.add({ 8000, 3, 7, 0, "vocals" });
+	EXPECT_EQ(6u, index.size());
+	EXPECT_EQ(std::vector<unsigned>({ 8000, 8000, 5000 }), scores(index.find(7, 0, "vocals")));
+	EXPECT_EQ(std::vector<unsigned>({ 6000 }), scores(index.find(7, 0, "guitar")));
+	EXPECT_EQ(std::vector<unsigned>({ 9000 }), scores(index.find(7, 1, "vocals")));
+	EXPECT_EQ(nullptr, index.find(7, 2, "vocals"));
+	EXPECT_EQ(nullptr, index.find(9, 0, "vocals"));
+	// Equal scores stay in the order they were added, like in the list of all scores
+	auto const* bucket = index.find(7, 0, "vocals");
+	EXPECT_EQ(2u, (*bucket)[0]->playerid);
+	EXPECT_EQ(3u, (*bucket)[1]->playerid);
+	ASSERT_NE(nullptr, index.tracks(7, 0));
+	EXPECT_EQ(2u, index.tracks(7, 0)->size());
+	EXPECT_EQ(9000u, index.items().begin()->score);
+	index.clear();
+	EXPECT_EQ(0u, index.size());
+	EXPECT_EQ(nullptr, index.tracks(7, 0));
+}
+
+TEST(UnitTest_HiscoreIndex, best_scores_match_a_scan) {
+	// Songs with a few scores on different levels and tracks
+	unsigned const songs = 2000;
+	char const* const tracks[] = { "vocals", "harmonic 1", "guitar", "drums" };
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<unsigned> score(2000, 10000), count(0, 6), track(0, 3), level(0, 2);
+	HiscoreIndex index;
+	for (unsigned song = 0; song < songs; ++song) {
+		for (unsigned i = count(rng); i > 0; --i) index.add({ score(rng), i, song, static_cast<unsigned short>(level(rng)), tracks[track(rng)] });
+	}
+	for (unsigned song = 0; song < songs; ++song) ASSERT_EQ(scanBest(index, song, 1), bucketBest(index, song, 1)) << "song " << song;
+}
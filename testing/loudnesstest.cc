@@ -0,0 +1,51 @@
+#include "common.hh"
+
+#include "game/libda/loudness.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+	constexpr double rate = 48000.0;
+
+	/// Stereo 1 kHz sine with the given peak level (dBFS) in both channels
+	std::vector<float> sine(double seconds, double level) {
+		double const amplitude = std::pow(10.0, level / 20.0);
+		std::vector<float> ret(2 * static_cast<std::size_t>(seconds * rate));
+		for (std::size_t i = 0; i < ret.size() / 2; ++i) ret[2 * i] = ret[2 * i + 1] = float(amplitude * std::sin(da::tau * 1000.0 * double(i) / rate));
+		return ret;
+	}
+
+	double measure(std::vector<float> const& data) {
+		da::LoudnessMeter meter(rate, 2);
+		meter.process(data.data(), data.size() / 2);
+		return meter.integrated();
+	}
+
+	std::vector<float> operator+(std::vector<float> a, std::vector<float> const& b) {
+		a.insert(a.end(), b.begin(), b.end());
+		return a;
+	}
+}
+
+TEST(UnitTest_Loudness, sine) {
+	// BS.1770: a 1 kHz sine at 0 dBFS in both stereo channels reads 0 LUFS
+	EXPECT_NEAR(-23.0, measure(sine(20.0, -23.0)), 0.1);
+	EXPECT_NEAR(-6.0, measure(sine(5.0, -6.0)), 0.1);
+}
+
+TEST(UnitTest_Loudness, silence) {
+	EXPECT_TRUE(std::isinf(measure(std::vector<float>(2 * 48000 * 5))));
+	EXPECT_TRUE(std::isinf(measure(sine(0.3, -20.0))));  // Shorter than a block
+}
+
+TEST(UnitTest_Loudness, absolute_gate) {
+	// Silence (and anything below -70 LUFS) does not count
+	EXPECT_NEAR(-20.0, measure(sine(10.0, -20.0) + std::vector<float>(2 * 48000 * 30) + sine(10.0, -80.0)), 0.1);
+}
+
+TEST(UnitTest_Loudness, relative_gate) {
+	// A quiet intro more than 10 LU below the rest does not count, one less than that does
+	EXPECT_NEAR(-20.0, measure(sine(20.0, -35.0) + sine(20.0, -20.0)), 0.1);
+	EXPECT_LT(measure(sine(20.0, -25.0) + sine(20.0, -20.0)), -21.0);
+}
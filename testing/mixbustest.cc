@@ -0,0 +1,84 @@
+#include "common.hh"
+
+#include "game/mixbus.hh"
+#include "game/triplebuffer.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+	constexpr double rate = 48000.0;
+
+	/// Decoded audio of one stem, played back like Music::Track does (summed into the bus with a fade level).
+	struct Stem {
+		std::vector<float> data;
+		float fadeLevel = 1.0f;
+		explicit Stem(unsigned n): data(static_cast<size_t>(rate) * 2 * 10) {
+			for (size_t i = 0; i < data.size(); ++i) data[i] = 0.05f * std::sin(static_cast<float>(i) * 0.001f * static_cast<float>(n + 1));
+		}
+		void read(float* bus, size_t samples, size_t pos) const {
+			for (size_t i = 0; i < samples; ++i) bus[i] += fadeLevel * data[(pos + i) % data.size()];
+		}
+	};
+
+	/// Same structure as the output callback: settings from the snapshot, scratch space from the bus.
+	struct Callback {
+		std::vector<Stem> stems;
+		MixBus bus;
+		TripleBuffer<MixParams> params;
+		size_t pos = 0;
+		Callback(unsigned stemCount, size_t busSamples): bus(busSamples) {
+			for (unsigned n = 0; n < stemCount; ++n) stems.emplace_back(n);
+		}
+		void operator()(float* begin, float* end) {
+			std::fill(begin, end, 0.0f);
+			MixParams const& p = params.read();
+			bus.process(begin, end, [&](float* b, float* e) {
+				auto samples = static_cast<size_t>(e - b);
+				float* mixbuf = bus.clear(samples);
+				for (auto const& stem: stems) stem.read(mixbuf, samples, pos);
+				for (size_t i = 0; i < samples; ++i) b[i] += mixbuf[i] * p.musicVolume;
+				pos += samples;
+			});
+		}
+	};
+}
+
+TEST(UnitTest_MixBus, capacity_is_even) {
+	EXPECT_EQ(0u, MixBus().capacity());
+	EXPECT_EQ(16u, MixBus(16).capacity());
+	EXPECT_EQ(16u, MixBus(17).capacity());
+}
+
+TEST(UnitTest_MixBus, clear) {
+	auto bus = MixBus(8);
+	float* data = bus.clear(8);
+	std::fill(data, data + 8, 1.0f);
+
+	data = bus.clear(4);
+
+	EXPECT_THAT(std::vector<float>(data, data + 8), ElementsAre(0.f, 0.f, 0.f, 0.f, 1.f, 1.f, 1.f, 1.f));
+}
+
+TEST(UnitTest_MixBus, process_splits_large_blocks) {
+	auto bus = MixBus(4);
+	auto out = std::vector<float>(10);
+	auto chunks = std::vector<std::ptrdiff_t>();
+
+	bus.process(out.data(), out.data() + out.size(), [&](float* b, float* e) { chunks.push_back(e - b); });
+
+	EXPECT_THAT(chunks, ElementsAre(4, 4, 2));
+}
+
+TEST(UnitTest_MixBus, chunked_mix_matches_single_pass) {
+	auto small = Callback(3, 64);
+	auto large = Callback(3, 4096);
+	auto a = std::vector<float>(1000);
+	auto b = std::vector<float>(1000);
+
+	small(a.data(), a.data() + a.size());
+	large(b.data(), b.data() + b.size());
+
+	EXPECT_EQ(a, b);
+}
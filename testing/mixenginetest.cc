@@ -0,0 +1,180 @@
+#include "common.hh"
+
+#include "game/libda/mix.hpp"
+#include "game/mixengine.hh"
+#include "game/trace.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+	std::vector<float> noise(std::size_t n, unsigned seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> ret(n);
+		for (auto& s: ret) s = dist(rng);
+		return ret;
+	}
+
+	/// Decoded stems of a song, read like Music reads its AudioBuffers
+	struct Song {
+		std::vector<std::vector<float>> stems;
+		Song(unsigned count, std::size_t samples) {
+			for (unsigned n = 0; n < count; ++n) stems.push_back(noise(samples, n + 1));
+		}
+		auto reader(std::size_t pos) const {
+			return [this, pos](std::size_t stem, float* mix, std::size_t samples, std::size_t offset, GainRamp::Ramp ramp) {
+				auto const& data = stems[stem];
+				std::size_t const at = (pos + offset) % data.size();
+				da::mix_kernels::best().stereo(mix, data.data() + at, std::min(samples, data.size() - at) / 2, ramp.gain, ramp.step);
+				return true;
+			};
+		}
+	};
+
+	MixEngine engine(unsigned stems, std::size_t block) {
+		MixEngine e(block);
+		for (unsigned n = 0; n < stems; ++n) e.addStem("test" + std::to_string(n));
+		e.fadeLevel = 1.0;
+		return e;
+	}
+}
+
+TEST(UnitTest_MixEngine, kernels_are_bit_identical) {
+	auto const kernels = da::mix_kernels::available();
+	EXPECT_STREQ("scalar", kernels.front().name);
+	EXPECT_STREQ(kernels.back().name, da::mix_kernels::best().name);
+	auto const in = noise(2 * 1003, 1), base = noise(2 * 1003, 2);
+	auto run = [&](da::mix_kernels::Kernel const& k) {
+		std::vector<float> stereo = base, mono = base, center = base;
+		k.stereo(stereo.data(), in.data(), 1003, 0.25f, 0.001f);
+		k.mono(mono.data(), in.data(), 1003, 0.9f, -0.0005f);
+		k.centerCancel(center.data(), 1003);
+		return std::vector<std::vector<float>>{ stereo, mono, center };
+	};
+	auto const reference = run(kernels.front());
+	for (auto const& kernel: kernels) EXPECT_EQ(reference, run(kernel)) << kernel.name;
+}
+
+TEST(UnitTest_MixEngine, kernels) {
+	std::vector<float> const in{ 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f };
+	for (auto const& k: da::mix_kernels::available()) {
+		std::vector<float> out(6, 1.0f);
+		k.stereo(out.data(), in.data(), 3, 1.0f, 0.5f);
+		EXPECT_EQ((std::vector<float>{ 2.0f, 3.0f, 5.5f, 7.0f, 11.0f, 13.0f }), out) << k.name;
+		out.assign(6, 0.0f);
+		k.mono(out.data(), in.data(), 3, 2.0f, 0.0f);
+		EXPECT_EQ((std::vector<float>{ 2.0f, 2.0f, 4.0f, 4.0f, 6.0f, 6.0f }), out) << k.name;
+		k.centerCancel(out.data(), 3);
+		EXPECT_EQ(std::vector<float>(6, 0.0f), out) << k.name;  // Mono is all center
+	}
+}
+
+TEST(UnitTest_MixEngine, gain_ramps_over_a_block) {
+	GainRamp g;
+	auto r = g.next(4);
+	EXPECT_EQ(1.0f, r.gain);
+	EXPECT_EQ(0.0f, r.step);
+	g.target = 0.0f;
+	r = g.next(4);
+	EXPECT_EQ(1.0f, r.gain);
+	EXPECT_EQ(-0.25f, r.step);
+	EXPECT_EQ(0.0f, g.gain);
+	EXPECT_EQ(0.0f, g.next(4).step);
+}
+
+TEST(UnitTest_MixEngine, track_fade_is_smooth) {
+	std::vector<float> ones(2 * 1024, 1.0f);
+	MixEngine e(64);
+	e.addStem("test");
+	e.fadeLevel = 1.0;
+	e.setGain(0, 0.0f);
+	MixBus bus(4096);
+	std::vector<float> out(2 * 256);
+	EXPECT_TRUE(e.mix(out.data(), out.data() + out.size(), bus, 1.0f, [&](std::size_t, float* mix, std::size_t samples, std::size_t, GainRamp::Ramp ramp) {
+		da::mix_kernels::best().stereo(mix, ones.data(), samples / 2, ramp.gain, ramp.step);
+		return true;
+	}));
+	// Down to zero over the first block of 64 frames, then silent
+	for (std::size_t k = 1; k < 64; ++k) EXPECT_NEAR(1.0f / 64.0f, out[2 * k - 2] - out[2 * k], 1e-6f);
+	EXPECT_NEAR(1.0f / 64.0f, out[2 * 63], 1e-6f);
+	EXPECT_EQ(std::vector<float>(2 * 192, 0.0f), std::vector<float>(out.begin() + 128, out.end()));
+	EXPECT_EQ(0.0f, e.gain(0));
+}
+
+TEST(UnitTest_MixEngine, fade_in_and_out) {
+	std::vector<float> ones(2 * 1000, 1.0f);
+	auto read = [&](std::size_t, float* mix, std::size_t samples, std::size_t, GainRamp::Ramp) {
+		std::copy_n(ones.begin(), samples, mix);
+		return true;
+	};
+	MixBus bus(256);
+	MixEngine e(100);
+	e.addStem("test");
+	e.fadeRate = 1.0 / 128.0;
+	std::vector<float> out(2 * 300);
+	EXPECT_TRUE(e.mix(out.data(), out.data() + out.size(), bus, 0.5f, read));
+	EXPECT_EQ(0.5f / 128.0f, out[0]);  // Frame k has level (k + 1) * rate
+	EXPECT_EQ(0.25f, out[2 * 63 + 1]);
+	EXPECT_EQ(0.5f, out[2 * 127]);
+	EXPECT_EQ(0.5f, out[2 * 128]);
+	EXPECT_EQ(1.0, e.fadeLevel);
+	EXPECT_EQ(0.0, e.fadeRate);
+	// Fading out ends the mix when the level reaches zero, leaving the rest alone
+	e.fadeRate = -1.0 / 128.0;
+	out.assign(out.size(), 0.0f);
+	EXPECT_FALSE(e.mix(out.data(), out.data() + out.size(), bus, 1.0f, read));
+	EXPECT_EQ(1.0f - 1.0f / 128.0f, out[0]);
+	EXPECT_EQ(1.0f / 128.0f, out[2 * 126]);
+	EXPECT_EQ(std::vector<float>(2 * 173, 0.0f), std::vector<float>(out.begin() + 2 * 127, out.end()));
+	EXPECT_EQ(0.0, e.fadeLevel);
+}
+
+TEST(UnitTest_MixEngine, center_cancel) {
+	Song const song(2, 2 * 512);
+	std::vector<float> plain(2 * 512), cancelled(2 * 512);
+	MixBus bus(4096);
+	auto e = engine(2, 128);
+	e.mix(plain.data(), plain.data() + plain.size(), bus, 1.0f, song.reader(0));
+	e.centerCancel = true;
+	e.mix(cancelled.data(), cancelled.data() + cancelled.size(), bus, 1.0f, song.reader(0));
+	for (std::size_t k = 0; k < 512; ++k) {
+		EXPECT_FLOAT_EQ(plain[2 * k] - plain[2 * k + 1], cancelled[2 * k]);
+		EXPECT_EQ(cancelled[2 * k], cancelled[2 * k + 1]);
+	}
+}
+
+TEST(UnitTest_MixEngine, block_size_does_not_change_steady_mix) {
+	Song const song(3, 2 * 4096);
+	MixBus bus(8192);
+	std::vector<float> a(2 * 1000), b(2 * 1000);
+	auto small = engine(3, 32), large = engine(3, 4096);
+	small.mix(a.data(), a.data() + a.size(), bus, 0.7f, song.reader(0));
+	large.mix(b.data(), b.data() + b.size(), bus, 0.7f, song.reader(0));
+	EXPECT_EQ(a, b);
+	// The bus limits the block
+	MixBus tiny(64);
+	std::vector<float> c(2 * 1000);
+	large.mix(c.data(), c.data() + c.size(), tiny, 0.7f, song.reader(0));
+	EXPECT_EQ(a, c);
+}
+
+TEST(UnitTest_MixEngine, stem_time_goes_to_the_profiler) {
+	Song const song(1, 2 * 512);
+	MixBus bus(4096);
+	MixEngine e;
+	e.addStem("guitar");
+	e.fadeLevel = 1.0;
+	trace::clear();
+	trace::enable(true);
+	std::vector<float> out(2 * 512);
+	e.mix(out.data(), out.data() + out.size(), bus, 1.0f, song.reader(0));
+	trace::enable(false);
+	EXPECT_EQ(2u, e.cost(0).count);
+	auto const summaries = trace::summaries(true);
+	EXPECT_TRUE(std::any_of(summaries.begin(), summaries.end(), [](trace::ZoneSummary const& z) { return z.name == "audio/stem/guitar"; }));
+	trace::clear();
+}
@@ -0,0 +1,142 @@
+#include "common.hh"
+
+#include "game/libda/resampler.hpp"
+#include "game/libda/sample.hpp"
+#include "game/ringbuffer.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	std::vector<float> sine(double freq, double rate, std::size_t n, float amplitude = 0.5f) {
+		std::vector<float> ret(n);
+		for (std::size_t i = 0; i < n; ++i) ret[i] = amplitude * static_cast<float>(std::sin(da::tau * freq * double(i) / rate));
+		return ret;
+	}
+
+	std::vector<float> resample(da::Resampler& resampler, std::vector<float> const& in, std::size_t block = 256) {
+		std::vector<float> out, buf(4 * block + da::Resampler::TAPS);
+		for (std::size_t pos = 0; pos < in.size(); ) {
+			pos += resampler.push(in.data() + pos, std::min(block, in.size() - pos));
+			while (std::size_t n = resampler.pull(buf.data(), buf.size())) out.insert(out.end(), buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(n));
+		}
+		return out;
+	}
+
+	/// Signal to noise ratio in dB of out against the sine that it should be, past the start and before the end
+	double snr(std::vector<float> const& out, double freq, double outRate) {
+		double signal = 0.0, noise = 0.0;
+		for (std::size_t j = 100; j + 100 < out.size(); ++j) {
+			double const expected = 0.5 * std::sin(da::tau * freq * double(j) / outRate);
+			signal += expected * expected;
+			noise += (out[j] - expected) * (out[j] - expected);
+		}
+		return 10.0 * std::log10(signal / noise);
+	}
+
+	double rms(std::vector<float> const& data, std::size_t skip) {
+		double sum = 0.0;
+		for (std::size_t i = skip; i < data.size(); ++i) sum += data[i] * data[i];
+		return std::sqrt(sum / double(data.size() - skip));
+	}
+}
+
+TEST(UnitTest_Resampler, sine_quality) {
+	for (auto rates: { std::pair(44100.0, 48000.0), std::pair(48000.0, 44100.0), std::pair(48000.0, 48000.0), std::pair(96000.0, 48000.0) }) {
+		for (double freq: { 220.0, 1000.0, 8000.0 }) {
+			da::Resampler resampler(rates.first / rates.second);
+			auto const out = resample(resampler, sine(freq, rates.first, 20000));
+			EXPECT_GT(snr(out, freq, rates.second), 60.0) << rates.first << " -> " << rates.second << " Hz, " << freq << " Hz";
+		}
+	}
+}
+
+TEST(UnitTest_Resampler, stop_band) {
+	// Above the Nyquist frequency of the output, tones would alias back into the audible range
+	da::Resampler resampler(48000.0 / 44100.0);
+	auto const out = resample(resampler, sine(23000.0, 48000.0, 20000));
+	EXPECT_LT(rms(out, 100), 0.5 * std::sqrt(0.5) * 0.01);  // -40 dB
+}
+
+TEST(UnitTest_Resampler, latency) {
+	da::Resampler resampler(48000.0 / 44100.0);
+	std::vector<float> in(1000), out(1000);
+	in[441] = 1.0f;
+	// Output sample 405 is at input time 440.8, so it needs input up to TAPS / 2 samples past that
+	std::size_t const needed = 441 + da::Resampler::TAPS / 2;
+	EXPECT_GE(resampler.needed(406), needed);
+	resampler.push(in.data(), needed - 1);
+	EXPECT_EQ(405u, resampler.pull(out.data(), out.size()));
+	resampler.push(in.data() + needed - 1, 1);
+	EXPECT_EQ(1u, resampler.pull(out.data() + 405, out.size()));
+	resampler.push(in.data() + needed, in.size() - needed);
+	std::size_t const produced = 406 + resampler.pull(out.data() + 406, out.size() - 406);
+	// No delay: the impulse comes out where it went in
+	auto const peak = std::max_element(out.begin(), out.end()) - out.begin();
+	EXPECT_EQ(405, peak);
+	EXPECT_NEAR(double(in.size()) - double(produced) * resampler.ratio(), resampler.buffered(), 1e-6);
+}
+
+TEST(UnitTest_Resampler, blocks_do_not_matter) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+	std::vector<float> in(10000);
+	for (auto& s: in) s = dist(rng);
+	da::Resampler a(44100.0 / 48000.0), b(44100.0 / 48000.0);
+	auto const whole = resample(a, in, 4096);
+	auto const pieces = resample(b, in, 7);
+	EXPECT_EQ(whole, pieces);
+	EXPECT_NEAR(10000 * 48000.0 / 44100.0 - da::Resampler::TAPS / 2 * 48000.0 / 44100.0, double(whole.size()), 2.0);
+}
+
+TEST(UnitTest_Resampler, kernels_agree) {
+	auto const kernels = da::resample_kernels::available();
+	EXPECT_STREQ("scalar", kernels.front().name);
+	EXPECT_STREQ(kernels.back().name, da::resample_kernels::best().name);
+	auto const in = sine(3000.0, 48000.0, 5000);
+	da::Resampler reference(48000.0 / 44100.0, 4096, kernels.front());
+	auto const expected = resample(reference, in);
+	for (auto const& kernel: kernels) {
+		da::Resampler resampler(48000.0 / 44100.0, 4096, kernel);
+		auto const out = resample(resampler, in);
+		ASSERT_EQ(expected.size(), out.size()) << kernel.name;
+		for (std::size_t i = 0; i < out.size(); ++i) ASSERT_NEAR(expected[i], out[i], 1e-6) << kernel.name << " at " << i;
+	}
+}
+
+TEST(UnitTest_Resampler, drift_compensation) {
+	// A mic that runs 0.3 % fast, captured in blocks of 240 samples, played in blocks of 256 frames at "the same" rate
+	constexpr double micRate = 48000.0 * 1.003, outRate = 48000.0;
+	RingBuffer<4096> ring;
+	da::Resampler resampler(1.0);
+	da::DriftCompensator drift(700.0);
+	std::vector<float> capture(240, 0.1f), pcm(4096);
+	double micTime = 0.0, outTime = 0.0;
+	unsigned underruns = 0, overflows = 0;
+	double minFill = 1e9, maxFill = 0.0;
+	for (unsigned block = 0; outTime < 120.0; ++block) {
+		while (micTime <= outTime) {
+			if (ring.size() + 240 > ring.capacity) ++overflows;
+			ring.insert(capture.begin(), capture.end());
+			micTime += 240.0 / micRate;
+		}
+		double const fill = double(ring.size()) + resampler.buffered();
+		resampler.setRatio(resampler.nominal() * drift.update(fill));
+		if (outTime > 60.0) {
+			minFill = std::min(minFill, drift.level());
+			maxFill = std::max(maxFill, drift.level());
+		}
+		auto const in = std::min({ resampler.needed(256), static_cast<std::size_t>(ring.size()), pcm.size() });
+		ring.read(pcm.data(), pcm.data() + in);
+		ring.pop(static_cast<std::ptrdiff_t>(resampler.push(pcm.data(), in)));
+		if (resampler.pull(pcm.data(), 256) < 256 && outTime > 1.0) ++underruns;
+		outTime += 256.0 / outRate;
+	}
+	EXPECT_EQ(0u, underruns);
+	EXPECT_EQ(0u, overflows);
+	EXPECT_NEAR(1.003, drift.factor(), 0.0005);
+	EXPECT_GT(minFill, 500.0);
+	EXPECT_LT(maxFill, 900.0);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "game/searchindex.hh"
+
+#include <unicode/errorcode.h>
+#include <unicode/stsearch.h>
+#include <unicode/tblcoll.h>
+
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Songs to search and the search that SearchIndex replaced, shared by its unit test and benchmark
+
+/// Primary strength, like the search collator of the game
+inline std::unique_ptr<icu::RuleBasedCollator> searchCollator() {
+	icu::ErrorCode error;
+	std::unique_ptr<icu::RuleBasedCollator> collator(dynamic_cast<icu::RuleBasedCollator*>(icu::Collator::createInstance(icu::Locale::getRoot(), error)));
+	collator->setStrength(icu::Collator::PRIMARY);
+	return collator;
+}
+
+/// What Songs::filter_internal did before the index: a StringSearch for every text
+inline std::vector<SearchIndex::Id> naiveFind(std::vector<std::string> const& texts, std::string const& query, icu::RuleBasedCollator* collator) {
+	std::vector<SearchIndex::Id> result;
+	auto pattern = icu::UnicodeString::fromUTF8(query);
+	icu::ErrorCode error;
+	for (std::size_t i = 0; i < texts.size(); ++i) {
+		icu::StringSearch search(pattern, icu::UnicodeString::fromUTF8(texts[i]), collator, nullptr, error);
+		if (search.first(error) != USEARCH_DONE) result.push_back(static_cast<SearchIndex::Id>(i));
+	}
+	return result;
+}
+
+/// Library of made up songs in the format of Song::strFull (title, artist, genre, edition, path)
+inline std::vector<std::string> library(std::size_t count) {
+	static const char* const words[] = { "love", "night", "dance", "heart", "fire", "dream", "cafe", "queen", "rock", "baby",
+	  "summer", "crazy", "blue", "time", "world", "song", "money", "party", "light", "girl", "boy", "rain", "star", "road" };
+	// Some artists with accents and other non-ASCII letters
+	static const char* const artists[] = { "Björk", "Motörhead", "Beyoncé", "Sigur Rós", "Ænima", "Mötley Crüe", "Straße" };
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<std::size_t> word(0, std::size(words) - 1);
+	std::uniform_int_distribution<std::size_t> artist(0, 10 * std::size(artists) - 1);
+	auto phrase = [&](int n) {
+		std::string s;
+		for (int i = 0; i < n; ++i) s += (i ? " " : "") + std::string(words[word(rng)]);
+		return s;
+	};
+	std::vector<std::string> texts;
+	for (std::size_t i = 0; i < count; ++i) {
+		std::string title = phrase(3) + " " + std::to_string(i);
+		std::size_t a = artist(rng);
+		std::string by = a < std::size(artists) ? artists[a] : phrase(2);
+		texts.push_back(title + "\n" + by + "\nPop\nSingStar " + std::to_string(i % 50) + "\n/songs/" + title + "/notes.txt");
+	}
+	return texts;
+}
@@ -0,0 +1,52 @@
+#include "common.hh"
+
+#include "searchcorpus.hh"
+
+#include <string>
+
+TEST(UnitTest_SearchIndex, fold) {
+	EXPECT_EQ("hello world", SearchIndex::fold("Hello WORLD"));
+	EXPECT_EQ("cafe", SearchIndex::fold("Café"));
+	EXPECT_EQ("motorhead", SearchIndex::fold("MOTÖRHEAD"));
+	EXPECT_EQ("strasse", SearchIndex::fold("Straße"));
+	EXPECT_EQ("", SearchIndex::fold(""));
+}
+
+TEST(UnitTest_SearchIndex, find) {
+	SearchIndex index;
+	EXPECT_EQ(0, index.add("Dancing Queen\nABBA"));
+	EXPECT_EQ(1, index.add("Café del Mar\nEnergy 52"));
+	EXPECT_EQ(2, index.add("Ace of Spades\nMotörhead"));
+	EXPECT_EQ(3u, index.size());
+	using Ids = std::vector<SearchIndex::Id>;
+	EXPECT_EQ(Ids({ 0 }), index.find("queen"));
+	EXPECT_EQ(Ids({ 1 }), index.find("CAFE"));
+	EXPECT_EQ(Ids({ 1 }), index.find("café"));
+	EXPECT_EQ(Ids({ 2 }), index.find("motorhead"));
+	EXPECT_EQ(Ids({ 0 }), index.find("Qu"));  // Too short for trigrams
+	EXPECT_EQ(Ids({ 0, 1, 2 }), index.find(""));
+	EXPECT_EQ(Ids(), index.find("queens"));
+	EXPECT_EQ(Ids({ 0 }), index.find("queen\nabba"));
+	index.remove(0);
+	index.remove(0);
+	EXPECT_EQ(2u, index.size());
+	EXPECT_EQ(Ids(), index.find("queen"));
+	EXPECT_EQ(Ids(), index.find("qu"));
+	EXPECT_EQ(Ids({ 2 }), index.find("ac"));
+	EXPECT_EQ(3, index.add("Queen of the Night"));
+	EXPECT_EQ(Ids({ 3 }), index.find("queen"));
+	index.clear();
+	EXPECT_EQ(0u, index.size());
+	EXPECT_EQ(Ids(), index.find("queen"));
+}
+
+TEST(UnitTest_SearchIndex, same_as_collator) {
+	auto collator = searchCollator();
+	auto texts = library(2000);
+	texts.push_back("Straße\nÆnima");
+	SearchIndex index;
+	for (auto const& text: texts) index.add(text);
+	for (std::string query: { "love", "LOVE night", "cafe", "Café", "motorhead", "bj", "é", "ae", "crue", "ros", "strasse", "1234", "fire\npop", "zzz" }) {
+		EXPECT_EQ(naiveFind(texts, query, collator.get()), index.find(query, collator.get())) << "query: " << query;
+	}
+}
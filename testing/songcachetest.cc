@@ -0,0 +1,189 @@
+#include "common.hh"
+
+#include "game/songcache.hh"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+	using Field = SongCache::Field;
+
+	struct UnitTest_SongCache: public ::testing::Test {
+		fs::path dir = fs::temp_directory_path() / ("performous-songcache-" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()));
+		void SetUp() override { fs::remove_all(dir); }
+		void TearDown() override { fs::remove_all(dir); }
+
+		static SongCache::Entry song(std::string const& file, std::string const& title) {
+			SongCache::Entry entry;
+			entry[Field::FILENAME] = file;
+			entry[Field::TITLE] = title;
+			entry[Field::ARTIST] = "Artist of " + title;
+			entry[Field::MUSIC] = std::string("background\0song.ogg", 19);
+			entry.record.stamp.size = 1234;
+			entry.record.year = 1999;
+			return entry;
+		}
+	};
+}
+
+TEST_F(UnitTest_SongCache, missing_cache) {
+	SongCache cache(dir);
+	EXPECT_FALSE(cache.load());
+	EXPECT_EQ(0u, cache.size());
+	EXPECT_FALSE(cache.find("a.txt"));
+}
+
+TEST_F(UnitTest_SongCache, round_trip) {
+	SongCache(dir).store({ song("a.txt", "A"), song("b.txt", "B") }, 42, true);
+
+	SongCache cache(dir);
+	ASSERT_TRUE(cache.load());
+	EXPECT_EQ(2u, cache.size());
+	EXPECT_EQ(42u, cache.collation());
+	auto b = cache.find("b.txt");
+	ASSERT_TRUE(b);
+	EXPECT_EQ("B", cache.string(*b, Field::TITLE));
+	EXPECT_EQ("Artist of B", cache.string(*b, Field::ARTIST));
+	EXPECT_EQ(std::string("background\0song.ogg", 19), cache.string(*b, Field::MUSIC));
+	EXPECT_EQ("", cache.string(*b, Field::GENRE));
+	EXPECT_EQ(1999, cache.record(*b).year);
+	EXPECT_EQ(1234u, cache.record(*b).stamp.size);
+}
+
+TEST_F(UnitTest_SongCache, duplicates_are_stored_once) {
+	SongCache cache(dir);
+	cache.store({ song("a.txt", "A"), song("a.txt", "A") }, 0, true);
+	EXPECT_EQ(1u, cache.size());
+}
+
+TEST_F(UnitTest_SongCache, updates_are_appended) {
+	std::vector<SongCache::Entry> songs;
+	for (int i = 0; i < 10; ++i) songs.push_back(song(std::to_string(i) + ".txt", "Song " + std::to_string(i)));
+	SongCache cache(dir);
+	cache.store(songs, 0, true);
+	auto const size = fs::file_size(dir / "songs.bin");
+
+	songs[3].record.stamp.time = 5;  // Changed without new strings
+	songs[4][Field::TITLE] = "Renamed";  // Changed with a new string
+	songs.push_back(song("new.txt", "New"));
+	cache.store(songs, 0, true);
+
+	ASSERT_TRUE(cache.loaded());
+	EXPECT_EQ(13u, cache.size());
+	EXPECT_EQ(size + 3 * sizeof(SongCache::Record), fs::file_size(dir / "songs.bin"));  // Appended, not rewritten
+	EXPECT_EQ(5, cache.record(*cache.find("3.txt")).stamp.time);
+	EXPECT_EQ("Renamed", cache.string(*cache.find("4.txt"), Field::TITLE));
+	EXPECT_EQ("Artist of Song 4", cache.string(*cache.find("4.txt"), Field::ARTIST));
+	EXPECT_EQ("New", cache.string(*cache.find("new.txt"), Field::TITLE));
+}
+
+TEST_F(UnitTest_SongCache, interrupted_update_keeps_the_old_cache) {
+	std::vector<SongCache::Entry> songs;
+	for (int i = 0; i < 10; ++i) songs.push_back(song(std::to_string(i) + ".txt", "Song " + std::to_string(i)));
+	SongCache cache(dir);
+	cache.store(songs, 0, true);
+	auto const headerSize = fs::file_size(dir / "songs.bin") - songs.size() * sizeof(SongCache::Record);
+	std::string header(headerSize, '\0');
+	std::ifstream(dir / "songs.bin", std::ios::binary).read(header.data(), static_cast<std::streamsize>(headerSize));
+
+	songs[4][Field::TITLE] = "Renamed";
+	songs.push_back(song("new.txt", "New"));
+	cache.store(songs, 0, true);
+	cache.close();
+	// Everything was written but the header
+	std::fstream(dir / "songs.bin", std::ios::binary | std::ios::in | std::ios::out).write(header.data(), static_cast<std::streamsize>(headerSize));
+
+	ASSERT_TRUE(cache.load());
+	EXPECT_EQ(10u, cache.size());
+	EXPECT_EQ("Song 4", cache.string(*cache.find("4.txt"), Field::TITLE));
+	EXPECT_FALSE(cache.find("new.txt"));
+}
+
+TEST_F(UnitTest_SongCache, missing_songs) {
+	std::vector<SongCache::Entry> songs;
+	for (int i = 0; i < 10; ++i) songs.push_back(song(std::to_string(i) + ".txt", "Song"));
+	SongCache cache(dir);
+	cache.store(songs, 0, true);
+
+	songs.pop_back();
+	cache.store(songs, 0, false);  // Interrupted scan keeps what it did not see
+	EXPECT_TRUE(cache.find("9.txt"));
+
+	cache.store(songs, 0, true);
+	EXPECT_FALSE(cache.find("9.txt"));
+	EXPECT_EQ(10u, cache.size());  // Marked deleted
+
+	songs.resize(2);
+	cache.store(songs, 0, true);
+	EXPECT_EQ(2u, cache.size());  // Mostly garbage, so the files were rewritten
+	EXPECT_TRUE(cache.find("1.txt"));
+}
+
+TEST_F(UnitTest_SongCache, changes_only) {
+	std::vector<SongCache::Entry> songs;
+	for (int i = 0; i < 10; ++i) songs.push_back(song(std::to_string(i) + ".txt", "Song " + std::to_string(i)));
+	SongCache cache(dir);
+	cache.store(songs, 0, true);
+
+	// The song folder watcher stores only what changed
+	cache.store({ song("3.txt", "Renamed"), song("new.txt", "New") }, 0, false, { "5.txt", "unknown.txt" });
+
+	ASSERT_TRUE(cache.loaded());
+	EXPECT_EQ(12u, cache.size());
+	EXPECT_EQ("Renamed", cache.string(*cache.find("3.txt"), Field::TITLE));
+	EXPECT_EQ("New", cache.string(*cache.find("new.txt"), Field::TITLE));
+	EXPECT_FALSE(cache.find("5.txt"));
+	EXPECT_EQ("Song 9", cache.string(*cache.find("9.txt"), Field::TITLE));
+}
+
+TEST_F(UnitTest_SongCache, partial_rewrite_keeps_unscanned_songs) {
+	std::vector<SongCache::Entry> songs;
+	for (int i = 0; i < 10; ++i) songs.push_back(song(std::to_string(i) + ".txt", "Song " + std::to_string(i)));
+	songs[0][Field::COMMENT] = songs[1][Field::COMMENT] = std::string(1000, 'x');
+	SongCache cache(dir);
+	cache.store(songs, 0, true);
+	auto const size = fs::file_size(dir / "songs.str");
+
+	// Only two songs scanned, but their changes make most of the string table garbage
+	songs.resize(2);
+	for (auto& s: songs) s[Field::COMMENT] = "Short";
+	cache.store(songs, 0, false);
+
+	ASSERT_TRUE(cache.loaded());
+	EXPECT_LT(fs::file_size(dir / "songs.str"), size);  // Rewritten
+	EXPECT_EQ(10u, cache.size());
+	EXPECT_EQ("Short", cache.string(*cache.find("1.txt"), Field::COMMENT));
+	for (int i = 2; i < 10; ++i) {
+		auto index = cache.find(std::to_string(i) + ".txt");
+		ASSERT_TRUE(index);
+		EXPECT_EQ("Song " + std::to_string(i), cache.string(*index, Field::TITLE));
+		EXPECT_EQ(1999, cache.record(*index).year);
+	}
+}
+
+TEST_F(UnitTest_SongCache, damaged_files_are_ignored) {
+	SongCache(dir).store({ song("a.txt", "A") }, 0, true);
+	{
+		std::fstream f(dir / "songs.bin", std::ios::binary | std::ios::in | std::ios::out);
+		f.seekp(8);
+		f.put('\x7f');  // Version
+	}
+	SongCache cache(dir);
+	EXPECT_FALSE(cache.load());
+
+	cache.store({ song("a.txt", "A") }, 0, true);
+	EXPECT_TRUE(cache.load());
+	fs::resize_file(dir / "songs.str", 9);
+	EXPECT_FALSE(cache.load());
+}
+
+TEST(UnitTest_FileStamp, of) {
+	fs::path file = fs::temp_directory_path() / "performous-filestamp.txt";
+	std::ofstream(file) << "hello";
+	FileStamp stamp = FileStamp::of(file);
+	EXPECT_EQ(5u, stamp.size);
+	EXPECT_NE(0, stamp.time);
+	fs::remove(file);
+	EXPECT_EQ(FileStamp(), FileStamp::of(file));
+}
@@ -0,0 +1,180 @@
+#include "common.hh"
+
+#include "game/songlistsnapshot.hh"
+#include "game/sortkey.hh"
+
+#include <unicode/errorcode.h>
+#include <unicode/tblcoll.h>
+#include <zlib.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	std::unique_ptr<icu::RuleBasedCollator> collator(icu::Collator::ECollationStrength strength) {
+		icu::ErrorCode error;
+		std::unique_ptr<icu::RuleBasedCollator> c(dynamic_cast<icu::RuleBasedCollator*>(icu::Collator::createInstance(icu::Locale::getRoot(), error)));
+		c->setStrength(strength);
+		return c;
+	}
+
+	SongListSnapshot::Entry entry(std::string const& artist, std::string const& title, std::string const& language = "English") {
+		static auto const sort = collator(icu::Collator::TERTIARY);
+		SongListSnapshot::Entry e;
+		e.artist = artist;
+		e.title = title;
+		e.language = language;
+		e.edition = "Edition";
+		e.searchText = artist + "\n" + title;
+		auto key = [&](SongListSnapshot::Sort s, std::string const& str) { e.sortKeys[static_cast<std::size_t>(s)] = sortKey(*sort, str); };
+		key(SongListSnapshot::Sort::TITLE, title);
+		key(SongListSnapshot::Sort::ARTIST, artist);
+		key(SongListSnapshot::Sort::LANGUAGE, language);
+		return e;
+	}
+
+	std::vector<SongListSnapshot::Entry> library() {
+		return { entry("Queen", "Bohemian Rhapsody"), entry("ABBA", "Waterloo"), entry("Édith Piaf", "La Vie en rose", "French"),
+		  entry("abba", "dancing Queen"), entry("Beatles", "Let It Be") };
+	}
+
+	std::vector<std::string> titles(SongListSnapshot const& snapshot, SongListSnapshot::Query const& query, std::size_t* total = nullptr) {
+		std::vector<std::string> result;
+		for (auto i: snapshot.select(query, total)) result.push_back(snapshot.entries()[i].title);
+		return result;
+	}
+
+	SongListSnapshot::Query parse(std::string const& urlQuery) {
+		SongListSnapshot::Query query;
+		query.parse(urlQuery);
+		return query;
+	}
+
+	std::string gunzip(std::string const& data) {
+		z_stream zs{};
+		EXPECT_EQ(Z_OK, inflateInit2(&zs, 15 + 16));
+		std::string out(1 << 20, '\0');
+		zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+		zs.avail_in = static_cast<uInt>(data.size());
+		zs.next_out = reinterpret_cast<Bytef*>(out.data());
+		zs.avail_out = static_cast<uInt>(out.size());
+		EXPECT_EQ(Z_STREAM_END, inflate(&zs, Z_FINISH));
+		out.resize(zs.total_out);
+		inflateEnd(&zs);
+		return out;
+	}
+}
+
+TEST(UnitTest_SongListSnapshot, parse_query) {
+	auto const query = parse("sort=artist&order=descending&search=caf%C3%A9+au+lait&offset=20&limit=10&fields=Title,Artist");
+	EXPECT_EQ(SongListSnapshot::Sort::ARTIST, query.sort);
+	EXPECT_TRUE(query.descending);
+	EXPECT_EQ("café au lait", query.search);
+	EXPECT_EQ(20u, query.offset);
+	EXPECT_EQ(10u, query.limit);
+	EXPECT_EQ(0b11u, query.fields);
+	EXPECT_NE(query.key(), parse("sort=artist&order=descending&search=cafe+au+lait&offset=20&limit=10&fields=Title,Artist").key());
+	EXPECT_EQ(SongListSnapshot::Query().key(), parse("&").key());
+	for (char const* bad: { "sort=year", "order=up", "offset=-1", "limit=ten", "fields=Title,Year", "fields=", "search=%zz", "sort=" }) {
+		EXPECT_THROW(parse(bad), std::invalid_argument) << bad;
+	}
+}
+
+TEST(UnitTest_SongListSnapshot, sort_and_page) {
+	SongListSnapshot const snapshot(1, library(), 2);
+	SongListSnapshot::Query query;
+	EXPECT_EQ((std::vector<std::string>{ "Bohemian Rhapsody", "Waterloo", "La Vie en rose", "dancing Queen", "Let It Be" }), titles(snapshot, query));
+	query.sort = SongListSnapshot::Sort::TITLE;
+	EXPECT_EQ((std::vector<std::string>{ "Bohemian Rhapsody", "dancing Queen", "La Vie en rose", "Let It Be", "Waterloo" }), titles(snapshot, query));
+	query.descending = true;
+	EXPECT_EQ((std::vector<std::string>{ "Waterloo", "Let It Be", "La Vie en rose", "dancing Queen", "Bohemian Rhapsody" }), titles(snapshot, query));
+	// Secondary strength keeps equal artists in library order, accents after plain letters
+	query = SongListSnapshot::Query();
+	query.sort = SongListSnapshot::Sort::ARTIST;
+	EXPECT_EQ((std::vector<std::string>{ "Waterloo", "dancing Queen", "Let It Be", "La Vie en rose", "Bohemian Rhapsody" }), titles(snapshot, query));
+	// Case sorting puts lower case first
+	SongListSnapshot const cased(1, library(), 3);
+	EXPECT_EQ((std::vector<std::string>{ "dancing Queen", "Waterloo", "Let It Be", "La Vie en rose", "Bohemian Rhapsody" }), titles(cased, query));
+	query.offset = 1;
+	query.limit = 2;
+	std::size_t total = 0;
+	EXPECT_EQ((std::vector<std::string>{ "dancing Queen", "Let It Be" }), titles(snapshot, query, &total));
+	EXPECT_EQ(5u, total);
+	query.offset = 10;
+	EXPECT_TRUE(titles(snapshot, query, &total).empty());
+	EXPECT_EQ(5u, total);
+}
+
+TEST(UnitTest_SongListSnapshot, search) {
+	auto const searchCollator = collator(icu::Collator::PRIMARY);
+	SongListSnapshot const snapshot(1, library(), 2, searchCollator.get());
+	SongListSnapshot::Query query;
+	query.search = "queen";
+	query.sort = SongListSnapshot::Sort::TITLE;
+	std::size_t total = 0;
+	EXPECT_EQ((std::vector<std::string>{ "Bohemian Rhapsody", "dancing Queen" }), titles(snapshot, query, &total));
+	EXPECT_EQ(2u, total);
+	query.search = "edith";
+	EXPECT_EQ((std::vector<std::string>{ "La Vie en rose" }), titles(snapshot, query));
+	query.search = "nothing like this";
+	EXPECT_TRUE(titles(snapshot, query).empty());
+}
+
+TEST(UnitTest_SongListSnapshot, json_fields_and_envelope) {
+	std::vector<SongListSnapshot::Entry> entries{ entry("Artist \"A\"", "Back\\slash\nline") };
+	entries.back().hasError = true;
+	SongListSnapshot const snapshot(1, std::move(entries), 2);
+	SongListSnapshot::Query query;
+	EXPECT_EQ(R"([{"Title":"Back\\slash\nline","Artist":"Artist \"A\"","Edition":"Edition","Language":"English","Creator":"",)"
+	  R"("name":"Artist \"A\" Back\\slash\nline","HasError":true,"ProvidedBy":"","Comment":""}])", snapshot.respond(query)->json);
+	query.parse("fields=HasError,Title&limit=5");
+	query.envelope = true;
+	auto const response = snapshot.respond(query);
+	EXPECT_EQ(R"({"total":1,"offset":0,"songs":[{"Title":"Back\\slash\nline","HasError":true}]})", response->json);
+	EXPECT_EQ(1u, response->total);
+	EXPECT_TRUE(response->gzip.empty());  // Too small to compress
+	EXPECT_EQ(response, snapshot.respond(query));  // Cached
+	EXPECT_EQ("[]", SongListSnapshot(2, {}, 2).respond(SongListSnapshot::Query())->json);
+}
+
+TEST(UnitTest_SongListSnapshot, etag_follows_content) {
+	SongListSnapshot const a(1, library(), 2), b(2, library(), 2);
+	auto changed = library();
+	changed[0].title = "Another One Bites the Dust";
+	SongListSnapshot const c(3, std::move(changed), 2);
+	SongListSnapshot::Query query;
+	auto const etag = a.respond(query)->etag;
+	EXPECT_EQ("W/\"", etag.substr(0, 3));
+	EXPECT_EQ(etag, b.respond(query)->etag);  // A rescan that found the same songs
+	EXPECT_NE(etag, c.respond(query)->etag);
+	query.sort = SongListSnapshot::Sort::TITLE;
+	EXPECT_NE(etag, a.respond(query)->etag);
+	EXPECT_TRUE(SongListSnapshot::matches(etag, etag));
+	EXPECT_TRUE(SongListSnapshot::matches("\"x\", " + etag.substr(2) + " ", etag));  // Weak comparison
+	EXPECT_TRUE(SongListSnapshot::matches("*", etag));
+	EXPECT_FALSE(SongListSnapshot::matches("", etag));
+	EXPECT_FALSE(SongListSnapshot::matches("W/\"0123456789abcdef\"", etag));
+}
+
+TEST(UnitTest_SongListSnapshot, gzip) {
+	std::vector<SongListSnapshot::Entry> entries;
+	for (unsigned i = 0; i < 100; ++i) entries.push_back(entry("Artist " + std::to_string(i % 7), "Title " + std::to_string(i)));
+	SongListSnapshot const snapshot(1, std::move(entries), 2);
+	auto const response = snapshot.respond(SongListSnapshot::Query());
+	ASSERT_FALSE(response->gzip.empty());
+	EXPECT_LT(response->gzip.size(), response->json.size() / 4);
+	EXPECT_EQ(response->json, gunzip(response->gzip));
+}
+
+TEST(UnitTest_SongListSnapshot, polling_clients_share_the_response) {
+	std::vector<SongListSnapshot::Entry> entries;
+	for (unsigned i = 0; i < 2000; ++i) entries.push_back(entry("Artist " + std::to_string(i / 10), "Song " + std::to_string(i * 7919 % 2000)));
+	SongListSnapshot const snapshot(1, std::move(entries), 2);
+	SongListSnapshot::Query query;
+	query.sort = SongListSnapshot::Sort::TITLE;
+	auto const first = snapshot.respond(query);
+	for (unsigned i = 0; i < 100; ++i) EXPECT_EQ(first, snapshot.respond(query));
+	EXPECT_EQ(2000u, first->total);
+}
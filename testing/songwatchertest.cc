@@ -0,0 +1,69 @@
+#include "common.hh"
+
+#include "game/songwatcher.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct UnitTest_SongWatcherEvents: public ::testing::Test {
+		fs::path root = fs::temp_directory_path() / ("performous-songwatcher-" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()));
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::vector<std::vector<SongWatcher::Change>> reports;
+
+		void SetUp() override { fs::remove_all(root); fs::create_directories(root); }
+		void TearDown() override { fs::remove_all(root); }
+
+		std::unique_ptr<SongWatcher> watch() {
+			// Polling is only used on systems without inotify; it gets a short interval to keep the test fast
+			return std::make_unique<SongWatcher>(Paths{ root }, [this](std::vector<SongWatcher::Change> const& changes) {
+				std::lock_guard<std::mutex> l(mutex);
+				reports.push_back(changes);
+				cond.notify_all();
+			}, Seconds(0.2), Seconds(0.3));
+		}
+		bool waitForReports(std::size_t count) {
+			std::unique_lock<std::mutex> l(mutex);
+			return cond.wait_for(l, 5s, [&] { return reports.size() >= count; });
+		}
+		/// True if the report contains path or a recursive change of a folder above it
+		static bool covers(std::vector<SongWatcher::Change> const& report, fs::path const& path) {
+			for (auto const& c: report) {
+				if (c.path == path) return true;
+				if (c.recursive && std::mismatch(c.path.begin(), c.path.end(), path.begin(), path.end()).first == c.path.end()) return true;
+			}
+			return false;
+		}
+	};
+}
+
+TEST_F(UnitTest_SongWatcherEvents, new_song_folder_is_reported_once) {
+	auto watcher = watch();
+	std::this_thread::sleep_for(200ms);  // Let the watcher start
+	fs::create_directories(root / "Artist - Title");
+	for (int i = 0; i < 20; ++i) std::ofstream(root / "Artist - Title" / ("file" + std::to_string(i) + ".txt")) << "data";
+
+	ASSERT_TRUE(waitForReports(1));
+	std::this_thread::sleep_for(500ms);
+	std::lock_guard<std::mutex> l(mutex);
+	EXPECT_EQ(1u, reports.size());  // The burst was coalesced
+	EXPECT_TRUE(covers(reports.front(), root / "Artist - Title" / "file7.txt"));
+}
+
+TEST_F(UnitTest_SongWatcherEvents, removed_file_is_reported) {
+	fs::create_directories(root / "song");
+	std::ofstream(root / "song" / "song.txt") << "data";
+	auto watcher = watch();
+	std::this_thread::sleep_for(200ms);
+	fs::remove(root / "song" / "song.txt");
+
+	ASSERT_TRUE(waitForReports(1));
+	std::lock_guard<std::mutex> l(mutex);
+	EXPECT_TRUE(covers(reports.front(), root / "song" / "song.txt"));
+}
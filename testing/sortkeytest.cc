@@ -0,0 +1,70 @@
+#include "common.hh"
+
+#include "game/sortkey.hh"
+
+#include <unicode/coll.h>
+#include <unicode/errorcode.h>
+#include <unicode/unistr.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	std::unique_ptr<icu::Collator> collator(icu::Collator::ECollationStrength strength) {
+		icu::ErrorCode error;
+		std::unique_ptr<icu::Collator> c(icu::Collator::createInstance(icu::Locale::getRoot(), error));
+		c->setStrength(strength);
+		return c;
+	}
+
+	/// Made up song titles, with some case and accent differences
+	std::vector<std::string> titles(std::size_t count) {
+		static const char* const words[] = { "love", "Love", "night", "dance", "heart", "Fire", "dream", "café", "Cafe", "über",
+		  "rock", "baby", "summer", "crazy", "blue", "time", "world", "Élan", "song", "money" };
+		std::mt19937 rng(7);
+		std::uniform_int_distribution<std::size_t> word(0, std::size(words) - 1);
+		std::vector<std::string> result;
+		for (std::size_t i = 0; i < count; ++i) result.push_back(std::string(words[word(rng)]) + " " + words[word(rng)] + " " + words[word(rng)]);
+		return result;
+	}
+
+	struct Item {
+		std::string title;
+		CollationKey key;
+	};
+}
+
+TEST(UnitTest_SortKey, levels) {
+	auto tertiary = collator(icu::Collator::TERTIARY);
+	auto key = [&](std::string const& str) { return sortKey(*tertiary, str); };
+	EXPECT_TRUE(sortKeyLess(key("apple"), key("banana"), 3));
+	EXPECT_FALSE(sortKeyLess(key("banana"), key("apple"), 3));
+	EXPECT_TRUE(sortKeyLess(key("app"), key("apple"), 1));
+	// Case is only seen at the third level, accents at the second
+	EXPECT_TRUE(sortKeyLess(key("abc"), key("ABC"), 3));
+	EXPECT_FALSE(sortKeyLess(key("abc"), key("ABC"), 2));
+	EXPECT_FALSE(sortKeyLess(key("ABC"), key("abc"), 2));
+	EXPECT_TRUE(sortKeyLess(key("cafe"), key("café"), 2));
+	EXPECT_FALSE(sortKeyLess(key("cafe"), key("café"), 1));
+	EXPECT_TRUE(sortKeyLess(key("café"), key("cafes"), 2));
+	EXPECT_TRUE(sortKeyLess(key(""), key("a"), 3));
+	EXPECT_FALSE(sortKeyLess(key(""), key(""), 3));
+}
+
+TEST(UnitTest_SortKey, same_order_as_collator) {
+	auto secondary = collator(icu::Collator::SECONDARY);
+	auto tertiary = collator(icu::Collator::TERTIARY);
+	std::vector<Item> byCollator;
+	for (auto& title: titles(2000)) byCollator.push_back({ std::move(title), CollationKey() });
+	auto byKey = byCollator;
+	std::stable_sort(byCollator.begin(), byCollator.end(), [&](Item const& a, Item const& b) {
+		icu::ErrorCode error;
+		return secondary->compare(icu::UnicodeString::fromUTF8(a.title), icu::UnicodeString::fromUTF8(b.title), error) == UCOL_LESS;
+	});
+	for (auto& item: byKey) item.key = sortKey(*tertiary, item.title);
+	std::stable_sort(byKey.begin(), byKey.end(), [](Item const& a, Item const& b) { return sortKeyLess(a.key, b.key, 2); });
+	for (std::size_t i = 0; i < byKey.size(); ++i) ASSERT_EQ(byCollator[i].title, byKey[i].title) << "at " << i;
+}
@@ -0,0 +1,89 @@
+#include "common.hh"
+
+#include "game/spscring.hh"
+#include "game/wakeup.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+TEST(UnitTest_SpscRing, capacity_is_power_of_two) {
+	EXPECT_EQ(8u, SpscRing<int>(5).capacity());
+	EXPECT_EQ(8u, SpscRing<int>(8).capacity());
+	EXPECT_EQ(1u << 22, SpscRing<float>(4000000).capacity());
+}
+
+TEST(UnitTest_SpscRing, wraps_around) {
+	SpscRing<int> ring(8);
+	std::vector<int> data = { 1, 2, 3, 4, 5, 6 };
+	ring.write(0, data.data(), 6);
+	ring.publish(6);
+	EXPECT_EQ(6, ring.written());
+	ring.consume(5);
+	ring.write(6, data.data(), 6);  // Slots 6, 7, 0, 1, 2, 3
+	ring.publish(12);
+	std::vector<int> out(7);
+	ring.read(5, out.data(), out.size());
+	EXPECT_EQ(std::vector<int>({ 6, 1, 2, 3, 4, 5, 6 }), out);
+	EXPECT_EQ(3, ring.at(8));
+	// Positions 5..11 are split at the end of the storage
+	std::vector<std::size_t> sizes;
+	ring.segments(5, 7, [&](int const*, std::size_t n) { sizes.push_back(n); });
+	EXPECT_EQ(std::vector<std::size_t>({ 3, 4 }), sizes);
+	sizes.clear();
+	ring.segments(8, 4, [&](int const*, std::size_t n) { sizes.push_back(n); });
+	EXPECT_EQ(std::vector<std::size_t>({ 4 }), sizes);
+}
+
+TEST(UnitTest_SpscRing, concurrent_stream) {
+	// A producer writing a counting stream in odd sized blocks and a consumer checking every value
+	SpscRing<std::uint32_t> ring(1024);
+	std::int64_t const total = 2000000;
+	std::thread producer([&] {
+		std::vector<std::uint32_t> block;
+		for (std::int64_t pos = 0; pos < total; ) {
+			auto const n = static_cast<std::int64_t>(std::min<std::int64_t>(1 + pos % 97, total - pos));
+			while (pos + n > ring.consumed() + static_cast<std::int64_t>(ring.capacity())) std::this_thread::yield();
+			block.resize(static_cast<std::size_t>(n));
+			for (std::int64_t i = 0; i < n; ++i) block[static_cast<std::size_t>(i)] = static_cast<std::uint32_t>(pos + i);
+			ring.write(pos, block.data(), block.size());
+			pos += n;
+			ring.publish(pos);
+		}
+	});
+	bool ordered = true;
+	for (std::int64_t pos = 0; pos < total; ) {
+		std::int64_t const end = std::min(ring.written(), pos + 61);
+		if (end == pos) { std::this_thread::yield(); continue; }
+		ring.segments(pos, static_cast<std::size_t>(end - pos), [&](std::uint32_t const* data, std::size_t n) {
+			for (std::size_t i = 0; i < n; ++i) if (data[i] != static_cast<std::uint32_t>(pos + static_cast<std::int64_t>(i))) ordered = false;
+			pos += static_cast<std::int64_t>(n);
+		});
+		ring.consume(pos);
+	}
+	producer.join();
+	EXPECT_TRUE(ordered);
+	EXPECT_EQ(total, ring.written());
+}
+
+TEST(UnitTest_Wakeup, post_and_wait) {
+	Wakeup wakeup;
+	using std::chrono::steady_clock;
+	// A post before waiting is not lost
+	wakeup.post();
+	auto start = steady_clock::now();
+	wakeup.wait(5s);
+	EXPECT_LT(steady_clock::now() - start, 2s);
+	// Without a post the wait times out
+	start = steady_clock::now();
+	wakeup.wait(20ms);
+	EXPECT_GE(steady_clock::now() - start, 15ms);
+	// Posting from another thread
+	std::thread poster([&] { std::this_thread::sleep_for(10ms); wakeup.post(); });
+	start = steady_clock::now();
+	wakeup.wait(5s);
+	EXPECT_LT(steady_clock::now() - start, 2s);
+	poster.join();
+}
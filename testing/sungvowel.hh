@@ -0,0 +1,86 @@
+#pragma once
+
+#include "game/analyzer.hh"
+#include "game/util.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/**
+* A sung vowel with a known pitch: harmonics shaped by the formants of "ah", with vibrato and breath noise,
+* starting after some silence. Bass voices have a weak fundamental, like real ones through a small microphone.
+**/
+struct SungVowel {
+	char const* name;
+	double f0;
+	double fundamental = 1.0;  ///< Level of the fundamental relative to the other harmonics
+	static constexpr double RATE = 48000.0;
+	static constexpr double ONSET = 0.1;  ///< Seconds of silence before singing
+	static constexpr double VIBRATO = 5.5;  ///< Hz, +-30 cents
+
+	double pitch(double t) const { return f0 * std::pow(2.0, 0.3 / 12.0 * std::sin(TAU * VIBRATO * t)); }
+	std::vector<float> render(double seconds) const {
+		// Formants at 700, 1220 and 2600 Hz on a falling source spectrum
+		std::vector<double> gains;
+		for (unsigned n = 1; n * f0 < 4000.0; ++n) {
+			double const f = n * f0;
+			double gain = 1.0 / n;
+			for (double formant: { 700.0, 1220.0, 2600.0 }) gain *= 1.0 + 4.0 * std::exp(-std::pow((f - formant) / 150.0, 2.0));
+			gains.push_back(n == 1 ? gain * fundamental : gain);
+		}
+		std::vector<float> pcm(static_cast<std::size_t>(seconds * RATE));
+		std::mt19937 rng(static_cast<unsigned>(f0));
+		std::normal_distribution<float> noise(0.0f, 0.003f);
+		double phase = 0.0;
+		for (std::size_t i = 0; i < pcm.size(); ++i) {
+			double const t = static_cast<double>(i) / RATE;
+			phase += pitch(t) / RATE;
+			if (t < ONSET) continue;
+			double s = 0.0;
+			for (std::size_t n = 0; n < gains.size(); ++n) s += gains[n] * std::sin(TAU * static_cast<double>(n + 1) * phase);
+			double const attack = std::min(1.0, (t - ONSET) / 0.01);
+			pcm[i] = static_cast<float>(0.1 * attack * s) + noise(rng);
+		}
+		return pcm;
+	}
+};
+
+/// How well a pitch engine follows a SungVowel
+struct PitchResult {
+	double correct = 0.0;  ///< Share of frames after the first 100 ms of singing with the pitch within 50 cents
+	double cents = 0.0;  ///< Mean absolute error of those
+	double latency = 0.0;  ///< Seconds from the onset until the pitch is first found
+	double cpu = 0.0;  ///< Median seconds per frame
+};
+
+inline PitchResult measurePitch(SungVowel const& voice, PitchEngine::Type engine, double seconds = 0.6) {
+	unsigned const step = 200;
+	Analyzer analyzer(SungVowel::RATE, "test", engine, step);
+	auto const pcm = voice.render(seconds);
+	PitchResult result;
+	result.latency = getNaN();
+	unsigned frames = 0, correct = 0;
+	for (std::size_t end = step; end <= pcm.size(); end += step) {
+		analyzer.input(pcm.begin() + static_cast<std::ptrdiff_t>(end - step), pcm.begin() + static_cast<std::ptrdiff_t>(end));
+		analyzer.process();
+		double const t = static_cast<double>(end) / SungVowel::RATE;
+		if (t < SungVowel::ONSET) continue;
+		Tone const* tone = analyzer.findTone(40.0, 1500.0);
+		// The pitch at the middle of the frame
+		double const expected = voice.pitch(t - 0.5 * FFT_N / SungVowel::RATE);
+		double const cents = tone ? 1200.0 * std::log2(tone->freq / expected) : getInf();
+		bool const ok = std::abs(cents) < 50.0;
+		if (ok && std::isnan(result.latency)) result.latency = t - SungVowel::ONSET;
+		if (t < SungVowel::ONSET + 0.1) continue;
+		++frames;
+		if (!ok) continue;
+		++correct;
+		result.cents += std::abs(cents);
+	}
+	result.correct = static_cast<double>(correct) / frames;
+	result.cents /= std::max(1u, correct);
+	result.cpu = analyzer.getCost().p50;
+	return result;
+}
@@ -0,0 +1,67 @@
+#include "common.hh"
+
+#include "game/cache.hh"
+#include "game/fs.hh"
+#include "game/swizzle.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace {
+	std::vector<std::uint8_t> noise(std::size_t bytes, unsigned seed) {
+		std::mt19937 rng(seed);
+		std::vector<std::uint8_t> data(bytes);
+		for (auto& b: data) b = static_cast<std::uint8_t>(rng());
+		return data;
+	}
+}
+
+TEST(UnitTest_SvgCache, swap_red_blue) {
+	// Every length around the SIMD block sizes, starting at odd offsets too
+	for (std::size_t count = 0; count < 40; ++count) {
+		for (std::size_t offset: { 0, 1, 3 }) {
+			auto data = noise((count + 1) * 4, static_cast<unsigned>(count));
+			auto expected = data;
+			pix::swapRedBlueScalar(expected.data() + offset, count);
+			pix::swapRedBlue(data.data() + offset, count);
+			EXPECT_EQ(expected, data) << count << " pixels at offset " << offset;
+		}
+	}
+	std::vector<std::uint8_t> pixel = { 1, 2, 3, 4 };
+	pix::swapRedBlue(pixel.data(), 1);
+	EXPECT_EQ(std::vector<std::uint8_t>({ 3, 2, 1, 4 }), pixel);
+}
+
+TEST(UnitTest_SvgCache, raster_file) {
+	TempDir dir;
+	fs::path const file = dir.path / "image.svg.cache_1.50.premul.raw";
+	FileStamp const stamp{ 1000, 2000 };
+	auto const pixels = noise(7 * 5 * 4, 1);
+	cache::writeRaster(file, stamp, 7, 5, pixels.data());
+	EXPECT_EQ(sizeof(cache::RasterHeader) + pixels.size(), fs::file_size(file));
+	unsigned width = 0, height = 0;
+	std::vector<unsigned char> read;
+	ASSERT_TRUE(cache::readRaster(file, stamp, width, height, read));
+	EXPECT_EQ(7u, width);
+	EXPECT_EQ(5u, height);
+	EXPECT_EQ(pixels, read);
+	EXPECT_TRUE(cache::hasRaster(file, stamp));
+	// The source has changed
+	EXPECT_FALSE(cache::readRaster(file, FileStamp{ 1001, 2000 }, width, height, read));
+	EXPECT_FALSE(cache::readRaster(file, FileStamp{ 1000, 2001 }, width, height, read));
+	EXPECT_FALSE(cache::hasRaster(file, FileStamp{ 1001, 2000 }));
+	EXPECT_FALSE(cache::readRaster(dir.path / "missing.raw", stamp, width, height, read));
+	// Truncated file
+	fs::resize_file(file, fs::file_size(file) - 1);
+	EXPECT_FALSE(cache::readRaster(file, stamp, width, height, read));
+	EXPECT_FALSE(cache::hasRaster(file, stamp));
+	// Not a raster file
+	std::ofstream(file, std::ios::binary) << "\x89PNG\r\n\x1a\n and then some more bytes to fill a header";
+	EXPECT_FALSE(cache::readRaster(file, stamp, width, height, read));
+	// Replacing an existing file leaves no temporary files behind
+	cache::writeRaster(file, stamp, 7, 5, pixels.data());
+	EXPECT_TRUE(cache::readRaster(file, stamp, width, height, read));
+	EXPECT_EQ(1, std::distance(fs::directory_iterator(dir.path), fs::directory_iterator()));
+}
@@ -0,0 +1,116 @@
+#include "common.hh"
+
+#include "game/fs.hh"
+#include "game/thumbnail.hh"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	/// Synthetic cover: RGBA gradient with some noise, rows padded to stride
+	std::vector<std::uint8_t> cover(unsigned width, unsigned height, unsigned stride, unsigned seed) {
+		std::vector<std::uint8_t> pixels(std::size_t(stride) * height);
+		std::mt19937 rng(seed);
+		for (unsigned y = 0; y < height; ++y) {
+			for (unsigned x = 0; x < width; ++x) {
+				std::uint8_t* p = &pixels[std::size_t(y) * stride + x * 4];
+				p[0] = static_cast<std::uint8_t>(x * 255 / width);
+				p[1] = static_cast<std::uint8_t>(y * 255 / height);
+				p[2] = static_cast<std::uint8_t>(rng() & 0xFF);
+				p[3] = 255;
+			}
+		}
+		return pixels;
+	}
+}
+
+TEST(UnitTest_Thumbnail, scale) {
+	// 4x2 RGB image, rows padded to 16 bytes
+	std::vector<std::uint8_t> const pixels = {
+		0, 0, 0,  10, 20, 30,  100, 100, 100,  200, 200, 200,  9, 9, 9, 9,
+		10, 20, 30,  0, 0, 0,  100, 100, 100,  0, 0, 0,  9, 9, 9, 9,
+	};
+	Thumbnail t = Thumbnail::scale(pixels.data(), 4, 2, 16, 3, 2);
+	EXPECT_EQ(2u, t.width);
+	EXPECT_EQ(1u, t.height);
+	EXPECT_EQ(std::vector<std::uint8_t>({ 5, 10, 15, 100, 100, 100 }), t.rgb);
+	// Images that fit are copied, dropping the alpha channel
+	std::vector<std::uint8_t> const rgba = { 1, 2, 3, 255, 4, 5, 6, 0 };
+	t = Thumbnail::scale(rgba.data(), 2, 1, 8, 4, 128);
+	EXPECT_EQ(2u, t.width);
+	EXPECT_EQ(1u, t.height);
+	EXPECT_EQ(std::vector<std::uint8_t>({ 1, 2, 3, 4, 5, 6 }), t.rgb);
+	// The aspect ratio is kept
+	auto const big = cover(1000, 500, 4000, 1);
+	t = Thumbnail::scale(big.data(), 1000, 500, 4000, 4, 128);
+	EXPECT_EQ(128u, t.width);
+	EXPECT_EQ(64u, t.height);
+	EXPECT_EQ(std::size_t(128 * 64 * 3), t.rgb.size());
+	EXPECT_TRUE(Thumbnail::scale(big.data(), 0, 0, 0, 4, 128).rgb.empty());
+}
+
+TEST(UnitTest_Thumbnail, name) {
+	FileStamp stamp{ 1234567890, 5000 };
+	fs::path const name = thumbnailName("/songs/a/cover.jpg", stamp, 128);
+	EXPECT_EQ(name, thumbnailName("/songs/a/cover.jpg", stamp, 128));
+	EXPECT_EQ(".jpg", name.extension());
+	EXPECT_EQ(name.filename().string().substr(0, 2), name.parent_path().string());
+	EXPECT_NE(name, thumbnailName("/songs/b/cover.jpg", stamp, 128));
+	EXPECT_NE(name, thumbnailName("/songs/a/cover.jpg", FileStamp{ 1234567891, 5000 }, 128));
+	EXPECT_NE(name, thumbnailName("/songs/a/cover.jpg", FileStamp{ 1234567890, 5001 }, 128));
+	EXPECT_NE(name, thumbnailName("/songs/a/cover.jpg", stamp, 256));
+}
+
+TEST(UnitTest_Thumbnail, atlas_slots) {
+	AtlasSlots slots(2, 2);
+	EXPECT_EQ(4u, slots.capacity());
+	EXPECT_FALSE(slots.find("a"));
+	auto [a, none] = slots.insert("a");
+	EXPECT_TRUE(none.empty());
+	EXPECT_EQ(0u, a.page);
+	slots.insert("b");
+	auto [c, none2] = slots.insert("c");
+	EXPECT_TRUE(none2.empty());
+	EXPECT_EQ(1u, c.page);
+	slots.insert("d");
+	EXPECT_EQ(4u, slots.size());
+	// "a" is used again, so "b" is now the least recently used
+	ASSERT_TRUE(slots.find("a"));
+	EXPECT_EQ(a.cell, slots.find("a")->cell);
+	auto [e, evicted] = slots.insert("e");
+	EXPECT_EQ("b", evicted);
+	EXPECT_FALSE(slots.find("b"));
+	EXPECT_TRUE(slots.find("e"));
+	EXPECT_EQ(4u, slots.size());
+	auto [f, evicted2] = slots.insert("f");
+	EXPECT_EQ("c", evicted2);
+	EXPECT_EQ(c.page, f.page);
+	EXPECT_EQ(c.cell, f.cell);
+}
+
+TEST(UnitTest_Thumbnail, browsing) {
+	// Browsing 200 songs with 1000x1000 covers through an atlas of 2 pages of 16x16 cells
+	unsigned const songs = 200, size = 1000, cell = 128;
+	auto const pixels = cover(size, size, size * 4, 2);
+	AtlasSlots slots(2, 256);
+	std::vector<Thumbnail> thumbnails(songs);
+	for (unsigned song = 0; song < songs; ++song) {
+		thumbnails[song] = Thumbnail::scale(pixels.data(), size, size, size * 4, 4, cell);
+		slots.insert(std::to_string(song));
+	}
+	// Scrolling back and forth, every visible cover is found in the atlas
+	unsigned hits = 0, lookups = 0;
+	for (unsigned pass = 0; pass < 2; ++pass) {
+		for (unsigned idx = 0; idx + 8 <= songs; ++idx) {
+			for (unsigned i = 0; i < 8; ++i, ++lookups) if (slots.find(std::to_string(idx + i))) ++hits;
+		}
+	}
+	EXPECT_EQ(lookups, hits);
+	EXPECT_EQ(std::size_t(cell * cell * 3), thumbnails.back().rgb.size());
+	// The atlas takes a fraction of the graphics memory of the full size covers
+	std::size_t const fullBytes = std::size_t(songs) * size * size * 4;
+	std::size_t const atlasBytes = std::size_t(2) * 2048 * 2048 * 4;
+	EXPECT_LT(atlasBytes * 10, fullBytes);
+}
@@ -0,0 +1,170 @@
+#include "common.hh"
+#include "allocationcounter.hh"
+
+#include "game/trace.hh"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct Exported {
+		std::string name;
+		std::string tid;
+		double ts;
+		double dur;
+	};
+
+	/// The complete events of a trace (each one is on a line of its own)
+	std::vector<Exported> events(std::string const& json) {
+		auto field = [](std::string const& line, std::string const& key) {
+			auto pos = line.find("\"" + key + "\":");
+			if (pos == std::string::npos) return std::string();
+			pos += key.size() + 3;
+			auto end = line.find_first_of(",}", line[pos] == '"' ? line.find('"', pos + 1) : pos);
+			return line.substr(pos, end - pos);
+		};
+		std::vector<Exported> result;
+		std::istringstream iss(json);
+		for (std::string line; std::getline(iss, line); ) {
+			if (line.find("\"ph\":\"X\"") == std::string::npos) continue;
+			result.push_back({ field(line, "name"), field(line, "tid"), std::stod(field(line, "ts")), std::stod(field(line, "dur")) });
+		}
+		return result;
+	}
+
+	std::string exportTrace() {
+		std::ostringstream oss;
+		trace::writeChromeTrace(oss);
+		return oss.str();
+	}
+
+	void inner() { TRACE_ZONE("test/inner"); }
+
+	trace::Site realtimeZone("test/realtime");
+}
+
+TEST(UnitTest_Trace, histogram_buckets) {
+	using trace::Histogram;
+	for (unsigned b = 0; b + 1 < Histogram::BUCKETS; ++b) {
+		ASSERT_EQ(b, Histogram::bucket(Histogram::upper(b))) << "bucket " << b;
+		ASSERT_EQ(b + 1, Histogram::bucket(Histogram::upper(b) + 1)) << "bucket " << b;
+	}
+	EXPECT_EQ(Histogram::BUCKETS - 1, Histogram::bucket(~std::uint64_t{ 0 }));
+}
+
+TEST(UnitTest_Trace, histogram_percentiles) {
+	trace::Histogram h;
+	EXPECT_EQ(0u, h.summary().count);
+	for (std::uint64_t us = 1; us <= 1000; ++us) h.add(us * 1000);
+	auto s = h.summary();
+	EXPECT_EQ(1000u, s.count);
+	EXPECT_NEAR(500e-6, s.p50, 500e-6 * 0.125);
+	EXPECT_GE(s.p50, 500e-6);
+	EXPECT_NEAR(990e-6, s.p99, 990e-6 * 0.125);
+	EXPECT_GE(s.p99, 990e-6);
+	EXPECT_DOUBLE_EQ(1000e-6, s.max);
+	EXPECT_DOUBLE_EQ(500500e-6, s.total);
+	h.reset();
+	EXPECT_EQ(0u, h.summary().count);
+	h.add(7);
+	EXPECT_DOUBLE_EQ(7e-9, h.summary().p99);
+}
+
+TEST(UnitTest_Trace, zones) {
+	trace::clear();
+	trace::enable(false);
+	{ TRACE_ZONE("test/disabled"); }
+	trace::enable(true);
+	trace::setThreadName("test \"main\"");
+	{
+		TRACE_ZONE("test/outer");
+		inner();
+		inner();
+	}
+	std::thread([] {
+		trace::setThreadName("test worker");
+		inner();
+	}).join();
+	trace::enable(false);
+	std::string const json = exportTrace();
+	EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"test \\\"main\\\"\"}")) << json;
+	EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"test worker\"}")) << json;
+	EXPECT_NE(std::string::npos, json.find("\"cat\":\"test\"")) << json;
+	auto const found = events(json);
+	ASSERT_EQ(4u, found.size()) << json;
+	// Zones are written as they end, so the inner ones come first
+	EXPECT_EQ("\"test/inner\"", found[0].name);
+	EXPECT_EQ("\"test/inner\"", found[1].name);
+	EXPECT_EQ("\"test/outer\"", found[2].name);
+	EXPECT_EQ(found[0].tid, found[2].tid);
+	EXPECT_LE(found[2].ts, found[0].ts);
+	EXPECT_GE(found[2].ts + found[2].dur, found[1].ts + found[1].dur);
+	EXPECT_EQ("\"test/inner\"", found[3].name);
+	EXPECT_NE(found[0].tid, found[3].tid);
+	auto const summaries = trace::summaries(true);
+	ASSERT_EQ(2u, summaries.size());
+	EXPECT_EQ(4u, summaries[0].summary.count + summaries[1].summary.count);
+	EXPECT_TRUE(trace::summaries(false).empty());
+	EXPECT_EQ("", trace::report());
+	trace::clear();
+	EXPECT_TRUE(events(exportTrace()).empty());
+}
+
+TEST(UnitTest_Trace, reserved_ring_does_not_allocate) {
+	trace::clear();
+	trace::enable(true);
+	std::size_t allocations = 0;
+	{
+		trace::RingReservation reservation;
+		// A thread that was never traced before, like the callback thread of a sound card
+		std::thread([&reservation, &allocations] {
+			AllocationCounter counter;
+			reservation.use();
+			trace::setThreadName("test realtime");
+			for (int i = 0; i < 3; ++i) trace::Zone zone(realtimeZone);
+			allocations = counter.count();
+		}).join();
+		trace::enable(false);
+		std::string const json = exportTrace();
+		EXPECT_NE(std::string::npos, json.find("\"args\":{\"name\":\"test realtime\"}")) << json;
+		auto const found = events(json);
+		ASSERT_EQ(3u, found.size()) << json;
+		EXPECT_EQ("\"test/realtime\"", found[0].name);
+	}
+	EXPECT_EQ(0u, allocations);
+	trace::clear();
+	trace::summaries(true);
+}
+
+TEST(UnitTest_Trace, ring_while_writing) {
+	trace::clear();
+	trace::enable(true);
+	std::atomic<bool> quit{ false };
+	std::atomic<unsigned> written{ 0 };
+	std::thread writer([&quit, &written] {
+		trace::setThreadName("test writer");
+		while (!quit) { inner(); ++written; }
+	});
+	while (written < 2u << 14) std::this_thread::yield();
+	// Export repeatedly while the writer goes around its ring many times; every event that is exported must be intact
+	unsigned exported = 0;
+	for (int i = 0; i < 10; ++i) {
+		auto const found = events(exportTrace());
+		for (std::size_t j = 1; j < found.size(); ++j) {
+			if (found[j].tid != found[j - 1].tid) continue;
+			ASSERT_GE(found[j].ts + 0.002, found[j - 1].ts + found[j - 1].dur) << "at " << j;  // Rounded to nanoseconds
+		}
+		for (auto const& e: found) ASSERT_GE(e.dur, 0.0);
+		exported = std::max(exported, static_cast<unsigned>(found.size()));
+	}
+	quit = true;
+	writer.join();
+	trace::enable(false);
+	EXPECT_GT(exported, 0u);
+	EXPECT_EQ(1u << 14, events(exportTrace()).size());  // The most recent ones
+	trace::clear();
+	trace::summaries(true);
+}
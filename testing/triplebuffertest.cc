@@ -0,0 +1,64 @@
+#include "common.hh"
+
+#include "game/triplebuffer.hh"
+
+#include <atomic>
+#include <thread>
+
+namespace {
+	struct Snapshot {
+		int a = 0;
+		int b = 0;
+		int c = 0;
+	};
+}
+
+TEST(UnitTest_TripleBuffer, initial_value) {
+	auto buffer = TripleBuffer<int>(42);
+
+	EXPECT_EQ(42, buffer.read());
+	EXPECT_EQ(42, buffer.read());
+}
+
+TEST(UnitTest_TripleBuffer, write_read) {
+	auto buffer = TripleBuffer<int>();
+
+	buffer.write(1);
+	EXPECT_EQ(1, buffer.read());
+	buffer.write(2);
+	buffer.write(3);
+	EXPECT_EQ(3, buffer.read());
+	EXPECT_EQ(3, buffer.read());
+}
+
+TEST(UnitTest_TripleBuffer, read_keeps_value_until_next_write) {
+	auto buffer = TripleBuffer<int>();
+
+	buffer.write(7);
+	int const& value = buffer.read();
+	EXPECT_EQ(7, buffer.read());
+	EXPECT_EQ(7, value);
+}
+
+TEST(UnitTest_TripleBuffer, concurrent_snapshots_are_consistent) {
+	auto buffer = TripleBuffer<Snapshot>();
+	std::atomic<bool> done{ false };
+	std::thread writer([&] {
+		for (int i = 1; i <= 200000; ++i) buffer.write(Snapshot{ i, -i, 2 * i });
+		done = true;
+	});
+	int last = 0;
+	bool consistent = true;
+	bool monotonic = true;
+	while (!done) {
+		Snapshot const& s = buffer.read();
+		if (s.b != -s.a || s.c != 2 * s.a) consistent = false;
+		if (s.a < last) monotonic = false;
+		last = s.a;
+	}
+	writer.join();
+
+	EXPECT_TRUE(consistent);
+	EXPECT_TRUE(monotonic);
+	EXPECT_EQ(200000, buffer.read().a);
+}
@@ -0,0 +1,71 @@
+#include "common.hh"
+
+#include "game/graphic/vertexstream.hh"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace glutil;
+
+TEST(UnitTest_VertexStream, ring) {
+	StreamRing ring(1024);
+	// The first allocation always gets new storage
+	auto r = ring.allocate(100, 48);
+	EXPECT_TRUE(r.orphan);
+	EXPECT_EQ(0u, r.offset);
+	r = ring.allocate(100, 48);
+	EXPECT_FALSE(r.orphan);
+	EXPECT_EQ(144u, r.offset);  // 100 rounded up to the vertex size
+	r = ring.allocate(64, 32);
+	EXPECT_FALSE(r.orphan);
+	EXPECT_EQ(256u, r.offset);
+	// Does not fit in what is left: start over in new storage
+	r = ring.allocate(800, 32);
+	EXPECT_TRUE(r.orphan);
+	EXPECT_EQ(0u, r.offset);
+	r = ring.allocate(224, 32);
+	EXPECT_FALSE(r.orphan);
+	EXPECT_EQ(800u, r.offset);
+	// Too large for the buffer: it grows and starts over
+	r = ring.allocate(3000, 32);
+	EXPECT_TRUE(r.orphan);
+	EXPECT_EQ(0u, r.offset);
+	EXPECT_EQ(4096u, ring.capacity());
+	ring.reset();
+	EXPECT_TRUE(ring.allocate(32, 32).orphan);
+}
+
+TEST(UnitTest_VertexStream, half) {
+	EXPECT_EQ(0x0000u, toHalf(0.0f));
+	EXPECT_EQ(0x8000u, toHalf(-0.0f));
+	EXPECT_EQ(0x3C00u, toHalf(1.0f));
+	EXPECT_EQ(0xC000u, toHalf(-2.0f));
+	EXPECT_EQ(0x3800u, toHalf(0.5f));
+	EXPECT_EQ(0x7BFFu, toHalf(65504.0f));  // Largest half
+	EXPECT_EQ(0x7C00u, toHalf(65536.0f));  // Too large
+	EXPECT_EQ(0x7C00u, toHalf(std::numeric_limits<float>::infinity()));
+	EXPECT_TRUE(std::isnan(fromHalf(toHalf(std::numeric_limits<float>::quiet_NaN()))));
+	EXPECT_EQ(0x0001u, toHalf(std::ldexp(1.0f, -24)));  // Smallest subnormal
+	EXPECT_EQ(0x0000u, toHalf(std::ldexp(1.0f, -26)));  // Rounds to zero
+	EXPECT_EQ(0x0200u, toHalf(std::ldexp(1.0f, -15)));
+	// Halfway between 1 and the next half rounds to even, a bit more rounds up
+	EXPECT_EQ(0x3C00u, toHalf(1.0f + std::ldexp(1.0f, -11)));
+	EXPECT_EQ(0x3C01u, toHalf(1.0f + std::ldexp(1.0f, -11) + std::ldexp(1.0f, -20)));
+	EXPECT_EQ(0x3C02u, toHalf(1.0f + 3.0f * std::ldexp(1.0f, -11)));
+	// Every half that is a number survives the round trip
+	for (unsigned h = 0; h < 0x10000u; ++h) {
+		auto const half = static_cast<std::uint16_t>(h);
+		if ((h & 0x7C00u) == 0x7C00u && (h & 0x3FFu)) continue;
+		ASSERT_EQ(half, toHalf(fromHalf(half))) << "half " << h;
+	}
+}
+
+TEST(UnitTest_VertexStream, normal) {
+	EXPECT_EQ(0u, packNormal(0.0f, 0.0f, 0.0f));
+	EXPECT_EQ(511u, packNormal(1.0f, 0.0f, 0.0f));
+	EXPECT_EQ(513u << 10, packNormal(0.0f, -1.0f, 0.0f));  // -511 in two's complement
+	EXPECT_EQ(511u << 20, packNormal(0.0f, 0.0f, 2.0f));  // Clamped
+	EXPECT_EQ(256u | 256u << 10 | 256u << 20, packNormal(0.5f, 0.5f, 0.5f));
+}
@@ -0,0 +1,55 @@
+#include "common.hh"
+
+#include "game/workerpool.hh"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(UnitTest_WorkerPool, threads) {
+	EXPECT_EQ(1u, WorkerPool(0).threads());
+	EXPECT_EQ(4u, WorkerPool(3).threads());
+}
+
+TEST(UnitTest_WorkerPool, runs_every_task_once) {
+	auto pool = WorkerPool(3);
+	auto counts = std::vector<std::atomic<int>>(11);
+
+	pool.run(counts.size(), [&](std::size_t i) { ++counts[i]; });
+
+	for (auto const& c: counts) EXPECT_EQ(1, c.load());
+}
+
+TEST(UnitTest_WorkerPool, without_workers_runs_on_caller) {
+	auto pool = WorkerPool(0);
+	auto const caller = std::this_thread::get_id();
+	bool sameThread = true;
+
+	pool.run(5, [&](std::size_t) { if (std::this_thread::get_id() != caller) sameThread = false; });
+
+	EXPECT_TRUE(sameThread);
+}
+
+TEST(UnitTest_WorkerPool, run_is_a_barrier) {
+	// Same shape as the engine: 11 analyzers per time step, each step must be complete before the next
+	auto pool = WorkerPool(3);
+	auto done = std::vector<std::atomic<unsigned>>(11);
+	unsigned incomplete = 0;
+
+	for (unsigned step = 1; step <= 1000; ++step) {
+		pool.run(done.size(), [&](std::size_t i) { done[i] = step; });
+		for (auto const& d: done) if (d != step) ++incomplete;
+	}
+
+	EXPECT_EQ(0u, incomplete);
+}
+
+TEST(UnitTest_WorkerPool, exception_is_rethrown) {
+	auto pool = WorkerPool(2);
+	std::atomic<int> count{ 0 };
+
+	EXPECT_THROW(pool.run(8, [&](std::size_t i) { ++count; if (i == 3) throw std::runtime_error("fail"); }), std::runtime_error);
+	EXPECT_EQ(8, count.load());
+	EXPECT_NO_THROW(pool.run(8, [](std::size_t) {}));
+}